@@ -187,6 +187,99 @@ virAdmServerPtr virAdmConnectLookupServer(virAdmConnectPtr conn,
 
 # define VIR_THREADPOOL_JOB_QUEUE_DEPTH "jobQueueDepth"
 
+/**
+ * VIR_THREADPOOL_JOB_QUEUE_DEPTH_MAX:
+ * Macro for the threadpool jobQueueDepthMax attribute: represents the highest
+ * number of jobs ever waiting in the queue, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_THREADPOOL_JOB_QUEUE_DEPTH_MAX "jobQueueDepthMax"
+
+/**
+ * VIR_THREADPOOL_JOBS_PROCESSED:
+ * Macro for the threadpool jobsProcessed attribute: represents the number of
+ * jobs completed by the workers so far, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_THREADPOOL_JOBS_PROCESSED "jobsProcessed"
+
+/**
+ * VIR_THREADPOOL_JOB_WAIT_TIME_AVG:
+ * Macro for the threadpool jobWaitTimeAvg attribute: represents the average
+ * time in microseconds a job spent in the queue before a worker picked it up,
+ * as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_THREADPOOL_JOB_WAIT_TIME_AVG "jobWaitTimeAvg"
+
+/**
+ * VIR_THREADPOOL_JOB_WAIT_TIME_MAX:
+ * Macro for the threadpool jobWaitTimeMax attribute: represents the longest
+ * time in microseconds a job spent in the queue, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_THREADPOOL_JOB_WAIT_TIME_MAX "jobWaitTimeMax"
+
+/**
+ * VIR_THREADPOOL_JOB_WAIT_TIME_HIST_PREFIX:
+ * Prefix of the threadpool job wait time histogram attributes. Each bucket
+ * is reported as VIR_TYPED_PARAM_ULLONG named after its exclusive upper
+ * bound, e.g. "jobWaitTimeHist.lt1000us", and the last bucket is named
+ * "jobWaitTimeHist.inf".
+ *
+ * NOTE: These attributes are read-only and any attempt to set them will be
+ * denied by daemon
+ */
+
+# define VIR_THREADPOOL_JOB_WAIT_TIME_HIST_PREFIX "jobWaitTimeHist."
+
+/**
+ * VIR_THREADPOOL_JOB_SERVICE_TIME_AVG:
+ * Macro for the threadpool jobServiceTimeAvg attribute: represents the average
+ * time in microseconds a worker spent processing a job, as
+ * VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_THREADPOOL_JOB_SERVICE_TIME_AVG "jobServiceTimeAvg"
+
+/**
+ * VIR_THREADPOOL_JOB_SERVICE_TIME_MAX:
+ * Macro for the threadpool jobServiceTimeMax attribute: represents the longest
+ * time in microseconds a worker spent processing a job, as
+ * VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_THREADPOOL_JOB_SERVICE_TIME_MAX "jobServiceTimeMax"
+
+/**
+ * VIR_THREADPOOL_JOB_SERVICE_TIME_HIST_PREFIX:
+ * Prefix of the threadpool job service time histogram attributes, with the
+ * same bucket naming as VIR_THREADPOOL_JOB_WAIT_TIME_HIST_PREFIX.
+ *
+ * NOTE: These attributes are read-only and any attempt to set them will be
+ * denied by daemon
+ */
+
+# define VIR_THREADPOOL_JOB_SERVICE_TIME_HIST_PREFIX "jobServiceTimeHist."
+
 /* Tunables for a server workerpool */
 int virAdmServerGetThreadPoolParameters(virAdmServerPtr srv,
                                         virTypedParameterPtr *params,
@@ -144,6 +144,22 @@ acrnDomainDeviceDefPostParse(virDomainDeviceDefPtr dev,
             return -1;
         }
 
+        if (hostdev->source.subsys.type == VIR_DOMAIN_HOSTDEV_SUBSYS_TYPE_PCI) {
+            virDomainHostdevSubsysPCIPtr pcisrc = &hostdev->source.subsys.u.pci;
+
+            /* acrn-dm expects passthrough devices bound to pci-stub */
+            if (pcisrc->backend == VIR_DOMAIN_HOSTDEV_PCI_BACKEND_DEFAULT)
+                pcisrc->backend = VIR_DOMAIN_HOSTDEV_PCI_BACKEND_KVM;
+
+            if (pcisrc->backend != VIR_DOMAIN_HOSTDEV_PCI_BACKEND_KVM) {
+                virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                               _("PCI hostdev backend %s not supported"),
+                               virDomainHostdevSubsysPCIBackendTypeToString(
+                                   pcisrc->backend));
+                return -1;
+            }
+        }
+
         if (info->type != VIR_DOMAIN_DEVICE_ADDRESS_TYPE_NONE &&
             info->type != VIR_DOMAIN_DEVICE_ADDRESS_TYPE_PCI) {
             virReportError(VIR_ERR_XML_ERROR,
@@ -269,6 +285,16 @@ acrnDomainDeviceDefPostParse(virDomainDeviceDefPtr dev,
                            virDomainChrDeviceTypeToString(chr->deviceType));
             return -1;
         }
+
+        /* acrn-dm can't duplicate chardev output itself, only what ends
+         * up on its stdio can be sent to a log file */
+        if (chr->source->logfile &&
+            chr->source->type != VIR_DOMAIN_CHR_TYPE_STDIO) {
+            virReportError(VIR_ERR_XML_ERROR,
+                           _("log file not supported for chr type %s"),
+                           virDomainChrTypeToString(chr->source->type));
+            return -1;
+        }
         break;
     }
     case VIR_DOMAIN_DEVICE_INPUT:
@@ -333,6 +359,8 @@ acrnDomainObjPrivateFree(void *data)
 
     acrnDomainTtyCleanup(priv);
     virBitmapFree(priv->cpuAffinitySet);
+    virCgroupFree(&priv->cgroup);
+    VIR_FREE(priv->machineName);
     VIR_FREE(priv);
 }
 
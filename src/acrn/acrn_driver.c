@@ -24,6 +24,10 @@
 #include "virlog.h"
 #include "domain_event.h"
 #include "viraccessapicheck.h"
+#include "logging/log_manager.h"
+#include "domain_cgroup.h"
+#include "virpidfile.h"
+#include "virprocess.h"
 #include "acrn_driver.h"
 #include "acrn_domain.h"
 
@@ -35,8 +39,11 @@
 #define ACRN_AUTOSTART_DIR      SYSCONFDIR "/libvirt/acrn/autostart"
 #define ACRN_CONFIG_DIR         SYSCONFDIR "/libvirt/acrn"
 #define ACRN_STATE_DIR          RUNSTATEDIR "/libvirt/acrn"
+#define ACRN_LOG_DIR            LOCALSTATEDIR "/log/libvirt/acrn"
 #define ACRN_NET_GENERATED_TAP_PREFIX   "tap"
 #define ACRN_PI_VERSION         (0x100)
+#define ACRN_DRIVER_NAME        "acrn"
+#define ACRN_HOSTDEV_FLAGS      (VIR_HOSTDEV_SP_PCI | VIR_HOSTDEV_SP_USB)
 
 VIR_LOG_INIT("acrn.acrn_driver");
 
@@ -696,16 +703,188 @@ acrnBuildStartCmd(virDomainObjPtr vm)
     return cmd;
 }
 
+/*
+ * Everything acrn-dm writes to stdout/stderr, including the output of
+ * 'stdio' chardevs, goes to a single log file. Unless a 'stdio' chardev
+ * asks for a specific one, that's the per-domain log.
+ */
+static char *
+acrnDomainGetLogPath(virDomainDefPtr def)
+{
+    const char *logfile = NULL;
+    size_t i;
+
+    for (i = 0; i < def->nserials + def->nconsoles; i++) {
+        virDomainChrDefPtr chr = i < def->nserials ?
+            def->serials[i] : def->consoles[i - def->nserials];
+
+        if (chr->source->type != VIR_DOMAIN_CHR_TYPE_STDIO ||
+            !chr->source->logfile)
+            continue;
+
+        if (logfile && STRNEQ(logfile, chr->source->logfile)) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                           _("stdio chr devices must share the same log file, "
+                             "got '%s' and '%s'"),
+                           logfile, chr->source->logfile);
+            return NULL;
+        }
+        logfile = chr->source->logfile;
+    }
+
+    if (logfile)
+        return g_strdup(logfile);
+
+    return g_strdup_printf("%s/%s.log", ACRN_LOG_DIR, def->name);
+}
+
+/*
+ * Hand acrn-dm's stdout/stderr to virtlogd, which rotates the log file so
+ * that a noisy guest can neither fill up the filesystem nor stall on a
+ * full pipe. Returns the write end of the log pipe.
+ */
+static int
+acrnProcessOpenLogFile(virDomainObjPtr vm)
+{
+    virLogManagerPtr logmgr;
+    g_autofree char *path = NULL;
+    ino_t inode;
+    off_t pos;
+    int fd;
+
+    if (!(path = acrnDomainGetLogPath(vm->def)))
+        return -1;
+
+    if (!(logmgr = virLogManagerNew(true)))
+        return -1;
+
+    fd = virLogManagerDomainOpenLogFile(logmgr, "acrn",
+                                        vm->def->uuid, vm->def->name,
+                                        path, 0, &inode, &pos);
+    virLogManagerFree(logmgr);
+
+    return fd;
+}
+
+static int
+acrnSetupCgroupTunables(virDomainDefPtr def, virCgroupPtr cgroup)
+{
+    if (virCgroupHasController(cgroup, VIR_CGROUP_CONTROLLER_CPU)) {
+        if (def->cputune.sharesSpecified) {
+            unsigned long long val;
+
+            if (virCgroupSetupCpuShares(cgroup, def->cputune.shares, &val) < 0)
+                return -1;
+            def->cputune.shares = val;
+        }
+
+        if (virCgroupSetupCpuPeriodQuota(cgroup, def->cputune.period,
+                                         def->cputune.quota) < 0)
+            return -1;
+    }
+
+    if (virDomainCgroupSetupBlkio(cgroup, def->blkio) < 0)
+        return -1;
+
+    if (virDomainCgroupSetupMemtune(cgroup, def->mem) < 0)
+        return -1;
+
+    return 0;
+}
+
+/*
+ * Guest vCPUs run on pCPUs owned by the hypervisor, so the cgroup only
+ * covers the device model. That is still what competes with the SOS and
+ * with other guests for host resources.
+ */
+static int
+acrnSetupCgroup(virDomainObjPtr vm)
+{
+    acrnDomainObjPrivatePtr priv = vm->privateData;
+    virDomainDefPtr def = vm->def;
+
+    if (!def->resource) {
+        virDomainResourceDefPtr res;
+
+        if (VIR_ALLOC(res) < 0)
+            return -1;
+
+        res->partition = g_strdup("/machine");
+        def->resource = res;
+    }
+
+    if (def->resource->partition[0] != '/') {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("Resource partition '%s' must start with '/'"),
+                       def->resource->partition);
+        return -1;
+    }
+
+    if (!priv->machineName &&
+        !(priv->machineName = virDomainGenerateMachineName("acrn", def->id,
+                                                           def->name, true)))
+        return -1;
+
+    if (virCgroupNewMachine(priv->machineName, "acrn", def->uuid, NULL,
+                            vm->pid, false, 0, NULL,
+                            def->resource->partition, -1, 0,
+                            &priv->cgroup) < 0) {
+        if (virCgroupNewIgnoreError()) {
+            VIR_DEBUG("Cgroups not available for domain '%s'", def->name);
+            return 0;
+        }
+        return -1;
+    }
+
+    return acrnSetupCgroupTunables(def, priv->cgroup);
+}
+
+static void
+acrnRemoveCgroup(virDomainObjPtr vm)
+{
+    acrnDomainObjPrivatePtr priv = vm->privateData;
+
+    if (priv->cgroup) {
+        virCgroupRemove(priv->cgroup);
+        virCgroupFree(&priv->cgroup);
+        virCgroupTerminateMachine(priv->machineName);
+    }
+
+    VIR_FREE(priv->machineName);
+}
+
 static int
 acrnProcessStart(virDomainObjPtr vm)
 {
-    virCommandPtr cmd;
+    virCommandPtr cmd = NULL;
+    g_autofree char *pidfile = NULL;
+    int logfd = -1;
     int ret = -1;
 
+    /* Detach managed devices from their host drivers, reset them and mark
+     * them as used by this domain so no other guest can claim them */
+    if (virHostdevPrepareDomainDevices(acrn_driver->hostdevMgr,
+                                       ACRN_DRIVER_NAME, vm->def,
+                                       ACRN_HOSTDEV_FLAGS) < 0)
+        return -1;
+
     if (!(cmd = acrnBuildStartCmd(vm)))
         goto cleanup;
 
+    if (!(pidfile = virPidFileBuildPath(ACRN_STATE_DIR, vm->def->name)))
+        goto cleanup;
+
+    if ((logfd = acrnProcessOpenLogFile(vm)) < 0)
+        goto cleanup;
+
+    virCommandWriteArgLog(cmd, logfd);
+    virCommandSetOutputFD(cmd, &logfd);
+    virCommandSetErrorFD(cmd, &logfd);
+    virCommandSetPidFile(cmd, pidfile);
     virCommandDaemonize(cmd);
+    /* Hold acrn-dm back until it has been placed in its cgroup, so that
+     * everything it allocates on startup is accounted for */
+    virCommandRequireHandshake(cmd);
 
     VIR_DEBUG("Starting domain '%s'", vm->def->name);
 
@@ -717,14 +896,35 @@ acrnProcessStart(virDomainObjPtr vm)
         sscanf(vm->def->name, "instance-%d", &vm->def->id) != 1)
         vm->def->id = 0;
 
+    if (virPidFileReadPath(pidfile, &vm->pid) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Domain %s didn't show up"), vm->def->name);
+        goto cleanup;
+    }
+
+    VIR_DEBUG("Waiting for handshake from child");
+    if (virCommandHandshakeWait(cmd) < 0 ||
+        acrnSetupCgroup(vm) < 0 ||
+        virCommandHandshakeNotify(cmd) < 0) {
+        virProcessKillPainfully(vm->pid, true);
+        acrnRemoveCgroup(vm);
+        virPidFileDeletePath(pidfile);
+        vm->pid = 0;
+        goto cleanup;
+    }
+
     virDomainObjSetState(vm, VIR_DOMAIN_RUNNING, VIR_DOMAIN_RUNNING_BOOTED);
     ret = 0;
 
 cleanup:
+    VIR_FORCE_CLOSE(logfd);
     virCommandFree(cmd);
     if (ret < 0) {
         acrnNetCleanup(vm);
         acrnTtyCleanup(vm);
+        virHostdevReAttachDomainDevices(acrn_driver->hostdevMgr,
+                                        ACRN_DRIVER_NAME, vm->def,
+                                        ACRN_HOSTDEV_FLAGS, NULL);
     }
     return ret;
 }
@@ -786,6 +986,35 @@ acrnBuildStopCmd(virDomainDefPtr def)
     return cmd;
 }
 
+/*
+ * acrnctl returns before acrn-dm is gone, wait for it so that the
+ * devices it used are really released. If it doesn't go away on its
+ * own shortly, kill it. Returns -1 if acrn-dm is still running, in
+ * which case its devices must not be handed back to the host.
+ */
+static int
+acrnProcessWaitForExit(virDomainObjPtr vm)
+{
+    size_t i;
+
+    if (vm->pid <= 0)
+        return 0;
+
+    for (i = 0; i < 30; i++) {
+        if (virProcessKill(vm->pid, 0) < 0)
+            return 0;
+        g_usleep(100 * 1000);
+    }
+
+    VIR_WARN("acrn-dm for domain '%s' (pid %lld) did not exit, killing it",
+             vm->def->name, (long long)vm->pid);
+
+    if (virProcessKillPainfully(vm->pid, true) < 0)
+        return -1;
+
+    return 0;
+}
+
 static int
 acrnProcessStop(virDomainObjPtr vm, int reason, size_t *allocMap)
 {
@@ -808,7 +1037,18 @@ acrnProcessStop(virDomainObjPtr vm, int reason, size_t *allocMap)
     /* clean up ttys */
     acrnTtyCleanup(vm);
 
+    if (acrnProcessWaitForExit(vm) < 0)
+        goto cleanup;
+
+    virHostdevReAttachDomainDevices(acrn_driver->hostdevMgr,
+                                    ACRN_DRIVER_NAME, def,
+                                    ACRN_HOSTDEV_FLAGS, NULL);
+
+    acrnRemoveCgroup(vm);
+    virPidFileDelete(ACRN_STATE_DIR, def->name);
+
     virDomainObjSetState(vm, VIR_DOMAIN_SHUTOFF, reason);
+    vm->pid = 0;
 
     def->id = -1;
     ret = 0;
@@ -1493,6 +1733,8 @@ acrnDomainMemoryStats(virDomainPtr dom,
                       unsigned int flags)
 {
     virDomainObjPtr vm;
+    acrnDomainObjPrivatePtr priv;
+    virCgroupStats cgstats = { 0 };
     int ret = -1;
 
     virCheckFlags(0, -1);
@@ -1506,11 +1748,21 @@ acrnDomainMemoryStats(virDomainPtr dom,
         goto cleanup;
     }
 
+    priv = vm->privateData;
+
+    /* guest memory is set aside up front, on top of it comes whatever the
+     * device model is using */
+    if (priv->cgroup &&
+        virCgroupGetStats(priv->cgroup, VIR_CGROUP_STATS_MEMORY,
+                          &cgstats) < 0)
+        goto cleanup;
+
     ret = 0;
 
     if (ret < nr_stats) {
         stats[ret].tag = VIR_DOMAIN_MEMORY_STAT_RSS;
-        stats[ret].val = virDomainDefGetMemoryInitial(vm->def);
+        stats[ret].val = virDomainDefGetMemoryInitial(vm->def) +
+                       cgstats.memUsage;
         ret++;
     }
 
@@ -1617,13 +1869,15 @@ cleanup:
 
 static int
 acrnGetDomainTotalCpuStats(virTypedParameterPtr params,
-                           int nparams)
+                           int nparams,
+                           virCgroupPtr cgroup)
 {
     struct timeval tv;
     unsigned long long cpu_time;
+    int ret;
 
     if (nparams == 0) /* return supported number of params */
-        return 1;
+        return cgroup ? virCgroupGetDomainTotalCpuStats(cgroup, params, 0) : 1;
 
     if (gettimeofday(&tv, NULL) < 0) {
         virReportSystemError(errno,
@@ -1634,6 +1888,17 @@ acrnGetDomainTotalCpuStats(virTypedParameterPtr params,
     /* FIXME fake an increasing cpu time value */
     cpu_time = (tv.tv_sec * 1000UL * 1000UL) + tv.tv_usec;
 
+    /* the device model's time, including user/system split, comes from
+     * its cgroup; the vCPUs' time is added on top of it */
+    if (cgroup) {
+        if ((ret = virCgroupGetDomainTotalCpuStats(cgroup, params,
+                                                   nparams)) < 0)
+            return -1;
+
+        params[0].value.ul += cpu_time;
+        return ret;
+    }
+
     /* entry 0 is cputime */
     if (virTypedParameterAssign(&params[0], VIR_DOMAIN_CPU_STATS_CPUTIME,
                                 VIR_TYPED_PARAM_ULLONG, cpu_time) < 0)
@@ -1650,7 +1915,8 @@ acrnGetPercpuStats(virTypedParameterPtr params,
                    unsigned int nparams,
                    int start_cpu,
                    unsigned int ncpus,
-                   virBitmapPtr vcpus)
+                   virBitmapPtr vcpus,
+                   virCgroupPtr cgroup)
 {
     int ret = -1;
     size_t i;
@@ -1697,6 +1963,12 @@ acrnGetPercpuStats(virTypedParameterPtr params,
     cpu_time = (tv.tv_sec * 1000UL * 1000UL) + tv.tv_usec;
     cpu_time /= virBitmapCountBits(vcpus);
 
+    /* device model usage of the SOS CPUs */
+    if (cgroup &&
+        virCgroupGetPercpuStats(cgroup, params, nparams,
+                                start_cpu, ncpus, NULL) < 0)
+        goto cleanup;
+
     /* return percpu cputime in index 0 */
     param_idx = 0;
 
@@ -1704,11 +1976,16 @@ acrnGetPercpuStats(virTypedParameterPtr params,
     need_cpus = MIN(total_cpus, start_cpu + ncpus);
 
     for (i = start_cpu; i < need_cpus; i++) {
+        unsigned long long val = virBitmapIsBitSet(vcpus, i) ? cpu_time : 0;
+
         ent = &params[(i - start_cpu) * nparams + param_idx];
+        if (cgroup) {
+            ent->value.ul += val;
+            continue;
+        }
+
         if (virTypedParameterAssign(ent, VIR_DOMAIN_CPU_STATS_CPUTIME,
-                                    VIR_TYPED_PARAM_ULLONG,
-                                    virBitmapIsBitSet(vcpus, i) ?
-                                    cpu_time : 0) < 0)
+                                    VIR_TYPED_PARAM_ULLONG, val) < 0)
             goto cleanup;
     }
 
@@ -1743,12 +2020,13 @@ acrnDomainGetCPUStats(virDomainPtr dom,
         goto cleanup;
     }
 
+    priv = vm->privateData;
+
     if (start_cpu == -1) {
-        ret = acrnGetDomainTotalCpuStats(params, nparams);
+        ret = acrnGetDomainTotalCpuStats(params, nparams, priv->cgroup);
     } else {
-        priv = vm->privateData;
         ret = acrnGetPercpuStats(params, nparams, start_cpu, ncpus,
-                                 priv->cpuAffinitySet);
+                                 priv->cpuAffinitySet, priv->cgroup);
     }
 
 cleanup:
@@ -2333,6 +2611,13 @@ acrnStateInitialize(bool privileged,
 	    goto cleanup;
     }
 
+    if (virFileMakePath(ACRN_LOG_DIR) < 0) {
+        virReportSystemError(errno,
+                             _("Failed to mkdir %s"),
+                             ACRN_LOG_DIR);
+        goto cleanup;
+    }
+
     if (virDomainObjListLoadAllConfigs(acrn_driver->domains,
                                        ACRN_STATE_DIR,
                                        NULL, true,
@@ -69,6 +69,30 @@ adminConnectLookupServer(virNetDaemonPtr dmn,
     return virNetDaemonGetServer(dmn, name);
 }
 
+static int
+adminServerAddThreadPoolHist(virTypedParamListPtr paramlist,
+                             const char *prefix,
+                             const unsigned long long *hist)
+{
+    size_t i;
+
+    for (i = 0; i < VIR_THREAD_POOL_HIST_BUCKETS; i++) {
+        unsigned long long bound = virThreadPoolGetHistBound(i);
+        int rc;
+
+        if (bound)
+            rc = virTypedParamListAddULLong(paramlist, hist[i],
+                                            "%slt%lluus", prefix, bound);
+        else
+            rc = virTypedParamListAddULLong(paramlist, hist[i],
+                                            "%sinf", prefix);
+        if (rc < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
 int
 adminServerGetThreadPoolParameters(virNetServerPtr srv,
                                    virTypedParameterPtr *params,
@@ -81,6 +105,8 @@ adminServerGetThreadPoolParameters(virNetServerPtr srv,
     size_t freeWorkers;
     size_t nPrioWorkers;
     size_t jobQueueDepth;
+    virThreadPoolStats stats;
+    unsigned long long jobs;
     g_autoptr(virTypedParamList) paramlist = g_new0(virTypedParamList, 1);
 
     virCheckFlags(0, -1);
@@ -88,7 +114,8 @@ adminServerGetThreadPoolParameters(virNetServerPtr srv,
     if (virNetServerGetThreadPoolParameters(srv, &minWorkers, &maxWorkers,
                                             &nWorkers, &freeWorkers,
                                             &nPrioWorkers,
-                                            &jobQueueDepth) < 0) {
+                                            &jobQueueDepth) < 0 ||
+        virNetServerGetThreadPoolStats(srv, &stats) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("Unable to retrieve threadpool parameters"));
         return -1;
@@ -118,6 +145,43 @@ adminServerGetThreadPoolParameters(virNetServerPtr srv,
                                  "%s", VIR_THREADPOOL_JOB_QUEUE_DEPTH) < 0)
         return -1;
 
+    if (virTypedParamListAddULLong(paramlist, stats.jobQueueDepthMax,
+                                   "%s", VIR_THREADPOOL_JOB_QUEUE_DEPTH_MAX) < 0)
+        return -1;
+
+    if (virTypedParamListAddULLong(paramlist, stats.jobsProcessed,
+                                   "%s", VIR_THREADPOOL_JOBS_PROCESSED) < 0)
+        return -1;
+
+    /* avoid dividing by zero before the first job completes */
+    jobs = MAX(stats.jobsProcessed, 1);
+
+    if (virTypedParamListAddULLong(paramlist, stats.waitTimeTotal / jobs,
+                                   "%s", VIR_THREADPOOL_JOB_WAIT_TIME_AVG) < 0)
+        return -1;
+
+    if (virTypedParamListAddULLong(paramlist, stats.waitTimeMax,
+                                   "%s", VIR_THREADPOOL_JOB_WAIT_TIME_MAX) < 0)
+        return -1;
+
+    if (adminServerAddThreadPoolHist(paramlist,
+                                     VIR_THREADPOOL_JOB_WAIT_TIME_HIST_PREFIX,
+                                     stats.waitTimeHist) < 0)
+        return -1;
+
+    if (virTypedParamListAddULLong(paramlist, stats.serviceTimeTotal / jobs,
+                                   "%s", VIR_THREADPOOL_JOB_SERVICE_TIME_AVG) < 0)
+        return -1;
+
+    if (virTypedParamListAddULLong(paramlist, stats.serviceTimeMax,
+                                   "%s", VIR_THREADPOOL_JOB_SERVICE_TIME_MAX) < 0)
+        return -1;
+
+    if (adminServerAddThreadPoolHist(paramlist,
+                                     VIR_THREADPOOL_JOB_SERVICE_TIME_HIST_PREFIX,
+                                     stats.serviceTimeHist) < 0)
+        return -1;
+
     *nparams = virTypedParamListStealParams(paramlist, params);
 
     return 0;
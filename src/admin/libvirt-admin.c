@@ -776,6 +776,16 @@ virAdmConnectLookupServer(virAdmConnectPtr conn,
  *      VIR_THREADPOOL_WORKERS_PRIORITY
  *      VIR_THREADPOOL_WORKERS_FREE
  *      VIR_THREADPOOL_WORKERS_CURRENT
+ *      VIR_THREADPOOL_JOB_QUEUE_DEPTH
+ *      VIR_THREADPOOL_JOB_QUEUE_DEPTH_MAX
+ *      VIR_THREADPOOL_JOBS_PROCESSED
+ *      VIR_THREADPOOL_JOB_WAIT_TIME_AVG
+ *      VIR_THREADPOOL_JOB_WAIT_TIME_MAX
+ *      VIR_THREADPOOL_JOB_SERVICE_TIME_AVG
+ *      VIR_THREADPOOL_JOB_SERVICE_TIME_MAX
+ * plus the histogram buckets whose names start with
+ * VIR_THREADPOOL_JOB_WAIT_TIME_HIST_PREFIX and
+ * VIR_THREADPOOL_JOB_SERVICE_TIME_HIST_PREFIX.
  *
  * Returns 0 on success, -1 in case of an error.
  */
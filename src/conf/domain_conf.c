@@ -29774,6 +29774,205 @@ virDomainUSBDeviceDefForeach(virDomainDefPtr def,
 }
 
 
+/* Copies the parts of @src which are parsed from XML with
+ * VIR_DOMAIN_DEF_PARSE_INACTIVE. Only the boot and rom elements permitted by
+ * @flags (VIR_DOMAIN_DEF_PARSE_ALLOW_*) are taken over. */
+static void
+virDomainDeviceInfoCopyConfig(virDomainDeviceInfoPtr dst,
+                              const virDomainDeviceInfo *src,
+                              virDomainXMLOptionPtr xmlopt,
+                              unsigned int flags)
+{
+    virDomainDeviceInfoClear(dst);
+
+    dst->type = src->type;
+    dst->addr = src->addr;
+    dst->mastertype = src->mastertype;
+    dst->master = src->master;
+
+    if (xmlopt->config.features & VIR_DOMAIN_DEF_FEATURE_USER_ALIAS &&
+        virDomainDeviceAliasIsUserAlias(src->alias) &&
+        strspn(src->alias, USER_ALIAS_CHARS) == strlen(src->alias))
+        dst->alias = g_strdup(src->alias);
+
+    if (flags & VIR_DOMAIN_DEF_PARSE_ALLOW_BOOT) {
+        dst->bootIndex = src->bootIndex;
+        dst->loadparm = g_strdup(src->loadparm);
+    }
+
+    if (flags & VIR_DOMAIN_DEF_PARSE_ALLOW_ROM) {
+        dst->romenabled = src->romenabled;
+        dst->rombar = src->rombar;
+        dst->romfile = g_strdup(src->romfile);
+    }
+}
+
+
+/**
+ * virDomainDiskDefCopyConfig:
+ * @src: disk definition to copy
+ * @xmlopt: XML parser callbacks
+ *
+ * Deep-copies @src into a new disk definition which is equivalent to the
+ * result of formatting @src with VIR_DOMAIN_DEF_FORMAT_SECURE and parsing it
+ * back with VIR_DOMAIN_DEF_PARSE_INACTIVE. Runtime state (block job mirror,
+ * aliases, chain indexes, private data) is not copied. Disks backed by
+ * storage pool volumes are not supported since their translated state is
+ * partially formatted.
+ *
+ * Returns the copy or NULL on error.
+ */
+static virDomainDiskDefPtr
+virDomainDiskDefCopyConfig(const virDomainDiskDef *src,
+                           virDomainXMLOptionPtr xmlopt)
+{
+    virDomainDiskDefPtr def;
+
+    if (!(def = virDomainDiskDefNew(xmlopt)))
+        return NULL;
+
+    virObjectUnref(def->src);
+    if (!(def->src = virStorageSourceCopyConfig(src->src)))
+        goto error;
+
+    def->device = src->device;
+    def->bus = src->bus;
+    def->dst = g_strdup(src->dst);
+
+    if (src->device == VIR_DOMAIN_DISK_DEVICE_FLOPPY ||
+        src->device == VIR_DOMAIN_DISK_DEVICE_CDROM)
+        def->tray_status = src->tray_status;
+    if (src->bus == VIR_DOMAIN_DISK_BUS_USB)
+        def->removable = src->removable;
+
+    def->geometry = src->geometry;
+    def->blockio = src->blockio;
+    virDomainBlockIoTuneInfoCopy(&src->blkdeviotune, &def->blkdeviotune);
+
+    def->driverName = g_strdup(src->driverName);
+    def->serial = g_strdup(src->serial);
+    def->wwn = g_strdup(src->wwn);
+    def->vendor = g_strdup(src->vendor);
+    def->product = g_strdup(src->product);
+    def->domain_name = g_strdup(src->domain_name);
+
+    def->cachemode = src->cachemode;
+    def->error_policy = src->error_policy;
+    def->rerror_policy = src->rerror_policy;
+    def->iomode = src->iomode;
+    def->ioeventfd = src->ioeventfd;
+    def->event_idx = src->event_idx;
+    def->copy_on_read = src->copy_on_read;
+    def->snapshot = src->snapshot;
+    def->startupPolicy = src->startupPolicy;
+    def->transient = src->transient;
+    def->rawio = src->rawio;
+    def->sgio = src->sgio;
+    def->discard = src->discard;
+    def->iothread = src->iothread;
+    def->detect_zeroes = src->detect_zeroes;
+    def->queues = src->queues;
+    def->model = src->model;
+
+    if (src->virtio) {
+        def->virtio = g_new0(virDomainVirtioOptions, 1);
+        *def->virtio = *src->virtio;
+    }
+
+    virDomainDeviceInfoCopyConfig(&def->info, &src->info, xmlopt,
+                                  VIR_DOMAIN_DEF_PARSE_ALLOW_BOOT);
+
+    return def;
+
+ error:
+    virDomainDiskDefFree(def);
+    return NULL;
+}
+
+
+static bool
+virDomainDefCanCopyDisksConfig(const virDomainDef *def)
+{
+    virStorageSourcePtr n;
+    size_t i;
+
+    for (i = 0; i < def->ndisks; i++) {
+        for (n = def->disks[i]->src;
+             virStorageSourceIsBacking(n);
+             n = n->backingStore) {
+            if (n->type == VIR_STORAGE_TYPE_VOLUME)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+
+/*
+ * Copies @src by formatting everything but the disks to XML and parsing it
+ * back, while the disks, which usually make up the bulk of a large
+ * definition, are copied natively. The post parse callbacks run once the
+ * disks are in place so that they see the same definition as they would
+ * after a full XML round-trip.
+ */
+static virDomainDefPtr
+virDomainDefCopyInactive(virDomainDefPtr src,
+                         virDomainXMLOptionPtr xmlopt,
+                         void *parseOpaque,
+                         unsigned int parse_flags)
+{
+    virDomainDef skeleton = *src;
+    g_autoptr(xmlDoc) xml = NULL;
+    g_autoptr(xmlXPathContext) ctxt = NULL;
+    g_autoptr(virDomainDef) def = NULL;
+    g_autofree char *xmlStr = NULL;
+    int keepBlanksDefault;
+    size_t i;
+
+    skeleton.disks = NULL;
+    skeleton.ndisks = 0;
+
+    if (!(xmlStr = virDomainDefFormat(&skeleton, xmlopt,
+                                      VIR_DOMAIN_DEF_FORMAT_SECURE)))
+        return NULL;
+
+    keepBlanksDefault = xmlKeepBlanksDefault(0);
+    xml = virXMLParse(NULL, xmlStr, _("(domain_definition)"));
+    xmlKeepBlanksDefault(keepBlanksDefault);
+    if (!xml)
+        return NULL;
+
+    if (!(ctxt = virXMLXPathContextNew(xml)))
+        return NULL;
+
+    ctxt->node = xmlDocGetRootElement(xml);
+
+    if (!(def = virDomainDefParseXML(xml, ctxt, xmlopt, parse_flags)))
+        return NULL;
+
+    if (src->ndisks)
+        def->disks = g_new0(virDomainDiskDefPtr, src->ndisks);
+
+    for (i = 0; i < src->ndisks; i++) {
+        virDomainDiskDefPtr disk;
+
+        if (!(disk = virDomainDiskDefCopyConfig(src->disks[i], xmlopt)))
+            return NULL;
+
+        virDomainDiskInsertPreAlloced(def, disk);
+    }
+
+    if (virDomainDefPostParse(def, parse_flags, xmlopt, parseOpaque) < 0)
+        return NULL;
+
+    if (virDomainDefValidate(def, parse_flags, xmlopt) < 0)
+        return NULL;
+
+    return g_steal_pointer(&def);
+}
+
+
 /* Copy src into a new definition; with the quality of the copy
  * depending on the migratable flag (false for transitions between
  * persistent and active, true for transitions across save files or
@@ -29789,6 +29988,9 @@ virDomainDefCopy(virDomainDefPtr src,
                                VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE;
     g_autofree char *xml = NULL;
 
+    if (!migratable && virDomainDefCanCopyDisksConfig(src))
+        return virDomainDefCopyInactive(src, xmlopt, parseOpaque, parse_flags);
+
     if (migratable)
         format_flags |= VIR_DOMAIN_DEF_FORMAT_INACTIVE | VIR_DOMAIN_DEF_FORMAT_MIGRATABLE;
 
@@ -523,7 +523,10 @@ typedef enum {
 } virDomainMemoryAllocation;
 
 
-/* Stores the virtual disk configuration */
+/* Stores the virtual disk configuration
+ *
+ * IMPORTANT: When adding fields to this struct which are part of the XML
+ * config it's also necessary to copy them in virDomainDiskDefCopyConfig */
 struct _virDomainDiskDef {
     virStorageSourcePtr src; /* non-NULL.  XXX Allow NULL for empty cdrom? */
 
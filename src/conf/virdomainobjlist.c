@@ -31,6 +31,7 @@
 #include "virfile.h"
 #include "virlog.h"
 #include "virstring.h"
+#include "virthreadpool.h"
 #include "virdomainsnapshotobjlist.h"
 #include "virdomaincheckpointobjlist.h"
 
@@ -42,16 +43,31 @@ static virClassPtr virDomainObjListClass;
 static void virDomainObjListDispose(void *obj);
 
 
+/* Number of lock stripes in each of the lookup tables */
+#define VIR_DOMAIN_OBJ_LIST_STRIPES 16
+
+/*
+ * Locking rules:
+ *
+ * The list's own RW lock serializes writers (add, remove, rename,
+ * config loading) against each other and against iterators
+ * (ForEach, Collect, ...), which take it in read mode. The lookup
+ * tables are lock-striped, so FindByUUID and FindByName only take
+ * the read lock of a single stripe and never touch the list lock.
+ * Objects are only locked after the stripe lock has been dropped:
+ * iterators work on a referenced snapshot of the list taken under
+ * the stripe locks, so the stripe locks are always innermost.
+ */
 struct _virDomainObjList {
     virObjectRWLockable parent;
 
     /* uuid string -> virDomainObj  mapping
-     * for O(1), lockless lookup-by-uuid */
-    virHashTable *objs;
+     * for O(1), lock-striped lookup-by-uuid */
+    virHashAtomicPtr objs;
 
     /* name -> virDomainObj mapping for O(1),
-     * lockless lookup-by-name */
-    virHashTable *objsName;
+     * lock-striped lookup-by-name */
+    virHashAtomicPtr objsName;
 };
 
 
@@ -75,8 +91,10 @@ virDomainObjListPtr virDomainObjListNew(void)
     if (!(doms = virObjectRWLockableNew(virDomainObjListClass)))
         return NULL;
 
-    if (!(doms->objs = virHashCreate(50, virObjectFreeHashData)) ||
-        !(doms->objsName = virHashCreate(50, virObjectFreeHashData))) {
+    if (!(doms->objs = virHashAtomicNewStriped(VIR_DOMAIN_OBJ_LIST_STRIPES,
+                                               50, virObjectFreeHashData)) ||
+        !(doms->objsName = virHashAtomicNewStriped(VIR_DOMAIN_OBJ_LIST_STRIPES,
+                                                   50, virObjectFreeHashData))) {
         virObjectUnref(doms);
         return NULL;
     }
@@ -89,25 +107,91 @@ static void virDomainObjListDispose(void *obj)
 {
     virDomainObjListPtr doms = obj;
 
-    virHashFree(doms->objs);
-    virHashFree(doms->objsName);
+    virObjectUnref(doms->objs);
+    virObjectUnref(doms->objsName);
+}
+
+
+struct virDomainListData {
+    virDomainObjPtr *vms;
+    size_t nvms;
+};
+
+
+static int
+virDomainObjListCollectIterator(void *payload,
+                                const void *name G_GNUC_UNUSED,
+                                void *opaque)
+{
+    struct virDomainListData *data = opaque;
+
+    data->vms[data->nvms++] = virObjectRef(payload);
+    return 0;
 }
 
 
-static int virDomainObjListSearchID(const void *payload,
+/* The caller must hold the list lock, which keeps the
+ * number of objects stable while the snapshot is taken. */
+static int
+virDomainObjListSnapshotLocked(virDomainObjListPtr doms,
+                               struct virDomainListData *data)
+{
+    ssize_t count = virHashAtomicSize(doms->objs);
+
+    data->vms = NULL;
+    data->nvms = 0;
+
+    if (count < 0 || VIR_ALLOC_N(data->vms, count) < 0)
+        return -1;
+
+    virHashAtomicForEach(doms->objs, virDomainObjListCollectIterator, data);
+    return 0;
+}
+
+
+/* Calls @iter on each object of a referenced snapshot of the list,
+ * so that @iter may lock the objects without holding a stripe lock.
+ * The caller must hold the list lock. */
+static void
+virDomainObjListIterateLocked(virDomainObjListPtr doms,
+                              virHashIterator iter,
+                              void *opaque)
+{
+    struct virDomainListData data;
+    size_t i;
+
+    if (virDomainObjListSnapshotLocked(doms, &data) < 0)
+        return;
+
+    for (i = 0; i < data.nvms; i++)
+        iter(data.vms[i], NULL, opaque);
+
+    virObjectListFreeCount(data.vms, data.nvms);
+}
+
+
+struct virDomainObjListSearchIDData {
+    int id;
+    virDomainObjPtr obj;
+};
+
+
+static int virDomainObjListSearchID(void *payload,
                                     const void *name G_GNUC_UNUSED,
-                                    const void *data)
+                                    void *opaque)
 {
-    virDomainObjPtr obj = (virDomainObjPtr)payload;
-    const int *id = data;
-    int want = 0;
+    virDomainObjPtr obj = payload;
+    struct virDomainObjListSearchIDData *data = opaque;
+
+    if (data->obj)
+        return 0;
 
     virObjectLock(obj);
     if (virDomainObjIsActive(obj) &&
-        obj->def->id == *id)
-        want = 1;
+        obj->def->id == data->id)
+        data->obj = virObjectRef(obj);
     virObjectUnlock(obj);
-    return want;
+    return 0;
 }
 
 
@@ -115,12 +199,13 @@ virDomainObjPtr
 virDomainObjListFindByID(virDomainObjListPtr doms,
                          int id)
 {
+    struct virDomainObjListSearchIDData data = { id, NULL };
     virDomainObjPtr obj;
 
     virObjectRWLockRead(doms);
-    obj = virHashSearch(doms->objs, virDomainObjListSearchID, &id, NULL);
-    virObjectRef(obj);
+    virDomainObjListIterateLocked(doms, virDomainObjListSearchID, &data);
     virObjectRWUnlock(doms);
+    obj = data.obj;
     if (obj) {
         virObjectLock(obj);
         if (obj->removing) {
@@ -142,11 +227,8 @@ virDomainObjListFindByUUIDLocked(virDomainObjListPtr doms,
     virDomainObjPtr obj;
 
     virUUIDFormat(uuid, uuidstr);
-    obj = virHashLookup(doms->objs, uuidstr);
-    if (obj) {
-        virObjectRef(obj);
+    if ((obj = virHashAtomicLookupRef(doms->objs, uuidstr)))
         virObjectLock(obj);
-    }
     return obj;
 }
 
@@ -165,9 +247,7 @@ virDomainObjListFindByUUID(virDomainObjListPtr doms,
 {
     virDomainObjPtr obj;
 
-    virObjectRWLockRead(doms);
     obj = virDomainObjListFindByUUIDLocked(doms, uuid);
-    virObjectRWUnlock(doms);
 
     if (obj && obj->removing) {
         virObjectUnlock(obj);
@@ -185,11 +265,8 @@ virDomainObjListFindByNameLocked(virDomainObjListPtr doms,
 {
     virDomainObjPtr obj;
 
-    obj = virHashLookup(doms->objsName, name);
-    if (obj) {
-        virObjectRef(obj);
+    if ((obj = virHashAtomicLookupRef(doms->objsName, name)))
         virObjectLock(obj);
-    }
     return obj;
 }
 
@@ -208,9 +285,7 @@ virDomainObjListFindByName(virDomainObjListPtr doms,
 {
     virDomainObjPtr obj;
 
-    virObjectRWLockRead(doms);
     obj = virDomainObjListFindByNameLocked(doms, name);
-    virObjectRWUnlock(doms);
 
     if (obj && obj->removing) {
         virObjectUnlock(obj);
@@ -230,11 +305,15 @@ virDomainObjListFindByName(virDomainObjListPtr doms,
  *
  * Add the @vm into the @doms->objs and @doms->objsName hash
  * tables. Once successfully added into a table, increase the
- * reference count since upon removal in virHashRemoveEntry
+ * reference count since upon removal in virHashAtomicRemove
  * the virObjectUnref will be called since the hash tables were
  * configured to call virObjectFreeHashData when the object is
  * removed from the hash table.
  *
+ * Since lookups do not take the list lock, both keys are checked
+ * up front so that a concurrent lookup can never observe an object
+ * that is inserted into one table and then backed out again.
+ *
  * Returns 0 on success with 3 references and locked
  *        -1 on failure with 1 reference and locked
  */
@@ -245,12 +324,23 @@ virDomainObjListAddObjLocked(virDomainObjListPtr doms,
     char uuidstr[VIR_UUID_STRING_BUFLEN];
 
     virUUIDFormat(vm->def->uuid, uuidstr);
-    if (virHashAddEntry(doms->objs, uuidstr, vm) < 0)
+    if (virHashAtomicHasEntry(doms->objs, uuidstr)) {
+        virReportError(VIR_ERR_OPERATION_FAILED,
+                       _("domain with uuid '%s' already exists"), uuidstr);
+        return -1;
+    }
+    if (virHashAtomicHasEntry(doms->objsName, vm->def->name)) {
+        virReportError(VIR_ERR_OPERATION_FAILED,
+                       _("domain '%s' already exists"), vm->def->name);
+        return -1;
+    }
+
+    if (virHashAtomicAdd(doms->objs, uuidstr, vm) < 0)
         return -1;
     virObjectRef(vm);
 
-    if (virHashAddEntry(doms->objsName, vm->def->name, vm) < 0) {
-        virHashRemoveEntry(doms->objs, uuidstr);
+    if (virHashAtomicAdd(doms->objsName, vm->def->name, vm) < 0) {
+        virHashAtomicRemove(doms->objs, uuidstr);
         return -1;
     }
     virObjectRef(vm);
@@ -380,8 +470,8 @@ virDomainObjListRemoveLocked(virDomainObjListPtr doms,
 
     virUUIDFormat(dom->def->uuid, uuidstr);
 
-    virHashRemoveEntry(doms->objs, uuidstr);
-    virHashRemoveEntry(doms->objsName, dom->def->name);
+    virHashAtomicRemove(doms->objs, uuidstr);
+    virHashAtomicRemove(doms->objsName, dom->def->name);
 }
 
 
@@ -451,14 +541,14 @@ virDomainObjListRename(virDomainObjListPtr doms,
     virObjectLock(dom);
     virObjectUnref(dom);
 
-    if (virHashLookup(doms->objsName, new_name) != NULL) {
+    if (virHashAtomicHasEntry(doms->objsName, new_name)) {
         virReportError(VIR_ERR_OPERATION_INVALID,
                        _("domain with name '%s' already exists"),
                        new_name);
         goto cleanup;
     }
 
-    if (virHashAddEntry(doms->objsName, new_name, dom) < 0)
+    if (virHashAtomicAdd(doms->objsName, new_name, dom) < 0)
         goto cleanup;
 
     /* Increment the refcnt for @new_name. We're about to remove
@@ -469,7 +559,7 @@ virDomainObjListRename(virDomainObjListPtr doms,
     virObjectRef(dom);
 
     rc = callback(dom, new_name, flags, opaque);
-    virHashRemoveEntry(doms->objsName, rc < 0 ? new_name : old_name);
+    virHashAtomicRemove(doms->objsName, rc < 0 ? new_name : old_name);
     if (rc < 0)
         goto cleanup;
 
@@ -481,37 +571,52 @@ virDomainObjListRename(virDomainObjListPtr doms,
 }
 
 
-static virDomainObjPtr
-virDomainObjListLoadConfig(virDomainObjListPtr doms,
-                           virDomainXMLOptionPtr xmlopt,
-                           const char *configDir,
-                           const char *autostartDir,
-                           const char *name,
-                           virDomainLoadConfigNotify notify,
-                           void *opaque)
+/* Upper bound of threads parsing domain XML files in parallel in
+ * virDomainObjListLoadAllConfigs */
+#define VIR_DOMAIN_OBJ_LIST_LOAD_WORKERS 16
+
+static virDomainDefPtr
+virDomainObjListParseConfig(virDomainXMLOptionPtr xmlopt,
+                            const char *configDir,
+                            const char *autostartDir,
+                            const char *name,
+                            int *autostart)
 {
-    char *configFile = NULL, *autostartLink = NULL;
-    virDomainDefPtr def = NULL;
-    virDomainObjPtr dom;
-    int autostart;
-    virDomainDefPtr oldDef = NULL;
+    g_autofree char *configFile = NULL;
+    g_autofree char *autostartLink = NULL;
+    g_autoptr(virDomainDef) def = NULL;
 
     if ((configFile = virDomainConfigFile(configDir, name)) == NULL)
-        goto error;
+        return NULL;
     if (!(def = virDomainDefParseFile(configFile, xmlopt, NULL,
                                       VIR_DOMAIN_DEF_PARSE_INACTIVE |
                                       VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE |
                                       VIR_DOMAIN_DEF_PARSE_ALLOW_POST_PARSE_FAIL)))
-        goto error;
+        return NULL;
 
     if ((autostartLink = virDomainConfigFile(autostartDir, name)) == NULL)
-        goto error;
+        return NULL;
 
-    if ((autostart = virFileLinkPointsTo(autostartLink, configFile)) < 0)
-        goto error;
+    if ((*autostart = virFileLinkPointsTo(autostartLink, configFile)) < 0)
+        return NULL;
+
+    return g_steal_pointer(&def);
+}
+
+
+static virDomainObjPtr
+virDomainObjListLoadConfig(virDomainObjListPtr doms,
+                           virDomainXMLOptionPtr xmlopt,
+                           virDomainDefPtr def,
+                           int autostart,
+                           virDomainLoadConfigNotify notify,
+                           void *opaque)
+{
+    virDomainObjPtr dom;
+    virDomainDefPtr oldDef = NULL;
 
     if (!(dom = virDomainObjListAddLocked(doms, def, xmlopt, 0, &oldDef)))
-        goto error;
+        return NULL;
 
     dom->autostart = autostart;
 
@@ -519,32 +624,22 @@ virDomainObjListLoadConfig(virDomainObjListPtr doms,
         (*notify)(dom, oldDef == NULL, opaque);
 
     virDomainDefFree(oldDef);
-    VIR_FREE(configFile);
-    VIR_FREE(autostartLink);
     return dom;
-
- error:
-    VIR_FREE(configFile);
-    VIR_FREE(autostartLink);
-    virDomainDefFree(def);
-    return NULL;
 }
 
 
+/* Returns the parsed object unlocked, so that it can be handed over
+ * to another thread. */
 static virDomainObjPtr
-virDomainObjListLoadStatus(virDomainObjListPtr doms,
-                           const char *statusDir,
-                           const char *name,
-                           virDomainXMLOptionPtr xmlopt,
-                           virDomainLoadConfigNotify notify,
-                           void *opaque)
+virDomainObjListParseStatus(const char *statusDir,
+                            const char *name,
+                            virDomainXMLOptionPtr xmlopt)
 {
-    char *statusFile = NULL;
-    virDomainObjPtr obj = NULL;
-    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    g_autofree char *statusFile = NULL;
+    virDomainObjPtr obj;
 
     if ((statusFile = virDomainConfigFile(statusDir, name)) == NULL)
-        goto error;
+        return NULL;
 
     if (!(obj = virDomainObjParseFile(statusFile, xmlopt,
                                       VIR_DOMAIN_DEF_PARSE_STATUS |
@@ -552,11 +647,27 @@ virDomainObjListLoadStatus(virDomainObjListPtr doms,
                                       VIR_DOMAIN_DEF_PARSE_PCI_ORIG_STATES |
                                       VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE |
                                       VIR_DOMAIN_DEF_PARSE_ALLOW_POST_PARSE_FAIL)))
-        goto error;
+        return NULL;
+
+    virObjectUnlock(obj);
+    return obj;
+}
+
+
+/* Consumes the reference of @obj, which must be unlocked. */
+static virDomainObjPtr
+virDomainObjListLoadStatus(virDomainObjListPtr doms,
+                           virDomainObjPtr obj,
+                           virDomainLoadConfigNotify notify,
+                           void *opaque)
+{
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+
+    virObjectLock(obj);
 
     virUUIDFormat(obj->def->uuid, uuidstr);
 
-    if (virHashLookup(doms->objs, uuidstr) != NULL) {
+    if (virHashAtomicHasEntry(doms->objs, uuidstr)) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("unexpected domain %s already exists"),
                        obj->def->name);
@@ -569,16 +680,95 @@ virDomainObjListLoadStatus(virDomainObjListPtr doms,
     if (notify)
         (*notify)(obj, 1, opaque);
 
-    VIR_FREE(statusFile);
     return obj;
 
  error:
     virDomainObjEndAPI(&obj);
-    VIR_FREE(statusFile);
     return NULL;
 }
 
 
+typedef struct _virDomainObjListLoadJob virDomainObjListLoadJob;
+typedef virDomainObjListLoadJob *virDomainObjListLoadJobPtr;
+struct _virDomainObjListLoadJob {
+    char *name;
+
+    /* filled in by the worker */
+    virDomainDefPtr def;
+    int autostart;
+    virDomainObjPtr obj;
+};
+
+struct virDomainObjListLoadData {
+    const char *configDir;
+    const char *autostartDir;
+    bool liveStatus;
+    virDomainXMLOptionPtr xmlopt;
+
+    virMutex lock;
+    virCond cond;
+    size_t ndone;
+};
+
+
+static void
+virDomainObjListLoadWorker(void *jobdata,
+                           void *opaque)
+{
+    virDomainObjListLoadJobPtr job = jobdata;
+    struct virDomainObjListLoadData *data = opaque;
+
+    VIR_INFO("Loading config file '%s.xml'", job->name);
+    if (data->liveStatus)
+        job->obj = virDomainObjListParseStatus(data->configDir, job->name,
+                                               data->xmlopt);
+    else
+        job->def = virDomainObjListParseConfig(data->xmlopt,
+                                               data->configDir,
+                                               data->autostartDir,
+                                               job->name,
+                                               &job->autostart);
+
+    virMutexLock(&data->lock);
+    data->ndone++;
+    virCondSignal(&data->cond);
+    virMutexUnlock(&data->lock);
+}
+
+
+/* Parses the files named in @jobs, using a pool of worker threads
+ * when there is more than one. Returns once all of them are done. */
+static void
+virDomainObjListLoadParse(virDomainObjListLoadJobPtr jobs,
+                          size_t njobs,
+                          struct virDomainObjListLoadData *data)
+{
+    virThreadPoolPtr pool = NULL;
+    size_t nworkers;
+    size_t i;
+
+    nworkers = MIN(njobs, MIN(g_get_num_processors(),
+                              VIR_DOMAIN_OBJ_LIST_LOAD_WORKERS));
+
+    if (nworkers > 1 &&
+        !(pool = virThreadPoolNew(nworkers, nworkers, 0,
+                                  virDomainObjListLoadWorker, data)))
+        virResetLastError();
+
+    for (i = 0; i < njobs; i++) {
+        if (!pool || virThreadPoolSendJob(pool, 0, &jobs[i]) < 0)
+            virDomainObjListLoadWorker(&jobs[i], data);
+    }
+
+    virMutexLock(&data->lock);
+    while (data->ndone < njobs)
+        ignore_value(virCondWait(&data->cond, &data->lock));
+    virMutexUnlock(&data->lock);
+
+    virThreadPoolFree(pool);
+}
+
+
 int
 virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
                                const char *configDir,
@@ -588,53 +778,103 @@ virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
                                virDomainLoadConfigNotify notify,
                                void *opaque)
 {
+    struct virDomainObjListLoadData data = {
+        .configDir = configDir,
+        .autostartDir = autostartDir,
+        .liveStatus = liveStatus,
+        .xmlopt = xmlopt,
+    };
+    virDomainObjListLoadJobPtr jobs = NULL;
+    size_t njobs = 0;
     DIR *dir;
     struct dirent *entry;
     int ret = -1;
     int rc;
+    size_t i;
 
     VIR_INFO("Scanning for configs in %s", configDir);
 
     if ((rc = virDirOpenIfExists(&dir, configDir)) <= 0)
         return rc;
 
-    virObjectRWLockWrite(doms);
-
     while ((ret = virDirRead(dir, &entry, configDir)) > 0) {
-        virDomainObjPtr dom;
+        virDomainObjListLoadJob job = { 0 };
 
         if (!virStringStripSuffix(entry->d_name, ".xml"))
             continue;
 
+        job.name = g_strdup(entry->d_name);
+        ignore_value(VIR_APPEND_ELEMENT(jobs, njobs, job));
+    }
+
+    VIR_DIR_CLOSE(dir);
+
+    if (njobs == 0)
+        return ret;
+
+    if (virMutexInit(&data.lock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot initialize mutex"));
+        ret = -1;
+        goto cleanup;
+    }
+    if (virCondInit(&data.cond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize condition variable"));
+        virMutexDestroy(&data.lock);
+        ret = -1;
+        goto cleanup;
+    }
+
+    /* Parsing is independent for each file and is fanned out to worker
+     * threads. Insertion into the list happens afterwards, in directory
+     * order, from this thread only. */
+    virDomainObjListLoadParse(jobs, njobs, &data);
+
+    virCondDestroy(&data.cond);
+    virMutexDestroy(&data.lock);
+
+    virObjectRWLockWrite(doms);
+
+    for (i = 0; i < njobs; i++) {
+        virDomainObjPtr dom = NULL;
+
         /* NB: ignoring errors, so one malformed config doesn't
            kill the whole process */
-        VIR_INFO("Loading config file '%s.xml'", entry->d_name);
-        if (liveStatus)
-            dom = virDomainObjListLoadStatus(doms,
-                                             configDir,
-                                             entry->d_name,
-                                             xmlopt,
-                                             notify,
-                                             opaque);
-        else
-            dom = virDomainObjListLoadConfig(doms,
-                                             xmlopt,
-                                             configDir,
-                                             autostartDir,
-                                             entry->d_name,
-                                             notify,
-                                             opaque);
+        if (liveStatus) {
+            if (jobs[i].obj)
+                dom = virDomainObjListLoadStatus(doms,
+                                                 g_steal_pointer(&jobs[i].obj),
+                                                 notify,
+                                                 opaque);
+        } else if (jobs[i].def) {
+            if ((dom = virDomainObjListLoadConfig(doms,
+                                                  xmlopt,
+                                                  jobs[i].def,
+                                                  jobs[i].autostart,
+                                                  notify,
+                                                  opaque)))
+                jobs[i].def = NULL;
+        }
+
         if (dom) {
             if (!liveStatus)
                 dom->persistent = 1;
             virDomainObjEndAPI(&dom);
         } else {
-            VIR_ERROR(_("Failed to load config for domain '%s'"), entry->d_name);
+            VIR_ERROR(_("Failed to load config for domain '%s'"), jobs[i].name);
         }
     }
 
-    VIR_DIR_CLOSE(dir);
     virObjectRWUnlock(doms);
+
+ cleanup:
+    for (i = 0; i < njobs; i++) {
+        VIR_FREE(jobs[i].name);
+        virDomainDefFree(jobs[i].def);
+        virObjectUnref(jobs[i].obj);
+    }
+    VIR_FREE(jobs);
     return ret;
 }
 
@@ -679,7 +919,7 @@ virDomainObjListNumOfDomains(virDomainObjListPtr doms,
 {
     struct virDomainObjListData data = { filter, conn, active, 0 };
     virObjectRWLockRead(doms);
-    virHashForEach(doms->objs, virDomainObjListCount, &data);
+    virDomainObjListIterateLocked(doms, virDomainObjListCount, &data);
     virObjectRWUnlock(doms);
     return data.count;
 }
@@ -723,7 +963,7 @@ virDomainObjListGetActiveIDs(virDomainObjListPtr doms,
     struct virDomainIDData data = { filter, conn,
                                     0, maxids, ids };
     virObjectRWLockRead(doms);
-    virHashForEach(doms->objs, virDomainObjListCopyActiveIDs, &data);
+    virDomainObjListIterateLocked(doms, virDomainObjListCopyActiveIDs, &data);
     virObjectRWUnlock(doms);
     return data.numids;
 }
@@ -776,7 +1016,7 @@ virDomainObjListGetInactiveNames(virDomainObjListPtr doms,
                                       0, 0, maxnames, names };
     size_t i;
     virObjectRWLockRead(doms);
-    virHashForEach(doms->objs, virDomainObjListCopyInactiveNames, &data);
+    virDomainObjListIterateLocked(doms, virDomainObjListCopyInactiveNames, &data);
     virObjectRWUnlock(doms);
     if (data.oom) {
         for (i = 0; i < data.numnames; i++)
@@ -788,26 +1028,6 @@ virDomainObjListGetInactiveNames(virDomainObjListPtr doms,
 }
 
 
-struct virDomainListIterData {
-    virDomainObjListIterator callback;
-    void *opaque;
-    int ret;
-};
-
-
-static int
-virDomainObjListHelper(void *payload,
-                       const void *name G_GNUC_UNUSED,
-                       void *opaque)
-{
-    struct virDomainListIterData *data = opaque;
-
-    if (data->callback(payload, data->opaque) < 0)
-        data->ret = -1;
-    return 0;
-}
-
-
 /**
  * virDomainObjListForEach:
  * @doms: Pointer to the domain object list
@@ -830,17 +1050,31 @@ virDomainObjListForEach(virDomainObjListPtr doms,
                         virDomainObjListIterator callback,
                         void *opaque)
 {
-    struct virDomainListIterData data = {
-        callback, opaque, 0,
-    };
+    struct virDomainListData data = { NULL, 0 };
+    size_t i;
+    int ret = 0;
 
     if (modify)
         virObjectRWLockWrite(doms);
     else
         virObjectRWLockRead(doms);
-    virHashForEach(doms->objs, virDomainObjListHelper, &data);
+
+    /* Iterate over a referenced snapshot rather than the striped
+     * tables themselves so that @callback may remove the current
+     * element without re-entering a stripe lock. */
+    if (virDomainObjListSnapshotLocked(doms, &data) < 0) {
+        virObjectRWUnlock(doms);
+        return -1;
+    }
+
+    for (i = 0; i < data.nvms; i++) {
+        if (callback(data.vms[i], opaque) < 0)
+            ret = -1;
+    }
+
     virObjectRWUnlock(doms);
-    return data.ret;
+    virObjectListFreeCount(data.vms, data.nvms);
+    return ret;
 }
 
 
@@ -917,24 +1151,6 @@ virDomainObjMatchFilter(virDomainObjPtr vm,
 #undef MATCH
 
 
-struct virDomainListData {
-    virDomainObjPtr *vms;
-    size_t nvms;
-};
-
-
-static int
-virDomainObjListCollectIterator(void *payload,
-                                const void *name G_GNUC_UNUSED,
-                                void *opaque)
-{
-    struct virDomainListData *data = opaque;
-
-    data->vms[data->nvms++] = virObjectRef(payload);
-    return 0;
-}
-
-
 static void
 virDomainObjListFilter(virDomainObjPtr **list,
                        size_t *nvms,
@@ -981,12 +1197,10 @@ virDomainObjListCollect(virDomainObjListPtr domlist,
 
     virObjectRWLockRead(domlist);
     sa_assert(domlist->objs);
-    if (VIR_ALLOC_N(data.vms, virHashSize(domlist->objs)) < 0) {
+    if (virDomainObjListSnapshotLocked(domlist, &data) < 0) {
         virObjectRWUnlock(domlist);
         return -1;
     }
-
-    virHashForEach(domlist->objs, virDomainObjListCollectIterator, &data);
     virObjectRWUnlock(domlist);
 
     virDomainObjListFilter(&data.vms, &data.nvms, conn, filter, flags);
@@ -1022,7 +1236,7 @@ virDomainObjListConvert(virDomainObjListPtr domlist,
 
         virUUIDFormat(dom->uuid, uuidstr);
 
-        if (!(vm = virHashLookup(domlist->objs, uuidstr))) {
+        if (!(vm = virHashAtomicLookupRef(domlist->objs, uuidstr))) {
             if (skip_missing)
                 continue;
 
@@ -1033,8 +1247,6 @@ virDomainObjListConvert(virDomainObjListPtr domlist,
             goto error;
         }
 
-        virObjectRef(vm);
-
         if (VIR_APPEND_ELEMENT(*vms, *nvms, vm) < 0) {
             virObjectRWUnlock(domlist);
             virObjectUnref(vm);
@@ -34,6 +34,8 @@
 #include "virlog.h"
 #include "virutil.h"
 #include "virnetdev.h"
+#include "virprobe.h"
+#include "virthread.h"
 #include "configmake.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
@@ -42,6 +44,9 @@ VIR_LOG_INIT("util.hostdev");
 
 #define HOSTDEV_STATE_DIR RUNSTATEDIR "/libvirt/hostdevmgr"
 
+/* Maximum number of threads resetting PCI devices in parallel */
+#define VIR_HOSTDEV_PCI_RESET_WORKERS 8
+
 static virHostdevManagerPtr manager; /* global hostdev manager, never freed */
 
 static virClassPtr virHostdevManagerClass;
@@ -613,29 +618,165 @@ virHostdevRestoreNetConfig(virDomainHostdevDefPtr hostdev,
     }
 }
 
+/* PCI devices sitting on the same bus are reset by the same worker,
+ * one after another: a secondary bus reset of one of them affects all
+ * the others. Devices on different buses are independent and can be
+ * reset concurrently, which matters because both PM and bus resets
+ * spend most of their time sleeping. */
+typedef struct _virHostdevPCIResetGroup virHostdevPCIResetGroup;
+struct _virHostdevPCIResetGroup {
+    unsigned int domain;
+    unsigned int bus;
+    virPCIDevicePtr *devs;
+    size_t ndevs;
+};
+
+typedef struct _virHostdevPCIResetData virHostdevPCIResetData;
+struct _virHostdevPCIResetData {
+    virHostdevManagerPtr mgr;
+
+    virMutex lock;
+    virHostdevPCIResetGroup *groups;
+    size_t ngroups;
+    size_t next;  /* first group not yet picked up by a worker */
+    int ret;
+    virErrorPtr err;  /* first error reported by a worker */
+};
+
+static int
+virHostdevResetPCIDevice(virHostdevManagerPtr mgr,
+                         virPCIDevicePtr pci)
+{
+    unsigned long long start = g_get_monotonic_time();
+    int ret;
+
+    /* We can avoid looking up the actual device here, because performing
+     * a PCI reset on a device doesn't require any information other than
+     * the address, which 'pci' already contains */
+    VIR_DEBUG("Resetting PCI device %s", virPCIDeviceGetName(pci));
+    ret = virPCIDeviceReset(pci, mgr->activePCIHostdevs,
+                            mgr->inactivePCIHostdevs);
+
+    PROBE(HOSTDEV_PCI_RESET,
+          "dev=%s ret=%d ms=%llu",
+          virPCIDeviceGetName(pci), ret,
+          (g_get_monotonic_time() - start) / 1000);
+
+    if (ret < 0)
+        VIR_ERROR(_("Failed to reset PCI device: %s"),
+                  virGetLastErrorMessage());
+
+    return ret;
+}
+
+static void
+virHostdevResetPCIWorker(void *opaque)
+{
+    virHostdevPCIResetData *data = opaque;
+    virHostdevPCIResetGroup *group;
+    size_t i;
+
+    while (true) {
+        virMutexLock(&data->lock);
+        if (data->next == data->ngroups) {
+            virMutexUnlock(&data->lock);
+            return;
+        }
+        group = &data->groups[data->next++];
+        virMutexUnlock(&data->lock);
+
+        for (i = 0; i < group->ndevs; i++) {
+            if (virHostdevResetPCIDevice(data->mgr, group->devs[i]) == 0)
+                continue;
+
+            /* Errors are thread local, so hand the first one over to
+             * the thread that is waiting for us */
+            virMutexLock(&data->lock);
+            data->ret = -1;
+            if (!data->err)
+                virErrorPreserveLast(&data->err);
+            virMutexUnlock(&data->lock);
+        }
+    }
+}
+
 static int
 virHostdevResetAllPCIDevices(virHostdevManagerPtr mgr,
                              virPCIDeviceListPtr pcidevs)
 {
-    int ret = 0;
-    size_t i;
+    virHostdevPCIResetData data = { .mgr = mgr };
+    g_autofree virThread *workers = NULL;
+    size_t maxworkers;
+    size_t nworkers = 0;
+    size_t count = virPCIDeviceListCount(pcidevs);
+    unsigned long long start = g_get_monotonic_time();
+    size_t i, j;
 
-    for (i = 0; i < virPCIDeviceListCount(pcidevs); i++) {
+    if (count == 0)
+        return 0;
+
+    if (virMutexInit(&data.lock) < 0) {
+        virReportSystemError(errno, "%s", _("unable to init mutex"));
+        return -1;
+    }
+
+    data.groups = g_new0(virHostdevPCIResetGroup, count);
+
+    for (i = 0; i < count; i++) {
         virPCIDevicePtr pci = virPCIDeviceListGet(pcidevs, i);
+        virPCIDeviceAddressPtr addr = virPCIDeviceGetAddress(pci);
+        virHostdevPCIResetGroup *group = NULL;
+
+        for (j = 0; j < data.ngroups; j++) {
+            if (data.groups[j].domain == addr->domain &&
+                data.groups[j].bus == addr->bus) {
+                group = &data.groups[j];
+                break;
+            }
+        }
 
-        /* We can avoid looking up the actual device here, because performing
-         * a PCI reset on a device doesn't require any information other than
-         * the address, which 'pci' already contains */
-        VIR_DEBUG("Resetting PCI device %s", virPCIDeviceGetName(pci));
-        if (virPCIDeviceReset(pci, mgr->activePCIHostdevs,
-                              mgr->inactivePCIHostdevs) < 0) {
-            VIR_ERROR(_("Failed to reset PCI device: %s"),
-                      virGetLastErrorMessage());
-            ret = -1;
+        if (!group) {
+            group = &data.groups[data.ngroups++];
+            group->domain = addr->domain;
+            group->bus = addr->bus;
         }
+
+        ignore_value(VIR_APPEND_ELEMENT_COPY(group->devs, group->ndevs, pci));
     }
 
-    return ret;
+    /* The calling thread acts as a worker as well, so a single bus
+     * doesn't need any extra thread at all */
+    maxworkers = MIN(data.ngroups, VIR_HOSTDEV_PCI_RESET_WORKERS);
+    workers = g_new0(virThread, maxworkers);
+    for (i = 1; i < maxworkers; i++) {
+        if (virThreadCreate(&workers[nworkers], true,
+                            virHostdevResetPCIWorker, &data) < 0) {
+            VIR_WARN("Failed to spawn PCI reset worker, continuing with %zu",
+                     nworkers + 1);
+            break;
+        }
+        nworkers++;
+    }
+
+    virHostdevResetPCIWorker(&data);
+
+    for (i = 0; i < nworkers; i++)
+        virThreadJoin(&workers[i]);
+
+    PROBE(HOSTDEV_PCI_RESET_ALL,
+          "devs=%zu buses=%zu threads=%zu ms=%llu",
+          count, data.ngroups, nworkers + 1,
+          (g_get_monotonic_time() - start) / 1000);
+
+    if (data.err)
+        virErrorRestore(&data.err);
+
+    for (i = 0; i < data.ngroups; i++)
+        g_free(data.groups[i].devs);
+    g_free(data.groups);
+    virMutexDestroy(&data.lock);
+
+    return data.ret;
 }
 
 static void
@@ -43,6 +43,9 @@ VIR_LOG_INIT("logging.log_handler");
 
 #define DEFAULT_MODE 0600
 
+/* Maximum amount of data moved from a log pipe to its file in one go */
+#define VIR_LOG_HANDLER_CHUNK_SIZE (1024 * 1024)
+
 typedef struct _virLogHandlerLogFile virLogHandlerLogFile;
 typedef virLogHandlerLogFile *virLogHandlerLogFilePtr;
 
@@ -143,7 +146,6 @@ virLogHandlerDomainLogFileEvent(int watch,
 {
     virLogHandlerPtr handler = opaque;
     virLogHandlerLogFilePtr logfile;
-    char buf[1024];
     ssize_t len;
 
     virObjectLock(handler);
@@ -159,18 +161,9 @@ virLogHandlerDomainLogFileEvent(int watch,
         goto cleanup;
     }
 
- reread:
-    len = read(fd, buf, sizeof(buf));
-    if (len < 0) {
-        if (errno == EINTR)
-            goto reread;
-
-        virReportSystemError(errno, "%s",
-                             _("Unable to read from log pipe"));
-        goto error;
-    }
-
-    if (virRotatingFileWriterAppend(logfile->file, buf, len) != len)
+    len = virRotatingFileWriterAppendFromFD(logfile->file, fd,
+                                            VIR_LOG_HANDLER_CHUNK_SIZE);
+    if (len < 0 && errno != EAGAIN)
         goto error;
 
     if (events & VIR_EVENT_HANDLE_HANGUP)
@@ -437,7 +430,6 @@ virLogHandlerDomainOpenLogFile(virLogHandlerPtr handler,
 static void
 virLogHandlerDomainLogFileDrain(virLogHandlerLogFilePtr file)
 {
-    char buf[1024];
     ssize_t len;
     struct pollfd pfd;
     int ret;
@@ -458,15 +450,10 @@ virLogHandlerDomainLogFileDrain(virLogHandlerLogFilePtr file)
         if (ret == 0)
             return;
 
-        len = read(file->pipefd, buf, sizeof(buf));
+        len = virRotatingFileWriterAppendFromFD(file->file, file->pipefd,
+                                                VIR_LOG_HANDLER_CHUNK_SIZE);
         file->drained = true;
-        if (len < 0) {
-            if (errno == EINTR)
-                continue;
-            return;
-        }
-
-        if (virRotatingFileWriterAppend(file->file, buf, len) != len)
+        if (len <= 0)
             return;
     }
 }
@@ -66,6 +66,7 @@
 #include "network_event.h"
 #include "virhook.h"
 #include "virjson.h"
+#include "virlease.h"
 #include "virnetworkportdef.h"
 #include "virutil.h"
 
@@ -426,6 +427,7 @@ networkRemoveInactive(virNetworkDriverStatePtr driver,
 {
     char *leasefile = NULL;
     char *customleasefile = NULL;
+    char *customleaseindex = NULL;
     char *radvdconfigfile = NULL;
     char *configfile = NULL;
     char *radvdpidbase = NULL;
@@ -448,6 +450,8 @@ networkRemoveInactive(virNetworkDriverStatePtr driver,
     if (!(customleasefile = networkDnsmasqLeaseFileNameCustom(driver, def->bridge)))
         goto cleanup;
 
+    customleaseindex = virLeaseIndexFileName(customleasefile);
+
     if (!(radvdconfigfile = networkRadvdConfigFileName(driver, def->name)))
         goto cleanup;
 
@@ -467,6 +471,7 @@ networkRemoveInactive(virNetworkDriverStatePtr driver,
     dnsmasqDelete(dctx);
     unlink(leasefile);
     unlink(customleasefile);
+    unlink(customleaseindex);
     unlink(configfile);
 
     /* MAC map manager */
@@ -488,6 +493,7 @@ networkRemoveInactive(virNetworkDriverStatePtr driver,
     VIR_FREE(leasefile);
     VIR_FREE(configfile);
     VIR_FREE(customleasefile);
+    VIR_FREE(customleaseindex);
     VIR_FREE(radvdconfigfile);
     VIR_FREE(radvdpidbase);
     VIR_FREE(statusfile);
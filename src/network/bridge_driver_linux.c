@@ -24,6 +24,7 @@
 #include "viralloc.h"
 #include "virfile.h"
 #include "viriptables.h"
+#include "virnftables.h"
 #include "virstring.h"
 #include "virlog.h"
 #include "virfirewall.h"
@@ -39,6 +40,9 @@ static virOnceControl createdOnce;
 static bool createdChains;
 static virErrorPtr errInitV4;
 static virErrorPtr errInitV6;
+/* set while reloading the rules on startup, when the rules might
+ * have been created with another firewall backend */
+static bool removeOtherBackend;
 
 /* Only call via virOnce */
 static void networkSetupPrivateChains(void)
@@ -85,6 +89,25 @@ static void networkSetupPrivateChains(void)
 }
 
 
+/* Drop the nftables rules of all networks at once */
+static void
+networkRemoveNftablesPrivateChains(void)
+{
+    g_autoptr(virFirewall) fw = NULL;
+
+    if (!virFileIsExecutable(NFT_PATH))
+        return;
+
+    fw = virFirewallNew();
+
+    virFirewallStartTransaction(fw, 0);
+    nftablesRemovePrivateChains(fw, VIR_FIREWALL_LAYER_IPV4);
+    nftablesRemovePrivateChains(fw, VIR_FIREWALL_LAYER_IPV6);
+
+    ignore_value(virFirewallApply(fw));
+}
+
+
 static int
 networkHasRunningNetworksHelper(virNetworkObjPtr obj,
                                 void *opaque)
@@ -129,7 +152,22 @@ void networkPreReloadFirewallRules(virNetworkDriverStatePtr driver, bool startup
      * Any errors here are saved to be reported at time
      * of starting the network though as that makes them
      * more likely to be seen by a human
+     *
+     * The nftables rules of each network carry their own
+     * copy of the global ones, so nothing is needed then.
+     *
+     * The backend may have been changed while networks were
+     * running, so on startup the rules of the other backend
+     * are removed as well.
      */
+    removeOtherBackend = startup;
+
+    if (virFirewallGetBackend() == VIR_FIREWALL_BACKEND_NFTABLES)
+        return;
+
+    if (startup)
+        networkRemoveNftablesPrivateChains();
+
     if (!networkHasRunningNetworks(driver)) {
         VIR_DEBUG("Delayed global rule setup as no networks are running");
         return;
@@ -160,6 +198,7 @@ void networkPreReloadFirewallRules(virNetworkDriverStatePtr driver, bool startup
 void networkPostReloadFirewallRules(bool startup G_GNUC_UNUSED)
 {
     iptablesSetDeletePrivate(true);
+    removeOtherBackend = false;
 }
 
 
@@ -693,7 +732,8 @@ networkRemoveGeneralFirewallRules(virFirewallPtr fw,
 
 static void
 networkAddChecksumFirewallRules(virFirewallPtr fw,
-                                virNetworkDefPtr def)
+                                virNetworkDefPtr def,
+                                bool builtin)
 {
     size_t i;
     virNetworkIPDefPtr ipv4def;
@@ -711,15 +751,21 @@ networkAddChecksumFirewallRules(virFirewallPtr fw,
      * add a rule that will fixup the checksum of DHCP response
      * packets back to the guests (but report failure without
      * aborting, since not all iptables implementations support it).
+     * Without our private chains, the rule goes to the builtin one.
      */
-    if (ipv4def)
-        iptablesAddOutputFixUdpChecksum(fw, def->bridge, 68);
+    if (ipv4def) {
+        if (builtin)
+            iptablesAddOutputFixUdpChecksumBuiltin(fw, def->bridge, 68);
+        else
+            iptablesAddOutputFixUdpChecksum(fw, def->bridge, 68);
+    }
 }
 
 
 static void
 networkRemoveChecksumFirewallRules(virFirewallPtr fw,
-                                   virNetworkDefPtr def)
+                                   virNetworkDefPtr def,
+                                   bool builtin)
 {
     size_t i;
     virNetworkIPDefPtr ipv4def;
@@ -733,8 +779,12 @@ networkRemoveChecksumFirewallRules(virFirewallPtr fw,
             break;
     }
 
-    if (ipv4def)
-        iptablesRemoveOutputFixUdpChecksum(fw, def->bridge, 68);
+    if (ipv4def) {
+        if (builtin)
+            iptablesRemoveOutputFixUdpChecksumBuiltin(fw, def->bridge, 68);
+        else
+            iptablesRemoveOutputFixUdpChecksum(fw, def->bridge, 68);
+    }
 }
 
 
@@ -776,15 +826,202 @@ networkRemoveIPSpecificFirewallRules(virFirewallPtr fw,
 }
 
 
+static bool
+networkHasIPv6FirewallRules(virNetworkDefPtr def)
+{
+    return virNetworkDefGetIPByIndex(def, AF_INET6, 0) || def->ipv6nogw;
+}
+
+
+static int
+networkAddNftablesIPRules(virFirewallPtr fw,
+                          virNetworkDefPtr def,
+                          virNetworkIPDefPtr ipdef)
+{
+    int prefix = virNetworkIPDefPrefix(ipdef);
+    const char *forwardIf = virNetworkDefForwardIf(def, 0);
+
+    if (def->forward.type != VIR_NETWORK_FORWARD_NAT &&
+        def->forward.type != VIR_NETWORK_FORWARD_ROUTE)
+        return 0;
+
+    if (prefix < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Invalid prefix or netmask for '%s'"),
+                       def->bridge);
+        return -1;
+    }
+
+    if (nftablesAddForwardAllowOut(fw, &ipdef->address, prefix,
+                                   def->bridge, forwardIf) < 0)
+        return -1;
+
+    /* Like with iptables, IPv6 is routed rather than NATed */
+    if (def->forward.type == VIR_NETWORK_FORWARD_ROUTE ||
+        !VIR_SOCKET_ADDR_IS_FAMILY(&ipdef->address, AF_INET))
+        return nftablesAddForwardAllowIn(fw, &ipdef->address, prefix,
+                                         def->bridge, forwardIf);
+
+    if (nftablesAddForwardAllowRelatedIn(fw, &ipdef->address, prefix,
+                                         def->bridge, forwardIf) < 0)
+        return -1;
+
+    /* See networkAddMasqueradingFirewallRules for the reasons
+     * behind these rules, which are appended in their final order */
+    if (nftablesAddDontMasquerade(fw, &ipdef->address, prefix, def->bridge,
+                                  forwardIf, networkLocalMulticast) < 0 ||
+        nftablesAddDontMasquerade(fw, &ipdef->address, prefix, def->bridge,
+                                  forwardIf, networkLocalBroadcast) < 0 ||
+        nftablesAddForwardMasquerade(fw, &ipdef->address, prefix, def->bridge,
+                                     forwardIf, &def->forward.addr,
+                                     &def->forward.port, "tcp") < 0 ||
+        nftablesAddForwardMasquerade(fw, &ipdef->address, prefix, def->bridge,
+                                     forwardIf, &def->forward.addr,
+                                     &def->forward.port, "udp") < 0 ||
+        nftablesAddForwardMasquerade(fw, &ipdef->address, prefix, def->bridge,
+                                     forwardIf, &def->forward.addr,
+                                     &def->forward.port, NULL) < 0)
+        return -1;
+
+    return nftablesAddNatSource(fw, &ipdef->address, prefix, def->bridge);
+}
+
+
+static int
+networkRemoveNftablesRules(virFirewallPtr fw,
+                           virNetworkDefPtr def)
+{
+    size_t i;
+    virNetworkIPDefPtr ipdef;
+
+    if (def->forward.type == VIR_NETWORK_FORWARD_NAT) {
+        for (i = 0;
+             (ipdef = virNetworkDefGetIPByIndex(def, AF_INET, i));
+             i++) {
+            int prefix = virNetworkIPDefPrefix(ipdef);
+
+            if (prefix >= 0 &&
+                nftablesRemoveNatSource(fw, &ipdef->address, prefix,
+                                        def->bridge) < 0)
+                return -1;
+        }
+    }
+
+    nftablesRemoveNetworkChains(fw, VIR_FIREWALL_LAYER_IPV4, def->bridge);
+    if (networkHasIPv6FirewallRules(def))
+        nftablesRemoveNetworkChains(fw, VIR_FIREWALL_LAYER_IPV6, def->bridge);
+
+    return 0;
+}
+
+
+/*
+ * With the nftables backend, each network gets private chains
+ * which are only looked up for its bridge. Their content follows
+ * the iptables rules above. All the statements are idempotent and
+ * applied as a single nft transaction. nftables cannot fix up the
+ * checksum of DHCP replies, which old dhclient versions in guests
+ * need, so that rule is still added through iptables.
+ */
+static int
+networkAddNftablesFirewallRules(virNetworkDefPtr def)
+{
+    size_t i;
+    virNetworkIPDefPtr ipdef;
+    virNetworkIPDefPtr ipv4def;
+    bool ipv6 = networkHasIPv6FirewallRules(def);
+    g_autoptr(virFirewall) fw = virFirewallNew();
+
+    virFirewallStartTransaction(fw, 0);
+
+    nftablesSetupPrivateChains(fw, VIR_FIREWALL_LAYER_IPV4);
+    nftablesAddNetworkChains(fw, VIR_FIREWALL_LAYER_IPV4, def->bridge);
+    if (ipv6) {
+        nftablesSetupPrivateChains(fw, VIR_FIREWALL_LAYER_IPV6);
+        nftablesAddNetworkChains(fw, VIR_FIREWALL_LAYER_IPV6, def->bridge);
+    }
+
+    for (i = 0;
+         (ipv4def = virNetworkDefGetIPByIndex(def, AF_INET, i));
+         i++) {
+        if (ipv4def->nranges || ipv4def->nhosts || ipv4def->tftproot)
+            break;
+    }
+
+    /* allow DHCP and DNS requests through to dnsmasq & back out */
+    nftablesAddTcpInput(fw, VIR_FIREWALL_LAYER_IPV4, def->bridge, 67);
+    nftablesAddUdpInput(fw, VIR_FIREWALL_LAYER_IPV4, def->bridge, 67);
+    nftablesAddTcpOutput(fw, VIR_FIREWALL_LAYER_IPV4, def->bridge, 68);
+    nftablesAddUdpOutput(fw, VIR_FIREWALL_LAYER_IPV4, def->bridge, 68);
+    nftablesAddTcpInput(fw, VIR_FIREWALL_LAYER_IPV4, def->bridge, 53);
+    nftablesAddUdpInput(fw, VIR_FIREWALL_LAYER_IPV4, def->bridge, 53);
+    nftablesAddTcpOutput(fw, VIR_FIREWALL_LAYER_IPV4, def->bridge, 53);
+    nftablesAddUdpOutput(fw, VIR_FIREWALL_LAYER_IPV4, def->bridge, 53);
+
+    /* allow TFTP requests through to dnsmasq if necessary & back out */
+    if (ipv4def && ipv4def->tftproot) {
+        nftablesAddUdpInput(fw, VIR_FIREWALL_LAYER_IPV4, def->bridge, 69);
+        nftablesAddUdpOutput(fw, VIR_FIREWALL_LAYER_IPV4, def->bridge, 69);
+    }
+
+    /* Allow traffic between guests on the same bridge */
+    nftablesAddForwardAllowCross(fw, VIR_FIREWALL_LAYER_IPV4, def->bridge);
+
+    if (ipv6) {
+        nftablesAddForwardAllowCross(fw, VIR_FIREWALL_LAYER_IPV6, def->bridge);
+
+        if (virNetworkDefGetIPByIndex(def, AF_INET6, 0)) {
+            /* allow DNS and DHCPv6 over IPv6 & back out */
+            nftablesAddTcpInput(fw, VIR_FIREWALL_LAYER_IPV6, def->bridge, 53);
+            nftablesAddUdpInput(fw, VIR_FIREWALL_LAYER_IPV6, def->bridge, 53);
+            nftablesAddTcpOutput(fw, VIR_FIREWALL_LAYER_IPV6, def->bridge, 53);
+            nftablesAddUdpOutput(fw, VIR_FIREWALL_LAYER_IPV6, def->bridge, 53);
+            nftablesAddUdpInput(fw, VIR_FIREWALL_LAYER_IPV6, def->bridge, 547);
+            nftablesAddUdpOutput(fw, VIR_FIREWALL_LAYER_IPV6, def->bridge, 546);
+        }
+    }
+
+    for (i = 0;
+         (ipdef = virNetworkDefGetIPByIndex(def, AF_UNSPEC, i));
+         i++) {
+        if (networkAddNftablesIPRules(fw, def, ipdef) < 0)
+            return -1;
+    }
+
+    /* Catch all rules to block forwarding to/from bridges, which
+     * must come after everything allowed */
+    nftablesAddForwardRejectIn(fw, VIR_FIREWALL_LAYER_IPV4, def->bridge);
+    nftablesAddForwardRejectOut(fw, VIR_FIREWALL_LAYER_IPV4, def->bridge);
+    nftablesLinkNetworkChains(fw, VIR_FIREWALL_LAYER_IPV4, def->bridge);
+    if (ipv6) {
+        nftablesAddForwardRejectIn(fw, VIR_FIREWALL_LAYER_IPV6, def->bridge);
+        nftablesAddForwardRejectOut(fw, VIR_FIREWALL_LAYER_IPV6, def->bridge);
+        nftablesLinkNetworkChains(fw, VIR_FIREWALL_LAYER_IPV6, def->bridge);
+    }
+
+    virFirewallStartRollback(fw, 0);
+
+    if (networkRemoveNftablesRules(fw, def) < 0)
+        return -1;
+
+    virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
+    networkAddChecksumFirewallRules(fw, def, true);
+
+    return virFirewallApply(fw);
+}
+
+
 /* Add all rules for all ip addresses (and general rules) on a network */
 int networkAddFirewallRules(virNetworkDefPtr def)
 {
     size_t i;
     virNetworkIPDefPtr ipdef;
     virFirewallPtr fw = NULL;
+    bool nftables = virFirewallGetBackend() == VIR_FIREWALL_BACKEND_NFTABLES;
     int ret = -1;
 
-    if (virOnce(&createdOnce, networkSetupPrivateChains) < 0)
+    if (!nftables &&
+        virOnce(&createdOnce, networkSetupPrivateChains) < 0)
         return -1;
 
     if (errInitV4 &&
@@ -868,6 +1105,11 @@ int networkAddFirewallRules(virNetworkDefPtr def)
         }
     }
 
+    if (nftables) {
+        ret = networkAddNftablesFirewallRules(def);
+        goto cleanup;
+    }
+
     fw = virFirewallNew();
 
     virFirewallStartTransaction(fw, 0);
@@ -892,7 +1134,7 @@ int networkAddFirewallRules(virNetworkDefPtr def)
     networkRemoveGeneralFirewallRules(fw, def);
 
     virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
-    networkAddChecksumFirewallRules(fw, def);
+    networkAddChecksumFirewallRules(fw, def, false);
 
     if (virFirewallApply(fw) < 0)
         goto cleanup;
@@ -903,17 +1145,32 @@ int networkAddFirewallRules(virNetworkDefPtr def)
     return ret;
 }
 
-/* Remove all rules for all ip addresses (and general rules) on a network */
-void networkRemoveFirewallRules(virNetworkDefPtr def)
+static void
+networkRemoveNftablesFirewallRules(virNetworkDefPtr def)
+{
+    g_autoptr(virFirewall) fw = virFirewallNew();
+
+    virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
+    networkRemoveChecksumFirewallRules(fw, def, true);
+
+    /* These can be batched as they are written not to fail */
+    virFirewallStartTransaction(fw, 0);
+    if (networkRemoveNftablesRules(fw, def) < 0)
+        return;
+
+    virFirewallApply(fw);
+}
+
+
+static void
+networkRemoveIptablesFirewallRules(virNetworkDefPtr def)
 {
     size_t i;
     virNetworkIPDefPtr ipdef;
-    virFirewallPtr fw = NULL;
-
-    fw = virFirewallNew();
+    g_autoptr(virFirewall) fw = virFirewallNew();
 
     virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
-    networkRemoveChecksumFirewallRules(fw, def);
+    networkRemoveChecksumFirewallRules(fw, def, false);
 
     virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
 
@@ -921,12 +1178,35 @@ void networkRemoveFirewallRules(virNetworkDefPtr def)
          (ipdef = virNetworkDefGetIPByIndex(def, AF_UNSPEC, i));
          i++) {
         if (networkRemoveIPSpecificFirewallRules(fw, def, ipdef) < 0)
-            goto cleanup;
+            return;
     }
     networkRemoveGeneralFirewallRules(fw, def);
 
     virFirewallApply(fw);
+}
 
- cleanup:
-    virFirewallFree(fw);
+
+/* Remove all rules for all ip addresses (and general rules) on a network */
+void networkRemoveFirewallRules(virNetworkDefPtr def)
+{
+    if (virFirewallGetBackend() == VIR_FIREWALL_BACKEND_NFTABLES) {
+        networkRemoveNftablesFirewallRules(def);
+
+        /* rules left over from running with iptables */
+        if (removeOtherBackend)
+            networkRemoveIptablesFirewallRules(def);
+    } else {
+        networkRemoveIptablesFirewallRules(def);
+
+        /* the nftables rules themselves went with the whole table in
+         * networkPreReloadFirewallRules, only the iptables checksum
+         * rule of the nftables backend is left */
+        if (removeOtherBackend) {
+            g_autoptr(virFirewall) fw = virFirewallNew();
+
+            virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
+            networkRemoveChecksumFirewallRules(fw, def, true);
+            virFirewallApply(fw);
+        }
+    }
 }
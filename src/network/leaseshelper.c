@@ -212,6 +212,10 @@ main(int argc, char **argv)
         if (virLeasePrintLeases(leases_array_new, server_duid) < 0)
             goto cleanup;
 
+        /* Make sure the index exists after an upgrade even before the
+         * first lease changes. Failing here would keep dnsmasq from
+         * starting, and the NSS module copes with a missing index. */
+        ignore_value(virLeaseWriteIndex(leases_array_new, custom_lease_file));
         break;
 
     case VIR_LEASE_ACTION_OLD:
@@ -234,6 +238,9 @@ main(int argc, char **argv)
         /* Write to file */
         if (virFileRewriteStr(custom_lease_file, 0644, leases_str) < 0)
             goto cleanup;
+
+        if (virLeaseWriteIndex(leases_array_new, custom_lease_file) < 0)
+            goto cleanup;
         break;
 
     case VIR_LEASE_ACTION_LAST:
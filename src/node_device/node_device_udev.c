@@ -41,6 +41,7 @@
 #include "virnetdev.h"
 #include "virmdev.h"
 #include "virutil.h"
+#include "virhostcpu.h"
 
 #include "configmake.h"
 
@@ -314,6 +315,8 @@ udevGenerateDeviceName(struct udev_device *device,
 }
 
 
+static virMutex udevPCIIdsLock = VIR_MUTEX_INITIALIZER;
+
 static int
 udevTranslatePCIIds(unsigned int vendor,
                     unsigned int product,
@@ -331,6 +334,10 @@ udevTranslatePCIIds(unsigned int vendor,
     m.device_class_mask = 0;
     m.match_data = 0;
 
+    /* libpciaccess loads its ID database lazily, and devices are
+     * probed by several threads during enumeration */
+    virMutexLock(&udevPCIIdsLock);
+
     /* pci_get_strings returns void */
     pci_get_strings(&m,
                     &device_name,
@@ -341,6 +348,8 @@ udevTranslatePCIIds(unsigned int vendor,
     *vendor_string = g_strdup(vendor_name);
     *product_string = g_strdup(device_name);
 
+    virMutexUnlock(&udevPCIIdsLock);
+
     return 0;
 }
 
@@ -1293,14 +1302,16 @@ udevSetParent(struct udev_device *device,
 }
 
 
+/* Builds the definition of @device from its udev properties and sysfs
+ * attributes. Everything but the parent device is filled in, because
+ * that one depends on what's already in the device list. Doesn't touch
+ * any driver state, so it is safe to run from several threads as long
+ * as each of them uses its own udev context. */
 static int
-udevAddOneDevice(struct udev_device *device)
+udevGetDeviceDef(struct udev_device *device,
+                 virNodeDeviceDefPtr *retdef)
 {
     virNodeDeviceDefPtr def = NULL;
-    virNodeDeviceObjPtr obj = NULL;
-    virNodeDeviceDefPtr objdef;
-    virObjectEventPtr event = NULL;
-    bool new_device = true;
     int ret = -1;
 
     if (VIR_ALLOC(def) != 0)
@@ -1323,6 +1334,32 @@ udevAddOneDevice(struct udev_device *device)
     if (udevGetDeviceDetails(device, def) != 0)
         goto cleanup;
 
+    *retdef = g_steal_pointer(&def);
+    ret = 0;
+
+ cleanup:
+    if (ret != 0) {
+        VIR_DEBUG("Discarding device %d %p %s", ret, def,
+                  def ? NULLSTR(def->sysfs_path) : "");
+        virNodeDeviceDefFree(def);
+    }
+
+    return ret;
+}
+
+
+/* Links @def, as returned by udevGetDeviceDef(), to its parent and
+ * adds it to the device list. Consumes @def in all cases. */
+static int
+udevAddOneDeviceDef(struct udev_device *device,
+                    virNodeDeviceDefPtr def)
+{
+    virNodeDeviceObjPtr obj = NULL;
+    virNodeDeviceDefPtr objdef;
+    virObjectEventPtr event = NULL;
+    bool new_device = true;
+    int ret = -1;
+
     if (udevSetParent(device, def) != 0)
         goto cleanup;
 
@@ -1362,28 +1399,14 @@ udevAddOneDevice(struct udev_device *device)
 
 
 static int
-udevProcessDeviceListEntry(struct udev *udev,
-                           struct udev_list_entry *list_entry)
+udevAddOneDevice(struct udev_device *device)
 {
-    struct udev_device *device;
-    const char *name = NULL;
-    int ret = -1;
-
-    name = udev_list_entry_get_name(list_entry);
-
-    device = udev_device_new_from_syspath(udev, name);
-
-    if (device != NULL) {
-        if (udevAddOneDevice(device) != 0) {
-            VIR_DEBUG("Failed to create node device for udev device '%s'",
-                      name);
-        }
-        ret = 0;
-    }
+    virNodeDeviceDefPtr def = NULL;
 
-    udev_device_unref(device);
+    if (udevGetDeviceDef(device, &def) < 0)
+        return -1;
 
-    return ret;
+    return udevAddOneDeviceDef(device, def);
 }
 
 
@@ -1411,11 +1434,82 @@ udevEnumerateAddMatches(struct udev_enumerate *udev_enumerate)
 }
 
 
+/* Enumerating the devices present at startup is done in two passes.
+ * Reading the device details is what takes time, as it means reading
+ * lots of sysfs attributes, but it doesn't depend on other devices, so
+ * it is split across several workers, each with its own udev context
+ * since libudev isn't thread safe. Resolving the parent of a device
+ * requires the parent to be known already, so the definitions are then
+ * added one by one in the order udev listed them, i.e. parents first. */
+#define UDEV_ENUMERATE_MAX_WORKERS 8
+#define UDEV_ENUMERATE_DEVICES_PER_WORKER 64
+
+typedef struct _udevEnumerateEntry udevEnumerateEntry;
+struct _udevEnumerateEntry {
+    const char *syspath;
+    struct udev_device *device;
+    virNodeDeviceDefPtr def;
+};
+
+typedef struct _udevEnumerateWorker udevEnumerateWorker;
+struct _udevEnumerateWorker {
+    virThread thread;
+    bool started;
+    struct udev *udev;
+
+    /* Entries first, first + stride, ... are processed by this worker */
+    udevEnumerateEntry *entries;
+    size_t nentries;
+    size_t first;
+    size_t stride;
+};
+
+
+static void
+udevEnumerateWorkerRun(void *opaque)
+{
+    udevEnumerateWorker *worker = opaque;
+    size_t i;
+
+    for (i = worker->first; i < worker->nentries; i += worker->stride) {
+        udevEnumerateEntry *entry = &worker->entries[i];
+
+        if (!(entry->device = udev_device_new_from_syspath(worker->udev,
+                                                            entry->syspath)))
+            continue;
+
+        if (udevGetDeviceDef(entry->device, &entry->def) < 0)
+            VIR_DEBUG("Failed to create node device for udev device '%s'",
+                      entry->syspath);
+    }
+}
+
+
+static size_t
+udevEnumerateWorkerCount(size_t nentries)
+{
+    int ncpus = virHostCPUGetCount();
+    size_t nworkers = nentries / UDEV_ENUMERATE_DEVICES_PER_WORKER;
+
+    if (ncpus > 0)
+        nworkers = MIN(nworkers, (size_t) ncpus);
+
+    return MAX(1, MIN(nworkers, UDEV_ENUMERATE_MAX_WORKERS));
+}
+
+
 static int
 udevEnumerateDevices(struct udev *udev)
 {
     struct udev_enumerate *udev_enumerate = NULL;
     struct udev_list_entry *list_entry = NULL;
+    g_autofree udevEnumerateEntry *entries = NULL;
+    g_autofree udevEnumerateWorker *workers = NULL;
+    size_t nentries = 0;
+    size_t nworkers;
+    size_t nstarted = 1;
+    unsigned long long start = g_get_monotonic_time();
+    size_t i;
     int ret = -1;
 
     udev_enumerate = udev_enumerate_new(udev);
@@ -1427,12 +1521,75 @@ udevEnumerateDevices(struct udev *udev)
 
     udev_list_entry_foreach(list_entry,
                             udev_enumerate_get_list_entry(udev_enumerate)) {
+        udevEnumerateEntry entry = {
+            .syspath = udev_list_entry_get_name(list_entry),
+        };
+
+        if (VIR_APPEND_ELEMENT(entries, nentries, entry) < 0)
+            goto cleanup;
+    }
+
+    nworkers = udevEnumerateWorkerCount(nentries);
+    workers = g_new0(udevEnumerateWorker, nworkers);
 
-        udevProcessDeviceListEntry(udev, list_entry);
+    for (i = 0; i < nworkers; i++) {
+        workers[i].entries = entries;
+        workers[i].nentries = nentries;
+        workers[i].first = i;
+        workers[i].stride = nworkers;
+    }
+
+    /* The calling thread takes the first share using the context it
+     * was given, every additional worker needs a context of its own */
+    workers[0].udev = udev_ref(udev);
+    for (i = 1; i < nworkers; i++) {
+        if ((workers[i].udev = udev_new()) &&
+            virThreadCreate(&workers[i].thread, true,
+                            udevEnumerateWorkerRun, &workers[i]) == 0) {
+            workers[i].started = true;
+            nstarted++;
+        } else {
+            VIR_WARN("Failed to start udev enumeration worker %zu, "
+                     "probing its devices serially", i);
+        }
+    }
+
+    udevEnumerateWorkerRun(&workers[0]);
+
+    for (i = 1; i < nworkers; i++) {
+        if (workers[i].started) {
+            virThreadJoin(&workers[i].thread);
+            continue;
+        }
+
+        if (!workers[i].udev)
+            workers[i].udev = udev_ref(udev);
+        udevEnumerateWorkerRun(&workers[i]);
+    }
+
+    VIR_DEBUG("Probed %zu devices using %zu threads in %llu ms",
+              nentries, nstarted, (g_get_monotonic_time() - start) / 1000);
+
+    for (i = 0; i < nentries; i++) {
+        if (entries[i].def &&
+            udevAddOneDeviceDef(entries[i].device,
+                                g_steal_pointer(&entries[i].def)) != 0) {
+            VIR_DEBUG("Failed to create node device for udev device '%s'",
+                      entries[i].syspath);
+        }
     }
 
     ret = 0;
  cleanup:
+    for (i = 0; i < nentries; i++) {
+        if (entries[i].device)
+            udev_device_unref(entries[i].device);
+        virNodeDeviceDefFree(entries[i].def);
+    }
+    for (i = 0; workers && i < nworkers; i++) {
+        if (workers[i].udev)
+            udev_unref(workers[i].udev);
+    }
     udev_enumerate_unref(udev_enumerate);
     return ret;
 }
@@ -60,6 +60,8 @@
 #include "configmake.h"
 #include "virtime.h"
 #include "virstring.h"
+#include "virutil.h"
+#include "virbuffer.h"
 
 #define VIR_FROM_THIS VIR_FROM_NWFILTER
 
@@ -71,18 +73,44 @@ VIR_LOG_INIT("nwfilter.nwfilter_dhcpsnoop");
 # define LEASEFILE LEASEFILE_DIR "nwfilter.leases"
 # define TMPLEASEFILE LEASEFILE_DIR "nwfilter.ltmp"
 
+/* don't compact the lease file before it holds this many records */
+# define LEASEFILE_COMPACT_MIN  100
+
+/*
+ * Number of decode worker pools; each has a single worker so that
+ * the packets of one interface are always decoded in order
+ */
+# define DHCP_DECODE_WORKERS    4
+
+typedef struct _virNWFilterSnoopCapture virNWFilterSnoopCapture;
+typedef virNWFilterSnoopCapture *virNWFilterSnoopCapturePtr;
+
 struct virNWFilterSnoopState {
     /* lease file */
     int                  leaseFD;
     int                  nLeases; /* number of active leases */
     int                  wLeases; /* number of written leases */
-    int                  nThreads; /* number of running threads */
+    int                  nCaptures; /* number of running captures */
     /* thread management */
     virHashTablePtr      snoopReqs;
     virHashTablePtr      ifnameToKey;
     virMutex             snoopLock;  /* protects SnoopReqs and IfNameToKey */
     virHashTablePtr      active;
     virMutex             activeLock; /* protects Active */
+    /* capture engine */
+    virThread            engineThread;
+    bool                 engineRunning;
+    int                  engineQuit;
+    int                  engineWakeup[2];
+    virMutex             engineLock; /* protects Captures */
+    virNWFilterSnoopCapturePtr *captures;
+    size_t               ncaptures;
+    virThreadPoolPtr     workers[DHCP_DECODE_WORKERS];
+    /* lease expiry */
+    virThread            leaseTimerThread;
+    virMutex             leaseTimerLock; /* protects LeaseTimerQuit */
+    virCond              leaseTimerCond;
+    bool                 leaseTimerQuit;
 };
 
 # define virNWFilterSnoopLock() \
@@ -110,12 +138,6 @@ typedef virNWFilterSnoopReq *virNWFilterSnoopReqPtr;
 typedef struct _virNWFilterSnoopIPLease virNWFilterSnoopIPLease;
 typedef virNWFilterSnoopIPLease *virNWFilterSnoopIPLeasePtr;
 
-typedef enum {
-    THREAD_STATUS_NONE,
-    THREAD_STATUS_OK,
-    THREAD_STATUS_FAIL,
-} virNWFilterSnoopThreadStatus;
-
 struct _virNWFilterSnoopReq {
     /*
      * reference counter: while the req is on the
@@ -133,13 +155,10 @@ struct _virNWFilterSnoopReq {
     virNWFilterSnoopIPLeasePtr           start;
     virNWFilterSnoopIPLeasePtr           end;
     char                                *threadkey;
-    virErrorPtr                          threadError;
-
-    virNWFilterSnoopThreadStatus         threadStatus;
-    virCond                              threadStatusCond;
 
     int                                  jobCompletionStatus;
-    /* the number of submitted jobs in the worker's queue */
+    /* the number of submitted jobs in the worker's queue, per direction */
+    int                                  qCtr[2];
     /*
      * protect those members that can change while the
      * req is on the public SnoopReq hash and
@@ -149,7 +168,6 @@ struct _virNWFilterSnoopReq {
      * - start
      * - end
      * - a lease while it is on the list
-     * - threadStatus
      * (for refctr, see above)
      */
     virMutex                             lock;
@@ -159,8 +177,10 @@ struct _virNWFilterSnoopReq {
  * Note about lock-order:
  * 1st: virNWFilterSnoopLock()
  * 2nd: virNWFilterSnoopReqLock(req)
+ * 3rd: virNWFilterSnoopState.engineLock
  *
- * Rationale: Former protects the SnoopReqs hash, latter its contents
+ * Rationale: Former protects the SnoopReqs hash, latter its contents;
+ * the engine lock only protects the list of running captures
  */
 
 struct _virNWFilterSnoopIPLease {
@@ -234,6 +254,7 @@ struct _virNWFilterDHCPDecodeJob {
     unsigned char packet[PCAP_PBUFSIZE];
     int caplen;
     bool fromVM;
+    virNWFilterSnoopReqPtr req; /* holds a reference */
     int *qCtr;
 };
 
@@ -250,25 +271,65 @@ struct _virNWFilterSnoopRateLimitConf {
     time_t prev;
     unsigned int pkt_ctr;
     time_t burst;
-    const unsigned int rate;
-    const unsigned int burstRate;
-    const unsigned int burstInterval;
+    unsigned int rate;
+    unsigned int burstRate;
+    unsigned int burstInterval;
 };
-# define SNOOP_POLL_MAX_TIMEOUT_MS  (10 * 1000) /* milliseconds */
+# define SNOOP_POLL_ERROR_DELAY_MS      100 /* ms */
+# define SNOOP_LEASE_TIMER_INTERVAL_MS  1000 /* ms */
 
 typedef struct _virNWFilterSnoopPcapConf virNWFilterSnoopPcapConf;
 typedef virNWFilterSnoopPcapConf *virNWFilterSnoopPcapConfPtr;
 
 struct _virNWFilterSnoopPcapConf {
     pcap_t *handle;
-    const pcap_direction_t dir;
+    pcap_direction_t dir;
     const char *filter;
     virNWFilterSnoopRateLimitConf rateLimit; /* indep. rate limiters */
-    int qCtr; /* number of jobs in the worker's queue */
-    const unsigned int maxQSize;
+    unsigned int maxQSize;
     unsigned long long penaltyTimeoutAbs;
 };
 
+static const virNWFilterSnoopPcapConf virNWFilterSnoopPcapTemplate[] = {
+    {
+        .dir = PCAP_D_IN, /* from VM */
+        .filter = "dst port 67 and src port 68",
+        .rateLimit = {
+            .rate = DHCP_PKT_RATE,
+            .burstRate = DHCP_PKT_BURST,
+            .burstInterval = DHCP_BURST_INTERVAL_S,
+        },
+        .maxQSize = MAX_QUEUED_JOBS,
+    }, {
+        .dir = PCAP_D_OUT, /* to VM */
+        .filter = "src port 67 and dst port 68",
+        .rateLimit = {
+            .rate = DHCP_PKT_RATE,
+            .burstRate = DHCP_PKT_BURST,
+            .burstInterval = DHCP_BURST_INTERVAL_S,
+        },
+        .maxQSize = MAX_QUEUED_JOBS,
+    },
+};
+
+/*
+ * A capture is the snooping state of a single request's interface.
+ * All captures are serviced by the one capture engine thread, which
+ * polls the pcap handles of all of them and hands the DHCP packets
+ * to the decode worker the capture is bound to.
+ */
+struct _virNWFilterSnoopCapture {
+    virNWFilterSnoopReqPtr req; /* holds a reference */
+    char *threadkey;
+    int ifindex;
+    int errcount;
+    bool penalized; /* one of the handles is muted for flooding */
+    virThreadPoolPtr worker; /* shared, not owned */
+    time_t last_displayed;
+    time_t last_displayed_queue;
+    virNWFilterSnoopPcapConf pcapConf[G_N_ELEMENTS(virNWFilterSnoopPcapTemplate)];
+};
+
 /* local function prototypes */
 static int virNWFilterSnoopReqLeaseDel(virNWFilterSnoopReqPtr req,
                                        virSocketAddrPtr ipaddr,
@@ -280,10 +341,14 @@ static void virNWFilterSnoopReqUnlock(virNWFilterSnoopReqPtr req);
 
 static void virNWFilterSnoopLeaseFileLoad(void);
 static void virNWFilterSnoopLeaseFileSave(virNWFilterSnoopIPLeasePtr ipl);
+static void virNWFilterSnoopLeaseFileRefresh(void);
+
+static void virNWFilterSnoopEngineWakeup(void);
 
 /* local variables */
 static struct virNWFilterSnoopState virNWFilterSnoopState = {
     .leaseFD = -1,
+    .engineWakeup = { -1, -1 },
 };
 
 static const unsigned char dhcp_magic[4] = { 99, 130, 83, 99 };
@@ -318,6 +383,9 @@ virNWFilterSnoopCancel(char **threadKey)
     VIR_FREE(*threadKey);
 
     virNWFilterSnoopActiveUnlock();
+
+    /* have the capture engine drop the capture right away */
+    virNWFilterSnoopEngineWakeup();
 }
 
 static bool
@@ -565,22 +633,14 @@ virNWFilterSnoopReqNew(const char *ifkey)
     if (VIR_ALLOC(req) < 0)
         return NULL;
 
-    req->threadStatus = THREAD_STATUS_NONE;
-
     if (virStrcpyStatic(req->ifkey, ifkey) < 0||
         virMutexInitRecursive(&req->lock) < 0)
         goto err_free_req;
 
-    if (virCondInit(&req->threadStatusCond) < 0)
-        goto err_destroy_mutex;
-
     virNWFilterSnoopReqGet(req);
 
     return req;
 
- err_destroy_mutex:
-    virMutexDestroy(&req->lock);
-
  err_free_req:
     VIR_FREE(req);
 
@@ -611,8 +671,6 @@ virNWFilterSnoopReqFree(virNWFilterSnoopReqPtr req)
     virNWFilterBindingDefFree(req->binding);
 
     virMutexDestroy(&req->lock);
-    virCondDestroy(&req->threadStatusCond);
-    virFreeError(req->threadError);
 
     VIR_FREE(req);
 }
@@ -1127,10 +1185,11 @@ virNWFilterSnoopDHCPOpen(const char *ifname, virMacAddr *mac,
  * Worker function to decode the DHCP message and with that
  * also do the time-consuming work of instantiating the filters
  */
-static void virNWFilterDHCPDecodeWorker(void *jobdata, void *opaque)
+static void virNWFilterDHCPDecodeWorker(void *jobdata,
+                                        void *opaque G_GNUC_UNUSED)
 {
-    virNWFilterSnoopReqPtr req = opaque;
     virNWFilterDHCPDecodeJobPtr job = jobdata;
+    virNWFilterSnoopReqPtr req = job->req;
     virNWFilterSnoopEthHdrPtr packet = (virNWFilterSnoopEthHdrPtr)job->packet;
 
     if (virNWFilterSnoopDHCPDecode(req, packet,
@@ -1140,8 +1199,12 @@ static void virNWFilterDHCPDecodeWorker(void *jobdata, void *opaque)
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("Instantiation of rules failed on "
                          "interface '%s'"), req->binding->portdevname);
+
+        /* have the capture engine end the capture */
+        virNWFilterSnoopEngineWakeup();
     }
     ignore_value(!!g_atomic_int_dec_and_test(job->qCtr));
+    virNWFilterSnoopReqPut(req);
     VIR_FREE(job);
 }
 
@@ -1150,6 +1213,7 @@ static void virNWFilterDHCPDecodeWorker(void *jobdata, void *opaque)
  */
 static int
 virNWFilterSnoopDHCPDecodeJobSubmit(virThreadPoolPtr pool,
+                                    virNWFilterSnoopReqPtr req,
                                     virNWFilterSnoopEthHdrPtr pep,
                                     int len, pcap_direction_t dir,
                                     int *qCtr)
@@ -1166,14 +1230,19 @@ virNWFilterSnoopDHCPDecodeJobSubmit(virThreadPoolPtr pool,
     memcpy(job->packet, pep, len);
     job->caplen = len;
     job->fromVM = (dir == PCAP_D_IN);
+    job->req = req;
     job->qCtr = qCtr;
 
+    virNWFilterSnoopReqGet(req);
+    g_atomic_int_add(qCtr, 1);
+
     ret = virThreadPoolSendJob(pool, 0, job);
 
-    if (ret == 0)
-        g_atomic_int_add(qCtr, 1);
-    else
+    if (ret < 0) {
+        ignore_value(!!g_atomic_int_dec_and_test(qCtr));
+        virNWFilterSnoopReqPut(req);
         VIR_FREE(job);
+    }
 
     return ret;
 }
@@ -1296,255 +1365,670 @@ virNWFilterSnoopAdjustPoll(virNWFilterSnoopPcapConfPtr pc,
 }
 
 /*
- * The DHCP snooping thread. It spends most of its time in the pcap
- * library and if it gets suitable packets, it submits them to the worker
- * thread for processing.
+ * Wake up the capture engine so it picks up new captures and
+ * notices cancelled ones without waiting for its poll timeout
  */
 static void
-virNWFilterDHCPSnoopThread(void *req0)
+virNWFilterSnoopEngineWakeup(void)
+{
+    char c = 0;
+
+    if (virNWFilterSnoopState.engineWakeup[1] < 0)
+        return;
+
+    /* a full pipe means the engine has a wakeup pending anyway */
+    ignore_value(safewrite(virNWFilterSnoopState.engineWakeup[1], &c, 1));
+}
+
+static void
+virNWFilterSnoopEngineDrain(void)
+{
+    char buf[64];
+
+    while (saferead(virNWFilterSnoopState.engineWakeup[0],
+                    buf, sizeof(buf)) > 0)
+        ;
+}
+
+static void
+virNWFilterSnoopCaptureFree(virNWFilterSnoopCapturePtr cap)
 {
-    virNWFilterSnoopReqPtr req = req0;
-    struct pcap_pkthdr *hdr;
-    virNWFilterSnoopEthHdrPtr packet;
-    int ifindex = 0;
-    int errcount = 0;
-    int tmp = -1, rv, n, pollTo;
     size_t i;
-    char *threadkey = NULL;
-    virThreadPoolPtr worker = NULL;
-    time_t last_displayed = 0, last_displayed_queue = 0;
-    virNWFilterSnoopPcapConf pcapConf[] = {
-        {
-            .dir = PCAP_D_IN, /* from VM */
-            .filter = "dst port 67 and src port 68",
-            .rateLimit = {
-                .prev = time(0),
-                .rate = DHCP_PKT_RATE,
-                .burstRate = DHCP_PKT_BURST,
-                .burstInterval = DHCP_BURST_INTERVAL_S,
-            },
-            .maxQSize = MAX_QUEUED_JOBS,
-        }, {
-            .dir = PCAP_D_OUT, /* to VM */
-            .filter = "src port 67 and dst port 68",
-            .rateLimit = {
-                .prev = time(0),
-                .rate = DHCP_PKT_RATE,
-                .burstRate = DHCP_PKT_BURST,
-                .burstInterval = DHCP_BURST_INTERVAL_S,
-            },
-            .maxQSize = MAX_QUEUED_JOBS,
-        },
-    };
-    struct pollfd fds[] = {
-        {
-            /* get a POLLERR if interface goes down or disappears */
-            .events = POLLIN | POLLERR,
-        }, {
-            .events = POLLIN | POLLERR,
-        },
-    };
-    bool error = false;
 
-    /* whoever started us increased the reference counter for the req for us */
+    if (!cap)
+        return;
 
-    /* protect req->binding->portdevname & req->threadkey */
-    virNWFilterSnoopReqLock(req);
+    for (i = 0; i < G_N_ELEMENTS(cap->pcapConf); i++) {
+        if (cap->pcapConf[i].handle)
+            pcap_close(cap->pcapConf[i].handle);
+    }
 
-    if (req->binding->portdevname && req->threadkey) {
-        for (i = 0; i < G_N_ELEMENTS(pcapConf); i++) {
-            pcapConf[i].handle =
-                virNWFilterSnoopDHCPOpen(req->binding->portdevname,
-                                         &req->binding->mac,
-                                         pcapConf[i].filter,
-                                         pcapConf[i].dir);
-            if (!pcapConf[i].handle) {
-                error = true;
-                break;
-            }
-            fds[i].fd = pcap_fileno(pcapConf[i].handle);
-        }
-        tmp = virNetDevGetIndex(req->binding->portdevname, &ifindex);
-        threadkey = g_strdup(req->threadkey);
-        worker = virThreadPoolNew(1, 1, 0,
-                                  virNWFilterDHCPDecodeWorker,
-                                  req);
-    }
-
-    /* let creator know how well we initialized */
-    if (error || !threadkey || tmp < 0 || !worker ||
-        ifindex != req->ifindex) {
-        virErrorPreserveLast(&req->threadError);
-        req->threadStatus = THREAD_STATUS_FAIL;
-    } else {
-        req->threadStatus = THREAD_STATUS_OK;
+    virNWFilterSnoopReqPut(cap->req);
+    VIR_FREE(cap->threadkey);
+    VIR_FREE(cap);
+}
+
+/*
+ * Open the pcap handles for snooping the DHCP traffic on the
+ * interface of the given request. The capture holds its own
+ * reference to the request.
+ * Call this function with the request's lock held.
+ */
+static virNWFilterSnoopCapturePtr
+virNWFilterSnoopCaptureNew(virNWFilterSnoopReqPtr req)
+{
+    virNWFilterSnoopCapturePtr cap;
+    size_t i;
+
+    if (VIR_ALLOC(cap) < 0)
+        return NULL;
+
+    virNWFilterSnoopReqGet(req);
+    cap->req = req;
+    cap->threadkey = g_strdup(req->threadkey);
+    memcpy(cap->pcapConf, virNWFilterSnoopPcapTemplate,
+           sizeof(cap->pcapConf));
+
+    for (i = 0; i < G_N_ELEMENTS(cap->pcapConf); i++) {
+        cap->pcapConf[i].rateLimit.prev = time(0);
+        cap->pcapConf[i].handle =
+            virNWFilterSnoopDHCPOpen(req->binding->portdevname,
+                                     &req->binding->mac,
+                                     cap->pcapConf[i].filter,
+                                     cap->pcapConf[i].dir);
+        if (!cap->pcapConf[i].handle)
+            goto error;
     }
 
-    virCondSignal(&req->threadStatusCond);
+    if (virNetDevGetIndex(req->binding->portdevname, &cap->ifindex) < 0)
+        goto error;
 
-    virNWFilterSnoopReqUnlock(req);
+    if (cap->ifindex != req->ifindex) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("interface '%s' changed its index while "
+                         "setting up DHCP snooping"),
+                       req->binding->portdevname);
+        goto error;
+    }
 
-    if (req->threadStatus != THREAD_STATUS_OK)
-        goto exit;
+    /* keep all packets of one interface on the same decode worker */
+    cap->worker = virNWFilterSnoopState.workers[cap->ifindex %
+                                                DHCP_DECODE_WORKERS];
+
+    return cap;
+
+ error:
+    virNWFilterSnoopCaptureFree(cap);
+    return NULL;
+}
+
+/*
+ * Hand a capture over to the capture engine
+ */
+static int
+virNWFilterSnoopEngineAdd(virNWFilterSnoopCapturePtr cap)
+{
+    virMutexLock(&virNWFilterSnoopState.engineLock);
+
+    if (VIR_APPEND_ELEMENT_COPY(virNWFilterSnoopState.captures,
+                                virNWFilterSnoopState.ncaptures, cap) < 0) {
+        virMutexUnlock(&virNWFilterSnoopState.engineLock);
+        return -1;
+    }
+
+    g_atomic_int_add(&virNWFilterSnoopState.nCaptures, 1);
+
+    virMutexUnlock(&virNWFilterSnoopState.engineLock);
+
+    virNWFilterSnoopEngineWakeup();
 
-    while (!error) {
-        if (virNWFilterSnoopAdjustPoll(pcapConf,
-                                       G_N_ELEMENTS(pcapConf),
-                                       fds, &pollTo) < 0) {
+    return 0;
+}
+
+/*
+ * Stop a capture and drop it from the capture engine. If the capture
+ * failed, the request also loses its association with the interface.
+ * Only the capture engine calls this function.
+ */
+static void
+virNWFilterSnoopCaptureEnd(virNWFilterSnoopCapturePtr cap, bool failed)
+{
+    virNWFilterSnoopReqPtr req = cap->req;
+    size_t i;
+
+    if (failed) {
+        /* protect IfNameToKey */
+        virNWFilterSnoopLock();
+
+        /* protect req->binding->portdevname & req->threadkey */
+        virNWFilterSnoopReqLock(req);
+
+        virNWFilterSnoopCancel(&req->threadkey);
+
+        ignore_value(virHashRemoveEntry(virNWFilterSnoopState.ifnameToKey,
+                                        req->binding->portdevname));
+
+        VIR_FREE(req->binding->portdevname);
+
+        virNWFilterSnoopReqUnlock(req);
+        virNWFilterSnoopUnlock();
+    }
+
+    virMutexLock(&virNWFilterSnoopState.engineLock);
+
+    for (i = 0; i < virNWFilterSnoopState.ncaptures; i++) {
+        if (virNWFilterSnoopState.captures[i] == cap) {
+            VIR_DELETE_ELEMENT(virNWFilterSnoopState.captures, i,
+                               virNWFilterSnoopState.ncaptures);
             break;
         }
+    }
 
-        /* cap pollTo so we don't hold up the join for too long */
-        if (pollTo < 0 || pollTo > SNOOP_POLL_MAX_TIMEOUT_MS)
-            pollTo = SNOOP_POLL_MAX_TIMEOUT_MS;
+    virMutexUnlock(&virNWFilterSnoopState.engineLock);
 
-        n = poll(fds, G_N_ELEMENTS(fds), pollTo);
+    virNWFilterSnoopCaptureFree(cap);
 
-        if (n < 0) {
-            if (errno != EAGAIN && errno != EINTR)
-                error = true;
-        }
+    ignore_value(!!g_atomic_int_dec_and_test(&virNWFilterSnoopState.nCaptures));
+}
 
-        virNWFilterSnoopReqLeaseTimerRun(req);
+/*
+ * Check whether a capture was cancelled or whether a previously
+ * submitted job failed.
+ */
+static bool
+virNWFilterSnoopCaptureIsRunning(virNWFilterSnoopCapturePtr cap)
+{
+    return virNWFilterSnoopIsActive(cap->threadkey) &&
+        cap->req->jobCompletionStatus == 0;
+}
 
-        /*
-         * Check whether we were cancelled or whether
-         * a previously submitted job failed.
-         */
-        if (!virNWFilterSnoopIsActive(threadkey) ||
-            req->jobCompletionStatus != 0)
-            goto exit;
+/*
+ * Read the packets that are waiting on the pcap handles of a capture
+ * and submit suitable ones to its decode worker.
+ *
+ * Returns 0 if the capture keeps running, 1 if it was cancelled and
+ * -1 if it failed.
+ */
+static int
+virNWFilterSnoopCaptureProcess(virNWFilterSnoopCapturePtr cap,
+                               struct pollfd *fds)
+{
+    virNWFilterSnoopReqPtr req = cap->req;
+    struct pcap_pkthdr *hdr;
+    virNWFilterSnoopEthHdrPtr packet;
+    int tmp, rv;
+    size_t i;
 
-        for (i = 0; n > 0 && i < G_N_ELEMENTS(fds); i++) {
-            if (!fds[i].revents)
-                continue;
+    if (!virNWFilterSnoopCaptureIsRunning(cap))
+        return 1;
 
-            fds[i].revents = 0;
-            n--;
+    for (i = 0; i < G_N_ELEMENTS(cap->pcapConf); i++) {
+        virNWFilterSnoopPcapConfPtr pc = &cap->pcapConf[i];
+
+        if (!fds[i].revents)
+            continue;
+
+        rv = pcap_next_ex(pc->handle, &hdr, (const u_char **)&packet);
+
+        if (rv < 0) {
+            /* error reading from socket */
+            tmp = -1;
+
+            /* protect req->binding->portdevname */
+            virNWFilterSnoopReqLock(req);
 
-            rv = pcap_next_ex(pcapConf[i].handle, &hdr,
-                              (const u_char **)&packet);
+            if (req->binding->portdevname)
+                tmp = virNetDevValidateConfig(req->binding->portdevname,
+                                              NULL, cap->ifindex);
 
-            if (rv < 0) {
-                /* error reading from socket */
-                tmp = -1;
+            virNWFilterSnoopReqUnlock(req);
+
+            if (tmp <= 0)
+                return -1;
+
+            if (++cap->errcount > PCAP_READ_MAXERRS) {
+                pcap_close(pc->handle);
+                pc->handle = NULL;
 
                 /* protect req->binding->portdevname */
                 virNWFilterSnoopReqLock(req);
 
+                virReportError(VIR_ERR_INTERNAL_ERROR,
+                               _("interface '%s' failing; "
+                                 "reopening"),
+                               req->binding->portdevname);
                 if (req->binding->portdevname)
-                    tmp = virNetDevValidateConfig(req->binding->portdevname, NULL, ifindex);
+                    pc->handle =
+                        virNWFilterSnoopDHCPOpen(req->binding->portdevname,
+                                                 &req->binding->mac,
+                                                 pc->filter,
+                                                 pc->dir);
 
                 virNWFilterSnoopReqUnlock(req);
 
-                if (tmp <= 0) {
-                    error = true;
-                    break;
+                if (!pc->handle)
+                    return -1;
+            }
+            continue;
+        }
+
+        cap->errcount = 0;
+
+        if (rv) {
+            unsigned int diff;
+
+            /* submit packet to worker thread */
+            if (g_atomic_int_get(&req->qCtr[i]) > pc->maxQSize) {
+                if (time(0) - cap->last_displayed_queue > 10) {
+                    cap->last_displayed_queue = time(0);
+                    VIR_WARN("Worker thread for interface '%s' has a "
+                             "job queue that is too long",
+                             req->binding->portdevname);
                 }
+                continue;
+            }
 
-                if (++errcount > PCAP_READ_MAXERRS) {
-                    pcap_close(pcapConf[i].handle);
-                    pcapConf[i].handle = NULL;
-
-                    /* protect req->binding->portdevname */
-                    virNWFilterSnoopReqLock(req);
-
-                    virReportError(VIR_ERR_INTERNAL_ERROR,
-                                   _("interface '%s' failing; "
-                                     "reopening"),
-                                   req->binding->portdevname);
-                    if (req->binding->portdevname)
-                        pcapConf[i].handle =
-                            virNWFilterSnoopDHCPOpen(req->binding->portdevname,
-                                                     &req->binding->mac,
-                                                     pcapConf[i].filter,
-                                                     pcapConf[i].dir);
-
-                    virNWFilterSnoopReqUnlock(req);
-
-                    if (!pcapConf[i].handle) {
-                        error = true;
-                        break;
-                    }
+            diff = virNWFilterSnoopRateLimit(&pc->rateLimit);
+            if (diff > 0) {
+                virNWFilterSnoopRatePenalty(pc, diff, DHCP_PKT_RATE);
+                if (pc->penaltyTimeoutAbs != 0)
+                    cap->penalized = true;
+                /* rate-limited warnings */
+                if (time(0) - cap->last_displayed > 10) {
+                     cap->last_displayed = time(0);
+                     VIR_WARN("Too many DHCP packets on interface '%s'",
+                              req->binding->portdevname);
                 }
                 continue;
             }
 
-            errcount = 0;
+            if (virNWFilterSnoopDHCPDecodeJobSubmit(cap->worker, req, packet,
+                                                    hdr->caplen, pc->dir,
+                                                    &req->qCtr[i]) < 0) {
+                virReportError(VIR_ERR_INTERNAL_ERROR,
+                               _("Job submission failed on "
+                                 "interface '%s'"), req->binding->portdevname);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Take a snapshot of the running captures and set up the pollfd array
+ * for them; only the capture engine removes captures, so the snapshot
+ * stays valid until it ends one itself.
+ */
+static void
+virNWFilterSnoopEngineSetupPoll(virNWFilterSnoopCapturePtr **caps,
+                                size_t *ncaps,
+                                struct pollfd **fds,
+                                size_t *nfds)
+{
+    size_t nhandles = G_N_ELEMENTS(virNWFilterSnoopPcapTemplate);
+    size_t i, j;
+
+    virMutexLock(&virNWFilterSnoopState.engineLock);
+
+    *ncaps = virNWFilterSnoopState.ncaptures;
+    *caps = g_renew(virNWFilterSnoopCapturePtr, *caps, *ncaps);
+    if (*ncaps)
+        memcpy(*caps, virNWFilterSnoopState.captures,
+               *ncaps * sizeof(**caps));
+
+    virMutexUnlock(&virNWFilterSnoopState.engineLock);
+
+    *nfds = 1 + *ncaps * nhandles;
+    *fds = g_renew(struct pollfd, *fds, *nfds);
 
-            if (rv) {
-                unsigned int diff;
+    (*fds)[0].fd = virNWFilterSnoopState.engineWakeup[0];
+    (*fds)[0].events = POLLIN;
 
-                /* submit packet to worker thread */
-                if (g_atomic_int_get(&pcapConf[i].qCtr) >
-                    pcapConf[i].maxQSize) {
-                    if (last_displayed_queue - time(0) > 10) {
-                        last_displayed_queue = time(0);
-                        VIR_WARN("Worker thread for interface '%s' has a "
-                                 "job queue that is too long",
-                                 req->binding->portdevname);
-                    }
+    for (i = 0; i < *ncaps; i++) {
+        struct pollfd *pfd = &(*fds)[1 + i * nhandles];
+
+        for (j = 0; j < nhandles; j++) {
+            pfd[j].fd = pcap_fileno((*caps)[i]->pcapConf[j].handle);
+            /* get a POLLERR if interface goes down or disappears */
+            pfd[j].events = POLLIN | POLLERR;
+        }
+
+        /* a muted handle stays muted */
+        for (j = 0; j < nhandles; j++) {
+            if ((*caps)[i]->pcapConf[j].penaltyTimeoutAbs != 0)
+                pfd[j].events &= ~POLLIN;
+        }
+    }
+}
+
+/*
+ * The DHCP capture engine. A single thread polls the pcap handles of
+ * all running captures, spending most of its time in poll() and the
+ * pcap library; suitable packets are submitted to the decode workers
+ * for processing.
+ *
+ * Each capture owns pcap handles bound to its own interface, so the
+ * packets arrive already demultiplexed by interface. Only the captures
+ * that have events pending are looked at; the pollfd array is only
+ * rebuilt when captures come or go. Lease expiry is handled by a
+ * separate thread, so that updating the firewall doesn't hold up the
+ * capture on all other interfaces.
+ */
+static void
+virNWFilterSnoopEngineRun(void *opaque G_GNUC_UNUSED)
+{
+    virNWFilterSnoopCapturePtr *caps = NULL;
+    struct pollfd *fds = NULL;
+    size_t nhandles = G_N_ELEMENTS(virNWFilterSnoopPcapTemplate);
+    size_t ncaps = 0, nfds = 0, i, j;
+    size_t npenalized = 0;
+    bool rebuild = true;
+    int n, pollTo, capTo;
+
+    while (!g_atomic_int_get(&virNWFilterSnoopState.engineQuit)) {
+        if (rebuild) {
+            virNWFilterSnoopEngineSetupPoll(&caps, &ncaps, &fds, &nfds);
+            rebuild = false;
+        }
+
+        pollTo = -1;
+
+        /* unmute handles whose flooding penalty has expired */
+        if (npenalized > 0) {
+            npenalized = 0;
+
+            for (i = 0; i < ncaps; i++) {
+                if (!caps[i]->penalized)
+                    continue;
+
+                if (virNWFilterSnoopAdjustPoll(caps[i]->pcapConf, nhandles,
+                                               &fds[1 + i * nhandles],
+                                               &capTo) < 0) {
+                    npenalized++;
                     continue;
                 }
 
-                diff = virNWFilterSnoopRateLimit(&pcapConf[i].rateLimit);
-                if (diff > 0) {
-                    virNWFilterSnoopRatePenalty(&pcapConf[i], diff,
-                                                DHCP_PKT_RATE);
-                    /* rate-limited warnings */
-                    if (time(0) - last_displayed > 10) {
-                         last_displayed = time(0);
-                         VIR_WARN("Too many DHCP packets on interface '%s'",
-                                  req->binding->portdevname);
-                    }
+                if (capTo < 0) {
+                    caps[i]->penalized = false;
                     continue;
                 }
 
-                if (virNWFilterSnoopDHCPDecodeJobSubmit(worker, packet,
-                                                      hdr->caplen,
-                                                      pcapConf[i].dir,
-                                                      &pcapConf[i].qCtr) < 0) {
-                    virReportError(VIR_ERR_INTERNAL_ERROR,
-                                   _("Job submission failed on "
-                                     "interface '%s'"), req->binding->portdevname);
-                    error = true;
-                    break;
+                npenalized++;
+                if (pollTo < 0 || capTo < pollTo)
+                    pollTo = capTo;
+            }
+        }
+
+        for (i = 0; i < nfds; i++)
+            fds[i].revents = 0;
+
+        n = poll(fds, nfds, pollTo);
+
+        if (n < 0) {
+            /* nothing points at a particular capture, so don't end any
+             * of them; back off a little in case the error persists */
+            if (errno != EAGAIN && errno != EINTR) {
+                VIR_WARN("unable to poll on DHCP snooping handles: %s",
+                         g_strerror(errno));
+                g_usleep(SNOOP_POLL_ERROR_DELAY_MS * 1000);
+            }
+            continue;
+        }
+
+        if (fds[0].revents) {
+            n--;
+            virNWFilterSnoopEngineDrain();
+
+            /* captures were added or cancelled, or a decode job failed */
+            for (i = 0; i < ncaps; i++) {
+                if (!virNWFilterSnoopCaptureIsRunning(caps[i])) {
+                    virNWFilterSnoopCaptureEnd(caps[i], false);
+                    caps[i] = NULL;
                 }
             }
-        } /* for all fds */
-    } /* while (!error) */
+            rebuild = true;
+        }
 
-    /* protect IfNameToKey */
-    virNWFilterSnoopLock();
+        for (i = 0; i < ncaps && n > 0; i++) {
+            struct pollfd *pfd = &fds[1 + i * nhandles];
+            short revents = 0;
+            int rv;
 
-    /* protect req->binding->portdevname & req->threadkey */
-    virNWFilterSnoopReqLock(req);
+            for (j = 0; j < nhandles; j++) {
+                if (pfd[j].revents) {
+                    revents |= pfd[j].revents;
+                    n--;
+                }
+            }
 
-    virNWFilterSnoopCancel(&req->threadkey);
+            if (!revents || !caps[i])
+                continue;
+
+            if (revents & POLLNVAL)
+                rv = -1;
+            else
+                rv = virNWFilterSnoopCaptureProcess(caps[i], pfd);
+
+            if (rv != 0) {
+                virNWFilterSnoopCaptureEnd(caps[i], rv < 0);
+                caps[i] = NULL;
+                rebuild = true;
+                continue;
+            }
+
+            if (caps[i]->penalized)
+                npenalized++;
 
-    ignore_value(virHashRemoveEntry(virNWFilterSnoopState.ifnameToKey,
-                                    req->binding->portdevname));
+            /* a failing handle may have been reopened */
+            for (j = 0; j < nhandles; j++) {
+                if (pfd[j].fd != pcap_fileno(caps[i]->pcapConf[j].handle))
+                    rebuild = true;
+            }
+        }
+    }
 
-    VIR_FREE(req->binding->portdevname);
+    VIR_FREE(caps);
+    VIR_FREE(fds);
+}
+
+/*
+ * Collect the requests with expired leases, each with a reference.
+ * Call this function with the SnoopLock held.
+ */
+static int
+virNWFilterSnoopLeaseTimerIter(void *payload,
+                               const void *name G_GNUC_UNUSED,
+                               void *data)
+{
+    virNWFilterSnoopReqPtr req = payload;
+    GPtrArray *expired = data;
+    time_t now = time(0);
+
+    /* protect req->threadkey and req->start */
+    virNWFilterSnoopReqLock(req);
+
+    /* requests without a capture are pruned with the lease file */
+    if (req->threadkey && req->start && req->start->timeout <= now) {
+        virNWFilterSnoopReqGet(req);
+        g_ptr_array_add(expired, req);
+    }
 
     virNWFilterSnoopReqUnlock(req);
+
+    return 0;
+}
+
+/*
+ * Expire the leases of all running captures. Removing a lease updates
+ * the firewall, so the SnoopLock isn't held while doing that.
+ */
+static void
+virNWFilterSnoopLeaseTimerExpire(void)
+{
+    g_autoptr(GPtrArray) expired = g_ptr_array_new();
+    size_t i;
+
+    virNWFilterSnoopLock();
+
+    if (virNWFilterSnoopState.snoopReqs)
+        virHashForEach(virNWFilterSnoopState.snoopReqs,
+                       virNWFilterSnoopLeaseTimerIter, expired);
+
     virNWFilterSnoopUnlock();
 
- exit:
-    virThreadPoolFree(worker);
+    for (i = 0; i < expired->len; i++) {
+        virNWFilterSnoopReqPtr req = g_ptr_array_index(expired, i);
 
-    virNWFilterSnoopReqPut(req);
+        virNWFilterSnoopReqLeaseTimerRun(req);
+        virNWFilterSnoopReqPut(req);
+    }
+}
+
+static void
+virNWFilterSnoopLeaseTimerRun(void *opaque G_GNUC_UNUSED)
+{
+    unsigned long long now;
+
+    virMutexLock(&virNWFilterSnoopState.leaseTimerLock);
+
+    while (!virNWFilterSnoopState.leaseTimerQuit) {
+        if (virTimeMillisNow(&now) < 0) {
+            virMutexUnlock(&virNWFilterSnoopState.leaseTimerLock);
+            g_usleep(SNOOP_LEASE_TIMER_INTERVAL_MS * 1000);
+            virMutexLock(&virNWFilterSnoopState.leaseTimerLock);
+        } else {
+            ignore_value(virCondWaitUntil(&virNWFilterSnoopState.leaseTimerCond,
+                                          &virNWFilterSnoopState.leaseTimerLock,
+                                          now + SNOOP_LEASE_TIMER_INTERVAL_MS));
+        }
+
+        if (virNWFilterSnoopState.leaseTimerQuit)
+            break;
+
+        virMutexUnlock(&virNWFilterSnoopState.leaseTimerLock);
 
-    VIR_FREE(threadkey);
+        virNWFilterSnoopLeaseTimerExpire();
 
-    for (i = 0; i < G_N_ELEMENTS(pcapConf); i++) {
-        if (pcapConf[i].handle)
-            pcap_close(pcapConf[i].handle);
+        virMutexLock(&virNWFilterSnoopState.leaseTimerLock);
     }
 
-    ignore_value(!!g_atomic_int_dec_and_test(&virNWFilterSnoopState.nThreads));
+    virMutexUnlock(&virNWFilterSnoopState.leaseTimerLock);
+}
 
-    return;
+static void
+virNWFilterSnoopLeaseTimerStop(void)
+{
+    virMutexLock(&virNWFilterSnoopState.leaseTimerLock);
+    virNWFilterSnoopState.leaseTimerQuit = true;
+    virCondSignal(&virNWFilterSnoopState.leaseTimerCond);
+    virMutexUnlock(&virNWFilterSnoopState.leaseTimerLock);
+
+    virThreadJoin(&virNWFilterSnoopState.leaseTimerThread);
+}
+
+static int
+virNWFilterSnoopEngineStart(void)
+{
+    size_t i;
+
+    if (virMutexInit(&virNWFilterSnoopState.engineLock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("unable to initialize mutex"));
+        return -1;
+    }
+
+    if (virMutexInit(&virNWFilterSnoopState.leaseTimerLock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("unable to initialize mutex"));
+        virMutexDestroy(&virNWFilterSnoopState.engineLock);
+        return -1;
+    }
+
+    if (virCondInit(&virNWFilterSnoopState.leaseTimerCond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to initialize condition variable"));
+        virMutexDestroy(&virNWFilterSnoopState.leaseTimerLock);
+        virMutexDestroy(&virNWFilterSnoopState.engineLock);
+        return -1;
+    }
+
+    if (virPipeNonBlock(virNWFilterSnoopState.engineWakeup) < 0)
+        goto error;
+
+    for (i = 0; i < DHCP_DECODE_WORKERS; i++) {
+        virNWFilterSnoopState.workers[i] =
+            virThreadPoolNew(1, 1, 0, virNWFilterDHCPDecodeWorker, NULL);
+        if (!virNWFilterSnoopState.workers[i])
+            goto error;
+    }
+
+    virNWFilterSnoopState.engineQuit = 0;
+    virNWFilterSnoopState.leaseTimerQuit = false;
+
+    if (virThreadCreate(&virNWFilterSnoopState.leaseTimerThread, true,
+                        virNWFilterSnoopLeaseTimerRun, NULL) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to create DHCP lease timer thread"));
+        goto error;
+    }
+
+    if (virThreadCreate(&virNWFilterSnoopState.engineThread, true,
+                        virNWFilterSnoopEngineRun, NULL) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to create DHCP snooping thread"));
+        virNWFilterSnoopLeaseTimerStop();
+        goto error;
+    }
+
+    virNWFilterSnoopState.engineRunning = true;
+
+    return 0;
+
+ error:
+    for (i = 0; i < DHCP_DECODE_WORKERS; i++) {
+        virThreadPoolFree(virNWFilterSnoopState.workers[i]);
+        virNWFilterSnoopState.workers[i] = NULL;
+    }
+    VIR_FORCE_CLOSE(virNWFilterSnoopState.engineWakeup[0]);
+    VIR_FORCE_CLOSE(virNWFilterSnoopState.engineWakeup[1]);
+    virCondDestroy(&virNWFilterSnoopState.leaseTimerCond);
+    virMutexDestroy(&virNWFilterSnoopState.leaseTimerLock);
+    virMutexDestroy(&virNWFilterSnoopState.engineLock);
+    return -1;
+}
+
+/*
+ * Stop the capture engine once all captures have ended; the decode
+ * workers finish the jobs that are still queued.
+ */
+static void
+virNWFilterSnoopEngineStop(void)
+{
+    size_t i;
+
+    if (!virNWFilterSnoopState.engineRunning)
+        return;
+
+    g_atomic_int_set(&virNWFilterSnoopState.engineQuit, 1);
+    virNWFilterSnoopEngineWakeup();
+    virThreadJoin(&virNWFilterSnoopState.engineThread);
+    virNWFilterSnoopLeaseTimerStop();
+    virNWFilterSnoopState.engineRunning = false;
+
+    for (i = 0; i < DHCP_DECODE_WORKERS; i++) {
+        virThreadPoolFree(virNWFilterSnoopState.workers[i]);
+        virNWFilterSnoopState.workers[i] = NULL;
+    }
+
+    VIR_FORCE_CLOSE(virNWFilterSnoopState.engineWakeup[0]);
+    VIR_FORCE_CLOSE(virNWFilterSnoopState.engineWakeup[1]);
+    VIR_FREE(virNWFilterSnoopState.captures);
+    virNWFilterSnoopState.ncaptures = 0;
+    virCondDestroy(&virNWFilterSnoopState.leaseTimerCond);
+    virMutexDestroy(&virNWFilterSnoopState.leaseTimerLock);
+    virMutexDestroy(&virNWFilterSnoopState.engineLock);
 }
 
 static void
@@ -1565,9 +2049,8 @@ virNWFilterDHCPSnoopReq(virNWFilterTechDriverPtr techdriver,
     bool isnewreq;
     char ifkey[VIR_IFKEY_LEN];
     int tmp;
-    virThread thread;
+    virNWFilterSnoopCapturePtr cap = NULL;
     virNWFilterVarValuePtr dhcpsrvrs;
-    bool threadPuts = false;
 
     virNWFilterSnoopIFKeyFMT(ifkey, binding->owneruuid, &binding->mac);
 
@@ -1635,21 +2118,9 @@ virNWFilterDHCPSnoopReq(virNWFilterTechDriverPtr techdriver,
         goto exit_rem_ifnametokey;
     }
 
-    /* prevent thread from holding req */
+    /* prevent the capture engine from seeing a half set up req */
     virNWFilterSnoopReqLock(req);
 
-    if (virThreadCreate(&thread, false, virNWFilterDHCPSnoopThread,
-                        req) != 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("virNWFilterDHCPSnoopReq virThreadCreate "
-                         "failed on interface '%s'"), binding->portdevname);
-        goto exit_snoopreq_unlock;
-    }
-
-    threadPuts = true;
-
-    g_atomic_int_add(&virNWFilterSnoopState.nThreads, 1);
-
     req->threadkey = virNWFilterSnoopActivate(req);
     if (!req->threadkey) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
@@ -1658,6 +2129,9 @@ virNWFilterDHCPSnoopReq(virNWFilterTechDriverPtr techdriver,
         goto exit_snoopreq_unlock;
     }
 
+    if (!(cap = virNWFilterSnoopCaptureNew(req)))
+        goto exit_snoop_cancel;
+
     if (virNWFilterSnoopReqRestore(req) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("Restoring of leases failed on "
@@ -1665,27 +2139,20 @@ virNWFilterDHCPSnoopReq(virNWFilterTechDriverPtr techdriver,
         goto exit_snoop_cancel;
     }
 
-    /* sync with thread */
-    if (virCondWait(&req->threadStatusCond, &req->lock) < 0) {
-        virReportSystemError(errno, "%s",
-                             _("unable to wait on dhcp snoop thread"));
+    if (virNWFilterSnoopEngineAdd(cap) < 0)
         goto exit_snoop_cancel;
-    }
-
-    if (req->threadStatus != THREAD_STATUS_OK) {
-        virErrorRestore(&req->threadError);
-        goto exit_snoop_cancel;
-    }
 
     virNWFilterSnoopReqUnlock(req);
 
     virNWFilterSnoopUnlock();
 
-    /* do not 'put' the req -- the thread will do this */
+    /* the capture holds its own reference to the req */
+    virNWFilterSnoopReqPut(req);
 
     return 0;
 
  exit_snoop_cancel:
+    virNWFilterSnoopCaptureFree(cap);
     virNWFilterSnoopCancel(&req->threadkey);
  exit_snoopreq_unlock:
     virNWFilterSnoopReqUnlock(req);
@@ -1694,8 +2161,7 @@ virNWFilterDHCPSnoopReq(virNWFilterTechDriverPtr techdriver,
  exit_snoopunlock:
     virNWFilterSnoopUnlock();
  exit_snoopreqput:
-    if (!threadPuts)
-        virNWFilterSnoopReqPut(req);
+    virNWFilterSnoopReqPut(req);
 
     return -1;
 }
@@ -1715,6 +2181,28 @@ virNWFilterSnoopLeaseFileOpen(void)
                                          0644);
 }
 
+/*
+ * Format a single lease as a line of the lease file.
+ */
+static int
+virNWFilterSnoopLeaseFormat(virBufferPtr buf, const char *ifkey,
+                            virNWFilterSnoopIPLeasePtr ipl)
+{
+    g_autofree char *ipstr = NULL;
+    g_autofree char *dhcpstr = NULL;
+
+    ipstr = virSocketAddrFormat(&ipl->ipAddress);
+    dhcpstr = virSocketAddrFormat(&ipl->ipServer);
+
+    if (!dhcpstr || !ipstr)
+        return -1;
+
+    /* time intf ip dhcpserver */
+    virBufferAsprintf(buf, "%u %s %s %s\n", ipl->timeout, ifkey, ipstr, dhcpstr);
+
+    return 0;
+}
+
 /*
  * Write a single lease to the given file.
  *
@@ -1723,44 +2211,30 @@ static int
 virNWFilterSnoopLeaseFileWrite(int lfd, const char *ifkey,
                                virNWFilterSnoopIPLeasePtr ipl)
 {
-    char *lbuf = NULL;
-    char *ipstr, *dhcpstr;
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
     int len;
-    int ret = 0;
 
-    ipstr = virSocketAddrFormat(&ipl->ipAddress);
-    dhcpstr = virSocketAddrFormat(&ipl->ipServer);
+    if (virNWFilterSnoopLeaseFormat(&buf, ifkey, ipl) < 0)
+        return -1;
 
-    if (!dhcpstr || !ipstr) {
-        ret = -1;
-        goto cleanup;
-    }
+    len = virBufferUse(&buf);
 
-    /* time intf ip dhcpserver */
-    lbuf = g_strdup_printf("%u %s %s %s\n", ipl->timeout, ifkey, ipstr, dhcpstr);
-    len = strlen(lbuf);
-
-    if (safewrite(lfd, lbuf, len) != len) {
+    if (safewrite(lfd, virBufferCurrentContent(&buf), len) != len) {
         virReportSystemError(errno, "%s", _("lease file write failed"));
-        ret = -1;
-        goto cleanup;
+        return -1;
     }
 
     ignore_value(g_fsync(lfd));
 
- cleanup:
-    VIR_FREE(lbuf);
-    VIR_FREE(dhcpstr);
-    VIR_FREE(ipstr);
-
-    return ret;
+    return 0;
 }
 
 /*
  * Append a single lease to the end of the lease file.
- * To keep a limited number of dead leases, re-read the lease
+ * To keep a limited number of dead leases, compact the lease
  * file if the threshold of active leases versus written ones
- * exceeds a threshold.
+ * exceeds a threshold. The in-memory leases are authoritative
+ * while running, so there is no need to re-read the file.
  */
 static void
 virNWFilterSnoopLeaseFileSave(virNWFilterSnoopIPLeasePtr ipl)
@@ -1777,8 +2251,9 @@ virNWFilterSnoopLeaseFileSave(virNWFilterSnoopIPLeasePtr ipl)
 
     /* keep dead leases at < ~95% of file size */
     if (g_atomic_int_add(&virNWFilterSnoopState.wLeases, 1) >=
-        g_atomic_int_get(&virNWFilterSnoopState.nLeases) * 20)
-        virNWFilterSnoopLeaseFileLoad();   /* load & refresh lease file */
+        MAX(g_atomic_int_get(&virNWFilterSnoopState.nLeases) * 20,
+            LEASEFILE_COMPACT_MIN))
+        virNWFilterSnoopLeaseFileRefresh();
 
  err_exit:
     virNWFilterSnoopUnlock();
@@ -1816,7 +2291,7 @@ virNWFilterSnoopPruneIter(const void *payload,
 }
 
 /*
- * Iterator to write all leases of a single request to a file.
+ * Iterator to format all leases of a single request into a buffer.
  * Call this function with the SnoopLock held.
  */
 static int
@@ -1825,14 +2300,16 @@ virNWFilterSnoopSaveIter(void *payload,
                          void *data)
 {
     virNWFilterSnoopReqPtr req = payload;
-    int tfd = *(int *)data;
+    virBufferPtr buf = data;
     virNWFilterSnoopIPLeasePtr ipl;
 
     /* protect req->start */
     virNWFilterSnoopReqLock(req);
 
-    for (ipl = req->start; ipl; ipl = ipl->next)
-        ignore_value(virNWFilterSnoopLeaseFileWrite(tfd, req->ifkey, ipl));
+    for (ipl = req->start; ipl; ipl = ipl->next) {
+        if (virNWFilterSnoopLeaseFormat(buf, req->ifkey, ipl) == 0)
+            g_atomic_int_inc(&virNWFilterSnoopState.wLeases);
+    }
 
     virNWFilterSnoopReqUnlock(req);
     return 0;
@@ -1840,13 +2317,16 @@ virNWFilterSnoopSaveIter(void *payload,
 
 /*
  * Write all valid leases into a temporary file and then
- * rename the file to the final file.
+ * rename the file to the final file. The leases are written
+ * with a single write and synced once before the rename.
  * Call this function with the SnoopLock held.
  */
 static void
 virNWFilterSnoopLeaseFileRefresh(void)
 {
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
     int tfd;
+    int len;
 
     if (virFileMakePathWithMode(LEASEFILE_DIR, 0700) < 0) {
         virReportError(errno, _("mkdir(\"%s\")"), LEASEFILE_DIR);
@@ -1863,15 +2343,28 @@ virNWFilterSnoopLeaseFileRefresh(void)
         return;
     }
 
+    g_atomic_int_set(&virNWFilterSnoopState.wLeases, 0);
+
     if (virNWFilterSnoopState.snoopReqs) {
         /* clean up the requests */
         virHashRemoveSet(virNWFilterSnoopState.snoopReqs,
                          virNWFilterSnoopPruneIter, NULL);
         /* now save them */
         virHashForEach(virNWFilterSnoopState.snoopReqs,
-                       virNWFilterSnoopSaveIter, (void *)&tfd);
+                       virNWFilterSnoopSaveIter, &buf);
     }
 
+    len = virBufferUse(&buf);
+    if (len > 0 &&
+        safewrite(tfd, virBufferCurrentContent(&buf), len) != len) {
+        virReportSystemError(errno, _("unable to write %s"), TMPLEASEFILE);
+        VIR_FORCE_CLOSE(tfd);
+        unlink(TMPLEASEFILE);
+        goto skip_rename;
+    }
+
+    ignore_value(g_fsync(tfd));
+
     if (VIR_CLOSE(tfd) < 0) {
         virReportSystemError(errno, _("unable to close %s"), TMPLEASEFILE);
         /* assuming the old lease file is still better, skip the renaming */
@@ -1883,7 +2376,6 @@ virNWFilterSnoopLeaseFileRefresh(void)
                              TMPLEASEFILE, LEASEFILE);
         unlink(TMPLEASEFILE);
     }
-    g_atomic_int_set(&virNWFilterSnoopState.wLeases, 0);
 
  skip_rename:
     virNWFilterSnoopLeaseFileOpen();
@@ -1967,14 +2459,14 @@ virNWFilterSnoopLeaseFileLoad(void)
 }
 
 /*
- * Wait until all threads have ended.
+ * Wait until the capture engine has ended all captures.
  */
 static void
 virNWFilterSnoopJoinThreads(void)
 {
-    while (g_atomic_int_get(&virNWFilterSnoopState.nThreads) != 0) {
-        VIR_WARN("Waiting for snooping threads to terminate: %u",
-                 g_atomic_int_get(&virNWFilterSnoopState.nThreads));
+    while (g_atomic_int_get(&virNWFilterSnoopState.nCaptures) != 0) {
+        VIR_WARN("Waiting for snooping captures to terminate: %u",
+                 g_atomic_int_get(&virNWFilterSnoopState.nCaptures));
         g_usleep(1000 * 1000);
     }
 }
@@ -2052,6 +2544,9 @@ virNWFilterDHCPSnoopInit(void)
         !virNWFilterSnoopState.active)
         goto err_exit;
 
+    if (virNWFilterSnoopEngineStart() < 0)
+        goto err_exit;
+
     virNWFilterSnoopLeaseFileLoad();
     virNWFilterSnoopLeaseFileOpen();
 
@@ -2141,6 +2636,7 @@ virNWFilterDHCPSnoopShutdown(void)
 {
     virNWFilterSnoopEndThreads();
     virNWFilterSnoopJoinThreads();
+    virNWFilterSnoopEngineStop();
 
     virNWFilterSnoopLock();
 
@@ -3790,6 +3790,11 @@ ebiptablesDriverInit(bool privileged)
     if (ebiptablesDriverProbeStateMatch() < 0)
         return -1;
 
+    /* There are no native nftables rules for network filters */
+    if (virFirewallGetBackend() == VIR_FIREWALL_BACKEND_NFTABLES)
+        VIR_INFO("nftables firewall backend in use, network filters "
+                 "are still applied with ebtables/iptables/ip6tables");
+
     ebiptables_driver.flags = TECHDRV_FLAG_INITIALIZED;
 
     return 0;
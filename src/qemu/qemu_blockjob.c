@@ -1577,6 +1577,15 @@ qemuBlockJobUpdate(virDomainObjPtr vm,
     if (job->newstate == -1)
         return -1;
 
+    /* The job might have rewritten image headers, e.g. the backing
+     * file of the overlay of a committed or pulled image */
+    if (job->disk) {
+        virStorageFileMetadataCacheInvalidate(job->disk->src);
+        virStorageFileMetadataCacheInvalidate(job->disk->mirror);
+    }
+    virStorageFileMetadataCacheInvalidate(job->chain);
+    virStorageFileMetadataCacheInvalidate(job->mirrorChain);
+
     if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV))
         qemuBlockJobEventProcess(priv->driver, vm, job, asyncJob);
     else
@@ -20759,22 +20759,23 @@ qemuDomainGetStatsCpuCgroup(virDomainObjPtr dom,
                             virTypedParamListPtr params)
 {
     qemuDomainObjPrivatePtr priv = dom->privateData;
-    unsigned long long cpu_time = 0;
-    unsigned long long user_time = 0;
-    unsigned long long sys_time = 0;
-    int err = 0;
+    virCgroupStats stats;
 
     if (!priv->cgroup)
         return 0;
 
-    err = virCgroupGetCpuacctUsage(priv->cgroup, &cpu_time);
-    if (!err && virTypedParamListAddULLong(params, cpu_time, "cpu.time") < 0)
-        return -1;
+    ignore_value(virCgroupGetStats(priv->cgroup,
+                                   VIR_CGROUP_STATS_CPU_USAGE |
+                                   VIR_CGROUP_STATS_CPU_TIMES,
+                                   &stats));
 
-    err = virCgroupGetCpuacctStat(priv->cgroup, &user_time, &sys_time);
-    if (!err && virTypedParamListAddULLong(params, user_time, "cpu.user") < 0)
+    if ((stats.valid & VIR_CGROUP_STATS_CPU_USAGE) &&
+        virTypedParamListAddULLong(params, stats.cpuUsage, "cpu.time") < 0)
         return -1;
-    if (!err && virTypedParamListAddULLong(params, sys_time, "cpu.system") < 0)
+
+    if ((stats.valid & VIR_CGROUP_STATS_CPU_TIMES) &&
+        (virTypedParamListAddULLong(params, stats.cpuUser, "cpu.user") < 0 ||
+         virTypedParamListAddULLong(params, stats.cpuSys, "cpu.system") < 0))
         return -1;
 
     return 0;
@@ -21313,18 +21314,9 @@ qemuDomainGetStatsBlock(virQEMUDriverPtr driver,
     if (HAVE_JOB(privflags) && virDomainObjIsActive(dom)) {
         qemuDomainObjEnterMonitor(driver, dom);
 
-        rc = qemuMonitorGetAllBlockStatsInfo(priv->mon, &stats, visitBacking);
-
-        if (rc >= 0) {
-            if (blockdev)
-                rc = qemuMonitorBlockStatsUpdateCapacityBlockdev(priv->mon, stats);
-            else
-                ignore_value(qemuMonitorBlockStatsUpdateCapacity(priv->mon, stats,
-                                                                 visitBacking));
-        }
-
-        if (fetchnodedata)
-            nodedata = qemuMonitorQueryNamedBlockNodes(priv->mon);
+        rc = qemuMonitorGetAllBlockStatsInfoFull(priv->mon, &stats,
+                                                 visitBacking, blockdev,
+                                                 fetchnodedata ? &nodedata : NULL);
 
         if (qemuDomainObjExitMonitor(driver, dom) < 0)
             goto cleanup;
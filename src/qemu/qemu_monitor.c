@@ -92,6 +92,8 @@ struct _qemuMonitor {
      * code to process & find message boundaries */
     size_t bufferOffset;
     size_t bufferLength;
+    /* how much of the buffer has been searched for a line ending */
+    size_t bufferScanned;
     char *buffer;
 
     /* If anything went wrong, this will be fed back
@@ -314,8 +316,11 @@ qemuMonitorIOProcess(qemuMonitorPtr mon)
     qemuMonitorMessagePtr msg = NULL;
 
     /* See if there's a message & whether its ready for its reply
-     * ie whether its completed writing all its data */
-    if (mon->msg && mon->msg->txOffset == mon->msg->txLength)
+     * ie whether its completed writing all its data. Replies to
+     * pipelined commands may arrive while the rest of the batch is
+     * still being written; they are matched by id. */
+    if (mon->msg &&
+        (mon->msg->txOffset == mon->msg->txLength || mon->msg->nrx > 0))
         msg = mon->msg;
 
 #if DEBUG_IO
@@ -335,6 +340,7 @@ qemuMonitorIOProcess(qemuMonitorPtr mon)
 
     len = qemuMonitorJSONIOProcess(mon,
                                    mon->buffer, mon->bufferOffset,
+                                   &mon->bufferScanned,
                                    msg);
     if (len < 0)
         return -1;
@@ -345,9 +351,11 @@ qemuMonitorIOProcess(qemuMonitorPtr mon)
     if (len < mon->bufferOffset) {
         memmove(mon->buffer, mon->buffer + len, mon->bufferOffset - len);
         mon->bufferOffset -= len;
+        mon->bufferScanned -= len;
+        mon->buffer[mon->bufferOffset] = '\0';
     } else {
         VIR_FREE(mon->buffer);
-        mon->bufferOffset = mon->bufferLength = 0;
+        mon->bufferOffset = mon->bufferLength = mon->bufferScanned = 0;
     }
 #if DEBUG_IO
     VIR_DEBUG("Process done %d used %d", (int)mon->bufferOffset, len);
@@ -462,17 +470,24 @@ qemuMonitorIORead(qemuMonitorPtr mon)
     int ret = 0;
 
     if (avail < 1024) {
+        size_t newLength;
+
         if (mon->bufferLength >= QEMU_MONITOR_MAX_RESPONSE) {
             virReportError(VIR_ERR_INTERNAL_ERROR,
                            _("QEMU monitor reply exceeds buffer size (%d bytes)"),
                            QEMU_MONITOR_MAX_RESPONSE);
             return -1;
         }
-        if (VIR_REALLOC_N(mon->buffer,
-                          mon->bufferLength + 1024) < 0)
+
+        /* grow geometrically so that large replies aren't copied
+         * over and over again */
+        newLength = MIN(mon->bufferLength * 2, QEMU_MONITOR_MAX_RESPONSE);
+        newLength = MAX(newLength, mon->bufferLength + 1024);
+
+        if (VIR_REALLOC_N(mon->buffer, newLength) < 0)
             return -1;
-        mon->bufferLength += 1024;
-        avail += 1024;
+        avail += newLength - mon->bufferLength;
+        mon->bufferLength = newLength;
     }
 
     /* Read as much as we can get into our buffer,
@@ -2170,6 +2185,49 @@ qemuMonitorGetAllBlockStatsInfo(qemuMonitorPtr mon,
 }
 
 
+/**
+ * qemuMonitorGetAllBlockStatsInfoFull:
+ * @mon: monitor object
+ * @ret_stats: filled with a hash table of qemuBlockStatsPtr
+ * @backingChain: whether to report stats of the backing chain too
+ * @blockdev: whether the VM uses -blockdev
+ * @nodedata: filled with the 'query-named-block-nodes' reply if non-NULL
+ *
+ * Like qemuMonitorGetAllBlockStatsInfo followed by updating the capacity
+ * of the images, but pipelines all the queries so that the monitor is
+ * only waited for once. Failure to get the capacity or @nodedata is not
+ * fatal.
+ */
+int
+qemuMonitorGetAllBlockStatsInfoFull(qemuMonitorPtr mon,
+                                    virHashTablePtr *ret_stats,
+                                    bool backingChain,
+                                    bool blockdev,
+                                    virJSONValuePtr *nodedata)
+{
+    int ret;
+
+    VIR_DEBUG("ret_stats=%p, backing=%d, blockdev=%d, nodedata=%p",
+              ret_stats, backingChain, blockdev, nodedata);
+
+    QEMU_CHECK_MONITOR(mon);
+
+    if (!(*ret_stats = virHashCreate(10, virHashValueFree)))
+        return -1;
+
+    ret = qemuMonitorJSONGetAllBlockStatsInfoFull(mon, *ret_stats,
+                                                  backingChain, blockdev,
+                                                  nodedata);
+
+    if (ret < 0) {
+        virHashFree(*ret_stats);
+        *ret_stats = NULL;
+    }
+
+    return ret;
+}
+
+
 /* Updates "stats" to fill virtual and physical size of the image */
 int
 qemuMonitorBlockStatsUpdateCapacity(qemuMonitorPtr mon,
@@ -58,6 +58,13 @@ struct _qemuMonitorMessage {
     /* Used by the JSON monitor to hold reply / error */
     void *rxObject;
 
+    /* Used by the JSON monitor when several commands are pipelined
+     * in one message: the ids of the commands and their replies */
+    char **rxIds;
+    void **rxObjects;
+    size_t nrx;
+    size_t nrxDone;
+
     /* True if rxBuffer / rxObject are ready, or a
      * fatal error occurred on the monitor channel
      */
@@ -674,6 +681,13 @@ int qemuMonitorGetAllBlockStatsInfo(qemuMonitorPtr mon,
                                     bool backingChain)
     ATTRIBUTE_NONNULL(2);
 
+int qemuMonitorGetAllBlockStatsInfoFull(qemuMonitorPtr mon,
+                                        virHashTablePtr *ret_stats,
+                                        bool backingChain,
+                                        bool blockdev,
+                                        virJSONValuePtr *nodedata)
+    ATTRIBUTE_NONNULL(2);
+
 int qemuMonitorBlockStatsUpdateCapacity(qemuMonitorPtr mon,
                                         virHashTablePtr stats,
                                         bool backingChain)
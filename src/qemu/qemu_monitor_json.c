@@ -209,6 +209,50 @@ qemuMonitorJSONIOProcessEvent(qemuMonitorPtr mon,
     return 0;
 }
 
+/*
+ * Hand a reply over to the message waiting for it. The replies to
+ * pipelined commands are matched by their 'id'; QMP answers commands
+ * in order, so a reply without one (e.g. to a command QEMU failed to
+ * parse) belongs to the oldest command still waiting.
+ */
+static int
+qemuMonitorJSONIOProcessReply(qemuMonitorMessagePtr msg,
+                              virJSONValuePtr obj)
+{
+    const char *id;
+    size_t i;
+
+    if (msg->nrx == 0) {
+        msg->rxObject = obj;
+        msg->finished = 1;
+        return 0;
+    }
+
+    id = virJSONValueObjectGetString(obj, "id");
+
+    for (i = 0; i < msg->nrx; i++) {
+        if (msg->rxObjects[i])
+            continue;
+
+        if (!id || STREQ(id, msg->rxIds[i]))
+            break;
+    }
+
+    if (i == msg->nrx) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unexpected JSON reply with id '%s'"), NULLSTR(id));
+        return -1;
+    }
+
+    msg->rxObjects[i] = obj;
+
+    if (++msg->nrxDone == msg->nrx)
+        msg->finished = 1;
+
+    return 0;
+}
+
+
 int
 qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
                              const char *line,
@@ -239,10 +283,10 @@ qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
         PROBE(QEMU_MONITOR_RECV_REPLY,
               "mon=%p reply=%s", mon, line);
         if (msg) {
-            msg->rxObject = obj;
-            msg->finished = 1;
-            obj = NULL;
-            ret = 0;
+            if (qemuMonitorJSONIOProcessReply(msg, obj) == 0) {
+                obj = NULL;
+                ret = 0;
+            }
         } else {
             virReportError(VIR_ERR_INTERNAL_ERROR,
                            _("Unexpected JSON reply '%s'"), line);
@@ -257,36 +301,47 @@ qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
     return ret;
 }
 
+/*
+ * Process all complete lines in @data. The lines are parsed in place,
+ * so @data must be writable and NUL terminated at @len.
+ *
+ * @scanned is the number of bytes of @data a previous call already
+ * searched for a line ending without finding one; it is updated so
+ * that a reply arriving in many pieces is only scanned once.
+ *
+ * Returns the number of bytes consumed or -1 on error.
+ */
 int qemuMonitorJSONIOProcess(qemuMonitorPtr mon,
-                             const char *data,
+                             char *data,
                              size_t len,
+                             size_t *scanned,
                              qemuMonitorMessagePtr msg)
 {
-    int used = 0;
+    size_t endlen = strlen(LINE_ENDING);
+    size_t used = 0;
     /*VIR_DEBUG("Data %d bytes [%s]", len, data);*/
 
     while (used < len) {
-        char *nl = strstr(data + used, LINE_ENDING);
-
-        if (nl) {
-            int got = nl - (data + used);
-            char *line;
-            line = g_strndup(data + used, got);
-            used += got + strlen(LINE_ENDING);
-            line[got] = '\0'; /* kill \n */
-            if (qemuMonitorJSONIOProcessLine(mon, line, msg) < 0) {
-                VIR_FREE(line);
-                return -1;
-            }
+        char *line = data + used;
+        char *nl = strstr(data + MAX(used, *scanned), LINE_ENDING);
 
-            VIR_FREE(line);
-        } else {
+        if (!nl) {
+            /* the line ending might be split across two reads */
+            if (len - used >= endlen)
+                *scanned = len - endlen + 1;
             break;
         }
+
+        *nl = '\0'; /* kill \r\n */
+        used = nl - data + endlen;
+        *scanned = used;
+
+        if (qemuMonitorJSONIOProcessLine(mon, line, msg) < 0)
+            return -1;
     }
 
 #if DEBUG_IO
-    VIR_DEBUG("Total used %d bytes out of %zd available in buffer", used, len);
+    VIR_DEBUG("Total used %zu bytes out of %zu available in buffer", used, len);
 #endif
 
     return used;
@@ -353,6 +408,84 @@ qemuMonitorJSONCommand(qemuMonitorPtr mon,
     return qemuMonitorJSONCommandWithFd(mon, cmd, -1, reply);
 }
 
+
+/**
+ * qemuMonitorJSONCommandBatch:
+ * @mon: monitor object
+ * @cmds: array of commands
+ * @ncmds: number of commands in @cmds
+ * @replies: array of @ncmds filled with the replies
+ *
+ * Sends all @cmds to the monitor at once without waiting for the reply
+ * to one command before sending the next one, and waits until all of
+ * them are answered. This saves a round trip per command when several
+ * independent queries are needed. The replies are returned in the order
+ * of @cmds and have to be checked individually.
+ *
+ * Returns 0 on success and -1 on error, in which case no replies are
+ * returned.
+ */
+static int
+qemuMonitorJSONCommandBatch(qemuMonitorPtr mon,
+                            virJSONValuePtr *cmds,
+                            size_t ncmds,
+                            virJSONValuePtr *replies)
+{
+    int ret = -1;
+    qemuMonitorMessage msg;
+    g_auto(virBuffer) cmdbuf = VIR_BUFFER_INITIALIZER;
+    VIR_AUTOSTRINGLIST ids = NULL;
+    size_t i;
+
+    memset(&msg, 0, sizeof(msg));
+
+    ids = g_new0(char *, ncmds + 1);
+    msg.rxObjects = g_new0(void *, ncmds);
+
+    for (i = 0; i < ncmds; i++) {
+        ids[i] = qemuMonitorNextCommandID(mon);
+        if (virJSONValueObjectAppendString(cmds[i], "id", ids[i]) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Unable to append command 'id' string"));
+            goto cleanup;
+        }
+
+        if (virJSONValueToBuffer(cmds[i], &cmdbuf, false) < 0)
+            goto cleanup;
+        virBufferAddLit(&cmdbuf, "\r\n");
+    }
+
+    msg.txLength = virBufferUse(&cmdbuf);
+    msg.txBuffer = virBufferContentAndReset(&cmdbuf);
+    msg.txFD = -1;
+    msg.rxIds = ids;
+    msg.nrx = ncmds;
+
+    if (qemuMonitorSend(mon, &msg) < 0)
+        goto cleanup;
+
+    if (msg.nrxDone != ncmds) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Missing monitor reply object"));
+        goto cleanup;
+    }
+
+    for (i = 0; i < ncmds; i++) {
+        replies[i] = msg.rxObjects[i];
+        msg.rxObjects[i] = NULL;
+    }
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < ncmds; i++)
+        virJSONValueFree(msg.rxObjects[i]);
+    VIR_FREE(msg.rxObjects);
+    VIR_FREE(msg.txBuffer);
+
+    return ret;
+}
+
 /* Ignoring OOM in this method, since we're already reporting
  * a more important error
  *
@@ -2670,18 +2803,14 @@ qemuMonitorJSONQueryBlockstats(qemuMonitorPtr mon)
 }
 
 
-int
-qemuMonitorJSONGetAllBlockStatsInfo(qemuMonitorPtr mon,
-                                    virHashTablePtr hash,
-                                    bool backingChain)
+static int
+qemuMonitorJSONGetAllBlockStatsInfoParse(virJSONValuePtr devices,
+                                         virHashTablePtr hash,
+                                         bool backingChain)
 {
     int nstats = 0;
     int rc;
     size_t i;
-    g_autoptr(virJSONValue) devices = NULL;
-
-    if (!(devices = qemuMonitorJSONQueryBlockstats(mon)))
-        return -1;
 
     for (i = 0; i < virJSONValueArraySize(devices); i++) {
         virJSONValuePtr dev = virJSONValueArrayGet(devices, i);
@@ -2718,6 +2847,21 @@ qemuMonitorJSONGetAllBlockStatsInfo(qemuMonitorPtr mon,
 }
 
 
+int
+qemuMonitorJSONGetAllBlockStatsInfo(qemuMonitorPtr mon,
+                                    virHashTablePtr hash,
+                                    bool backingChain)
+{
+    g_autoptr(virJSONValue) devices = NULL;
+
+    if (!(devices = qemuMonitorJSONQueryBlockstats(mon)))
+        return -1;
+
+    return qemuMonitorJSONGetAllBlockStatsInfoParse(devices, hash,
+                                                    backingChain);
+}
+
+
 static int
 qemuMonitorJSONBlockStatsUpdateCapacityData(virJSONValuePtr image,
                                             const char *name,
@@ -2784,17 +2928,12 @@ qemuMonitorJSONBlockStatsUpdateCapacityOne(virJSONValuePtr image,
 }
 
 
-int
-qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
-                                        virHashTablePtr stats,
-                                        bool backingChain)
+static int
+qemuMonitorJSONBlockStatsUpdateCapacityParse(virJSONValuePtr devices,
+                                             virHashTablePtr stats,
+                                             bool backingChain)
 {
-    int ret = -1;
     size_t i;
-    virJSONValuePtr devices;
-
-    if (!(devices = qemuMonitorJSONQueryBlock(mon)))
-        return -1;
 
     for (i = 0; i < virJSONValueArraySize(devices); i++) {
         virJSONValuePtr dev;
@@ -2803,10 +2942,10 @@ qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
         const char *dev_name;
 
         if (!(dev = qemuMonitorJSONGetBlockDev(devices, i)))
-            goto cleanup;
+            return -1;
 
         if (!(dev_name = qemuMonitorJSONGetBlockDevDevice(dev)))
-            goto cleanup;
+            return -1;
 
         /* drive may be empty */
         if (!(inserted = virJSONValueObjectGetObject(dev, "inserted")) ||
@@ -2816,14 +2955,25 @@ qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
         if (qemuMonitorJSONBlockStatsUpdateCapacityOne(image, dev_name, 0,
                                                        stats,
                                                        backingChain) < 0)
-            goto cleanup;
+            return -1;
     }
 
-    ret = 0;
+    return 0;
+}
 
- cleanup:
-    virJSONValueFree(devices);
-    return ret;
+
+int
+qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
+                                        virHashTablePtr stats,
+                                        bool backingChain)
+{
+    g_autoptr(virJSONValue) devices = NULL;
+
+    if (!(devices = qemuMonitorJSONQueryBlock(mon)))
+        return -1;
+
+    return qemuMonitorJSONBlockStatsUpdateCapacityParse(devices, stats,
+                                                        backingChain);
 }
 
 
@@ -2878,6 +3028,97 @@ qemuMonitorJSONBlockStatsUpdateCapacityBlockdev(qemuMonitorPtr mon,
 }
 
 
+/**
+ * qemuMonitorJSONGetAllBlockStatsInfoFull:
+ * @mon: monitor object
+ * @hash: hash table filled with the stats
+ * @backingChain: whether to report stats of the backing chain too
+ * @blockdev: whether the VM uses -blockdev
+ * @nodedata: filled with the 'query-named-block-nodes' reply if non-NULL
+ *
+ * Fetches the block statistics together with the capacity of the images
+ * and optionally the data of the named block nodes. The queries are
+ * pipelined so that only one round trip to the monitor is needed.
+ *
+ * Failure to fetch the capacity or @nodedata is not fatal; an error is
+ * reported, but the stats are returned.
+ *
+ * Returns the maximum number of stats per device or -1 on error.
+ */
+int
+qemuMonitorJSONGetAllBlockStatsInfoFull(qemuMonitorPtr mon,
+                                        virHashTablePtr hash,
+                                        bool backingChain,
+                                        bool blockdev,
+                                        virJSONValuePtr *nodedata)
+{
+    virJSONValuePtr cmds[3] = { NULL };
+    virJSONValuePtr replies[3] = { NULL };
+    size_t ncmds = 0;
+    size_t capacitycmd;
+    size_t nodescmd = 0;
+    virJSONValuePtr array;
+    size_t i;
+    int ret = -1;
+
+    if (!(cmds[ncmds++] = qemuMonitorJSONMakeCommand("query-blockstats", NULL)))
+        goto cleanup;
+
+    capacitycmd = ncmds;
+    if (!(cmds[ncmds++] = qemuMonitorJSONMakeCommand(blockdev ?
+                                                     "query-named-block-nodes" :
+                                                     "query-block", NULL)))
+        goto cleanup;
+
+    if (nodedata) {
+        nodescmd = capacitycmd;
+        if (!blockdev) {
+            nodescmd = ncmds;
+            if (!(cmds[ncmds++] = qemuMonitorJSONMakeCommand("query-named-block-nodes",
+                                                             NULL)))
+                goto cleanup;
+        }
+    }
+
+    if (qemuMonitorJSONCommandBatch(mon, cmds, ncmds, replies) < 0)
+        goto cleanup;
+
+    if (qemuMonitorJSONCheckReply(cmds[0], replies[0], VIR_JSON_TYPE_ARRAY) < 0)
+        goto cleanup;
+
+    array = virJSONValueObjectGetArray(replies[0], "return");
+    if ((ret = qemuMonitorJSONGetAllBlockStatsInfoParse(array, hash,
+                                                        backingChain)) < 0)
+        goto cleanup;
+
+    if (qemuMonitorJSONCheckReply(cmds[capacitycmd], replies[capacitycmd],
+                                  VIR_JSON_TYPE_ARRAY) == 0) {
+        array = virJSONValueObjectGetArray(replies[capacitycmd], "return");
+
+        if (blockdev)
+            ignore_value(virJSONValueArrayForeachSteal(array,
+                                                       qemuMonitorJSONBlockStatsUpdateCapacityBlockdevWorker,
+                                                       hash));
+        else
+            ignore_value(qemuMonitorJSONBlockStatsUpdateCapacityParse(array,
+                                                                      hash,
+                                                                      backingChain));
+    }
+
+    if (nodedata &&
+        qemuMonitorJSONCheckReply(cmds[nodescmd], replies[nodescmd],
+                                  VIR_JSON_TYPE_ARRAY) == 0)
+        *nodedata = virJSONValueObjectStealArray(replies[nodescmd], "return");
+
+ cleanup:
+    for (i = 0; i < G_N_ELEMENTS(cmds); i++) {
+        virJSONValueFree(cmds[i]);
+        virJSONValueFree(replies[i]);
+    }
+    return ret;
+}
+
+
 static void
 qemuMonitorJSONBlockNamedNodeDataBitmapFree(qemuBlockNamedNodeDataBitmapPtr bitmap)
 {
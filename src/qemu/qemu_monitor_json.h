@@ -33,8 +33,9 @@ int qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
                                  qemuMonitorMessagePtr msg);
 
 int qemuMonitorJSONIOProcess(qemuMonitorPtr mon,
-                             const char *data,
+                             char *data,
                              size_t len,
+                             size_t *scanned,
                              qemuMonitorMessagePtr msg);
 
 int qemuMonitorJSONHumanCommand(qemuMonitorPtr mon,
@@ -86,6 +87,11 @@ int qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
                                             bool backingChain);
 int qemuMonitorJSONBlockStatsUpdateCapacityBlockdev(qemuMonitorPtr mon,
                                                     virHashTablePtr stats);
+int qemuMonitorJSONGetAllBlockStatsInfoFull(qemuMonitorPtr mon,
+                                            virHashTablePtr hash,
+                                            bool backingChain,
+                                            bool blockdev,
+                                            virJSONValuePtr *nodedata);
 
 virHashTablePtr
 qemuMonitorJSONBlockGetNamedNodeDataJSON(virJSONValuePtr nodes);
@@ -57,6 +57,7 @@
 #include "util/virnetdevopenvswitch.h"
 #include "virsystemd.h"
 #include "virhostuptime.h"
+#include "virfirewall.h"
 
 #include "driver.h"
 
@@ -725,7 +726,18 @@ static void daemonReloadHandler(virNetDaemonPtr dmn G_GNUC_UNUSED,
     }
 }
 
-static int daemonSetupSignals(virNetDaemonPtr dmn)
+static void daemonDumpLogHandler(virNetDaemonPtr dmn G_GNUC_UNUSED,
+                                 siginfo_t *sig G_GNUC_UNUSED,
+                                 void *opaque)
+{
+    bool privileged = !!opaque;
+
+    if (virLogDumpMemoryToFile(DAEMON_NAME, privileged) < 0)
+        VIR_WARN("Failed to dump recorded log messages: %s",
+                 virGetLastErrorMessage());
+}
+
+static int daemonSetupSignals(virNetDaemonPtr dmn, bool privileged)
 {
     if (virNetDaemonAddSignalHandler(dmn, SIGINT, daemonShutdownHandler, NULL) < 0)
         return -1;
@@ -735,6 +747,9 @@ static int daemonSetupSignals(virNetDaemonPtr dmn)
         return -1;
     if (virNetDaemonAddSignalHandler(dmn, SIGHUP, daemonReloadHandler, NULL) < 0)
         return -1;
+    if (virNetDaemonAddSignalHandler(dmn, SIGUSR2, daemonDumpLogHandler,
+                                     privileged ? (void *) 1 : NULL) < 0)
+        return -1;
     return 0;
 }
 
@@ -920,6 +935,23 @@ daemonSetupHostUUID(const struct daemonConfig *config)
     return 0;
 }
 
+static int
+daemonSetupFirewall(const struct daemonConfig *config,
+                    bool privileged)
+{
+    int backend;
+
+    if (!config->firewall_backend || !privileged)
+        return 0;
+
+    if ((backend = virFirewallBackendTypeFromString(config->firewall_backend)) < 0) {
+        VIR_ERROR(_("invalid firewall backend: %s"), config->firewall_backend);
+        return -1;
+    }
+
+    return virFirewallSetBackend(backend);
+}
+
 typedef struct {
     const char *opts;
     const char *help;
@@ -1156,6 +1188,12 @@ int main(int argc, char **argv) {
         exit(EXIT_FAILURE);
     }
 
+    if (daemonSetupFirewall(config, privileged) < 0) {
+        VIR_ERROR(_("Can't setup firewall backend: %s"),
+                  virGetLastErrorMessage());
+        exit(EXIT_FAILURE);
+    }
+
     /* Let's try to initialize global variable that holds the host's boot time. */
     if (virHostBootTimeInit() < 0) {
         /* This is acceptable failure. Maybe we won't need the boot time
@@ -1210,6 +1248,14 @@ int main(int argc, char **argv) {
         }
     }
 
+    /* The writer thread has to be started after we've forked */
+    if (config->log_async &&
+        virLogStartAsync() < 0) {
+        VIR_ERROR(_("Failed to enable asynchronous logging: %s"),
+                  virGetLastErrorMessage());
+        goto cleanup;
+    }
+
     /* Try to claim the pidfile, exiting if we can't */
     if ((pid_file_fd = virPidFileAcquirePath(pid_file, false, getpid())) < 0) {
         ret = VIR_DAEMON_ERR_PIDFILE;
@@ -1351,7 +1397,7 @@ int main(int argc, char **argv) {
         virNetDaemonAutoShutdown(dmn, timeout);
     }
 
-    if ((daemonSetupSignals(dmn)) < 0) {
+    if ((daemonSetupSignals(dmn, privileged)) < 0) {
         ret = VIR_DAEMON_ERR_SIGNAL;
         goto cleanup;
     }
@@ -1485,5 +1531,7 @@ int main(int argc, char **argv) {
     VIR_FREE(remote_config_file);
     daemonConfigFree(config);
 
+    virLogStopAsync();
+
     return ret;
 }
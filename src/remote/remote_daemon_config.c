@@ -217,6 +217,7 @@ daemonConfigFree(struct daemonConfig *data)
 
     VIR_FREE(data->host_uuid);
     VIR_FREE(data->host_uuid_source);
+    VIR_FREE(data->firewall_backend);
     VIR_FREE(data->log_filters);
     VIR_FREE(data->log_outputs);
 
@@ -348,12 +349,17 @@ daemonConfigLoadOptions(struct daemonConfig *data,
     if (virConfGetValueString(conf, "host_uuid_source", &data->host_uuid_source) < 0)
         return -1;
 
+    if (virConfGetValueString(conf, "firewall_backend", &data->firewall_backend) < 0)
+        return -1;
+
     if (virConfGetValueUInt(conf, "log_level", &data->log_level) < 0)
         return -1;
     if (virConfGetValueString(conf, "log_filters", &data->log_filters) < 0)
         return -1;
     if (virConfGetValueString(conf, "log_outputs", &data->log_outputs) < 0)
         return -1;
+    if (virConfGetValueBool(conf, "log_async", &data->log_async) < 0)
+        return -1;
 
     if (virConfGetValueInt(conf, "keepalive_interval", &data->keepalive_interval) < 0)
         return -1;
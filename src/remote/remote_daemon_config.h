@@ -26,6 +26,7 @@
 struct daemonConfig {
     char *host_uuid;
     char *host_uuid_source;
+    char *firewall_backend;
 
 #ifdef WITH_IP
     bool listen_tls;
@@ -78,6 +79,7 @@ struct daemonConfig {
     unsigned int log_level;
     char *log_filters;
     char *log_outputs;
+    bool log_async;
 
     unsigned int audit_level;
     bool audit_logging;
@@ -1039,6 +1039,16 @@ virNetServerGetThreadPoolParameters(virNetServerPtr srv,
     return 0;
 }
 
+int
+virNetServerGetThreadPoolStats(virNetServerPtr srv,
+                               virThreadPoolStatsPtr stats)
+{
+    virObjectLock(srv);
+    virThreadPoolGetStats(srv->workers, stats);
+    virObjectUnlock(srv);
+    return 0;
+}
+
 int
 virNetServerSetThreadPoolParameters(virNetServerPtr srv,
                                     long long int minWorkers,
@@ -28,6 +28,7 @@
 #include "virobject.h"
 #include "virjson.h"
 #include "virsystemd.h"
+#include "virthreadpool.h"
 
 
 virNetServerPtr virNetServerNew(const char *name,
@@ -109,6 +110,9 @@ int virNetServerGetThreadPoolParameters(virNetServerPtr srv,
                                         size_t *nPrioWorkers,
                                         size_t *jobQueueDepth);
 
+int virNetServerGetThreadPoolStats(virNetServerPtr srv,
+                                   virThreadPoolStatsPtr stats);
+
 int virNetServerSetThreadPoolParameters(virNetServerPtr srv,
                                         long long int minWorkers,
                                         long long int maxWorkers,
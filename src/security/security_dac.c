@@ -81,6 +81,7 @@ struct _virSecurityDACChownItem {
     gid_t gid;
     bool remember; /* Whether owner remembering should be done for @path/@src */
     bool restore; /* Whether current operation is 'set' or 'restore' */
+    bool skip; /* Whether an earlier item already does the same on @path */
 };
 
 typedef struct _virSecurityDACChownList virSecurityDACChownList;
@@ -201,6 +202,77 @@ static int virSecurityDACRestoreFileLabelInternal(virSecurityManagerPtr mgr,
                                                   const virStorageSource *src,
                                                   const char *path,
                                                   bool recall);
+/**
+ * virSecurityDACChownListDedup:
+ * @list: transaction list
+ *
+ * Marks items that would just repeat what the previous item touching
+ * the same path does. Items that remember the original owner are
+ * never skipped, each of them holds a reference on the remembered
+ * owner.
+ *
+ * Returns: the number of items marked to be skipped.
+ */
+static size_t
+virSecurityDACChownListDedup(virSecurityDACChownListPtr list)
+{
+    size_t ndups = 0;
+    size_t i, j;
+
+    for (i = 0; i < list->nItems; i++) {
+        virSecurityDACChownItemPtr item = list->items[i];
+
+        if (!item->path || (item->remember && list->lock))
+            continue;
+
+        for (j = i; j > 0; j--) {
+            virSecurityDACChownItemPtr prev = list->items[j - 1];
+
+            if (STRNEQ_NULLABLE(prev->path, item->path))
+                continue;
+
+            if (!(prev->remember && list->lock) &&
+                prev->restore == item->restore &&
+                prev->uid == item->uid &&
+                prev->gid == item->gid) {
+                item->skip = true;
+                ndups++;
+            }
+            break;
+        }
+    }
+
+    return ndups;
+}
+
+
+static int
+virSecurityDACTransactionRunItem(size_t idx,
+                                 void *opaque)
+{
+    virSecurityDACChownListPtr list = opaque;
+    virSecurityDACChownItemPtr item = list->items[idx];
+    const bool remember = item->remember && list->lock;
+
+    if (item->skip)
+        return 0;
+
+    if (!item->restore) {
+        return virSecurityDACSetOwnership(list->manager,
+                                          item->src,
+                                          item->path,
+                                          item->uid,
+                                          item->gid,
+                                          remember);
+    }
+
+    return virSecurityDACRestoreFileLabelInternal(list->manager,
+                                                  item->src,
+                                                  item->path,
+                                                  remember);
+}
+
+
 /**
  * virSecurityDACTransactionRun:
  * @pid: process pid
@@ -222,6 +294,9 @@ virSecurityDACTransactionRun(pid_t pid G_GNUC_UNUSED,
     virSecurityManagerMetadataLockStatePtr state;
     const char **paths = NULL;
     size_t npaths = 0;
+    const char **relabelPaths = NULL;
+    bool *done = NULL;
+    size_t ndups;
     size_t i;
     int rv = 0;
     int ret = -1;
@@ -256,32 +331,32 @@ virSecurityDACTransactionRun(pid_t pid G_GNUC_UNUSED,
         }
     }
 
+    ndups = virSecurityDACChownListDedup(list);
+
+    relabelPaths = g_new0(const char *, list->nItems);
+    done = g_new0(bool, list->nItems);
     for (i = 0; i < list->nItems; i++) {
         virSecurityDACChownItemPtr item = list->items[i];
-        const bool remember = item->remember && list->lock;
-
-        if (!item->restore) {
-            rv = virSecurityDACSetOwnership(list->manager,
-                                            item->src,
-                                            item->path,
-                                            item->uid,
-                                            item->gid,
-                                            remember);
-        } else {
-            rv = virSecurityDACRestoreFileLabelInternal(list->manager,
-                                                        item->src,
-                                                        item->path,
-                                                        remember);
-        }
 
-        if (rv < 0)
-            break;
+        relabelPaths[i] = item->path;
+        if (!relabelPaths[i] && item->src)
+            relabelPaths[i] = item->src->path;
     }
 
-    for (; rv < 0 && i > 0; i--) {
+    rv = virSecurityRelabelParallel(relabelPaths, list->nItems,
+                                    virSecurityDACTransactionRunItem,
+                                    list, done);
+
+    VIR_DEBUG("Relabelled %zu paths, skipped %zu duplicates",
+              list->nItems - ndups, ndups);
+
+    for (i = list->nItems; rv < 0 && i > 0; i--) {
         virSecurityDACChownItemPtr item = list->items[i - 1];
         const bool remember = item->remember && list->lock;
 
+        if (!done[i - 1] || item->skip)
+            continue;
+
         if (!item->restore) {
             virSecurityDACRestoreFileLabelInternal(list->manager,
                                                    item->src,
@@ -302,6 +377,8 @@ virSecurityDACTransactionRun(pid_t pid G_GNUC_UNUSED,
     ret = 0;
  cleanup:
     VIR_FREE(paths);
+    VIR_FREE(relabelPaths);
+    VIR_FREE(done);
     return ret;
 }
 
@@ -622,6 +699,7 @@ virSecurityDACTransactionCommit(virSecurityManagerPtr mgr G_GNUC_UNUSED,
                                 bool lock)
 {
     virSecurityDACChownListPtr list;
+    unsigned long long start;
     int rc;
     int ret = -1;
 
@@ -639,6 +717,7 @@ virSecurityDACTransactionCommit(virSecurityManagerPtr mgr G_GNUC_UNUSED,
     }
 
     list->lock = lock;
+    start = g_get_monotonic_time();
 
     if (pid == -1) {
         if (lock)
@@ -651,6 +730,10 @@ virSecurityDACTransactionCommit(virSecurityManagerPtr mgr G_GNUC_UNUSED,
                                            list);
     }
 
+    VIR_DEBUG("Relabelling %zu paths for pid %lld took %llu ms",
+              list->nItems, (long long) pid,
+              (g_get_monotonic_time() - start) / 1000);
+
     if (rc < 0)
         goto cleanup;
 
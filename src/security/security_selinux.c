@@ -79,6 +79,7 @@ struct _virSecuritySELinuxContextItem {
     char *tcon;
     bool remember; /* Whether owner remembering should be done for @path/@src */
     bool restore; /* Whether current operation is 'set' or 'restore' */
+    bool skip; /* Whether an earlier item already does the same on @path */
 };
 
 typedef struct _virSecuritySELinuxContextList virSecuritySELinuxContextList;
@@ -101,6 +102,10 @@ virSecuritySELinuxRestoreTPMFileLabelInt(virSecurityManagerPtr mgr,
 
 virThreadLocal contextList;
 
+/* Transactions relabel paths from several threads, but a selabel
+ * handle must not be used by more than one at a time */
+static virMutex labelHandleLock = VIR_MUTEX_INITIALIZER;
+
 
 static void
 virSecuritySELinuxContextItemFree(virSecuritySELinuxContextItemPtr item)
@@ -233,6 +238,73 @@ static int virSecuritySELinuxRestoreFileLabel(virSecurityManagerPtr mgr,
                                               bool recall);
 
 
+/**
+ * virSecuritySELinuxContextListDedup:
+ * @list: transaction list
+ *
+ * Marks items that would just repeat what the previous item touching
+ * the same path does. Items that remember the original label are
+ * never skipped, each of them holds a reference on the remembered
+ * label.
+ *
+ * Returns: the number of items marked to be skipped.
+ */
+static size_t
+virSecuritySELinuxContextListDedup(virSecuritySELinuxContextListPtr list)
+{
+    size_t ndups = 0;
+    size_t i, j;
+
+    for (i = 0; i < list->nItems; i++) {
+        virSecuritySELinuxContextItemPtr item = list->items[i];
+
+        if (item->remember && list->lock)
+            continue;
+
+        for (j = i; j > 0; j--) {
+            virSecuritySELinuxContextItemPtr prev = list->items[j - 1];
+
+            if (STRNEQ(prev->path, item->path))
+                continue;
+
+            if (!(prev->remember && list->lock) &&
+                prev->restore == item->restore &&
+                STREQ_NULLABLE(prev->tcon, item->tcon)) {
+                item->skip = true;
+                ndups++;
+            }
+            break;
+        }
+    }
+
+    return ndups;
+}
+
+
+static int
+virSecuritySELinuxTransactionRunItem(size_t idx,
+                                     void *opaque)
+{
+    virSecuritySELinuxContextListPtr list = opaque;
+    virSecuritySELinuxContextItemPtr item = list->items[idx];
+    const bool remember = item->remember && list->lock;
+
+    if (item->skip)
+        return 0;
+
+    if (!item->restore) {
+        return virSecuritySELinuxSetFilecon(list->manager,
+                                            item->path,
+                                            item->tcon,
+                                            remember);
+    }
+
+    return virSecuritySELinuxRestoreFileLabel(list->manager,
+                                              item->path,
+                                              remember);
+}
+
+
 /**
  * virSecuritySELinuxTransactionRun:
  * @pid: process pid
@@ -253,6 +325,9 @@ virSecuritySELinuxTransactionRun(pid_t pid G_GNUC_UNUSED,
     virSecurityManagerMetadataLockStatePtr state;
     const char **paths = NULL;
     size_t npaths = 0;
+    const char **relabelPaths = NULL;
+    bool *done = NULL;
+    size_t ndups;
     size_t i;
     int rv;
     int ret = -1;
@@ -287,30 +362,27 @@ virSecuritySELinuxTransactionRun(pid_t pid G_GNUC_UNUSED,
         }
     }
 
-    rv = 0;
-    for (i = 0; i < list->nItems; i++) {
-        virSecuritySELinuxContextItemPtr item = list->items[i];
-        const bool remember = item->remember && list->lock;
+    ndups = virSecuritySELinuxContextListDedup(list);
 
-        if (!item->restore) {
-            rv = virSecuritySELinuxSetFilecon(list->manager,
-                                              item->path,
-                                              item->tcon,
-                                              remember);
-        } else {
-            rv = virSecuritySELinuxRestoreFileLabel(list->manager,
-                                                    item->path,
-                                                    remember);
-        }
+    relabelPaths = g_new0(const char *, list->nItems);
+    done = g_new0(bool, list->nItems);
+    for (i = 0; i < list->nItems; i++)
+        relabelPaths[i] = list->items[i]->path;
 
-        if (rv < 0)
-            break;
-    }
+    rv = virSecurityRelabelParallel(relabelPaths, list->nItems,
+                                    virSecuritySELinuxTransactionRunItem,
+                                    list, done);
+
+    VIR_DEBUG("Relabelled %zu paths, skipped %zu duplicates",
+              list->nItems - ndups, ndups);
 
-    for (; rv < 0 && i > 0; i--) {
+    for (i = list->nItems; rv < 0 && i > 0; i--) {
         virSecuritySELinuxContextItemPtr item = list->items[i - 1];
         const bool remember = item->remember && list->lock;
 
+        if (!done[i - 1] || item->skip)
+            continue;
+
         if (!item->restore) {
             virSecuritySELinuxRestoreFileLabel(list->manager,
                                                item->path,
@@ -329,6 +401,8 @@ virSecuritySELinuxTransactionRun(pid_t pid G_GNUC_UNUSED,
     ret = 0;
  cleanup:
     VIR_FREE(paths);
+    VIR_FREE(relabelPaths);
+    VIR_FREE(done);
     return ret;
 }
 
@@ -1145,6 +1219,7 @@ virSecuritySELinuxTransactionCommit(virSecurityManagerPtr mgr G_GNUC_UNUSED,
                                     bool lock)
 {
     virSecuritySELinuxContextListPtr list;
+    unsigned long long start;
     int rc;
     int ret = -1;
 
@@ -1162,6 +1237,7 @@ virSecuritySELinuxTransactionCommit(virSecurityManagerPtr mgr G_GNUC_UNUSED,
     }
 
     list->lock = lock;
+    start = g_get_monotonic_time();
 
     if (pid == -1) {
         if (lock)
@@ -1174,6 +1250,10 @@ virSecuritySELinuxTransactionCommit(virSecurityManagerPtr mgr G_GNUC_UNUSED,
                                            list);
     }
 
+    VIR_DEBUG("Relabelling %zu paths for pid %lld took %llu ms",
+              list->nItems, (long long) pid,
+              (g_get_monotonic_time() - start) / 1000);
+
     if (rc < 0)
         goto cleanup;
 
@@ -1263,9 +1343,21 @@ virSecuritySELinuxSetFileconImpl(const char *path,
                                  const char *tcon,
                                  bool privileged)
 {
+    security_context_t econ = NULL;
+
     /* Be aware that this function might run in a separate process.
      * Therefore, any driver state changes would be thrown away. */
 
+    if (getfilecon_raw(path, &econ) >= 0) {
+        bool same = STREQ_NULLABLE(econ, tcon);
+
+        freecon(econ);
+        if (same) {
+            VIR_DEBUG("SELinux context on '%s' is already '%s'", path, tcon);
+            return 0;
+        }
+    }
+
     VIR_INFO("Setting SELinux context on '%s' to '%s'", path, tcon);
 
     if (setfilecon_raw(path, (const char *)tcon) < 0) {
@@ -1435,8 +1527,13 @@ getContext(virSecurityManagerPtr mgr G_GNUC_UNUSED,
            const char *newpath, mode_t mode, security_context_t *fcon)
 {
     virSecuritySELinuxDataPtr data = virSecurityManagerGetPrivateData(mgr);
+    int ret;
+
+    virMutexLock(&labelHandleLock);
+    ret = selabel_lookup_raw(data->label_handle, fcon, newpath, mode);
+    virMutexUnlock(&labelHandleLock);
 
-    return selabel_lookup_raw(data->label_handle, fcon, newpath, mode);
+    return ret;
 }
 
 
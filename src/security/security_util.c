@@ -18,6 +18,8 @@
 
 #include <config.h>
 
+#include <sys/stat.h>
+
 #include "viralloc.h"
 #include "virfile.h"
 #include "virstring.h"
@@ -25,6 +27,7 @@
 #include "virlog.h"
 #include "viruuid.h"
 #include "virhostuptime.h"
+#include "virthread.h"
 
 #include "security_util.h"
 
@@ -528,3 +531,191 @@ virSecurityMoveRememberedLabel(const char *name,
 
     return 0;
 }
+
+
+/* Maximum number of threads relabelling paths of a single transaction */
+#define VIR_SECURITY_RELABEL_WORKERS 8
+
+typedef struct _virSecurityRelabelGroup virSecurityRelabelGroup;
+struct _virSecurityRelabelGroup {
+    /* Paths are grouped by the inode they point to. If the path can't
+     * be stat()-ed, the canonical path is used instead. */
+    bool havestat;
+    dev_t dev;
+    ino_t ino;
+    char *canonpath;
+
+    size_t *items;
+    size_t nitems;
+};
+
+typedef struct _virSecurityRelabelData virSecurityRelabelData;
+struct _virSecurityRelabelData {
+    virSecurityRelabelFunc func;
+    void *opaque;
+    bool *done;
+
+    virMutex lock;
+    virSecurityRelabelGroup *groups;
+    size_t ngroups;
+    size_t next;  /* first group not yet picked up by a worker */
+    bool failed;
+    virErrorPtr err;  /* first error reported by @func */
+};
+
+
+static void
+virSecurityRelabelWorker(void *opaque)
+{
+    virSecurityRelabelData *data = opaque;
+    virSecurityRelabelGroup *group;
+    size_t i;
+
+    while (true) {
+        virMutexLock(&data->lock);
+        if (data->failed || data->next == data->ngroups) {
+            virMutexUnlock(&data->lock);
+            return;
+        }
+        group = &data->groups[data->next++];
+        virMutexUnlock(&data->lock);
+
+        for (i = 0; i < group->nitems; i++) {
+            size_t item = group->items[i];
+
+            if (data->func(item, data->opaque) < 0) {
+                /* Errors are thread local, so hand the first one over
+                 * to the thread that is waiting for us */
+                virMutexLock(&data->lock);
+                data->failed = true;
+                if (!data->err)
+                    virErrorPreserveLast(&data->err);
+                virMutexUnlock(&data->lock);
+                break;
+            }
+
+            data->done[item] = true;
+        }
+    }
+}
+
+
+/**
+ * virSecurityRelabelParallel:
+ * @paths: path touched by each item (NULL if not known)
+ * @nitems: number of items
+ * @func: callback relabelling a single item
+ * @opaque: data passed to @func
+ * @done: array of @nitems booleans
+ *
+ * Calls @func for each of @nitems items of a relabel transaction, using
+ * up to VIR_SECURITY_RELABEL_WORKERS threads. Items whose paths lead to
+ * the same inode are processed by a single thread in the order they were
+ * given, so that the remembered label and its refcount are updated in
+ * sequence.
+ * Once @func fails no further items are started.
+ *
+ * Upon return, @done is set to true for every item @func succeeded on,
+ * so that the caller can roll them back if needed.
+ *
+ * Returns: 0 on success,
+ *         -1 otherwise (with the first error reported by @func set).
+ */
+int
+virSecurityRelabelParallel(const char **paths,
+                           size_t nitems,
+                           virSecurityRelabelFunc func,
+                           void *opaque,
+                           bool *done)
+{
+    virSecurityRelabelData data = {
+        .func = func, .opaque = opaque, .done = done
+    };
+    g_autofree virThread *workers = NULL;
+    size_t maxworkers;
+    size_t nworkers = 0;
+    size_t i, j;
+
+    if (nitems == 0)
+        return 0;
+
+    if (virMutexInit(&data.lock) < 0) {
+        virReportSystemError(errno, "%s", _("unable to init mutex"));
+        return -1;
+    }
+
+    data.groups = g_new0(virSecurityRelabelGroup, nitems);
+
+    for (i = 0; i < nitems; i++) {
+        virSecurityRelabelGroup *group = NULL;
+        g_autofree char *canonpath = NULL;
+        struct stat sb;
+        bool havestat = false;
+
+        /* Several paths may lead to the same inode (symlinks, the
+         * /dev/disk/by-* links, different spellings of a backing
+         * file). The remembered label and its refcount live on the
+         * inode, so all of them must be handled by one thread. */
+        if (paths[i]) {
+            if (stat(paths[i], &sb) == 0)
+                havestat = true;
+            else if (!(canonpath = virFileCanonicalizePath(paths[i])))
+                canonpath = g_strdup(paths[i]);
+        }
+
+        for (j = 0; paths[i] && j < data.ngroups; j++) {
+            virSecurityRelabelGroup *tmp = &data.groups[j];
+
+            if (havestat ?
+                (tmp->havestat && tmp->dev == sb.st_dev && tmp->ino == sb.st_ino) :
+                STREQ_NULLABLE(tmp->canonpath, canonpath)) {
+                group = tmp;
+                break;
+            }
+        }
+
+        if (!group) {
+            group = &data.groups[data.ngroups++];
+            if (havestat) {
+                group->havestat = true;
+                group->dev = sb.st_dev;
+                group->ino = sb.st_ino;
+            } else {
+                group->canonpath = g_steal_pointer(&canonpath);
+            }
+        }
+
+        ignore_value(VIR_APPEND_ELEMENT_COPY(group->items, group->nitems, i));
+    }
+
+    /* The calling thread is a worker too, so a transaction touching
+     * a single path doesn't spawn any thread at all */
+    maxworkers = MIN(data.ngroups, VIR_SECURITY_RELABEL_WORKERS);
+    workers = g_new0(virThread, maxworkers);
+    for (i = 1; i < maxworkers; i++) {
+        if (virThreadCreate(&workers[nworkers], true,
+                            virSecurityRelabelWorker, &data) < 0) {
+            VIR_WARN("Failed to spawn relabel worker, continuing with %zu",
+                     nworkers + 1);
+            break;
+        }
+        nworkers++;
+    }
+
+    virSecurityRelabelWorker(&data);
+
+    for (i = 0; i < nworkers; i++)
+        virThreadJoin(&workers[i]);
+
+    if (data.err)
+        virErrorRestore(&data.err);
+
+    for (i = 0; i < data.ngroups; i++) {
+        g_free(data.groups[i].items);
+        g_free(data.groups[i].canonpath);
+    }
+    g_free(data.groups);
+    virMutexDestroy(&data.lock);
+
+    return data.failed ? -1 : 0;
+}
@@ -32,3 +32,13 @@ int
 virSecurityMoveRememberedLabel(const char *name,
                                const char *src,
                                const char *dst);
+
+typedef int (*virSecurityRelabelFunc)(size_t item,
+                                      void *opaque);
+
+int
+virSecurityRelabelParallel(const char **paths,
+                           size_t nitems,
+                           virSecurityRelabelFunc func,
+                           void *opaque,
+                           bool *done);
@@ -100,6 +100,8 @@ virStorageBackendNamespaceInit(int poolType,
 
 #define READ_BLOCK_SIZE_DEFAULT  (1024 * 1024)
 #define WRITE_BLOCK_SIZE_DEFAULT (4 * 1024)
+#define COPY_BLOCK_SIZE_MAX      (1024 * 1024 * 1024)
+#define WIPE_BLOCK_SIZE_DEFAULT  (1024 * 1024)
 
 /*
  * Perform the O(1) btrfs clone operation, if possible.
@@ -122,21 +124,183 @@ reflinkCloneFile(int dest_fd G_GNUC_UNUSED,
 #endif
 
 
+/*
+ * Check whether the @len bytes at @buf are all zero. Comparing the
+ * buffer against itself shifted by one byte lets the (vectorized)
+ * memcmp() do the scanning without a separate zero-filled buffer.
+ */
+static bool
+storageBackendIsZeroBlock(const char *buf,
+                          size_t len)
+{
+    if (len == 0)
+        return true;
+
+    return buf[0] == 0 && memcmp(buf, buf + 1, len - 1) == 0;
+}
+
+
+/*
+ * Copy up to @len bytes from the current position in @inputfd to the
+ * current position in @fd without bouncing the data through userspace.
+ * Filesystems supporting it may share the extents instead of copying.
+ * @copied is incremented by the amount copied, which is less than @len
+ * only on EOF or when falling back.
+ *
+ * Returns 0 on success, 1 if the kernel or the files involved do not
+ * support offloaded copying (the caller should continue with a plain
+ * read/write loop), or -errno on error.
+ */
+#if HAVE_COPY_FILE_RANGE
+static int
+storageBackendCopyExtentOffload(virStorageVolDefPtr vol,
+                                virStorageVolDefPtr inputvol,
+                                int inputfd,
+                                int fd,
+                                unsigned long long len,
+                                unsigned long long *copied)
+{
+    while (*copied < len) {
+        size_t chunk = MIN(len - *copied, COPY_BLOCK_SIZE_MAX);
+        ssize_t amtcopied;
+
+        if ((amtcopied = copy_file_range(inputfd, NULL, fd, NULL,
+                                         chunk, 0)) < 0) {
+            int ret = -errno;
+
+            if (errno == EINTR)
+                continue;
+
+            if (errno == ENOSYS || errno == EXDEV || errno == EINVAL ||
+                errno == EOPNOTSUPP || errno == ENOTSUP)
+                return 1;
+
+            virReportSystemError(errno,
+                                 _("failed to copy data from '%s' to '%s'"),
+                                 inputvol->target.path, vol->target.path);
+            return ret;
+        }
+
+        if (amtcopied == 0)
+            break;
+
+        *copied += amtcopied;
+    }
+
+    return 0;
+}
+#else /* !HAVE_COPY_FILE_RANGE */
+static int
+storageBackendCopyExtentOffload(virStorageVolDefPtr vol G_GNUC_UNUSED,
+                                virStorageVolDefPtr inputvol G_GNUC_UNUSED,
+                                int inputfd G_GNUC_UNUSED,
+                                int fd G_GNUC_UNUSED,
+                                unsigned long long len G_GNUC_UNUSED,
+                                unsigned long long *copied G_GNUC_UNUSED)
+{
+    return 1;
+}
+#endif /* !HAVE_COPY_FILE_RANGE */
+
+
+/*
+ * Copy up to @len bytes from the current position in @inputfd to the
+ * current position in @fd through @buf. If @detect_zeroes is true,
+ * @wbytes sized blocks which are all zero are skipped over instead of
+ * being written. @copied is incremented by the amount copied, which
+ * is less than @len only on EOF.
+ *
+ * Returns 0 on success, -errno on error.
+ */
+static int
+storageBackendCopyExtentBuffered(virStorageVolDefPtr vol,
+                                 virStorageVolDefPtr inputvol,
+                                 int inputfd,
+                                 int fd,
+                                 char *buf,
+                                 size_t wbytes,
+                                 unsigned long long len,
+                                 bool detect_zeroes,
+                                 unsigned long long *copied)
+{
+    int ret;
+
+    while (*copied < len) {
+        size_t rbytes = MIN(len - *copied, READ_BLOCK_SIZE_DEFAULT);
+        size_t offset;
+        size_t interval;
+        ssize_t amtread;
+
+        if ((amtread = saferead(inputfd, buf, rbytes)) < 0) {
+            ret = -errno;
+            virReportSystemError(errno,
+                                 _("failed reading from file '%s'"),
+                                 inputvol->target.path);
+            return ret;
+        }
+
+        if (amtread == 0)
+            break;
+
+        *copied += amtread;
+
+        /* Loop over amt read in wbytes increments, looking for sparse
+         * blocks */
+        for (offset = 0; offset < (size_t) amtread; offset += interval) {
+            interval = MIN(wbytes, (size_t) amtread - offset);
+
+            if (detect_zeroes &&
+                storageBackendIsZeroBlock(buf + offset, interval)) {
+                if (lseek(fd, interval, SEEK_CUR) < 0) {
+                    ret = -errno;
+                    virReportSystemError(errno,
+                                         _("cannot extend file '%s'"),
+                                         vol->target.path);
+                    return ret;
+                }
+            } else if (safewrite(fd, buf + offset, interval) < 0) {
+                ret = -errno;
+                virReportSystemError(errno,
+                                     _("failed writing to file '%s'"),
+                                     vol->target.path);
+                return ret;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+/*
+ * Copy @inputvol into @fd, decrementing @total by the amount of data
+ * consumed from @inputvol.
+ *
+ * If @want_sparse is true, holes in @inputvol are skipped over instead
+ * of being written out; the caller is expected to have sized @fd
+ * already. Unless @preallocated is true as well, data extents are
+ * additionally scanned for blocks of zeroes so that they are not
+ * allocated in the output either. If @want_sparse and @preallocated are
+ * both false, data is copied in kernel with copy_file_range() where
+ * possible.
+ */
 static int ATTRIBUTE_NONNULL(2)
 virStorageBackendCopyToFD(virStorageVolDefPtr vol,
                           virStorageVolDefPtr inputvol,
                           int fd,
                           unsigned long long *total,
                           bool want_sparse,
+                          bool preallocated,
                           bool reflink_copy)
 {
-    int amtread = -1;
     int ret = 0;
-    size_t rbytes = READ_BLOCK_SIZE_DEFAULT;
     int wbytes = 0;
-    int interval;
+    bool skip_holes = false;
+    bool detect_zeroes = want_sparse && !preallocated;
+    /* copy_file_range() may share extents with the input, which would
+     * silently undo the preallocation of the output */
+    bool offload = !detect_zeroes && !preallocated;
     struct stat st;
-    g_autofree char *zerobuf = NULL;
     g_autofree char *buf = NULL;
     VIR_AUTOCLOSE inputfd = -1;
 
@@ -148,6 +312,11 @@ virStorageBackendCopyToFD(virStorageVolDefPtr vol,
         return ret;
     }
 
+#if HAVE_DECL_SEEK_HOLE
+    if (want_sparse && fstat(inputfd, &st) == 0 && S_ISREG(st.st_mode))
+        skip_holes = true;
+#endif
+
 #ifdef __linux__
     if (ioctl(fd, BLKBSZGET, &wbytes) < 0)
         wbytes = 0;
@@ -157,10 +326,7 @@ virStorageBackendCopyToFD(virStorageVolDefPtr vol,
     if (wbytes < WRITE_BLOCK_SIZE_DEFAULT)
         wbytes = WRITE_BLOCK_SIZE_DEFAULT;
 
-    if (VIR_ALLOC_N(zerobuf, wbytes) < 0)
-        return -errno;
-
-    if (VIR_ALLOC_N(buf, rbytes) < 0)
+    if (VIR_ALLOC_N(buf, READ_BLOCK_SIZE_DEFAULT) < 0)
         return -errno;
 
     if (reflink_copy) {
@@ -176,45 +342,71 @@ virStorageBackendCopyToFD(virStorageVolDefPtr vol,
         }
     }
 
-    while (amtread != 0) {
-        int amtleft;
+    while (*total > 0) {
+        unsigned long long len = *total;
+        unsigned long long copied = 0;
+        int inData = 1;
 
-        if (*total < rbytes)
-            rbytes = *total;
+        if (skip_holes) {
+            long long extent;
 
-        if ((amtread = saferead(inputfd, buf, rbytes)) < 0) {
-            ret = -errno;
-            virReportSystemError(errno,
-                                 _("failed reading from file '%s'"),
-                                 inputvol->target.path);
-            return ret;
+            if (virFileInData(inputfd, &inData, &extent) < 0)
+                return -errno;
+
+            /* Implicit hole at EOF */
+            if (extent == 0)
+                break;
+
+            len = MIN(len, (unsigned long long) extent);
         }
-        *total -= amtread;
 
-        /* Loop over amt read in 512 byte increments, looking for sparse
-         * blocks */
-        amtleft = amtread;
-        do {
-            interval = ((wbytes > amtleft) ? amtleft : wbytes);
-            int offset = amtread - amtleft;
+        if (!inData) {
+            if (lseek(inputfd, len, SEEK_CUR) < 0) {
+                ret = -errno;
+                virReportSystemError(errno,
+                                     _("cannot seek in file '%s'"),
+                                     inputvol->target.path);
+                return ret;
+            }
 
-            if (want_sparse && memcmp(buf+offset, zerobuf, interval) == 0) {
-                if (lseek(fd, interval, SEEK_CUR) < 0) {
-                    ret = -errno;
-                    virReportSystemError(errno,
-                                         _("cannot extend file '%s'"),
-                                         vol->target.path);
-                    return ret;
-                }
-            } else if (safewrite(fd, buf+offset, interval) < 0) {
+            if (lseek(fd, len, SEEK_CUR) < 0) {
                 ret = -errno;
                 virReportSystemError(errno,
-                                     _("failed writing to file '%s'"),
+                                     _("cannot extend file '%s'"),
                                      vol->target.path);
                 return ret;
+            }
 
+            *total -= len;
+            continue;
+        }
+
+        if (offload) {
+            if ((ret = storageBackendCopyExtentOffload(vol, inputvol,
+                                                       inputfd, fd,
+                                                       len, &copied)) < 0)
+                return ret;
+
+            if (ret > 0) {
+                VIR_DEBUG("offloaded copy to '%s' not supported, "
+                          "falling back to read/write", vol->target.path);
+                offload = false;
+                ret = 0;
             }
-        } while ((amtleft -= interval) > 0);
+        }
+
+        if (!offload &&
+            (ret = storageBackendCopyExtentBuffered(vol, inputvol,
+                                                    inputfd, fd,
+                                                    buf, wbytes,
+                                                    len, detect_zeroes,
+                                                    &copied)) < 0)
+            return ret;
+
+        *total -= copied;
+
+        if (copied < len)
+            break;
     }
 
     if (virFileDataSync(fd) < 0) {
@@ -274,7 +466,7 @@ storageBackendCreateBlockFrom(virStoragePoolObjPtr pool G_GNUC_UNUSED,
 
     if (inputvol) {
         if (virStorageBackendCopyToFD(vol, inputvol, fd, &remain,
-                                      false, reflink_copy) < 0)
+                                      false, false, reflink_copy) < 0)
             return -1;
     }
 
@@ -320,6 +512,7 @@ createRawFile(int fd, virStorageVolDefPtr vol,
               bool reflink_copy)
 {
     bool need_alloc = true;
+    bool preallocated = false;
     int ret = 0;
     unsigned long long pos = 0;
 
@@ -351,6 +544,7 @@ createRawFile(int fd, virStorageVolDefPtr vol,
     if (vol->target.allocation && need_alloc) {
         if (fallocate(fd, 0, 0, vol->target.allocation) == 0) {
             need_alloc = false;
+            preallocated = true;
         } else if (errno != ENOSYS && errno != EOPNOTSUPP) {
             ret = -errno;
             virReportSystemError(errno,
@@ -367,7 +561,8 @@ createRawFile(int fd, virStorageVolDefPtr vol,
          * allocation (allocation < capacity) or we have already
          * been able to allocate the required space. */
         if ((ret = virStorageBackendCopyToFD(vol, inputvol, fd, &remain,
-                                             !need_alloc, reflink_copy)) < 0)
+                                             !need_alloc, preallocated,
+                                             reflink_copy)) < 0)
             return ret;
 
         /* If the new allocation is greater than the original capacity,
@@ -2499,22 +2694,94 @@ storageBackendVolZeroSparseFileLocal(const char *path,
 }
 
 
+/*
+ * Ask the kernel to zero (or, if @discard is true, to deallocate) @len
+ * bytes of @fd starting at @offset without transferring the data:
+ * BLKZEROOUT/BLKDISCARD for block devices and fallocate() for files.
+ *
+ * Returns 0 on success, 1 if neither the kernel nor the volume supports
+ * the operation, -1 on error.
+ */
+static int
+storageBackendWipeOffload(const char *path,
+                          int fd,
+                          const struct stat *st,
+                          unsigned long long offset,
+                          unsigned long long len,
+                          bool discard)
+{
+    if (S_ISBLK(st->st_mode)) {
+#if defined(__linux__) && defined(BLKZEROOUT) && defined(BLKDISCARD)
+        uint64_t range[2] = { offset, len };
+
+        if (ioctl(fd, discard ? BLKDISCARD : BLKZEROOUT, range) == 0)
+            return 0;
+
+        if (errno != ENOTTY && errno != EOPNOTSUPP &&
+            errno != ENOTSUP && errno != EINVAL) {
+            virReportSystemError(errno,
+                                 _("Failed to %s %llu bytes of storage "
+                                   "volume with path '%s'"),
+                                 discard ? "discard" : "zero out",
+                                 len, path);
+            return -1;
+        }
+#endif /* __linux__ && BLKZEROOUT && BLKDISCARD */
+    } else if (S_ISREG(st->st_mode)) {
+/* Avoid issues with older kernel's <linux/fs.h> namespace pollution. */
+#if HAVE_FALLOCATE - 0
+        int rc = -1;
+
+        errno = ENOSYS;
+        /* Zeroing the range keeps the blocks allocated, which matches
+         * what writing the zeroes out would have done. Punching a hole
+         * would deallocate a preallocated volume, so only do that when
+         * asked to discard. */
+        if (!discard) {
+# ifdef FALLOC_FL_ZERO_RANGE
+            rc = fallocate(fd, FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE,
+                           offset, len);
+# endif
+        } else {
+# ifdef FALLOC_FL_PUNCH_HOLE
+            rc = fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                           offset, len);
+# endif
+        }
+
+        if (rc == 0)
+            return 0;
+
+        if (errno != ENOSYS && errno != EOPNOTSUPP && errno != ENOTSUP) {
+            virReportSystemError(errno,
+                                 _("Failed to %s %llu bytes of storage "
+                                   "volume with path '%s'"),
+                                 discard ? "discard" : "zero out",
+                                 len, path);
+            return -1;
+        }
+#endif /* HAVE_FALLOCATE */
+    }
+
+    return 1;
+}
+
+
 static int
 storageBackendWipeLocal(const char *path,
                         int fd,
+                        const struct stat *st,
                         unsigned long long wipe_len,
-                        size_t writebuf_length,
                         bool zero_end)
 {
     int written = 0;
     unsigned long long remaining = 0;
     off_t size;
     size_t write_size = 0;
+    size_t writebuf_length = MAX(WIPE_BLOCK_SIZE_DEFAULT, (size_t) st->st_blksize);
+    int rc;
     g_autofree char *writebuf = NULL;
 
-    if (VIR_ALLOC_N(writebuf, writebuf_length) < 0)
-        return -1;
-
     if (!zero_end) {
         if ((size = lseek(fd, 0, SEEK_SET)) < 0) {
             virReportSystemError(errno,
@@ -2535,23 +2802,34 @@ storageBackendWipeLocal(const char *path,
 
     VIR_DEBUG("wiping start: %zd len: %llu", (ssize_t)size, wipe_len);
 
-    remaining = wipe_len;
-    while (remaining > 0) {
-
-        write_size = (writebuf_length < remaining) ? writebuf_length : remaining;
-        written = safewrite(fd, writebuf, write_size);
-        if (written < 0) {
-            virReportSystemError(errno,
-                                 _("Failed to write %zu bytes to "
-                                   "storage volume with path '%s'"),
-                                 write_size, path);
+    if ((rc = storageBackendWipeOffload(path, fd, st, size,
+                                        wipe_len, false)) < 0)
+        return -1;
 
+    if (rc > 0) {
+        if (VIR_ALLOC_N(writebuf, writebuf_length) < 0)
             return -1;
-        }
 
-        remaining -= written;
+        remaining = wipe_len;
+        while (remaining > 0) {
+
+            write_size = (writebuf_length < remaining) ? writebuf_length : remaining;
+            written = safewrite(fd, writebuf, write_size);
+            if (written < 0) {
+                virReportSystemError(errno,
+                                     _("Failed to write %zu bytes to "
+                                       "storage volume with path '%s'"),
+                                     write_size, path);
+
+                return -1;
+            }
+
+            remaining -= written;
+        }
     }
 
+    /* Zeroing offloaded to the kernel isn't necessarily durable
+     * either, so sync in both cases */
     if (virFileDataSync(fd) < 0) {
         virReportSystemError(errno,
                              _("cannot sync data to volume with path '%s'"),
@@ -2559,7 +2837,41 @@ storageBackendWipeLocal(const char *path,
         return -1;
     }
 
-    VIR_DEBUG("Wrote %llu bytes to volume with path '%s'", wipe_len, path);
+    if (rc == 0)
+        VIR_DEBUG("Zeroed %llu bytes of volume with path '%s' in kernel",
+                  wipe_len, path);
+    else
+        VIR_DEBUG("Wrote %llu bytes to volume with path '%s'", wipe_len, path);
+
+    return 0;
+}
+
+
+static int
+storageBackendVolTrimLocal(const char *path,
+                           int fd,
+                           const struct stat *st,
+                           unsigned long long len)
+{
+    int rc;
+
+    if ((rc = storageBackendWipeOffload(path, fd, st, 0, len, true)) < 0)
+        return -1;
+
+    if (rc > 0) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED,
+                       _("storage volume with path '%s' does not support "
+                         "discarding data"),
+                       path);
+        return -1;
+    }
+
+    if (virFileDataSync(fd) < 0) {
+        virReportSystemError(errno,
+                             _("cannot sync data to volume with path '%s'"),
+                             path);
+        return -1;
+    }
 
     return 0;
 }
@@ -2620,9 +2932,8 @@ storageBackendVolWipeLocalFile(const char *path,
         alg_char = "random";
         break;
     case VIR_STORAGE_VOL_WIPE_ALG_TRIM:
-        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
-                       _("'trim' algorithm not supported"));
-        return -1;
+        alg_char = "trim";
+        break;
     case VIR_STORAGE_VOL_WIPE_ALG_LAST:
         virReportError(VIR_ERR_INVALID_ARG,
                        _("unsupported algorithm %d"),
@@ -2632,6 +2943,11 @@ storageBackendVolWipeLocalFile(const char *path,
 
     VIR_DEBUG("Wiping file '%s' with algorithm '%s'", path, alg_char);
 
+    if (algorithm == VIR_STORAGE_VOL_WIPE_ALG_TRIM)
+        return storageBackendVolTrimLocal(path, fd, &st,
+                                          S_ISREG(st.st_mode) ?
+                                          st.st_size : allocation);
+
     if (algorithm != VIR_STORAGE_VOL_WIPE_ALG_ZERO) {
         cmd = virCommandNew(SCRUB);
         virCommandAddArgList(cmd, "-f", "-p", alg_char, path, NULL);
@@ -2642,8 +2958,7 @@ storageBackendVolWipeLocalFile(const char *path,
     if (S_ISREG(st.st_mode) && st.st_blocks < (st.st_size / DEV_BSIZE))
         return storageBackendVolZeroSparseFileLocal(path, st.st_size, fd);
 
-    return storageBackendWipeLocal(path, fd, allocation, st.st_blksize,
-                                   zero_end);
+    return storageBackendWipeLocal(path, fd, &st, allocation, zero_end);
 }
 
 
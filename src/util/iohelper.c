@@ -42,6 +42,86 @@
 # define O_DIRECT 0
 #endif
 
+/* Number of buffers that can be in flight between the reader thread
+ * and the writer */
+#define IOHELPER_NBUFFERS 4
+
+typedef struct _runIOData runIOData;
+struct _runIOData {
+    virMutex lock;
+    virCond cond;
+
+    int fdin;
+    bool directRead;
+    size_t buflen;
+
+    char *bufs[IOHELPER_NBUFFERS];
+    /* Amount of data in each buffer, 0 on EOF or -1 on error */
+    ssize_t lens[IOHELPER_NBUFFERS];
+    size_t head; /* next buffer to be filled by the reader */
+    size_t tail; /* next buffer to be drained by the writer */
+    size_t nfilled;
+
+    int readErrno;
+    bool quit;
+};
+
+
+/* Reads @data->fdin into the free buffers until EOF, error or until
+ * told to quit. Filled buffers are passed on to the writer in order;
+ * EOF and errors are queued the same way so that all data read before
+ * them is still written out. */
+static void
+runIOReader(void *opaque)
+{
+    runIOData *data = opaque;
+
+    virMutexLock(&data->lock);
+    while (!data->quit) {
+        char *buf;
+        ssize_t got;
+        int err = 0;
+
+        if (data->nfilled == IOHELPER_NBUFFERS) {
+            ignore_value(virCondWait(&data->cond, &data->lock));
+            continue;
+        }
+
+        buf = data->bufs[data->head];
+        virMutexUnlock(&data->lock);
+
+        /* If we read with O_DIRECT from file we can't use saferead as
+         * it can lead to unaligned read after reading last bytes.
+         * If we write with O_DIRECT use should use saferead so that
+         * writes will be aligned.
+         * In other cases using saferead reduces number of syscalls.
+         */
+        if (data->directRead) {
+            while ((got = read(data->fdin, buf, data->buflen)) < 0 &&
+                   errno == EINTR)
+                ;
+        } else {
+            got = saferead(data->fdin, buf, data->buflen);
+        }
+
+        if (got < 0)
+            err = errno;
+
+        virMutexLock(&data->lock);
+        data->lens[data->head] = got;
+        data->head = (data->head + 1) % IOHELPER_NBUFFERS;
+        data->nfilled++;
+        if (got < 0)
+            data->readErrno = err;
+        virCondBroadcast(&data->cond);
+
+        if (got <= 0)
+            break;
+    }
+    virMutexUnlock(&data->lock);
+}
+
+
 static int
 runIO(const char *path, int fd, int oflags)
 {
@@ -55,15 +135,21 @@ runIO(const char *path, int fd, int oflags)
     unsigned long long total = 0;
     bool direct = O_DIRECT && ((oflags & O_DIRECT) != 0);
     off_t end = 0;
+    g_autofree runIOData *data = g_new0(runIOData, 1);
+    virThread reader;
+    bool haveLock = false;
+    bool haveCond = false;
+    bool haveReader = false;
+    size_t i;
 
 #if HAVE_POSIX_MEMALIGN
-    if (posix_memalign(&base, alignMask + 1, buflen)) {
+    if (posix_memalign(&base, alignMask + 1, buflen * IOHELPER_NBUFFERS)) {
         virReportOOMError();
         goto cleanup;
     }
     buf = base;
 #else
-    if (VIR_ALLOC_N(buf, buflen + alignMask) < 0)
+    if (VIR_ALLOC_N(buf, buflen * IOHELPER_NBUFFERS + alignMask) < 0)
         goto cleanup;
     base = buf;
     buf = (char *) (((intptr_t) base + alignMask) & ~alignMask);
@@ -105,25 +191,45 @@ runIO(const char *path, int fd, int oflags)
         goto cleanup;
     }
 
+    if (virMutexInit(&data->lock) < 0) {
+        virReportSystemError(errno, "%s", _("Unable to init mutex"));
+        goto cleanup;
+    }
+    haveLock = true;
+
+    if (virCondInit(&data->cond) < 0) {
+        virReportSystemError(errno, "%s", _("Unable to init condition"));
+        goto cleanup;
+    }
+    haveCond = true;
+
+    data->fdin = fdin;
+    data->directRead = fdin == fd && direct;
+    data->buflen = buflen;
+    for (i = 0; i < IOHELPER_NBUFFERS; i++)
+        data->bufs[i] = buf + i * buflen;
+
+    /* Reading and writing are overlapped: a separate thread keeps
+     * filling buffers while the previous ones are being written. */
+    if (virThreadCreate(&reader, true, runIOReader, data) < 0) {
+        virReportSystemError(errno, "%s", _("Unable to create reader thread"));
+        goto cleanup;
+    }
+    haveReader = true;
+
     while (1) {
         ssize_t got;
 
-        /* If we read with O_DIRECT from file we can't use saferead as
-         * it can lead to unaligned read after reading last bytes.
-         * If we write with O_DIRECT use should use saferead so that
-         * writes will be aligned.
-         * In other cases using saferead reduces number of syscalls.
-         */
-        if (fdin == fd && direct) {
-            if ((got = read(fdin, buf, buflen)) < 0 &&
-                errno == EINTR)
-                continue;
-        } else {
-            got = saferead(fdin, buf, buflen);
-        }
+        virMutexLock(&data->lock);
+        while (data->nfilled == 0)
+            ignore_value(virCondWait(&data->cond, &data->lock));
+        buf = data->bufs[data->tail];
+        got = data->lens[data->tail];
+        virMutexUnlock(&data->lock);
 
         if (got < 0) {
-            virReportSystemError(errno, _("Unable to read %s"), fdinname);
+            virReportSystemError(data->readErrno, _("Unable to read %s"),
+                                 fdinname);
             goto cleanup;
         }
         if (got == 0)
@@ -154,6 +260,12 @@ runIO(const char *path, int fd, int oflags)
             virReportSystemError(errno, _("Unable to write %s"), fdoutname);
             goto cleanup;
         }
+
+        virMutexLock(&data->lock);
+        data->tail = (data->tail + 1) % IOHELPER_NBUFFERS;
+        data->nfilled--;
+        virCondBroadcast(&data->cond);
+        virMutexUnlock(&data->lock);
     }
 
     /* Ensure all data is written */
@@ -168,6 +280,28 @@ runIO(const char *path, int fd, int oflags)
     ret = 0;
 
  cleanup:
+    if (haveReader) {
+        virMutexLock(&data->lock);
+        data->quit = true;
+        virCondBroadcast(&data->cond);
+        virMutexUnlock(&data->lock);
+
+        if (ret == 0) {
+            virThreadJoin(&reader);
+        } else {
+            /* On failure the reader may be stuck in read() on a pipe
+             * for as long as the other end keeps it open. We exit
+             * right after this anyway, so rather than waiting for it,
+             * leave it the memory it might still touch. */
+            ignore_value(g_steal_pointer(&base));
+            ignore_value(g_steal_pointer(&data));
+            haveCond = haveLock = false;
+        }
+    }
+    if (haveCond)
+        virCondDestroy(&data->cond);
+    if (haveLock)
+        virMutexDestroy(&data->lock);
     if (VIR_CLOSE(fd) < 0 &&
         ret == 0) {
         virReportSystemError(errno, _("Unable to close %s"), path);
@@ -496,6 +496,110 @@ virCgroupGetValueRaw(const char *path,
 }
 
 
+/* Largest stat file virCgroupStatFileRead will accept, as with
+ * virCgroupGetValueRaw */
+#define VIR_CGROUP_STAT_FILE_MAX (1024 * 1024)
+
+static int
+virCgroupStatFileRead(int fd,
+                      char **value)
+{
+    g_autofree char *buf = NULL;
+    size_t size = 8192;
+    size_t len = 0;
+    ssize_t got;
+
+    buf = g_new0(char, size);
+
+    /* cgroup files regenerate their content on every read from offset
+     * zero, so there's no need to reopen them */
+    for (;;) {
+        got = pread(fd, buf + len, size - len - 1, len);
+        if (got < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (got == 0)
+            break;
+
+        len += got;
+        if (len == size - 1) {
+            if (size >= VIR_CGROUP_STAT_FILE_MAX) {
+                errno = EFBIG;
+                return -1;
+            }
+            size *= 2;
+            buf = g_renew(char, buf, size);
+        }
+    }
+
+    buf[len] = '\0';
+    *value = g_steal_pointer(&buf);
+    return len;
+}
+
+
+static int
+virCgroupGetValueSampled(virCgroupPtr group,
+                         const char *path,
+                         char **value)
+{
+    virCgroupStatFilePtr file = NULL;
+    bool reopened = false;
+    size_t i;
+    int rc;
+
+    *value = NULL;
+
+    for (i = 0; i < group->nstatFiles; i++) {
+        if (STREQ(group->statFiles[i].path, path)) {
+            file = &group->statFiles[i];
+            break;
+        }
+    }
+
+    if (!file) {
+        virCgroupStatFile tmp = { NULL, -1 };
+
+        VIR_DEBUG("Keeping %s open for sampling", path);
+        if ((tmp.fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+            goto error;
+        tmp.path = g_strdup(path);
+
+        if (VIR_APPEND_ELEMENT(group->statFiles, group->nstatFiles, tmp) < 0) {
+            VIR_FORCE_CLOSE(tmp.fd);
+            VIR_FREE(tmp.path);
+            return -1;
+        }
+        file = &group->statFiles[group->nstatFiles - 1];
+        reopened = true;
+    }
+
+    while ((rc = virCgroupStatFileRead(file->fd, value)) < 0) {
+        /* The cgroup may have been removed and recreated since the file
+         * was opened, so give it another go with a fresh one */
+        if (reopened)
+            goto error;
+
+        VIR_FORCE_CLOSE(file->fd);
+        if ((file->fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+            goto error;
+        reopened = true;
+    }
+
+    /* Terminated with '\n' has sometimes harmful effects to the caller */
+    if (rc > 0 && (*value)[rc - 1] == '\n')
+        (*value)[rc - 1] = '\0';
+
+    return 0;
+
+ error:
+    virReportSystemError(errno, _("Unable to read from '%s'"), path);
+    return -1;
+}
+
+
 int
 virCgroupSetValueStr(virCgroupPtr group,
                      int controller,
@@ -522,6 +626,9 @@ virCgroupGetValueStr(virCgroupPtr group,
     if (virCgroupPathOfController(group, controller, key, &keypath) < 0)
         return -1;
 
+    if (group->sampling)
+        return virCgroupGetValueSampled(group, keypath, value);
+
     return virCgroupGetValueRaw(keypath, value);
 }
 
@@ -2204,40 +2311,33 @@ virCgroupGetDomainTotalCpuStats(virCgroupPtr group,
                                 virTypedParameterPtr params,
                                 int nparams)
 {
-    unsigned long long cpu_time;
-    int ret;
+    virCgroupStats stats;
+    unsigned int want = VIR_CGROUP_STATS_CPU_USAGE;
 
     if (nparams == 0) /* return supported number of params */
         return CGROUP_NB_TOTAL_CPU_STAT_PARAM;
-    /* entry 0 is cputime */
-    ret = virCgroupGetCpuacctUsage(group, &cpu_time);
-    if (ret < 0) {
-        virReportSystemError(-ret, "%s", _("unable to get cpu account"));
+
+    if (nparams > 1)
+        want |= VIR_CGROUP_STATS_CPU_TIMES;
+
+    if (virCgroupGetStats(group, want, &stats) < 0 ||
+        stats.valid != want)
         return -1;
-    }
 
+    /* entry 0 is cputime */
     if (virTypedParameterAssign(&params[0], VIR_DOMAIN_CPU_STATS_CPUTIME,
-                                VIR_TYPED_PARAM_ULLONG, cpu_time) < 0)
+                                VIR_TYPED_PARAM_ULLONG, stats.cpuUsage) < 0)
         return -1;
 
     if (nparams > 1) {
-        unsigned long long user;
-        unsigned long long sys;
-
-        ret = virCgroupGetCpuacctStat(group, &user, &sys);
-        if (ret < 0) {
-            virReportSystemError(-ret, "%s", _("unable to get cpu account"));
-            return -1;
-        }
-
         if (virTypedParameterAssign(&params[1],
                                     VIR_DOMAIN_CPU_STATS_USERTIME,
-                                    VIR_TYPED_PARAM_ULLONG, user) < 0)
+                                    VIR_TYPED_PARAM_ULLONG, stats.cpuUser) < 0)
             return -1;
         if (nparams > 2 &&
             virTypedParameterAssign(&params[2],
                                     VIR_DOMAIN_CPU_STATS_SYSTEMTIME,
-                                    VIR_TYPED_PARAM_ULLONG, sys) < 0)
+                                    VIR_TYPED_PARAM_ULLONG, stats.cpuSys) < 0)
             return -1;
 
         if (nparams > CGROUP_NB_TOTAL_CPU_STAT_PARAM)
@@ -2248,6 +2348,62 @@ virCgroupGetDomainTotalCpuStats(virCgroupPtr group,
 }
 
 
+/**
+ * virCgroupGetStats:
+ * @group: the cgroup to sample
+ * @flags: bitwise-OR of virCgroupStatsFlags to collect
+ * @stats: filled in with the values collected
+ *
+ * Collect several accounting values of @group in one go. The files
+ * they come from are kept open on @group and simply re-read by later
+ * calls, which avoids the path lookup, open and close of every file
+ * when a large number of domains is sampled periodically.
+ *
+ * Values which can't be read are left out of @stats->valid and an
+ * error is reported, but collection carries on with the remaining
+ * ones.
+ *
+ * Returns 0 if at least one of the requested values was collected,
+ * -1 otherwise.
+ */
+int
+virCgroupGetStats(virCgroupPtr group,
+                  unsigned int flags,
+                  virCgroupStatsPtr stats)
+{
+    memset(stats, 0, sizeof(*stats));
+
+    group->sampling = true;
+
+    if ((flags & VIR_CGROUP_STATS_CPU_USAGE) &&
+        virCgroupGetCpuacctUsage(group, &stats->cpuUsage) == 0)
+        stats->valid |= VIR_CGROUP_STATS_CPU_USAGE;
+
+    if ((flags & VIR_CGROUP_STATS_CPU_TIMES) &&
+        virCgroupGetCpuacctStat(group, &stats->cpuUser, &stats->cpuSys) == 0)
+        stats->valid |= VIR_CGROUP_STATS_CPU_TIMES;
+
+    if ((flags & VIR_CGROUP_STATS_MEMORY) &&
+        virCgroupGetMemoryUsage(group, &stats->memUsage) == 0)
+        stats->valid |= VIR_CGROUP_STATS_MEMORY;
+
+    if ((flags & VIR_CGROUP_STATS_BLKIO) &&
+        virCgroupGetBlkioIoServiced(group,
+                                    &stats->blkioReadBytes,
+                                    &stats->blkioWriteBytes,
+                                    &stats->blkioReadOps,
+                                    &stats->blkioWriteOps) == 0)
+        stats->valid |= VIR_CGROUP_STATS_BLKIO;
+
+    group->sampling = false;
+
+    if (flags && !stats->valid)
+        return -1;
+
+    return 0;
+}
+
+
 int
 virCgroupSetCpuShares(virCgroupPtr group, unsigned long long shares)
 {
@@ -3444,6 +3600,17 @@ virCgroupGetCpuacctStat(virCgroupPtr group G_GNUC_UNUSED,
 }
 
 
+int
+virCgroupGetStats(virCgroupPtr group G_GNUC_UNUSED,
+                  unsigned int flags G_GNUC_UNUSED,
+                  virCgroupStatsPtr stats G_GNUC_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Control groups not supported on this platform"));
+    return -1;
+}
+
+
 int
 virCgroupGetDomainTotalCpuStats(virCgroupPtr group G_GNUC_UNUSED,
                                 virTypedParameterPtr params G_GNUC_UNUSED,
@@ -3558,6 +3725,12 @@ virCgroupFree(virCgroupPtr *group)
     VIR_FREE((*group)->unified.mountPoint);
     VIR_FREE((*group)->unified.placement);
 
+    for (i = 0; i < (*group)->nstatFiles; i++) {
+        VIR_FORCE_CLOSE((*group)->statFiles[i].fd);
+        VIR_FREE((*group)->statFiles[i].path);
+    }
+    VIR_FREE((*group)->statFiles);
+
     VIR_FREE((*group)->path);
     VIR_FREE(*group);
 }
@@ -239,6 +239,34 @@ int virCgroupGetCpuacctPercpuUsage(virCgroupPtr group, char **usage);
 int virCgroupGetCpuacctStat(virCgroupPtr group, unsigned long long *user,
                             unsigned long long *sys);
 
+typedef enum {
+    VIR_CGROUP_STATS_CPU_USAGE = 1 << 0,
+    VIR_CGROUP_STATS_CPU_TIMES = 1 << 1,
+    VIR_CGROUP_STATS_MEMORY = 1 << 2,
+    VIR_CGROUP_STATS_BLKIO = 1 << 3,
+} virCgroupStatsFlags;
+
+typedef struct _virCgroupStats virCgroupStats;
+typedef virCgroupStats *virCgroupStatsPtr;
+struct _virCgroupStats {
+    unsigned int valid; /* virCgroupStatsFlags which were filled in */
+
+    unsigned long long cpuUsage; /* ns */
+    unsigned long long cpuUser; /* ns */
+    unsigned long long cpuSys; /* ns */
+
+    unsigned long memUsage; /* KiB */
+
+    long long blkioReadBytes;
+    long long blkioWriteBytes;
+    long long blkioReadOps;
+    long long blkioWriteOps;
+};
+
+int virCgroupGetStats(virCgroupPtr group,
+                      unsigned int flags,
+                      virCgroupStatsPtr stats);
+
 int virCgroupSetFreezerState(virCgroupPtr group, const char *state);
 int virCgroupGetFreezerState(virCgroupPtr group, char **state);
 
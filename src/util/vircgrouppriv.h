@@ -59,6 +59,13 @@ struct _virCgroupV2Controller {
 typedef struct _virCgroupV2Controller virCgroupV2Controller;
 typedef virCgroupV2Controller *virCgroupV2ControllerPtr;
 
+struct _virCgroupStatFile {
+    char *path;
+    int fd;
+};
+typedef struct _virCgroupStatFile virCgroupStatFile;
+typedef virCgroupStatFile *virCgroupStatFilePtr;
+
 struct _virCgroup {
     char *path;
 
@@ -66,6 +73,12 @@ struct _virCgroup {
 
     virCgroupV1Controller legacy[VIR_CGROUP_CONTROLLER_LAST];
     virCgroupV2Controller unified;
+
+    /* Set while virCgroupGetStats() runs, reads then go through
+     * statFiles which are kept open across calls */
+    bool sampling;
+    virCgroupStatFilePtr statFiles;
+    size_t nstatFiles;
 };
 
 int virCgroupSetValueRaw(const char *path,
@@ -46,8 +46,24 @@ VIR_ENUM_IMPL(virFirewallLayerCommand,
               EBTABLES_PATH,
               IPTABLES_PATH,
               IP6TABLES_PATH,
+              NFT_PATH,
 );
 
+VIR_ENUM_IMPL(virFirewallBackend,
+              VIR_FIREWALL_BACKEND_LAST,
+              "automatic",
+              "direct",
+              "firewalld",
+              "nftables",
+);
+
+/* Commands able to apply a batch of rules of a layer at once */
+static const char *virFirewallLayerRestoreCommand[VIR_FIREWALL_LAYER_LAST] = {
+    [VIR_FIREWALL_LAYER_IPV4] = IPTABLES_RESTORE_PATH,
+    [VIR_FIREWALL_LAYER_IPV6] = IP6TABLES_RESTORE_PATH,
+    [VIR_FIREWALL_LAYER_NFTABLES] = NFT_PATH,
+};
+
 struct _virFirewallRule {
     virFirewallLayer layer;
 
@@ -101,6 +117,10 @@ static bool ip6tablesUseLock;
 static bool ebtablesUseLock;
 static bool lockOverride; /* true to avoid lock probes */
 
+/* Whether consecutive rules of a layer may be applied as one
+ * transaction through the layer's restore command */
+static bool restoreBatch[VIR_FIREWALL_LAYER_LAST];
+
 void
 virFirewallSetLockOverride(bool avoid)
 {
@@ -143,6 +163,80 @@ virFirewallCheckUpdateLocking(void)
                                ebtablesArgs);
 }
 
+/**
+ * virFirewallSetBatching:
+ * @enable: whether to batch rules through iptables-restore
+ *
+ * Override the result of the iptables-restore probe, which is
+ * skipped when lock probes are disabled. For use by the test suite.
+ */
+void
+virFirewallSetBatching(bool enable)
+{
+    size_t i;
+
+    for (i = 0; i < VIR_FIREWALL_LAYER_LAST; i++)
+        restoreBatch[i] = enable && virFirewallLayerRestoreCommand[i];
+}
+
+/**
+ * virFirewallSetBackendOverride:
+ * @backend: the backend to generate rules for
+ *
+ * Switch to @backend without checking that the tools it runs are
+ * installed, for tests which only capture the generated rules. The
+ * firewall must have been initialized already. For use by the test
+ * suite.
+ */
+void
+virFirewallSetBackendOverride(virFirewallBackend backend)
+{
+    currentBackend = backend;
+}
+
+static void
+virFirewallCheckUpdateBatch(virFirewallLayer layer,
+                            bool useLock)
+{
+    const char *bin = virFirewallLayerRestoreCommand[layer];
+    g_autoptr(virCommand) cmd = NULL;
+    int status;
+
+    restoreBatch[layer] = false;
+
+    if (!bin || !virFileIsExecutable(bin))
+        return;
+
+    /* Validate an empty ruleset without touching the kernel, to
+     * make sure all the options we are going to use are known */
+    cmd = virCommandNewArgList(bin, NULL);
+    if (useLock)
+        virCommandAddArg(cmd, "-w");
+    virCommandAddArgList(cmd, "--noflush", "--test", NULL);
+    virCommandSetInputBuffer(cmd, "");
+
+    if (virCommandRun(cmd, &status) < 0 || status) {
+        VIR_INFO("batching not supported by %s", bin);
+    } else {
+        VIR_INFO("using %s for batching rules", bin);
+        restoreBatch[layer] = true;
+    }
+}
+
+static void
+virFirewallCheckUpdateBatching(virFirewallBackend backend)
+{
+    if (lockOverride)
+        return;
+    if (backend != VIR_FIREWALL_BACKEND_FIREWALLD) {
+        virFirewallCheckUpdateBatch(VIR_FIREWALL_LAYER_IPV4, iptablesUseLock);
+        virFirewallCheckUpdateBatch(VIR_FIREWALL_LAYER_IPV6, ip6tablesUseLock);
+    }
+
+    /* nft always reads whole transactions from a file */
+    restoreBatch[VIR_FIREWALL_LAYER_NFTABLES] = virFileIsExecutable(NFT_PATH);
+}
+
 static int
 virFirewallValidateBackend(virFirewallBackend backend)
 {
@@ -171,7 +265,20 @@ virFirewallValidateBackend(virFirewallBackend backend)
         }
     }
 
-    if (backend == VIR_FIREWALL_BACKEND_DIRECT) {
+    if (backend == VIR_FIREWALL_BACKEND_NFTABLES) {
+        if (!virFileIsExecutable(NFT_PATH)) {
+            virReportSystemError(errno,
+                                 _("nftables firewall backend requested, but %s is not available"),
+                                 NFT_PATH);
+            return -1;
+        }
+        VIR_DEBUG("found nft, using nftables backend");
+    }
+
+    /* The nftables backend still runs iptables/ebtables rules of
+     * the drivers which have no native nftables support directly */
+    if (backend == VIR_FIREWALL_BACKEND_DIRECT ||
+        backend == VIR_FIREWALL_BACKEND_NFTABLES) {
         const char *commands[] = {
             IPTABLES_PATH, IP6TABLES_PATH, EBTABLES_PATH
         };
@@ -180,17 +287,20 @@ virFirewallValidateBackend(virFirewallBackend backend)
         for (i = 0; i < G_N_ELEMENTS(commands); i++) {
             if (!virFileIsExecutable(commands[i])) {
                 virReportSystemError(errno,
-                                     _("direct firewall backend requested, but %s is not available"),
+                                     _("%s firewall backend requested, but %s is not available"),
+                                     virFirewallBackendTypeToString(backend),
                                      commands[i]);
                 return -1;
             }
         }
-        VIR_DEBUG("found iptables/ip6tables/ebtables, using direct backend");
+        VIR_DEBUG("found iptables/ip6tables/ebtables, using %s backend",
+                  virFirewallBackendTypeToString(backend));
     }
 
     currentBackend = backend;
 
     virFirewallCheckUpdateLocking();
+    virFirewallCheckUpdateBatching(backend);
 
     return 0;
 }
@@ -206,6 +316,22 @@ virFirewallSetBackend(virFirewallBackend backend)
     return virFirewallValidateBackend(backend);
 }
 
+
+/**
+ * virFirewallGetBackend:
+ *
+ * Returns the backend rules are applied with, or
+ * VIR_FIREWALL_BACKEND_AUTOMATIC if none could be found
+ */
+virFirewallBackend
+virFirewallGetBackend(void)
+{
+    if (virFirewallInitialize() < 0)
+        return VIR_FIREWALL_BACKEND_AUTOMATIC;
+
+    return currentBackend;
+}
+
 static virFirewallGroupPtr
 virFirewallGroupNew(void)
 {
@@ -367,6 +493,7 @@ virFirewallAddRuleFullV(virFirewallPtr firewall,
         if (ip6tablesUseLock)
             ADD_ARG(rule, "-w");
         break;
+    case VIR_FIREWALL_LAYER_NFTABLES:
     case VIR_FIREWALL_LAYER_LAST:
         break;
     }
@@ -699,6 +826,199 @@ virFirewallApplyRuleDirect(virFirewallRulePtr rule,
 }
 
 
+/*
+ * Convert @rule to a line of iptables-restore input, storing the
+ * table it belongs to in @table. Only rules which modify the
+ * ruleset can be batched; queries and anything we cannot quote
+ * safely are applied one by one.
+ *
+ * Returns 0 if @rule was converted, -1 if it cannot be batched.
+ */
+static int
+virFirewallRuleToRestoreLine(virFirewallRulePtr rule,
+                             virBufferPtr buf,
+                             const char **table)
+{
+    static const char *commands[] = {
+        "-A", "--append", "-I", "--insert", "-D", "--delete",
+        "-R", "--replace", "-N", "--new-chain", "-X", "--delete-chain",
+        "-F", "--flush", "-P", "--policy", "-E", "--rename-chain",
+        NULL,
+    };
+    g_auto(virBuffer) line = VIR_BUFFER_INITIALIZER;
+    bool haveCommand = false;
+    size_t i;
+
+    *table = "filter";
+
+    for (i = 0; i < rule->argsLen; i++) {
+        const char *arg = rule->args[i];
+
+        if (STREQ(arg, "-w") || STREQ(arg, "--wait"))
+            continue;
+
+        if (STREQ(arg, "-t") || STREQ(arg, "--table")) {
+            if (++i == rule->argsLen)
+                return -1;
+            *table = rule->args[i];
+            continue;
+        }
+
+        if (!haveCommand) {
+            if (!virStringListHasString(commands, arg))
+                return -1;
+            haveCommand = true;
+        }
+
+        if (strpbrk(arg, "\"\\\n"))
+            return -1;
+
+        if (virBufferUse(&line) > 0)
+            virBufferAddLit(&line, " ");
+
+        if (!*arg || strpbrk(arg, " \t'#"))
+            virBufferAsprintf(&line, "\"%s\"", arg);
+        else
+            virBufferAdd(&line, arg, -1);
+    }
+
+    if (!haveCommand)
+        return -1;
+
+    virBufferAddBuffer(buf, &line);
+    virBufferAddLit(buf, "\n");
+    return 0;
+}
+
+
+static bool
+virFirewallRuleCanBatch(virFirewallRulePtr rule,
+                        bool ignoreErrors)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    const char *table;
+
+    /* iptables-restore and nft commit a whole batch or nothing, so
+     * rules whose failure must be ignored, or whose output is needed,
+     * have to run on their own */
+    if (!restoreBatch[rule->layer] ||
+        rule->queryCB ||
+        ignoreErrors || rule->ignoreErrors)
+        return false;
+
+    if (rule->layer == VIR_FIREWALL_LAYER_NFTABLES)
+        return true;
+
+    if (currentBackend != VIR_FIREWALL_BACKEND_DIRECT &&
+        currentBackend != VIR_FIREWALL_BACKEND_NFTABLES)
+        return false;
+
+    return virFirewallRuleToRestoreLine(rule, &buf, &table) == 0;
+}
+
+
+/*
+ * nft(8) concatenates its arguments into a single command, so
+ * a rule is batched by writing its arguments out as one line.
+ */
+static void
+virFirewallRuleToNftLine(virFirewallRulePtr rule,
+                         virBufferPtr buf)
+{
+    size_t i;
+
+    for (i = 0; i < rule->argsLen; i++) {
+        if (i > 0)
+            virBufferAddLit(buf, " ");
+        virBufferAdd(buf, rule->args[i], -1);
+    }
+    virBufferAddLit(buf, "\n");
+}
+
+
+static int
+virFirewallFormatRestoreBatch(virFirewallRulePtr *rules,
+                              size_t nrules,
+                              virBufferPtr buf)
+{
+    const char *curTable = NULL;
+    size_t i;
+
+    for (i = 0; i < nrules; i++) {
+        g_auto(virBuffer) line = VIR_BUFFER_INITIALIZER;
+        const char *table;
+
+        if (virFirewallRuleToRestoreLine(rules[i], &line, &table) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Unable to batch firewall rule"));
+            return -1;
+        }
+
+        /* Keep the original ordering: every switch of table
+         * starts a new, separately committed section */
+        if (!curTable || STRNEQ(curTable, table)) {
+            if (curTable)
+                virBufferAddLit(buf, "COMMIT\n");
+            virBufferAsprintf(buf, "*%s\n", table);
+            curTable = table;
+        }
+        virBufferAddBuffer(buf, &line);
+    }
+    virBufferAddLit(buf, "COMMIT\n");
+
+    return 0;
+}
+
+
+static int
+virFirewallApplyBatchDirect(virFirewallRulePtr *rules,
+                            size_t nrules)
+{
+    virFirewallLayer layer = rules[0]->layer;
+    const char *bin = virFirewallLayerRestoreCommand[layer];
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autoptr(virCommand) cmd = NULL;
+    g_autofree char *input = NULL;
+    g_autofree char *error = NULL;
+    int status;
+    size_t i;
+
+    if (layer == VIR_FIREWALL_LAYER_NFTABLES) {
+        for (i = 0; i < nrules; i++)
+            virFirewallRuleToNftLine(rules[i], &buf);
+    } else if (virFirewallFormatRestoreBatch(rules, nrules, &buf) < 0) {
+        return -1;
+    }
+
+    input = virBufferContentAndReset(&buf);
+    VIR_INFO("Applying %zu rules with '%s'", nrules, bin);
+    VIR_DEBUG("Batched rules:\n%s", input);
+
+    cmd = virCommandNewArgList(bin, NULL);
+    if ((layer == VIR_FIREWALL_LAYER_IPV4 && iptablesUseLock) ||
+        (layer == VIR_FIREWALL_LAYER_IPV6 && ip6tablesUseLock))
+        virCommandAddArg(cmd, "-w");
+    if (layer == VIR_FIREWALL_LAYER_NFTABLES)
+        virCommandAddArgList(cmd, "-f", "-", NULL);
+    else
+        virCommandAddArg(cmd, "--noflush");
+    virCommandSetInputBuffer(cmd, input);
+    virCommandSetErrorBuffer(cmd, &error);
+
+    if (virCommandRun(cmd, &status) < 0)
+        return -1;
+
+    if (status != 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Failed to apply firewall rules with %s: %s"),
+                       bin, NULLSTR(error));
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 virFirewallApplyRuleFirewallD(virFirewallRulePtr rule,
                               bool ignoreErrors,
@@ -716,13 +1036,20 @@ virFirewallApplyRule(virFirewallPtr firewall,
     g_autofree char *output = NULL;
     g_autofree char *str = virFirewallRuleToString(rule);
     VIR_AUTOSTRINGLIST lines = NULL;
+    virFirewallBackend backend = currentBackend;
     VIR_INFO("Applying rule '%s'", NULLSTR(str));
 
     if (rule->ignoreErrors)
         ignoreErrors = rule->ignoreErrors;
 
-    switch (currentBackend) {
+    /* firewalld has no passthrough for nftables rules, they
+     * are always run directly */
+    if (rule->layer == VIR_FIREWALL_LAYER_NFTABLES)
+        backend = VIR_FIREWALL_BACKEND_DIRECT;
+
+    switch (backend) {
     case VIR_FIREWALL_BACKEND_DIRECT:
+    case VIR_FIREWALL_BACKEND_NFTABLES:
         if (virFirewallApplyRuleDirect(rule, ignoreErrors, &output) < 0)
             return -1;
         break;
@@ -734,7 +1061,7 @@ virFirewallApplyRule(virFirewallPtr firewall,
     case VIR_FIREWALL_BACKEND_AUTOMATIC:
     case VIR_FIREWALL_BACKEND_LAST:
     default:
-        virReportEnumRangeError(virFirewallBackend, currentBackend);
+        virReportEnumRangeError(virFirewallBackend, backend);
         return -1;
     }
 
@@ -774,6 +1101,24 @@ virFirewallApplyGroup(virFirewallPtr firewall,
     firewall->currentGroup = idx;
     group->addingRollback = false;
     for (i = 0; i < group->naction; i++) {
+        size_t n = 1;
+
+        /* Collect a run of consecutive rules for the same layer
+         * which can be committed in a single restore transaction */
+        if (virFirewallRuleCanBatch(group->action[i], ignoreErrors)) {
+            while (i + n < group->naction &&
+                   group->action[i + n]->layer == group->action[i]->layer &&
+                   virFirewallRuleCanBatch(group->action[i + n], ignoreErrors))
+                n++;
+        }
+
+        if (n > 1) {
+            if (virFirewallApplyBatchDirect(group->action + i, n) < 0)
+                return -1;
+            i += n - 1;
+            continue;
+        }
+
         if (virFirewallApplyRule(firewall,
                                  group->action[i],
                                  ignoreErrors) < 0)
@@ -21,6 +21,7 @@
 #pragma once
 
 #include "internal.h"
+#include "virenum.h"
 
 typedef struct _virFirewall virFirewall;
 typedef virFirewall *virFirewallPtr;
@@ -32,10 +33,25 @@ typedef enum {
     VIR_FIREWALL_LAYER_ETHERNET,
     VIR_FIREWALL_LAYER_IPV4,
     VIR_FIREWALL_LAYER_IPV6,
+    VIR_FIREWALL_LAYER_NFTABLES, /* rules in nft(8) syntax, any family */
 
     VIR_FIREWALL_LAYER_LAST,
 } virFirewallLayer;
 
+typedef enum {
+    VIR_FIREWALL_BACKEND_AUTOMATIC,
+    VIR_FIREWALL_BACKEND_DIRECT,
+    VIR_FIREWALL_BACKEND_FIREWALLD,
+    VIR_FIREWALL_BACKEND_NFTABLES,
+
+    VIR_FIREWALL_BACKEND_LAST,
+} virFirewallBackend;
+
+VIR_ENUM_DECL(virFirewallBackend);
+
+int virFirewallSetBackend(virFirewallBackend backend);
+virFirewallBackend virFirewallGetBackend(void);
+
 virFirewallPtr virFirewallNew(void);
 
 void virFirewallFree(virFirewallPtr firewall);
@@ -46,6 +46,7 @@ VIR_ENUM_IMPL(virFirewallLayerFirewallD,
               "eb",
               "ipv4",
               "ipv6",
+              "nft",
               );
 
 
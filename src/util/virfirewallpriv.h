@@ -26,12 +26,6 @@
 
 #include "virfirewall.h"
 
-typedef enum {
-    VIR_FIREWALL_BACKEND_AUTOMATIC,
-    VIR_FIREWALL_BACKEND_DIRECT,
-    VIR_FIREWALL_BACKEND_FIREWALLD,
+void virFirewallSetBatching(bool enable);
 
-    VIR_FIREWALL_BACKEND_LAST,
-} virFirewallBackend;
-
-int virFirewallSetBackend(virFirewallBackend backend);
+void virFirewallSetBackendOverride(virFirewallBackend backend);
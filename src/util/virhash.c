@@ -34,6 +34,9 @@ VIR_LOG_INIT("util.hash");
 
 #define MAX_HASH_LEN 8
 
+/* Default number of lock stripes in a virHashAtomic table */
+#define VIR_HASH_ATOMIC_STRIPES 16
+
 /* #define DEBUG_GROW */
 
 /*
@@ -63,17 +66,31 @@ struct _virHashTable {
     virHashKeyFree keyFree;
 };
 
-struct _virHashAtomic {
-    virObjectLockable parent;
+/*
+ * One stripe of a virHashAtomic table: an independent hash table
+ * guarded by its own read-write lock, so that operations on keys
+ * hashing to different stripes never touch the same lock.
+ */
+typedef struct _virHashAtomicStripe virHashAtomicStripe;
+typedef virHashAtomicStripe *virHashAtomicStripePtr;
+struct _virHashAtomicStripe {
+    virRWLock lock;
     virHashTablePtr hash;
 };
 
+struct _virHashAtomic {
+    virObject parent;
+    uint32_t seed;
+    size_t nstripes;
+    virHashAtomicStripePtr stripes;
+};
+
 static virClassPtr virHashAtomicClass;
 static void virHashAtomicDispose(void *obj);
 
 static int virHashAtomicOnceInit(void)
 {
-    if (!VIR_CLASS_NEW(virHashAtomic, virClassForObjectLockable()))
+    if (!VIR_CLASS_NEW(virHashAtomic, virClassForObject()))
         return -1;
 
     return 0;
@@ -211,32 +228,86 @@ virHashTablePtr virHashCreate(ssize_t size, virHashDataFree dataFree)
 }
 
 
+/**
+ * virHashAtomicNewStriped:
+ * @nstripes: number of lock stripes, rounded up to a power of two
+ * @size: the expected total number of entries
+ * @dataFree: callback to free data
+ *
+ * Create a new thread safe hash table. The key space is split
+ * into @nstripes independent tables, each with its own read-write
+ * lock, so that concurrent readers and writers of unrelated keys
+ * do not contend on a single lock.
+ *
+ * Returns the newly created object, or NULL on error.
+ */
 virHashAtomicPtr
-virHashAtomicNew(ssize_t size,
-                 virHashDataFree dataFree)
+virHashAtomicNewStriped(size_t nstripes,
+                        ssize_t size,
+                        virHashDataFree dataFree)
 {
     virHashAtomicPtr hash;
+    size_t n = 1;
+    size_t i;
 
     if (virHashAtomicInitialize() < 0)
         return NULL;
 
-    if (!(hash = virObjectLockableNew(virHashAtomicClass)))
-        return NULL;
+    while (n < nstripes)
+        n <<= 1;
 
-    if (!(hash->hash = virHashCreate(size, dataFree))) {
-        virObjectUnref(hash);
+    if (!(hash = virObjectNew(virHashAtomicClass)))
         return NULL;
+
+    hash->seed = virRandomBits(32);
+    hash->stripes = g_new0(virHashAtomicStripe, n);
+
+    for (i = 0; i < n; i++) {
+        if (virRWLockInit(&hash->stripes[i].lock) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("unable to initialize hash stripe lock"));
+            virObjectUnref(hash);
+            return NULL;
+        }
+        hash->nstripes++;
+
+        hash->stripes[i].hash = virHashCreate(size > 0 ? MAX(size / n, 8) : 0,
+                                              dataFree);
     }
+
     return hash;
 }
 
 
+virHashAtomicPtr
+virHashAtomicNew(ssize_t size,
+                 virHashDataFree dataFree)
+{
+    return virHashAtomicNewStriped(VIR_HASH_ATOMIC_STRIPES, size, dataFree);
+}
+
+
 static void
 virHashAtomicDispose(void *obj)
 {
     virHashAtomicPtr hash = obj;
+    size_t i;
 
-    virHashFree(hash->hash);
+    for (i = 0; i < hash->nstripes; i++) {
+        virHashFree(hash->stripes[i].hash);
+        virRWLockDestroy(&hash->stripes[i].lock);
+    }
+    VIR_FREE(hash->stripes);
+}
+
+
+static virHashAtomicStripePtr
+virHashAtomicGetStripe(virHashAtomicPtr table,
+                       const void *name)
+{
+    uint32_t code = virHashStrCode(name, table->seed);
+
+    return &table->stripes[code & (table->nstripes - 1)];
 }
 
 
@@ -431,11 +502,47 @@ virHashAtomicUpdate(virHashAtomicPtr table,
                     const void *name,
                     void *userdata)
 {
+    virHashAtomicStripePtr stripe;
     int ret;
 
-    virObjectLock(table);
-    ret = virHashAddOrUpdateEntry(table->hash, name, userdata, true);
-    virObjectUnlock(table);
+    if (!table || !name)
+        return -1;
+
+    stripe = virHashAtomicGetStripe(table, name);
+    virRWLockWrite(&stripe->lock);
+    ret = virHashAddOrUpdateEntry(stripe->hash, name, userdata, true);
+    virRWLockUnlock(&stripe->lock);
+
+    return ret;
+}
+
+
+/**
+ * virHashAtomicAdd:
+ * @table: the thread safe hash table
+ * @name: the name of the userdata
+ * @userdata: a pointer to the userdata
+ *
+ * Add the @userdata to the hash @table, holding only the lock of
+ * the stripe @name maps to. Duplicate entries generate errors.
+ *
+ * Returns 0 the addition succeeded and -1 in case of error.
+ */
+int
+virHashAtomicAdd(virHashAtomicPtr table,
+                 const void *name,
+                 void *userdata)
+{
+    virHashAtomicStripePtr stripe;
+    int ret;
+
+    if (!table || !name)
+        return -1;
+
+    stripe = virHashAtomicGetStripe(table, name);
+    virRWLockWrite(&stripe->lock);
+    ret = virHashAddOrUpdateEntry(stripe->hash, name, userdata, false);
+    virRWLockUnlock(&stripe->lock);
 
     return ret;
 }
@@ -525,11 +632,16 @@ void *
 virHashAtomicSteal(virHashAtomicPtr table,
                    const void *name)
 {
+    virHashAtomicStripePtr stripe;
     void *data;
 
-    virObjectLock(table);
-    data = virHashSteal(table->hash, name);
-    virObjectUnlock(table);
+    if (!table || !name)
+        return NULL;
+
+    stripe = virHashAtomicGetStripe(table, name);
+    virRWLockWrite(&stripe->lock);
+    data = virHashSteal(stripe->hash, name);
+    virRWLockUnlock(&stripe->lock);
 
     return data;
 }
@@ -849,3 +961,185 @@ bool virHashEqual(const virHashTable *table1,
 
     return data.equal;
 }
+
+
+/**
+ * virHashAtomicRemove:
+ * @table: the thread safe hash table
+ * @name: the name of the userdata
+ *
+ * Remove the entry specified by @name, freeing its payload with the
+ * callback provided at creation time.
+ *
+ * Returns 0 if the removal succeeded and -1 in case of error or not found.
+ */
+int
+virHashAtomicRemove(virHashAtomicPtr table,
+                    const void *name)
+{
+    virHashAtomicStripePtr stripe;
+    int ret;
+
+    if (!table || !name)
+        return -1;
+
+    stripe = virHashAtomicGetStripe(table, name);
+    virRWLockWrite(&stripe->lock);
+    ret = virHashRemoveEntry(stripe->hash, name);
+    virRWLockUnlock(&stripe->lock);
+
+    return ret;
+}
+
+
+/**
+ * virHashAtomicHasEntry:
+ * @table: the thread safe hash table
+ * @name: the name of the userdata
+ *
+ * Returns true if the entry specified by @name exists and false otherwise
+ */
+bool
+virHashAtomicHasEntry(virHashAtomicPtr table,
+                      const void *name)
+{
+    virHashAtomicStripePtr stripe;
+    bool ret;
+
+    if (!table || !name)
+        return false;
+
+    stripe = virHashAtomicGetStripe(table, name);
+    virRWLockRead(&stripe->lock);
+    ret = virHashHasEntry(stripe->hash, name);
+    virRWLockUnlock(&stripe->lock);
+
+    return ret;
+}
+
+
+/**
+ * virHashAtomicLookupRef:
+ * @table: the thread safe hash table
+ * @name: the name of the userdata
+ *
+ * Find the userdata specified by @name. The payloads stored in
+ * @table must be virObject instances; the returned object has its
+ * reference count increased while the stripe lock is still held,
+ * so it stays valid even if it is concurrently removed. Only the
+ * lock of the stripe @name maps to is taken, in read mode.
+ *
+ * Returns a referenced pointer to the userdata or NULL if not found.
+ */
+void *
+virHashAtomicLookupRef(virHashAtomicPtr table,
+                       const void *name)
+{
+    virHashAtomicStripePtr stripe;
+    void *data;
+
+    if (!table || !name)
+        return NULL;
+
+    stripe = virHashAtomicGetStripe(table, name);
+    virRWLockRead(&stripe->lock);
+    data = virObjectRef(virHashLookup(stripe->hash, name));
+    virRWLockUnlock(&stripe->lock);
+
+    return data;
+}
+
+
+/**
+ * virHashAtomicSize:
+ * @table: the thread safe hash table
+ *
+ * Query the number of elements installed in the hash @table. The
+ * count is only exact if the caller prevents concurrent modification.
+ *
+ * Returns the number of elements in the hash table or
+ * -1 in case of error
+ */
+ssize_t
+virHashAtomicSize(virHashAtomicPtr table)
+{
+    ssize_t ret = 0;
+    size_t i;
+
+    if (!table)
+        return -1;
+
+    for (i = 0; i < table->nstripes; i++) {
+        virRWLockRead(&table->stripes[i].lock);
+        ret += virHashSize(table->stripes[i].hash);
+        virRWLockUnlock(&table->stripes[i].lock);
+    }
+
+    return ret;
+}
+
+
+/**
+ * virHashAtomicForEach:
+ * @table: the thread safe hash table to process
+ * @iter: callback to process each element
+ * @data: opaque data to pass to the iterator
+ *
+ * Iterates over every element in the hash table, one stripe at a
+ * time, holding the read lock of the stripe being visited. The
+ * callback must not modify @table. If @iter fails and returns a
+ * negative value, the evaluation is stopped and -1 is returned.
+ *
+ * Returns 0 on success or -1 on failure.
+ */
+int
+virHashAtomicForEach(virHashAtomicPtr table,
+                     virHashIterator iter,
+                     void *data)
+{
+    size_t i;
+    int ret = 0;
+
+    if (!table || !iter)
+        return -1;
+
+    for (i = 0; i < table->nstripes && ret == 0; i++) {
+        virRWLockRead(&table->stripes[i].lock);
+        ret = virHashForEach(table->stripes[i].hash, iter, data);
+        virRWLockUnlock(&table->stripes[i].lock);
+    }
+
+    return ret;
+}
+
+
+/**
+ * virHashAtomicSearchRef:
+ * @table: the thread safe hash table to search
+ * @iter: an iterator to identify the desired element
+ * @data: extra opaque information passed to the iter
+ *
+ * Like virHashSearch, but the payloads must be virObject instances
+ * and the returned one has its reference count increased.
+ *
+ * Returns a referenced pointer to the first matching element or NULL.
+ */
+void *
+virHashAtomicSearchRef(virHashAtomicPtr table,
+                       virHashSearcher iter,
+                       const void *data)
+{
+    void *ret = NULL;
+    size_t i;
+
+    if (!table || !iter)
+        return NULL;
+
+    for (i = 0; i < table->nstripes && !ret; i++) {
+        virRWLockRead(&table->stripes[i].lock);
+        ret = virObjectRef(virHashSearch(table->stripes[i].hash, iter, data, NULL));
+        virRWLockUnlock(&table->stripes[i].lock);
+    }
+
+    return ret;
+}
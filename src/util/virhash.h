@@ -116,6 +116,9 @@ virHashTablePtr virHashCreate(ssize_t size,
                               virHashDataFree dataFree);
 virHashAtomicPtr virHashAtomicNew(ssize_t size,
                                   virHashDataFree dataFree);
+virHashAtomicPtr virHashAtomicNewStriped(size_t nstripes,
+                                         ssize_t size,
+                                         virHashDataFree dataFree);
 virHashTablePtr virHashCreateFull(ssize_t size,
                                   virHashDataFree dataFree,
                                   virHashKeyCode keyCode,
@@ -138,12 +141,17 @@ int virHashUpdateEntry(virHashTablePtr table,
 int virHashAtomicUpdate(virHashAtomicPtr table,
                         const void *name,
                         void *userdata);
+int virHashAtomicAdd(virHashAtomicPtr table,
+                     const void *name,
+                     void *userdata);
 
 /*
  * Remove an entry from the hash table.
  */
 int virHashRemoveEntry(virHashTablePtr table,
                        const void *name);
+int virHashAtomicRemove(virHashAtomicPtr table,
+                        const void *name);
 
 /*
  * Remove all entries from the hash table.
@@ -155,6 +163,9 @@ ssize_t virHashRemoveAll(virHashTablePtr table);
  */
 void *virHashLookup(const virHashTable *table, const void *name);
 bool virHashHasEntry(const virHashTable *table, const void *name);
+void *virHashAtomicLookupRef(virHashAtomicPtr table, const void *name);
+bool virHashAtomicHasEntry(virHashAtomicPtr table, const void *name);
+ssize_t virHashAtomicSize(virHashAtomicPtr table);
 
 /*
  * Retrieve & remove the userdata.
@@ -205,6 +216,10 @@ int virHashForEach(virHashTablePtr table, virHashIterator iter, void *data);
 ssize_t virHashRemoveSet(virHashTablePtr table, virHashSearcher iter, const void *data);
 void *virHashSearch(const virHashTable *table, virHashSearcher iter,
                     const void *data, void **name);
+int virHashAtomicForEach(virHashAtomicPtr table, virHashIterator iter,
+                         void *data);
+void *virHashAtomicSearchRef(virHashAtomicPtr table, virHashSearcher iter,
+                             const void *data);
 
 /* Convenience for when VIR_FREE(value) is sufficient as a data freer.  */
 void virHashValueFree(void *value);
@@ -1148,3 +1148,38 @@ iptablesRemoveOutputFixUdpChecksum(virFirewallPtr fw,
 {
     iptablesOutputFixUdpChecksum(fw, deletePrivate, iface, port, REMOVE);
 }
+
+/**
+ * iptablesAddOutputFixUdpChecksumBuiltin:
+ * @ctx: pointer to the IP table context
+ * @iface: the interface name
+ * @port: the UDP port to match
+ *
+ * Like iptablesAddOutputFixUdpChecksum(), but adds the rule straight
+ * to the POSTROUTING chain, for when the libvirt private chains are
+ * not used, i.e. with the nftables backend.
+ */
+void
+iptablesAddOutputFixUdpChecksumBuiltin(virFirewallPtr fw,
+                                       const char *iface,
+                                       int port)
+{
+    iptablesOutputFixUdpChecksum(fw, false, iface, port, ADD);
+}
+
+/**
+ * iptablesRemoveOutputFixUdpChecksumBuiltin:
+ * @ctx: pointer to the IP table context
+ * @iface: the interface name
+ * @port: the UDP port of the rule to remove
+ *
+ * Removes the checksum fixup rule that was previous added with
+ * iptablesAddOutputFixUdpChecksumBuiltin.
+ */
+void
+iptablesRemoveOutputFixUdpChecksumBuiltin(virFirewallPtr fw,
+                                          const char *iface,
+                                          int port)
+{
+    iptablesOutputFixUdpChecksum(fw, false, iface, port, REMOVE);
+}
@@ -155,3 +155,9 @@ void             iptablesAddOutputFixUdpChecksum (virFirewallPtr fw,
 void             iptablesRemoveOutputFixUdpChecksum (virFirewallPtr fw,
                                                      const char *iface,
                                                      int port);
+void             iptablesAddOutputFixUdpChecksumBuiltin (virFirewallPtr fw,
+                                                         const char *iface,
+                                                         int port);
+void             iptablesRemoveOutputFixUdpChecksumBuiltin (virFirewallPtr fw,
+                                                            const char *iface,
+                                                            int port);
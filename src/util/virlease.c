@@ -23,10 +23,14 @@
 #include <config.h>
 
 #include "virlease.h"
+#include "virleaseindex.h"
 
 #include <time.h>
+#include <sys/stat.h>
 
 #include "virfile.h"
+#include "virlog.h"
+#include "virsocketaddr.h"
 #include "virstring.h"
 #include "virerror.h"
 #include "viralloc.h"
@@ -34,6 +38,8 @@
 
 #define VIR_FROM_THIS VIR_FROM_NETWORK
 
+VIR_LOG_INIT("util.lease");
+
 /**
  * VIR_NETWORK_DHCP_LEASE_FILE_SIZE_MAX:
  *
@@ -263,3 +269,161 @@ virLeaseNew(virJSONValuePtr *lease_ret,
     lease_new = NULL;
     return 0;
 }
+
+
+/**
+ * virLeaseIndexFileName:
+ * @custom_lease_file: path to the custom leases file
+ *
+ * Returns the path of the index kept alongside @custom_lease_file.
+ */
+char *
+virLeaseIndexFileName(const char *custom_lease_file)
+{
+    return g_strdup_printf("%s" VIR_LEASE_INDEX_SUFFIX, custom_lease_file);
+}
+
+
+typedef struct {
+    virLeaseIndexHeader header;
+    const virLeaseIndexRecord *records;
+} virLeaseIndex;
+
+
+static int
+virLeaseIndexRecordCompare(const void *a,
+                           const void *b)
+{
+    const virLeaseIndexRecord *ra = a;
+    const virLeaseIndexRecord *rb = b;
+
+    return strcmp(ra->hostname, rb->hostname);
+}
+
+
+static int
+virLeaseIndexWriteHelper(int fd, const void *opaque)
+{
+    const virLeaseIndex *idx = opaque;
+
+    if (safewrite(fd, &idx->header, sizeof(idx->header)) < 0)
+        return -1;
+
+    if (idx->header.nrecords > 0 &&
+        safewrite(fd, idx->records,
+                  sizeof(*idx->records) * idx->header.nrecords) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static struct timespec
+virLeaseGetMtime(const struct stat *sb)
+{
+#if defined(__APPLE__)
+    return sb->st_mtimespec;
+#elif defined(WIN32)
+    return (struct timespec){ sb->st_mtime, 0 };
+#else
+    return sb->st_mtim;
+#endif
+}
+
+
+/**
+ * virLeaseWriteIndex:
+ * @leases_array: leases as just written to @custom_lease_file
+ * @custom_lease_file: path to the custom leases file
+ *
+ * Atomically replace the binary index of @custom_lease_file which
+ * lets the NSS module look up hostnames without parsing JSON. The
+ * index records the inode, size and mtime of @custom_lease_file, so it
+ * has to be regenerated whenever the leases file is rewritten. If some
+ * lease can't be represented in the index, the index is removed
+ * instead and readers fall back to the leases file.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virLeaseWriteIndex(virJSONValuePtr leases_array,
+                   const char *custom_lease_file)
+{
+    g_autofree char *index_file = virLeaseIndexFileName(custom_lease_file);
+    g_autofree virLeaseIndexRecord *records = NULL;
+    size_t nrecords = virJSONValueArraySize(leases_array);
+    virLeaseIndex idx = { 0 };
+    struct timespec mtime;
+    struct stat sb;
+    size_t i;
+
+    if (stat(custom_lease_file, &sb) < 0) {
+        virReportSystemError(errno, _("cannot stat file '%s'"),
+                             custom_lease_file);
+        return -1;
+    }
+
+    records = g_new0(virLeaseIndexRecord, nrecords);
+
+    for (i = 0; i < nrecords; i++) {
+        virJSONValuePtr lease_tmp = virJSONValueArrayGet(leases_array, i);
+        virLeaseIndexRecord *rec = &records[i];
+        const char *ip_tmp = virJSONValueObjectGetString(lease_tmp, "ip-address");
+        const char *mac_tmp = virJSONValueObjectGetString(lease_tmp, "mac-address");
+        const char *hostname_tmp = virJSONValueObjectGetString(lease_tmp, "hostname");
+        long long expirytime = 0;
+        virSocketAddr addr;
+
+        /* A lease without expiry time is treated as expired by the
+         * JSON parser in the NSS module, keep it that way. */
+        ignore_value(virJSONValueObjectGetNumberLong(lease_tmp, "expiry-time",
+                                                     &expirytime));
+
+        if (!ip_tmp || !mac_tmp ||
+            virStrcpyStatic(rec->mac, mac_tmp) < 0 ||
+            (hostname_tmp && virStrcpyStatic(rec->hostname, hostname_tmp) < 0) ||
+            virSocketAddrParse(&addr, ip_tmp, AF_UNSPEC) < 0) {
+            VIR_DEBUG("Lease %zu can't be indexed, removing '%s'",
+                      i, index_file);
+            goto unindexable;
+        }
+
+        rec->expirytime = expirytime;
+        rec->af = VIR_SOCKET_ADDR_FAMILY(&addr);
+        if (rec->af == AF_INET) {
+            memcpy(rec->addr, &addr.data.inet4.sin_addr,
+                   sizeof(addr.data.inet4.sin_addr));
+        } else if (rec->af == AF_INET6) {
+            memcpy(rec->addr, &addr.data.inet6.sin6_addr,
+                   sizeof(addr.data.inet6.sin6_addr));
+        } else {
+            VIR_DEBUG("Unexpected address family %d of lease %zu",
+                      rec->af, i);
+            goto unindexable;
+        }
+    }
+
+    if (nrecords > 0)
+        qsort(records, nrecords, sizeof(*records), virLeaseIndexRecordCompare);
+
+    mtime = virLeaseGetMtime(&sb);
+
+    memcpy(idx.header.magic, VIR_LEASE_INDEX_MAGIC, sizeof(VIR_LEASE_INDEX_MAGIC));
+    idx.header.version = VIR_LEASE_INDEX_VERSION;
+    idx.header.recordSize = sizeof(virLeaseIndexRecord);
+    idx.header.nrecords = nrecords;
+    idx.header.leasesInode = sb.st_ino;
+    idx.header.leasesSize = sb.st_size;
+    idx.header.leasesMtimeSec = mtime.tv_sec;
+    idx.header.leasesMtimeNsec = mtime.tv_nsec;
+    idx.records = records;
+
+    return virFileRewrite(index_file, 0644, virLeaseIndexWriteHelper, &idx);
+
+ unindexable:
+    if (unlink(index_file) < 0 && errno != ENOENT) {
+        virReportSystemError(errno, _("Unable to remove '%s'"), index_file);
+        return -1;
+    }
+    return 0;
+}
@@ -40,3 +40,8 @@ int virLeaseNew(virJSONValuePtr *lease_ret,
                 const char *hostname,
                 const char *iaid,
                 const char *server_duid);
+
+char *virLeaseIndexFileName(const char *custom_lease_file);
+
+int virLeaseWriteIndex(virJSONValuePtr leases_array,
+                       const char *custom_lease_file);
@@ -0,0 +1,73 @@
+/*
+ * virleaseindex.h: on-disk format of the leases index
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+/* This header is shared between the leases helper, which writes the
+ * index, and the NSS module, which maps it. The NSS module is loaded
+ * into arbitrary processes and is built without the rest of libvirt,
+ * so nothing but libc may be used here. */
+
+#include <stdint.h>
+
+/* The index lives next to the custom leases file, e.g.
+ * virbr0.status -> virbr0.status.idx */
+#define VIR_LEASE_INDEX_SUFFIX ".idx"
+
+#define VIR_LEASE_INDEX_MAGIC "LVLEASE"
+#define VIR_LEASE_INDEX_VERSION 1
+
+#define VIR_LEASE_INDEX_HOSTNAME_LEN 64
+#define VIR_LEASE_INDEX_MAC_LEN 24
+
+/*
+ * The file consists of a virLeaseIndexHeader immediately followed by
+ * @nrecords virLeaseIndexRecord structs sorted by hostname (strcmp
+ * order). Leases without a hostname have an empty one and thus sort
+ * first. Numbers are stored in host byte order since the file never
+ * leaves the host.
+ *
+ * @leasesInode, @leasesSize and @leasesMtime* describe the custom leases
+ * file the index was generated from. A reader must ignore the index
+ * whenever they don't match the leases file anymore. The leases file is
+ * always replaced by rename, so a new inode reliably tells that it was
+ * rewritten, whatever the timestamp granularity of the filesystem.
+ */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t nrecords;
+    uint32_t padding;
+    int64_t leasesSize;
+    int64_t leasesMtimeSec;
+    int64_t leasesMtimeNsec;
+    uint64_t leasesInode;
+} virLeaseIndexHeader;
+
+typedef struct {
+    char hostname[VIR_LEASE_INDEX_HOSTNAME_LEN];
+    char mac[VIR_LEASE_INDEX_MAC_LEN];
+    int64_t expirytime;
+    int32_t af;
+    unsigned char addr[16];
+    uint32_t padding;
+} virLeaseIndexRecord;
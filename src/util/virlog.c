@@ -69,7 +69,7 @@ static GRegex *virLogRegex;
 VIR_ENUM_DECL(virLogDestination);
 VIR_ENUM_IMPL(virLogDestination,
               VIR_LOG_TO_OUTPUT_LAST,
-              "stderr", "syslog", "file", "journald",
+              "stderr", "syslog", "file", "journald", "memory",
 );
 
 /*
@@ -127,16 +127,60 @@ static void virLogOutputToFd(virLogSourcePtr src,
  */
 virMutex virLogMutex;
 
+/*
+ * In asynchronous mode messages are formatted by the thread emitting
+ * them and appended to a queue, from which a dedicated writer thread
+ * passes them on to the outputs in batches. That way threads logging
+ * only contend on the short queue lock instead of waiting for every
+ * output's I/O to complete.
+ */
+#define VIR_LOG_ASYNC_QUEUE_MAX 16384
+
+typedef struct _virLogAsyncMessage virLogAsyncMessage;
+typedef virLogAsyncMessage *virLogAsyncMessagePtr;
+struct _virLogAsyncMessage {
+    virLogAsyncMessagePtr next;
+    virLogSourcePtr source;
+    virLogPriority priority;
+    const char *filename;
+    int linenr;
+    const char *funcname;
+    char timestamp[VIR_TIME_STRING_BUFLEN];
+    char *str;
+    char *msg;
+};
+
+static virMutex virLogQueueMutex;
+static virCond virLogQueueCond;       /* messages queued or stop requested */
+static virCond virLogQueueFlushCond;  /* a batch was written out */
+static virLogAsyncMessagePtr virLogQueueHead;
+static virLogAsyncMessagePtr *virLogQueueTail = &virLogQueueHead;
+static size_t virLogQueueLen;
+static unsigned long long virLogQueueSeq;      /* messages queued so far */
+static unsigned long long virLogQueueDone;     /* messages written so far */
+static unsigned long long virLogQueueDropped;  /* not reported yet */
+static unsigned long long virLogQueueDroppedTotal;
+static bool virLogAsync;
+static bool virLogAsyncQuit;
+static pid_t virLogAsyncPid;
+static virThread virLogAsyncThread;
+
+/*
+ * Besides serializing output, the lock taken by virLogLock also keeps
+ * the message queue consistent across fork().
+ */
 void
 virLogLock(void)
 {
     virMutexLock(&virLogMutex);
+    virMutexLock(&virLogQueueMutex);
 }
 
 
 void
 virLogUnlock(void)
 {
+    virMutexUnlock(&virLogQueueMutex);
     virMutexUnlock(&virLogMutex);
 }
 
@@ -163,28 +207,38 @@ virLogSetDefaultOutputToJournald(void)
 }
 
 
-static int
-virLogSetDefaultOutputToFile(const char *binary, bool privileged)
+static char *
+virLogGetDefaultLogDir(bool privileged)
 {
     g_autofree char *logdir = NULL;
     mode_t old_umask;
 
-    if (privileged) {
-        virLogDefaultOutput = g_strdup_printf("%d:file:%s/log/libvirt/%s.log",
-                                              virLogDefaultPriority, LOCALSTATEDIR, binary);
-    } else {
-        logdir = virGetUserCacheDirectory();
+    if (privileged)
+        return g_strdup(LOCALSTATEDIR "/log/libvirt");
 
-        old_umask = umask(077);
-        if (virFileMakePath(logdir) < 0) {
-            umask(old_umask);
-            return -1;
-        }
-        umask(old_umask);
+    logdir = virGetUserCacheDirectory();
 
-        virLogDefaultOutput = g_strdup_printf("%d:file:%s/%s.log",
-                                              virLogDefaultPriority, logdir, binary);
+    old_umask = umask(077);
+    if (virFileMakePath(logdir) < 0) {
+        umask(old_umask);
+        return NULL;
     }
+    umask(old_umask);
+
+    return g_steal_pointer(&logdir);
+}
+
+
+static int
+virLogSetDefaultOutputToFile(const char *binary, bool privileged)
+{
+    g_autofree char *logdir = NULL;
+
+    if (!(logdir = virLogGetDefaultLogDir(privileged)))
+        return -1;
+
+    virLogDefaultOutput = g_strdup_printf("%d:file:%s/%s.log",
+                                          virLogDefaultPriority, logdir, binary);
 
     return 0;
 }
@@ -247,7 +301,10 @@ virLogPriorityString(virLogPriority lvl)
 static int
 virLogOnceInit(void)
 {
-    if (virMutexInit(&virLogMutex) < 0)
+    if (virMutexInit(&virLogMutex) < 0 ||
+        virMutexInit(&virLogQueueMutex) < 0 ||
+        virCondInit(&virLogQueueCond) < 0 ||
+        virCondInit(&virLogQueueFlushCond) < 0)
         return -1;
 
     virLogLock();
@@ -283,6 +340,8 @@ virLogReset(void)
     if (virLogInitialize() < 0)
         return -1;
 
+    virLogStopAsync();
+
     virLogLock();
     virLogResetFilters();
     virLogResetOutputs();
@@ -485,6 +544,333 @@ virLogSourceUpdate(virLogSourcePtr source)
     virLogUnlock();
 }
 
+/*
+ * Push the message to the outputs defined, if none exist then
+ * use stderr. Must be called with virLogMutex held.
+ */
+static void
+virLogOutputMessage(virLogSourcePtr source,
+                    virLogPriority priority,
+                    const char *filename,
+                    int linenr,
+                    const char *funcname,
+                    const char *timestamp,
+                    virLogMetadataPtr metadata,
+                    const char *str,
+                    const char *msg)
+{
+    static bool logInitMessageStderr = true;
+    size_t i;
+
+    for (i = 0; i < virLogNbOutputs; i++) {
+        if (priority >= virLogOutputs[i]->priority) {
+            if (virLogOutputs[i]->logInitMessage) {
+                const char *rawinitmsg;
+                char *hoststr = NULL;
+                char *initmsg = NULL;
+                virLogVersionString(&rawinitmsg, &initmsg);
+                virLogOutputs[i]->f(&virLogSelf, VIR_LOG_INFO,
+                                    __FILE__, __LINE__, __func__,
+                                    timestamp, NULL, rawinitmsg, initmsg,
+                                    virLogOutputs[i]->data);
+                VIR_FREE(initmsg);
+
+                virLogHostnameString(&hoststr, &initmsg);
+                virLogOutputs[i]->f(&virLogSelf, VIR_LOG_INFO,
+                                    __FILE__, __LINE__, __func__,
+                                    timestamp, NULL, hoststr, initmsg,
+                                    virLogOutputs[i]->data);
+                VIR_FREE(hoststr);
+                VIR_FREE(initmsg);
+                virLogOutputs[i]->logInitMessage = false;
+            }
+            virLogOutputs[i]->f(source, priority,
+                                filename, linenr, funcname,
+                                timestamp, metadata,
+                                str, msg, virLogOutputs[i]->data);
+        }
+    }
+    if (virLogNbOutputs == 0) {
+        if (logInitMessageStderr) {
+            const char *rawinitmsg;
+            char *hoststr = NULL;
+            char *initmsg = NULL;
+            virLogVersionString(&rawinitmsg, &initmsg);
+            virLogOutputToFd(&virLogSelf, VIR_LOG_INFO,
+                             __FILE__, __LINE__, __func__,
+                             timestamp, NULL, rawinitmsg, initmsg,
+                             (void *) STDERR_FILENO);
+            VIR_FREE(initmsg);
+
+            virLogHostnameString(&hoststr, &initmsg);
+            virLogOutputToFd(&virLogSelf, VIR_LOG_INFO,
+                             __FILE__, __LINE__, __func__,
+                             timestamp, NULL, hoststr, initmsg,
+                             (void *) STDERR_FILENO);
+            VIR_FREE(hoststr);
+            VIR_FREE(initmsg);
+            logInitMessageStderr = false;
+        }
+        virLogOutputToFd(source, priority,
+                         filename, linenr, funcname,
+                         timestamp, metadata,
+                         str, msg, (void *) STDERR_FILENO);
+    }
+}
+
+
+static void
+virLogAsyncMessageFree(virLogAsyncMessagePtr entry)
+{
+    if (!entry)
+        return;
+
+    VIR_FREE(entry->str);
+    VIR_FREE(entry->msg);
+    VIR_FREE(entry);
+}
+
+
+/*
+ * Hands the message over to the writer thread if asynchronous logging
+ * is enabled, stealing @str and @msg. If the queue is full, the message
+ * is dropped and accounted for unless it is an error.
+ *
+ * Returns 1 if the message was queued, 0 if it was dropped and -1 if
+ * it has to be written out synchronously.
+ */
+static int
+virLogEnqueue(virLogSourcePtr source,
+              virLogPriority priority,
+              const char *filename,
+              int linenr,
+              const char *funcname,
+              const char *timestamp,
+              char **str,
+              char **msg)
+{
+    virLogAsyncMessagePtr entry;
+
+    /* Intentionally non-thread safe read, re-checked below */
+    if (!virLogAsync)
+        return -1;
+
+    entry = g_new0(virLogAsyncMessage, 1);
+    entry->source = source;
+    entry->priority = priority;
+    entry->filename = filename;
+    entry->linenr = linenr;
+    entry->funcname = funcname;
+    if (virStrcpyStatic(entry->timestamp, timestamp) < 0)
+        entry->timestamp[0] = '\0';
+    entry->str = g_steal_pointer(str);
+    entry->msg = g_steal_pointer(msg);
+
+    virMutexLock(&virLogQueueMutex);
+    if (!virLogAsync) {
+        virMutexUnlock(&virLogQueueMutex);
+        *str = g_steal_pointer(&entry->str);
+        *msg = g_steal_pointer(&entry->msg);
+        VIR_FREE(entry);
+        return -1;
+    }
+
+    if (virLogQueueLen >= VIR_LOG_ASYNC_QUEUE_MAX &&
+        priority < VIR_LOG_ERROR) {
+        virLogQueueDropped++;
+        virLogQueueDroppedTotal++;
+        virMutexUnlock(&virLogQueueMutex);
+        virLogAsyncMessageFree(entry);
+        return 0;
+    }
+
+    *virLogQueueTail = entry;
+    virLogQueueTail = &entry->next;
+    virLogQueueLen++;
+    virLogQueueSeq++;
+    virCondSignal(&virLogQueueCond);
+    virMutexUnlock(&virLogQueueMutex);
+
+    return 1;
+}
+
+
+static void
+virLogAsyncWorker(void *opaque G_GNUC_UNUSED)
+{
+    virMutexLock(&virLogQueueMutex);
+    while (true) {
+        virLogAsyncMessagePtr batch;
+        unsigned long long dropped;
+        unsigned long long droppedTotal;
+        size_t nbatch;
+
+        while (!virLogQueueHead && !virLogAsyncQuit)
+            ignore_value(virCondWait(&virLogQueueCond, &virLogQueueMutex));
+
+        if (!virLogQueueHead)
+            break;
+
+        batch = g_steal_pointer(&virLogQueueHead);
+        virLogQueueTail = &virLogQueueHead;
+        nbatch = virLogQueueLen;
+        virLogQueueLen = 0;
+        dropped = virLogQueueDropped;
+        droppedTotal = virLogQueueDroppedTotal;
+        virLogQueueDropped = 0;
+        virMutexUnlock(&virLogQueueMutex);
+
+        /* The whole batch is written with a single acquisition of the
+         * output lock; producers only ever need the queue lock. */
+        virMutexLock(&virLogMutex);
+        if (dropped) {
+            g_autofree char *str = NULL;
+            g_autofree char *msg = NULL;
+
+            str = g_strdup_printf("%llu log messages dropped (%llu in total), "
+                                  "the log queue is full",
+                                  dropped, droppedTotal);
+            virLogFormatString(&msg, __LINE__, __func__, VIR_LOG_WARN, str);
+            virLogOutputMessage(&virLogSelf, VIR_LOG_WARN,
+                                __FILE__, __LINE__, __func__,
+                                batch->timestamp, NULL, str, msg);
+        }
+        while (batch) {
+            virLogAsyncMessagePtr next = batch->next;
+
+            virLogOutputMessage(batch->source, batch->priority,
+                                batch->filename, batch->linenr,
+                                batch->funcname, batch->timestamp,
+                                NULL, batch->str, batch->msg);
+            virLogAsyncMessageFree(batch);
+            batch = next;
+        }
+        virMutexUnlock(&virLogMutex);
+
+        virMutexLock(&virLogQueueMutex);
+        virLogQueueDone += nbatch;
+        virCondBroadcast(&virLogQueueFlushCond);
+    }
+    virMutexUnlock(&virLogQueueMutex);
+}
+
+
+/**
+ * virLogStartAsync:
+ *
+ * Switches logging to asynchronous mode: messages are queued by the
+ * threads emitting them and written to the outputs by a dedicated
+ * thread. Messages below error priority are dropped (and the amount
+ * reported) if the writer can't keep up.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virLogStartAsync(void)
+{
+    int ret = -1;
+
+    if (virLogInitialize() < 0)
+        return -1;
+
+    virMutexLock(&virLogQueueMutex);
+    if (virLogAsync) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (virThreadCreateFull(&virLogAsyncThread, true, virLogAsyncWorker,
+                            "log-writer", false, NULL) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create log writer thread"));
+        goto cleanup;
+    }
+
+    virLogAsync = true;
+    virLogAsyncQuit = false;
+    virLogAsyncPid = getpid();
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&virLogQueueMutex);
+    return ret;
+}
+
+
+/**
+ * virLogStopAsync:
+ *
+ * Writes out any queued messages and switches logging back to
+ * synchronous mode. In a child process forked off a process logging
+ * asynchronously the writer thread does not exist, so the queue is
+ * just discarded.
+ */
+void
+virLogStopAsync(void)
+{
+    virLogAsyncMessagePtr orphans = NULL;
+
+    if (virLogInitialize() < 0)
+        return;
+
+    virMutexLock(&virLogQueueMutex);
+    if (!virLogAsync) {
+        virMutexUnlock(&virLogQueueMutex);
+        return;
+    }
+
+    virLogAsync = false;
+
+    if (virLogAsyncPid != getpid()) {
+        orphans = g_steal_pointer(&virLogQueueHead);
+        virLogQueueTail = &virLogQueueHead;
+        virLogQueueLen = 0;
+        virMutexUnlock(&virLogQueueMutex);
+
+        while (orphans) {
+            virLogAsyncMessagePtr next = orphans->next;
+            virLogAsyncMessageFree(orphans);
+            orphans = next;
+        }
+        return;
+    }
+
+    virLogAsyncQuit = true;
+    virCondSignal(&virLogQueueCond);
+    virMutexUnlock(&virLogQueueMutex);
+
+    virThreadJoin(&virLogAsyncThread);
+
+    virMutexLock(&virLogQueueMutex);
+    virLogAsyncQuit = false;
+    virCondBroadcast(&virLogQueueFlushCond);
+    virMutexUnlock(&virLogQueueMutex);
+}
+
+
+/**
+ * virLogFlush:
+ *
+ * Waits until all messages queued so far in asynchronous mode are
+ * written to the outputs. Does nothing in synchronous mode.
+ */
+void
+virLogFlush(void)
+{
+    unsigned long long seq;
+
+    /* Intentionally non-thread safe read, re-checked below */
+    if (!virLogAsync)
+        return;
+
+    virMutexLock(&virLogQueueMutex);
+    seq = virLogQueueSeq;
+    while (virLogAsync && virLogQueueDone < seq)
+        ignore_value(virCondWait(&virLogQueueFlushCond, &virLogQueueMutex));
+    virMutexUnlock(&virLogQueueMutex);
+}
+
+
 /**
  * virLogMessage:
  * @source: where is that message coming from
@@ -541,11 +927,9 @@ virLogVMessage(virLogSourcePtr source,
                const char *fmt,
                va_list vargs)
 {
-    static bool logInitMessageStderr = true;
     char *str = NULL;
     char *msg = NULL;
     char timestamp[VIR_TIME_STRING_BUFLEN];
-    size_t i;
     int saved_errno = errno;
 
     if (virLogInitialize() < 0)
@@ -577,66 +961,26 @@ virLogVMessage(virLogSourcePtr source,
     if (virTimeStringNowRaw(timestamp) < 0)
         timestamp[0] = '\0';
 
-    virLogLock();
-
-    /*
-     * Push the message to the outputs defined, if none exist then
-     * use stderr.
-     */
-    for (i = 0; i < virLogNbOutputs; i++) {
-        if (priority >= virLogOutputs[i]->priority) {
-            if (virLogOutputs[i]->logInitMessage) {
-                const char *rawinitmsg;
-                char *hoststr = NULL;
-                char *initmsg = NULL;
-                virLogVersionString(&rawinitmsg, &initmsg);
-                virLogOutputs[i]->f(&virLogSelf, VIR_LOG_INFO,
-                                    __FILE__, __LINE__, __func__,
-                                    timestamp, NULL, rawinitmsg, initmsg,
-                                    virLogOutputs[i]->data);
-                VIR_FREE(initmsg);
-
-                virLogHostnameString(&hoststr, &initmsg);
-                virLogOutputs[i]->f(&virLogSelf, VIR_LOG_INFO,
-                                    __FILE__, __LINE__, __func__,
-                                    timestamp, NULL, hoststr, initmsg,
-                                    virLogOutputs[i]->data);
-                VIR_FREE(hoststr);
-                VIR_FREE(initmsg);
-                virLogOutputs[i]->logInitMessage = false;
-            }
-            virLogOutputs[i]->f(source, priority,
-                                filename, linenr, funcname,
-                                timestamp, metadata,
-                                str, msg, virLogOutputs[i]->data);
+    /* Metadata is owned by the caller so it can't be queued, and it is
+     * rare enough to simply write it out directly, after whatever was
+     * queued before it. */
+    if (!metadata) {
+        int rc = virLogEnqueue(source, priority, filename, linenr, funcname,
+                               timestamp, &str, &msg);
+
+        if (rc >= 0) {
+            /* Make sure errors hit the outputs before we possibly crash */
+            if (rc > 0 && priority >= VIR_LOG_ERROR)
+                virLogFlush();
+            goto cleanup;
         }
+    } else {
+        virLogFlush();
     }
-    if (virLogNbOutputs == 0) {
-        if (logInitMessageStderr) {
-            const char *rawinitmsg;
-            char *hoststr = NULL;
-            char *initmsg = NULL;
-            virLogVersionString(&rawinitmsg, &initmsg);
-            virLogOutputToFd(&virLogSelf, VIR_LOG_INFO,
-                             __FILE__, __LINE__, __func__,
-                             timestamp, NULL, rawinitmsg, initmsg,
-                             (void *) STDERR_FILENO);
-            VIR_FREE(initmsg);
 
-            virLogHostnameString(&hoststr, &initmsg);
-            virLogOutputToFd(&virLogSelf, VIR_LOG_INFO,
-                             __FILE__, __LINE__, __func__,
-                             timestamp, NULL, hoststr, initmsg,
-                             (void *) STDERR_FILENO);
-            VIR_FREE(hoststr);
-            VIR_FREE(initmsg);
-            logInitMessageStderr = false;
-        }
-        virLogOutputToFd(source, priority,
-                         filename, linenr, funcname,
-                         timestamp, metadata,
-                         str, msg, (void *) STDERR_FILENO);
-    }
+    virLogLock();
+    virLogOutputMessage(source, priority, filename, linenr, funcname,
+                        timestamp, metadata, str, msg);
     virLogUnlock();
 
  cleanup:
@@ -710,6 +1054,218 @@ virLogNewOutputToFile(virLogPriority priority,
 }
 
 
+/*
+ * The memory output keeps the most recent messages in a fixed size ring
+ * buffer. Recording a message costs just a copy, so verbose logging can
+ * stay enabled permanently and be looked at only when something went
+ * wrong, see virLogDumpMemory.
+ */
+#define VIR_LOG_MEMORY_SIZE (4 * 1024 * 1024)
+
+typedef struct _virLogMemory virLogMemory;
+typedef virLogMemory *virLogMemoryPtr;
+struct _virLogMemory {
+    char *buf;
+    size_t pos;     /* where the next message is written */
+    bool wrapped;   /* the whole buffer contains messages */
+};
+
+
+static void
+virLogMemoryAppend(virLogMemoryPtr mem,
+                   const char *data,
+                   size_t len)
+{
+    if (len > VIR_LOG_MEMORY_SIZE) {
+        data += len - VIR_LOG_MEMORY_SIZE;
+        len = VIR_LOG_MEMORY_SIZE;
+    }
+
+    while (len > 0) {
+        size_t chunk = MIN(len, VIR_LOG_MEMORY_SIZE - mem->pos);
+
+        memcpy(mem->buf + mem->pos, data, chunk);
+        mem->pos += chunk;
+        data += chunk;
+        len -= chunk;
+
+        if (mem->pos == VIR_LOG_MEMORY_SIZE) {
+            mem->pos = 0;
+            mem->wrapped = true;
+        }
+    }
+}
+
+
+static void
+virLogOutputToMemory(virLogSourcePtr source G_GNUC_UNUSED,
+                     virLogPriority priority G_GNUC_UNUSED,
+                     const char *filename G_GNUC_UNUSED,
+                     int linenr G_GNUC_UNUSED,
+                     const char *funcname G_GNUC_UNUSED,
+                     const char *timestamp,
+                     virLogMetadataPtr metadata G_GNUC_UNUSED,
+                     const char *rawstr G_GNUC_UNUSED,
+                     const char *str,
+                     void *data)
+{
+    virLogMemoryPtr mem = data;
+
+    virLogMemoryAppend(mem, timestamp, strlen(timestamp));
+    virLogMemoryAppend(mem, ": ", 2);
+    virLogMemoryAppend(mem, str, strlen(str));
+}
+
+
+static void
+virLogCloseMemory(void *data)
+{
+    virLogMemoryPtr mem = data;
+
+    VIR_FREE(mem->buf);
+    VIR_FREE(mem);
+}
+
+
+static virLogOutputPtr
+virLogNewOutputToMemory(virLogPriority priority)
+{
+    virLogMemoryPtr mem = g_new0(virLogMemory, 1);
+    virLogOutputPtr ret = NULL;
+
+    mem->buf = g_new0(char, VIR_LOG_MEMORY_SIZE);
+
+    if (!(ret = virLogOutputNew(virLogOutputToMemory, virLogCloseMemory,
+                                mem, priority, VIR_LOG_TO_MEMORY, NULL))) {
+        virLogCloseMemory(mem);
+        return NULL;
+    }
+    return ret;
+}
+
+
+/* Writes the contents of @mem, oldest message first. Returns 0 on
+ * success, -1 with errno set on error. */
+static int
+virLogMemoryWrite(virLogMemoryPtr mem,
+                  int fd)
+{
+    if (mem->wrapped) {
+        const char *tail = mem->buf + mem->pos;
+        size_t taillen = VIR_LOG_MEMORY_SIZE - mem->pos;
+        const char *eol;
+
+        /* The oldest message was partially overwritten, skip it */
+        if ((eol = memchr(tail, '\n', taillen))) {
+            taillen -= eol + 1 - tail;
+            if (safewrite(fd, eol + 1, taillen) < 0)
+                return -1;
+        } else if ((eol = memchr(mem->buf, '\n', mem->pos))) {
+            size_t skip = eol + 1 - mem->buf;
+
+            if (safewrite(fd, eol + 1, mem->pos - skip) < 0)
+                return -1;
+            return 0;
+        } else {
+            return 0;
+        }
+    }
+
+    if (safewrite(fd, mem->buf, mem->pos) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+/**
+ * virLogDumpMemory:
+ * @fd: file descriptor to write to
+ *
+ * Writes the messages recorded by all memory outputs to @fd, oldest
+ * first.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virLogDumpMemory(int fd)
+{
+    size_t i;
+    int ret = 0;
+    int saved_errno = 0;
+
+    if (virLogInitialize() < 0)
+        return -1;
+
+    virLogFlush();
+
+    virLogLock();
+    for (i = 0; i < virLogNbOutputs; i++) {
+        if (virLogOutputs[i]->dest != VIR_LOG_TO_MEMORY)
+            continue;
+
+        if (virLogMemoryWrite(virLogOutputs[i]->data, fd) < 0) {
+            saved_errno = errno;
+            ret = -1;
+            break;
+        }
+    }
+    virLogUnlock();
+
+    /* Can't report while holding the lock, as reporting logs too */
+    if (ret < 0)
+        virReportSystemError(saved_errno, "%s",
+                             _("failed to write recorded log messages"));
+
+    return ret;
+}
+
+
+/**
+ * virLogDumpMemoryToFile:
+ * @binary: the binary for which logging is performed
+ * @privileged: whether we're running with root privileges or not (session)
+ *
+ * Like virLogDumpMemory, but writes into "@binary-dump.log" created in
+ * the directory where the default log file of @binary is placed. Any
+ * previous dump is overwritten.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virLogDumpMemoryToFile(const char *binary,
+                       bool privileged)
+{
+    g_autofree char *logdir = NULL;
+    g_autofree char *path = NULL;
+    VIR_AUTOCLOSE fd = -1;
+
+    if (!(logdir = virLogGetDefaultLogDir(privileged))) {
+        virReportSystemError(errno, "%s",
+                             _("failed to create log directory"));
+        return -1;
+    }
+
+    path = g_strdup_printf("%s/%s-dump.log", logdir, binary);
+
+    if ((fd = open(path, O_CREAT | O_TRUNC | O_WRONLY,
+                   S_IRUSR | S_IWUSR)) < 0) {
+        virReportSystemError(errno, _("failed to open %s"), path);
+        return -1;
+    }
+
+    if (virLogDumpMemory(fd) < 0)
+        return -1;
+
+    if (VIR_CLOSE(fd) < 0) {
+        virReportSystemError(errno, _("failed to close %s"), path);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 #if HAVE_SYSLOG_H || USE_JOURNALD
 
 /* Compat in case we build with journald, but no syslog */
@@ -1122,6 +1678,7 @@ virLogGetOutputs(void)
                 break;
             case VIR_LOG_TO_STDERR:
             case VIR_LOG_TO_JOURNALD:
+            case VIR_LOG_TO_MEMORY:
                 virBufferAsprintf(&outputbuf, "%d:%s",
                                   virLogOutputs[i]->priority,
                                   virLogDestinationTypeToString(dest));
@@ -1459,6 +2016,7 @@ virLogDefineFilters(virLogFilterPtr *filters, size_t nfilters)
  *    x:journald - output is sent to journald
  *    x:syslog:name - output is sent to syslog using 'name' as the message tag
  *    x:file:abs_file_path - output is sent to file specified by 'abs_file_path'
+ *    x:memory - output is recorded in memory, see virLogDumpMemory
  *
  *      'x' - minimal priority level which acts as a filter meaning that only
  *            messages with priority level greater than or equal to 'x' will be
@@ -1511,7 +2069,8 @@ virLogParseOutput(const char *src)
     }
 
     if (((dest == VIR_LOG_TO_STDERR ||
-          dest == VIR_LOG_TO_JOURNALD) && count != 2) ||
+          dest == VIR_LOG_TO_JOURNALD ||
+          dest == VIR_LOG_TO_MEMORY) && count != 2) ||
         ((dest == VIR_LOG_TO_FILE ||
           dest == VIR_LOG_TO_SYSLOG) && count != 3)) {
         virReportError(VIR_ERR_INVALID_ARG,
@@ -1540,6 +2099,9 @@ virLogParseOutput(const char *src)
         ret = virLogNewOutputToJournald(prio);
 #endif
         break;
+    case VIR_LOG_TO_MEMORY:
+        ret = virLogNewOutputToMemory(prio);
+        break;
     case VIR_LOG_TO_OUTPUT_LAST:
         break;
     }
@@ -54,6 +54,7 @@ typedef enum {
     VIR_LOG_TO_SYSLOG,
     VIR_LOG_TO_FILE,
     VIR_LOG_TO_JOURNALD,
+    VIR_LOG_TO_MEMORY,
     VIR_LOG_TO_OUTPUT_LAST,
 } virLogDestination;
 
@@ -190,6 +191,11 @@ void virLogSetDefaultOutput(const char *fname, bool godaemon, bool privileged);
 void virLogLock(void);
 void virLogUnlock(void);
 int virLogReset(void);
+int virLogStartAsync(void);
+void virLogStopAsync(void);
+void virLogFlush(void);
+int virLogDumpMemory(int fd);
+int virLogDumpMemoryToFile(const char *binary, bool privileged);
 int virLogParseDefaultPriority(const char *priority);
 int virLogPriorityFromSyslog(int priority);
 void virLogMessage(virLogSourcePtr source,
@@ -0,0 +1,859 @@
+/*
+ * virnftables.c: helper APIs for managing nftables
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "internal.h"
+#include "virnftables.h"
+#include "viralloc.h"
+#include "virerror.h"
+#include "virlog.h"
+#include "virstring.h"
+
+VIR_LOG_INIT("util.nftables");
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+/*
+ * All rules live in a "libvirt" table of the "ip" and "ip6"
+ * families. The base chains only hold a lookup in a verdict map,
+ * keyed by interface name (or by source network for NAT), which
+ * jumps to the chains private to a network:
+ *
+ *   forward     oifname vmap @fwd_in  -> fwi_$BRIDGE
+ *               iifname vmap @fwd_out -> fwo_$BRIDGE
+ *   input       iifname vmap @inp_if  -> inp_$BRIDGE
+ *   output      oifname vmap @out_if  -> out_$BRIDGE
+ *   postrouting ip saddr vmap @nat_src -> nat_$BRIDGE  (ip only)
+ *
+ * so the cost of classifying a packet does not depend on the
+ * number of networks. Every statement is written so that it can
+ * be repeated, which lets the removal of a network be applied as
+ * a single transaction regardless of what is currently loaded.
+ */
+
+#define NFTABLES_TABLE "libvirt"
+
+typedef struct {
+    const char *prefix; /* of the per network chain */
+    const char *map;
+    const char *key;    /* interface matched by the map */
+    const char *base;   /* chain doing the lookup */
+} nftablesNetworkChain;
+
+/* Traffic towards a network is looked up first, like LIBVIRT_FWI
+ * comes before LIBVIRT_FWO with iptables */
+static const nftablesNetworkChain nftablesNetworkChains[] = {
+    { "fwi", "fwd_in", "oifname", "forward" },
+    { "fwo", "fwd_out", "iifname", "forward" },
+    { "inp", "inp_if", "iifname", "input" },
+    { "out", "out_if", "oifname", "output" },
+};
+
+/* Base chains, named after their hook */
+static const char *nftablesBaseChains[] = {
+    "forward", "input", "output",
+};
+
+
+static const char *
+nftablesFamily(virFirewallLayer layer)
+{
+    return layer == VIR_FIREWALL_LAYER_IPV6 ? "ip6" : "ip";
+}
+
+
+static char *
+nftablesFormatIface(const char *iface)
+{
+    return g_strdup_printf("\"%s\"", iface);
+}
+
+
+static char *
+nftablesFormatNetwork(virSocketAddr *netaddr,
+                      unsigned int prefix)
+{
+    virSocketAddr network;
+    g_autofree char *netstr = NULL;
+
+    if (!(VIR_SOCKET_ADDR_IS_FAMILY(netaddr, AF_INET) ||
+          VIR_SOCKET_ADDR_IS_FAMILY(netaddr, AF_INET6))) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("Only IPv4 or IPv6 addresses can be used with nftables"));
+        return NULL;
+    }
+
+    if (virSocketAddrMaskByPrefix(netaddr, prefix, &network) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Failure to mask address"));
+        return NULL;
+    }
+
+    if (!(netstr = virSocketAddrFormat(&network)))
+        return NULL;
+
+    return g_strdup_printf("%s/%d", netstr, prefix);
+}
+
+
+/* Declares the table and the maps, without touching any rules */
+static void
+nftablesDeclareTable(virFirewallPtr fw,
+                     virFirewallLayer layer)
+{
+    const char *family = nftablesFamily(layer);
+    size_t i;
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                       "add", "table", family, NFTABLES_TABLE, NULL);
+
+    for (i = 0; i < G_N_ELEMENTS(nftablesNetworkChains); i++)
+        virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                           "add", "map", family, NFTABLES_TABLE,
+                           nftablesNetworkChains[i].map,
+                           "{", "type", "ifname", ":", "verdict", ";", "}",
+                           NULL);
+
+    if (layer == VIR_FIREWALL_LAYER_IPV4)
+        virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                           "add", "map", family, NFTABLES_TABLE, "nat_src",
+                           "{", "type", "ipv4_addr", ":", "verdict", ";",
+                           "flags", "interval", ";", "}",
+                           NULL);
+}
+
+
+/**
+ * nftablesSetupPrivateChains:
+ * @fw: the firewall ruleset to add to
+ * @layer: VIR_FIREWALL_LAYER_IPV4 or VIR_FIREWALL_LAYER_IPV6
+ *
+ * Add the statements creating the libvirt table, its maps and the
+ * base chains dispatching packets through them. The base chains are
+ * flushed and refilled, so this can be applied any number of times.
+ */
+void
+nftablesSetupPrivateChains(virFirewallPtr fw,
+                           virFirewallLayer layer)
+{
+    const char *family = nftablesFamily(layer);
+    size_t i;
+
+    nftablesDeclareTable(fw, layer);
+
+    for (i = 0; i < G_N_ELEMENTS(nftablesBaseChains); i++) {
+        virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                           "add", "chain", family, NFTABLES_TABLE,
+                           nftablesBaseChains[i],
+                           "{", "type", "filter",
+                           "hook", nftablesBaseChains[i],
+                           "priority", "0", ";",
+                           "policy", "accept", ";", "}",
+                           NULL);
+        virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                           "flush", "chain", family, NFTABLES_TABLE,
+                           nftablesBaseChains[i], NULL);
+    }
+
+    for (i = 0; i < G_N_ELEMENTS(nftablesNetworkChains); i++) {
+        g_autofree char *map = g_strdup_printf("@%s",
+                                               nftablesNetworkChains[i].map);
+
+        virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                           "add", "rule", family, NFTABLES_TABLE,
+                           nftablesNetworkChains[i].base,
+                           nftablesNetworkChains[i].key, "vmap", map,
+                           NULL);
+    }
+
+    if (layer == VIR_FIREWALL_LAYER_IPV4) {
+        virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                           "add", "chain", family, NFTABLES_TABLE,
+                           "postrouting",
+                           "{", "type", "nat", "hook", "postrouting",
+                           "priority", "100", ";", "}",
+                           NULL);
+        virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                           "flush", "chain", family, NFTABLES_TABLE,
+                           "postrouting", NULL);
+        virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                           "add", "rule", family, NFTABLES_TABLE,
+                           "postrouting", "ip", "saddr", "vmap", "@nat_src",
+                           NULL);
+    }
+}
+
+
+static void
+nftablesNetworkChainsOp(virFirewallPtr fw,
+                        virFirewallLayer layer,
+                        const char *iface,
+                        const char *op)
+{
+    const char *family = nftablesFamily(layer);
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(nftablesNetworkChains); i++) {
+        g_autofree char *chain = g_strdup_printf("%s_%s",
+                                                 nftablesNetworkChains[i].prefix,
+                                                 iface);
+
+        virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                           op, "chain", family, NFTABLES_TABLE, chain, NULL);
+    }
+
+    if (layer == VIR_FIREWALL_LAYER_IPV4) {
+        g_autofree char *chain = g_strdup_printf("nat_%s", iface);
+
+        virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                           op, "chain", family, NFTABLES_TABLE, chain, NULL);
+    }
+}
+
+
+static void
+nftablesNetworkElementsOp(virFirewallPtr fw,
+                          virFirewallLayer layer,
+                          const char *iface,
+                          bool add)
+{
+    const char *family = nftablesFamily(layer);
+    g_autofree char *ifname = nftablesFormatIface(iface);
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(nftablesNetworkChains); i++) {
+        g_autofree char *chain = g_strdup_printf("%s_%s",
+                                                 nftablesNetworkChains[i].prefix,
+                                                 iface);
+
+        if (add)
+            virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                               "add", "element", family, NFTABLES_TABLE,
+                               nftablesNetworkChains[i].map,
+                               "{", ifname, ":", "jump", chain, "}",
+                               NULL);
+        else
+            virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                               "delete", "element", family, NFTABLES_TABLE,
+                               nftablesNetworkChains[i].map,
+                               "{", ifname, "}",
+                               NULL);
+    }
+}
+
+
+/**
+ * nftablesRemovePrivateChains:
+ * @fw: the firewall ruleset to add to
+ * @layer: VIR_FIREWALL_LAYER_IPV4 or VIR_FIREWALL_LAYER_IPV6
+ *
+ * Add the statements deleting the libvirt table together with the
+ * rules of all networks, e.g. after switching to another firewall
+ * backend. The table is declared first, so this works whether or not
+ * it exists.
+ */
+void
+nftablesRemovePrivateChains(virFirewallPtr fw,
+                            virFirewallLayer layer)
+{
+    const char *family = nftablesFamily(layer);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                       "add", "table", family, NFTABLES_TABLE, NULL);
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                       "delete", "table", family, NFTABLES_TABLE, NULL);
+}
+
+
+/**
+ * nftablesAddNetworkChains:
+ * @fw: the firewall ruleset to add to
+ * @layer: VIR_FIREWALL_LAYER_IPV4 or VIR_FIREWALL_LAYER_IPV6
+ * @iface: the bridge of the network
+ *
+ * Create empty private chains for the network on @iface. They are
+ * only consulted once nftablesLinkNetworkChains has been applied,
+ * which should happen after filling them.
+ */
+void
+nftablesAddNetworkChains(virFirewallPtr fw,
+                         virFirewallLayer layer,
+                         const char *iface)
+{
+    nftablesNetworkChainsOp(fw, layer, iface, "add");
+    nftablesNetworkChainsOp(fw, layer, iface, "flush");
+}
+
+
+/**
+ * nftablesLinkNetworkChains:
+ * @fw: the firewall ruleset to add to
+ * @layer: VIR_FIREWALL_LAYER_IPV4 or VIR_FIREWALL_LAYER_IPV6
+ * @iface: the bridge of the network
+ *
+ * Make the base chains jump to the private chains of the network
+ * on @iface for packets going through it.
+ */
+void
+nftablesLinkNetworkChains(virFirewallPtr fw,
+                          virFirewallLayer layer,
+                          const char *iface)
+{
+    nftablesNetworkElementsOp(fw, layer, iface, true);
+}
+
+
+/**
+ * nftablesRemoveNetworkChains:
+ * @fw: the firewall ruleset to add to
+ * @layer: VIR_FIREWALL_LAYER_IPV4 or VIR_FIREWALL_LAYER_IPV6
+ * @iface: the bridge of the network
+ *
+ * Unlink and delete the private chains of the network on @iface.
+ * Anything missing is created first so that none of the statements
+ * can fail. Any NAT source must have been removed already.
+ */
+void
+nftablesRemoveNetworkChains(virFirewallPtr fw,
+                            virFirewallLayer layer,
+                            const char *iface)
+{
+    nftablesDeclareTable(fw, layer);
+    nftablesNetworkChainsOp(fw, layer, iface, "add");
+    nftablesNetworkElementsOp(fw, layer, iface, true);
+    nftablesNetworkElementsOp(fw, layer, iface, false);
+    nftablesNetworkChainsOp(fw, layer, iface, "flush");
+    nftablesNetworkChainsOp(fw, layer, iface, "delete");
+}
+
+
+static void
+nftablesPort(virFirewallPtr fw,
+             virFirewallLayer layer,
+             const char *prefix,
+             const char *iface,
+             const char *protocol,
+             int port)
+{
+    g_autofree char *chain = g_strdup_printf("%s_%s", prefix, iface);
+    char portstr[32];
+
+    g_snprintf(portstr, sizeof(portstr), "%d", port);
+    portstr[sizeof(portstr) - 1] = '\0';
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                       "add", "rule", nftablesFamily(layer), NFTABLES_TABLE,
+                       chain, protocol, "dport", portstr, "accept",
+                       NULL);
+}
+
+/**
+ * nftablesAddTcpInput:
+ * @fw: the firewall ruleset to add to
+ * @layer: VIR_FIREWALL_LAYER_IPV4 or VIR_FIREWALL_LAYER_IPV6
+ * @iface: the interface name
+ * @port: the TCP port to allow
+ *
+ * Allow access to the given TCP @port on the host through @iface
+ */
+void
+nftablesAddTcpInput(virFirewallPtr fw,
+                    virFirewallLayer layer,
+                    const char *iface,
+                    int port)
+{
+    nftablesPort(fw, layer, "inp", iface, "tcp", port);
+}
+
+/**
+ * nftablesAddUdpInput:
+ * @fw: the firewall ruleset to add to
+ * @layer: VIR_FIREWALL_LAYER_IPV4 or VIR_FIREWALL_LAYER_IPV6
+ * @iface: the interface name
+ * @port: the UDP port to allow
+ *
+ * Allow access to the given UDP @port on the host through @iface
+ */
+void
+nftablesAddUdpInput(virFirewallPtr fw,
+                    virFirewallLayer layer,
+                    const char *iface,
+                    int port)
+{
+    nftablesPort(fw, layer, "inp", iface, "udp", port);
+}
+
+/**
+ * nftablesAddTcpOutput:
+ * @fw: the firewall ruleset to add to
+ * @layer: VIR_FIREWALL_LAYER_IPV4 or VIR_FIREWALL_LAYER_IPV6
+ * @iface: the interface name
+ * @port: the TCP port to allow
+ *
+ * Allow the host to send to the given TCP @port through @iface
+ */
+void
+nftablesAddTcpOutput(virFirewallPtr fw,
+                     virFirewallLayer layer,
+                     const char *iface,
+                     int port)
+{
+    nftablesPort(fw, layer, "out", iface, "tcp", port);
+}
+
+/**
+ * nftablesAddUdpOutput:
+ * @fw: the firewall ruleset to add to
+ * @layer: VIR_FIREWALL_LAYER_IPV4 or VIR_FIREWALL_LAYER_IPV6
+ * @iface: the interface name
+ * @port: the UDP port to allow
+ *
+ * Allow the host to send to the given UDP @port through @iface
+ */
+void
+nftablesAddUdpOutput(virFirewallPtr fw,
+                     virFirewallLayer layer,
+                     const char *iface,
+                     int port)
+{
+    nftablesPort(fw, layer, "out", iface, "udp", port);
+}
+
+
+static int
+nftablesForward(virFirewallPtr fw,
+                const char *prefix,
+                virSocketAddr *netaddr,
+                unsigned int prefixlen,
+                const char *iface,
+                const char *physdev,
+                bool related)
+{
+    virFirewallLayer layer = VIR_SOCKET_ADDR_FAMILY(netaddr) == AF_INET ?
+        VIR_FIREWALL_LAYER_IPV4 : VIR_FIREWALL_LAYER_IPV6;
+    const char *family = nftablesFamily(layer);
+    bool out = STREQ(prefix, "fwo");
+    g_autofree char *networkstr = NULL;
+    g_autofree char *chain = g_strdup_printf("%s_%s", prefix, iface);
+    virFirewallRulePtr rule;
+
+    if (!(networkstr = nftablesFormatNetwork(netaddr, prefixlen)))
+        return -1;
+
+    rule = virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                              "add", "rule", family, NFTABLES_TABLE, chain,
+                              family, out ? "saddr" : "daddr", networkstr,
+                              NULL);
+
+    if (physdev && physdev[0]) {
+        g_autofree char *ifname = nftablesFormatIface(physdev);
+
+        virFirewallRuleAddArgList(fw, rule,
+                                  out ? "oifname" : "iifname", ifname, NULL);
+    }
+
+    if (related)
+        virFirewallRuleAddArgList(fw, rule,
+                                  "ct", "state", "related,established", NULL);
+
+    virFirewallRuleAddArg(fw, rule, "accept");
+
+    return 0;
+}
+
+/**
+ * nftablesAddForwardAllowOut:
+ * @fw: the firewall ruleset to add to
+ * @netaddr: the source network address
+ * @prefix: the source network prefix
+ * @iface: the source interface name
+ * @physdev: the physical output device or NULL
+ *
+ * Allow the traffic from the network via @iface to be forwarded
+ * to @physdev, or any other device.
+ *
+ * Returns 0 in case of success or -1 on error
+ */
+int
+nftablesAddForwardAllowOut(virFirewallPtr fw,
+                           virSocketAddr *netaddr,
+                           unsigned int prefix,
+                           const char *iface,
+                           const char *physdev)
+{
+    return nftablesForward(fw, "fwo", netaddr, prefix, iface, physdev, false);
+}
+
+/**
+ * nftablesAddForwardAllowRelatedIn:
+ * @fw: the firewall ruleset to add to
+ * @netaddr: the destination network address
+ * @prefix: the destination network prefix
+ * @iface: the output interface name
+ * @physdev: the physical input device or NULL
+ *
+ * Allow the traffic of established connections towards the network
+ * to be forwarded from @physdev, or any other device, to @iface.
+ *
+ * Returns 0 in case of success or -1 on error
+ */
+int
+nftablesAddForwardAllowRelatedIn(virFirewallPtr fw,
+                                 virSocketAddr *netaddr,
+                                 unsigned int prefix,
+                                 const char *iface,
+                                 const char *physdev)
+{
+    return nftablesForward(fw, "fwi", netaddr, prefix, iface, physdev, true);
+}
+
+/**
+ * nftablesAddForwardAllowIn:
+ * @fw: the firewall ruleset to add to
+ * @netaddr: the destination network address
+ * @prefix: the destination network prefix
+ * @iface: the output interface name
+ * @physdev: the physical input device or NULL
+ *
+ * Allow all traffic towards the network to be forwarded from
+ * @physdev, or any other device, to @iface.
+ *
+ * Returns 0 in case of success or -1 on error
+ */
+int
+nftablesAddForwardAllowIn(virFirewallPtr fw,
+                          virSocketAddr *netaddr,
+                          unsigned int prefix,
+                          const char *iface,
+                          const char *physdev)
+{
+    return nftablesForward(fw, "fwi", netaddr, prefix, iface, physdev, false);
+}
+
+
+/**
+ * nftablesAddForwardAllowCross:
+ * @fw: the firewall ruleset to add to
+ * @layer: VIR_FIREWALL_LAYER_IPV4 or VIR_FIREWALL_LAYER_IPV6
+ * @iface: the bridge interface name
+ *
+ * Allow traffic between guests on the bridge @iface
+ */
+void
+nftablesAddForwardAllowCross(virFirewallPtr fw,
+                             virFirewallLayer layer,
+                             const char *iface)
+{
+    g_autofree char *chain = g_strdup_printf("fwi_%s", iface);
+    g_autofree char *ifname = nftablesFormatIface(iface);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                       "add", "rule", nftablesFamily(layer), NFTABLES_TABLE,
+                       chain, "iifname", ifname, "accept",
+                       NULL);
+}
+
+
+static void
+nftablesForwardReject(virFirewallPtr fw,
+                      virFirewallLayer layer,
+                      const char *prefix,
+                      const char *iface)
+{
+    g_autofree char *chain = g_strdup_printf("%s_%s", prefix, iface);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                       "add", "rule", nftablesFamily(layer), NFTABLES_TABLE,
+                       chain, "reject",
+                       NULL);
+}
+
+/**
+ * nftablesAddForwardRejectOut:
+ * @fw: the firewall ruleset to add to
+ * @layer: VIR_FIREWALL_LAYER_IPV4 or VIR_FIREWALL_LAYER_IPV6
+ * @iface: the bridge interface name
+ *
+ * Reject any traffic from @iface not allowed by an earlier rule.
+ * Must be added after all such rules.
+ */
+void
+nftablesAddForwardRejectOut(virFirewallPtr fw,
+                            virFirewallLayer layer,
+                            const char *iface)
+{
+    nftablesForwardReject(fw, layer, "fwo", iface);
+}
+
+/**
+ * nftablesAddForwardRejectIn:
+ * @fw: the firewall ruleset to add to
+ * @layer: VIR_FIREWALL_LAYER_IPV4 or VIR_FIREWALL_LAYER_IPV6
+ * @iface: the bridge interface name
+ *
+ * Reject any traffic to @iface not allowed by an earlier rule.
+ * Must be added after all such rules.
+ */
+void
+nftablesAddForwardRejectIn(virFirewallPtr fw,
+                           virFirewallLayer layer,
+                           const char *iface)
+{
+    nftablesForwardReject(fw, layer, "fwi", iface);
+}
+
+
+/**
+ * nftablesAddForwardMasquerade:
+ * @fw: the firewall ruleset to add to
+ * @netaddr: the source network address
+ * @prefix: the source network prefix
+ * @iface: the bridge interface name
+ * @physdev: the physical output device or NULL
+ * @addr: the public address range to use, if any
+ * @port: the source port range to use with @protocol
+ * @protocol: the network protocol or NULL
+ *
+ * Masquerade, or SNAT to @addr if given, the traffic of the
+ * network leaving through @physdev, or any other device.
+ *
+ * Returns 0 in case of success or -1 on error
+ */
+int
+nftablesAddForwardMasquerade(virFirewallPtr fw,
+                             virSocketAddr *netaddr,
+                             unsigned int prefix,
+                             const char *iface,
+                             const char *physdev,
+                             virSocketAddrRangePtr addr,
+                             virPortRangePtr port,
+                             const char *protocol)
+{
+    g_autofree char *networkstr = NULL;
+    g_autofree char *addrStartStr = NULL;
+    g_autofree char *addrEndStr = NULL;
+    g_autofree char *portRangeStr = NULL;
+    g_autofree char *natRangeStr = NULL;
+    g_autofree char *chain = g_strdup_printf("nat_%s", iface);
+    virFirewallRulePtr rule;
+
+    if (!(networkstr = nftablesFormatNetwork(netaddr, prefix)))
+        return -1;
+
+    if (!VIR_SOCKET_ADDR_IS_FAMILY(netaddr, AF_INET)) {
+        /* Higher level code *should* guaranteee it's impossible to get here. */
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Attempted to NAT '%s'. NAT is only supported for IPv4."),
+                       networkstr);
+        return -1;
+    }
+
+    if (VIR_SOCKET_ADDR_IS_FAMILY(&addr->start, AF_INET)) {
+        if (!(addrStartStr = virSocketAddrFormat(&addr->start)))
+            return -1;
+        if (VIR_SOCKET_ADDR_IS_FAMILY(&addr->end, AF_INET)) {
+            if (!(addrEndStr = virSocketAddrFormat(&addr->end)))
+                return -1;
+        }
+    }
+
+    rule = virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                              "add", "rule", "ip", NFTABLES_TABLE, chain,
+                              "ip", "saddr", networkstr,
+                              "ip", "daddr", "!=", networkstr,
+                              NULL);
+
+    if (physdev && physdev[0]) {
+        g_autofree char *ifname = nftablesFormatIface(physdev);
+
+        virFirewallRuleAddArgList(fw, rule, "oifname", ifname, NULL);
+    }
+
+    if (protocol && protocol[0]) {
+        if (port->start == 0 && port->end == 0) {
+            port->start = 1024;
+            port->end = 65535;
+        }
+
+        if (port->start < port->end && port->end < 65536) {
+            portRangeStr = g_strdup_printf(":%u-%u", port->start, port->end);
+        } else {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Invalid port range '%u-%u'."),
+                           port->start, port->end);
+            return -1;
+        }
+
+        virFirewallRuleAddArgList(fw, rule, "meta", "l4proto", protocol, NULL);
+    }
+
+    if (addrStartStr && addrStartStr[0]) {
+        if (addrEndStr && addrEndStr[0]) {
+            natRangeStr = g_strdup_printf("%s-%s%s", addrStartStr, addrEndStr,
+                                          portRangeStr ? portRangeStr : "");
+        } else {
+            natRangeStr = g_strdup_printf("%s%s", addrStartStr,
+                                          portRangeStr ? portRangeStr : "");
+        }
+
+        virFirewallRuleAddArgList(fw, rule, "snat", "to", natRangeStr, NULL);
+    } else {
+        virFirewallRuleAddArg(fw, rule, "masquerade");
+
+        if (portRangeStr && portRangeStr[0])
+            virFirewallRuleAddArgList(fw, rule, "to", portRangeStr, NULL);
+    }
+
+    return 0;
+}
+
+
+/**
+ * nftablesAddDontMasquerade:
+ * @fw: the firewall ruleset to add to
+ * @netaddr: the source network address
+ * @prefix: the source network prefix
+ * @iface: the bridge interface name
+ * @physdev: the physical output device or NULL
+ * @destaddr: the destination network not to masquerade for
+ *
+ * Exempt the traffic of the network towards @destaddr from the
+ * masquerading rules. Must be added before them.
+ *
+ * Returns 0 in case of success or -1 on error
+ */
+int
+nftablesAddDontMasquerade(virFirewallPtr fw,
+                          virSocketAddr *netaddr,
+                          unsigned int prefix,
+                          const char *iface,
+                          const char *physdev,
+                          const char *destaddr)
+{
+    g_autofree char *networkstr = NULL;
+    g_autofree char *chain = g_strdup_printf("nat_%s", iface);
+    virFirewallRulePtr rule;
+
+    if (!(networkstr = nftablesFormatNetwork(netaddr, prefix)))
+        return -1;
+
+    if (!VIR_SOCKET_ADDR_IS_FAMILY(netaddr, AF_INET)) {
+        /* Higher level code *should* guaranteee it's impossible to get here. */
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Attempted to NAT '%s'. NAT is only supported for IPv4."),
+                       networkstr);
+        return -1;
+    }
+
+    rule = virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                              "add", "rule", "ip", NFTABLES_TABLE, chain,
+                              "ip", "saddr", networkstr,
+                              "ip", "daddr", destaddr,
+                              NULL);
+
+    if (physdev && physdev[0]) {
+        g_autofree char *ifname = nftablesFormatIface(physdev);
+
+        virFirewallRuleAddArgList(fw, rule, "oifname", ifname, NULL);
+    }
+
+    virFirewallRuleAddArg(fw, rule, "return");
+
+    return 0;
+}
+
+
+static int
+nftablesNatSource(virFirewallPtr fw,
+                  virSocketAddr *netaddr,
+                  unsigned int prefix,
+                  const char *iface,
+                  bool add)
+{
+    g_autofree char *networkstr = NULL;
+    g_autofree char *chain = g_strdup_printf("nat_%s", iface);
+
+    if (!(networkstr = nftablesFormatNetwork(netaddr, prefix)))
+        return -1;
+
+    if (add)
+        virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                           "add", "element", "ip", NFTABLES_TABLE, "nat_src",
+                           "{", networkstr, ":", "jump", chain, "}",
+                           NULL);
+    else
+        virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                           "delete", "element", "ip", NFTABLES_TABLE, "nat_src",
+                           "{", networkstr, "}",
+                           NULL);
+
+    return 0;
+}
+
+/**
+ * nftablesAddNatSource:
+ * @fw: the firewall ruleset to add to
+ * @netaddr: the source network address
+ * @prefix: the source network prefix
+ * @iface: the bridge interface name
+ *
+ * Send the traffic originating from the network through the NAT
+ * chain of the network on @iface.
+ *
+ * Returns 0 in case of success or -1 on error
+ */
+int
+nftablesAddNatSource(virFirewallPtr fw,
+                     virSocketAddr *netaddr,
+                     unsigned int prefix,
+                     const char *iface)
+{
+    return nftablesNatSource(fw, netaddr, prefix, iface, true);
+}
+
+/**
+ * nftablesRemoveNatSource:
+ * @fw: the firewall ruleset to add to
+ * @netaddr: the source network address
+ * @prefix: the source network prefix
+ * @iface: the bridge interface name
+ *
+ * Undo nftablesAddNatSource. Like nftablesRemoveNetworkChains,
+ * anything missing is created first.
+ *
+ * Returns 0 in case of success or -1 on error
+ */
+int
+nftablesRemoveNatSource(virFirewallPtr fw,
+                        virSocketAddr *netaddr,
+                        unsigned int prefix,
+                        const char *iface)
+{
+    g_autofree char *chain = g_strdup_printf("nat_%s", iface);
+
+    nftablesDeclareTable(fw, VIR_FIREWALL_LAYER_IPV4);
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                       "add", "chain", "ip", NFTABLES_TABLE, chain, NULL);
+
+    if (nftablesNatSource(fw, netaddr, prefix, iface, true) < 0 ||
+        nftablesNatSource(fw, netaddr, prefix, iface, false) < 0)
+        return -1;
+
+    return 0;
+}
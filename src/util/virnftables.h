@@ -0,0 +1,111 @@
+/*
+ * virnftables.h: helper APIs for managing nftables
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "virsocketaddr.h"
+#include "virfirewall.h"
+
+void             nftablesSetupPrivateChains      (virFirewallPtr fw,
+                                                  virFirewallLayer layer);
+void             nftablesRemovePrivateChains     (virFirewallPtr fw,
+                                                  virFirewallLayer layer);
+
+void             nftablesAddNetworkChains        (virFirewallPtr fw,
+                                                  virFirewallLayer layer,
+                                                  const char *iface);
+void             nftablesLinkNetworkChains       (virFirewallPtr fw,
+                                                  virFirewallLayer layer,
+                                                  const char *iface);
+void             nftablesRemoveNetworkChains     (virFirewallPtr fw,
+                                                  virFirewallLayer layer,
+                                                  const char *iface);
+
+void             nftablesAddTcpInput             (virFirewallPtr fw,
+                                                  virFirewallLayer layer,
+                                                  const char *iface,
+                                                  int port);
+void             nftablesAddUdpInput             (virFirewallPtr fw,
+                                                  virFirewallLayer layer,
+                                                  const char *iface,
+                                                  int port);
+void             nftablesAddTcpOutput            (virFirewallPtr fw,
+                                                  virFirewallLayer layer,
+                                                  const char *iface,
+                                                  int port);
+void             nftablesAddUdpOutput            (virFirewallPtr fw,
+                                                  virFirewallLayer layer,
+                                                  const char *iface,
+                                                  int port);
+
+int              nftablesAddForwardAllowOut      (virFirewallPtr fw,
+                                                  virSocketAddr *netaddr,
+                                                  unsigned int prefix,
+                                                  const char *iface,
+                                                  const char *physdev)
+    G_GNUC_WARN_UNUSED_RESULT;
+int              nftablesAddForwardAllowRelatedIn(virFirewallPtr fw,
+                                                  virSocketAddr *netaddr,
+                                                  unsigned int prefix,
+                                                  const char *iface,
+                                                  const char *physdev)
+    G_GNUC_WARN_UNUSED_RESULT;
+int              nftablesAddForwardAllowIn       (virFirewallPtr fw,
+                                                  virSocketAddr *netaddr,
+                                                  unsigned int prefix,
+                                                  const char *iface,
+                                                  const char *physdev)
+    G_GNUC_WARN_UNUSED_RESULT;
+
+void             nftablesAddForwardAllowCross    (virFirewallPtr fw,
+                                                  virFirewallLayer layer,
+                                                  const char *iface);
+void             nftablesAddForwardRejectOut     (virFirewallPtr fw,
+                                                  virFirewallLayer layer,
+                                                  const char *iface);
+void             nftablesAddForwardRejectIn      (virFirewallPtr fw,
+                                                  virFirewallLayer layer,
+                                                  const char *iface);
+
+int              nftablesAddForwardMasquerade    (virFirewallPtr fw,
+                                                  virSocketAddr *netaddr,
+                                                  unsigned int prefix,
+                                                  const char *iface,
+                                                  const char *physdev,
+                                                  virSocketAddrRangePtr addr,
+                                                  virPortRangePtr port,
+                                                  const char *protocol)
+    G_GNUC_WARN_UNUSED_RESULT;
+int              nftablesAddDontMasquerade       (virFirewallPtr fw,
+                                                  virSocketAddr *netaddr,
+                                                  unsigned int prefix,
+                                                  const char *iface,
+                                                  const char *physdev,
+                                                  const char *destaddr)
+    G_GNUC_WARN_UNUSED_RESULT;
+
+int              nftablesAddNatSource            (virFirewallPtr fw,
+                                                  virSocketAddr *netaddr,
+                                                  unsigned int prefix,
+                                                  const char *iface)
+    G_GNUC_WARN_UNUSED_RESULT;
+int              nftablesRemoveNatSource         (virFirewallPtr fw,
+                                                  virSocketAddr *netaddr,
+                                                  unsigned int prefix,
+                                                  const char *iface)
+    G_GNUC_WARN_UNUSED_RESULT;
@@ -37,6 +37,8 @@
 #include "virkmod.h"
 #include "virstring.h"
 #include "viralloc.h"
+#include "virhash.h"
+#include "virthread.h"
 
 VIR_LOG_INIT("util.pci");
 
@@ -63,6 +65,20 @@ VIR_ENUM_IMPL(virPCIHeader,
               "cardbus-bridge",
 );
 
+/* Devices on different buses may be reset from different threads, but
+ * SR-IOV VFs living on different bus numbers can still share the bridge
+ * that a secondary bus reset toggles. Serialize the resets done through
+ * the same bridge, keyed by the bridge's name. Entries only live while
+ * somebody is using them. */
+typedef struct _virPCIBridgeResetLock virPCIBridgeResetLock;
+struct _virPCIBridgeResetLock {
+    virMutex lock;
+    size_t refs;
+};
+
+static virMutex virPCIBridgeResetLocksLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr virPCIBridgeResetLocks;
+
 struct _virPCIDevice {
     virPCIDeviceAddress address;
 
@@ -771,6 +787,65 @@ virPCIDeviceGetParent(virPCIDevicePtr dev, virPCIDevicePtr *parent)
     return ret;
 }
 
+static void
+virPCIBridgeResetLockFree(void *opaque)
+{
+    virPCIBridgeResetLock *lock = opaque;
+
+    virMutexDestroy(&lock->lock);
+    g_free(lock);
+}
+
+static virPCIBridgeResetLock *
+virPCIBridgeResetLockAcquire(virPCIDevicePtr bridge)
+{
+    virPCIBridgeResetLock *lock = NULL;
+
+    virMutexLock(&virPCIBridgeResetLocksLock);
+
+    if (!virPCIBridgeResetLocks &&
+        !(virPCIBridgeResetLocks = virHashNew(virPCIBridgeResetLockFree)))
+        goto cleanup;
+
+    if (!(lock = virHashLookup(virPCIBridgeResetLocks, bridge->name))) {
+        lock = g_new0(virPCIBridgeResetLock, 1);
+
+        if (virMutexInit(&lock->lock) < 0) {
+            virReportSystemError(errno, "%s", _("unable to init mutex"));
+            VIR_FREE(lock);
+            goto cleanup;
+        }
+
+        if (virHashAddEntry(virPCIBridgeResetLocks, bridge->name, lock) < 0) {
+            virPCIBridgeResetLockFree(lock);
+            lock = NULL;
+            goto cleanup;
+        }
+    }
+
+    lock->refs++;
+
+ cleanup:
+    virMutexUnlock(&virPCIBridgeResetLocksLock);
+
+    if (lock)
+        virMutexLock(&lock->lock);
+
+    return lock;
+}
+
+static void
+virPCIBridgeResetLockRelease(virPCIDevicePtr bridge,
+                             virPCIBridgeResetLock *lock)
+{
+    virMutexUnlock(&lock->lock);
+
+    virMutexLock(&virPCIBridgeResetLocksLock);
+    if (--lock->refs == 0)
+        virHashRemoveEntry(virPCIBridgeResetLocks, bridge->name);
+    virMutexUnlock(&virPCIBridgeResetLocksLock);
+}
+
 /* Secondary Bus Reset is our sledgehammer - it resets all
  * devices behind a bus.
  */
@@ -785,6 +860,7 @@ virPCIDeviceTrySecondaryBusReset(virPCIDevicePtr dev,
     uint16_t ctl;
     int ret = -1;
     int parentfd;
+    virPCIBridgeResetLock *lock;
 
     /* Refuse to do a secondary bus reset if there are other
      * devices/functions behind the bus are used by the host
@@ -825,6 +901,9 @@ virPCIDeviceTrySecondaryBusReset(virPCIDevicePtr dev,
     /* Read the control register, set the reset flag, wait 200ms,
      * unset the reset flag and wait 200ms.
      */
+    if (!(lock = virPCIBridgeResetLockAcquire(parent)))
+        goto out;
+
     ctl = virPCIDeviceRead16(dev, parentfd, PCI_BRIDGE_CONTROL);
 
     virPCIDeviceWrite16(parent, parentfd, PCI_BRIDGE_CONTROL,
@@ -836,6 +915,8 @@ virPCIDeviceTrySecondaryBusReset(virPCIDevicePtr dev,
 
     g_usleep(200 * 1000); /* sleep 200ms */
 
+    virPCIBridgeResetLockRelease(parent, lock);
+
     if (virPCIDeviceWrite(dev, cfgfd, 0, config_space, PCI_CONF_LEN) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("Failed to restore PCI config space for %s"),
@@ -38,6 +38,9 @@ VIR_LOG_INIT("util.rotatingfile");
 
 #define VIR_MAX_MAX_BACKUP 32
 
+/* How far back from the size limit to look for a line break */
+#define VIR_ROTATING_FILE_LINE_SEARCH 80
+
 typedef struct virRotatingFileWriterEntry virRotatingFileWriterEntry;
 typedef virRotatingFileWriterEntry *virRotatingFileWriterEntryPtr;
 
@@ -46,6 +49,7 @@ typedef virRotatingFileReaderEntry *virRotatingFileReaderEntryPtr;
 
 struct virRotatingFileWriterEntry {
     int fd;
+    int splicefd;
     off_t inode;
     off_t pos;
     off_t len;
@@ -57,6 +61,7 @@ struct virRotatingFileWriter {
     size_t maxbackup;
     mode_t mode;
     size_t maxlen;
+    bool nosplice;
 };
 
 
@@ -80,6 +85,7 @@ virRotatingFileWriterEntryFree(virRotatingFileWriterEntryPtr entry)
         return;
 
     VIR_FORCE_CLOSE(entry->fd);
+    VIR_FORCE_CLOSE(entry->splicefd);
     VIR_FREE(entry);
 }
 
@@ -108,12 +114,24 @@ virRotatingFileWriterEntryNew(const char *path,
     if (VIR_ALLOC(entry) < 0)
         return NULL;
 
+    entry->splicefd = -1;
+
     if ((entry->fd = open(path, O_CREAT|O_APPEND|O_WRONLY|O_CLOEXEC, mode)) < 0) {
         virReportSystemError(errno,
                              _("Unable to open file: %s"), path);
         goto error;
     }
 
+#if HAVE_SPLICE
+    /* splice() refuses to write to files opened with O_APPEND, so
+     * keep a second descriptor for it. Writes through it always use
+     * an explicit offset taken from the current end of the file. If
+     * it can't be opened we simply never splice. */
+    if ((entry->splicefd = open(path, O_WRONLY|O_CLOEXEC)) < 0)
+        VIR_DEBUG("Unable to open %s for splicing: %s",
+                  path, g_strerror(errno));
+#endif /* HAVE_SPLICE */
+
     entry->pos = lseek(entry->fd, 0, SEEK_END);
     if (entry->pos == (off_t)-1) {
         virReportSystemError(errno,
@@ -449,7 +467,7 @@ virRotatingFileWriterAppend(virRotatingFileWriterPtr file,
              * point to avoid splitting lines across
              * separate files
              */
-            for (i = 0; i < towrite && i < 80; i++) {
+            for (i = 0; i < towrite && i < VIR_ROTATING_FILE_LINE_SEARCH; i++) {
                 if (buf[towrite - i - 1] == '\n') {
                     towrite -= i;
                     forceRollover = true;
@@ -495,6 +513,101 @@ virRotatingFileWriterAppend(virRotatingFileWriterPtr file,
 }
 
 
+/**
+ * virRotatingFileWriterAppendFromFD:
+ * @file: the file context
+ * @fd: the file descriptor to read data from, typically a pipe
+ * @len: the maximum number of bytes to transfer
+ *
+ * Transfer up to @len bytes of data available on @fd into the
+ * file, handling rollover in the same way as
+ * virRotatingFileWriterAppend. Where possible the data is moved by
+ * the kernel via splice() without copying it through userspace; the
+ * last few bytes before the size limit are always read into a buffer
+ * so that lines are not split across files.
+ *
+ * Data is transferred with a single read from @fd, so callers can
+ * invoke this whenever @fd is reported readable. If @fd is a pipe with
+ * no data pending, -1 is returned with errno set to EAGAIN and no
+ * error is reported.
+ *
+ * Returns the number of bytes transferred, 0 on EOF, or -1 on error
+ */
+ssize_t
+virRotatingFileWriterAppendFromFD(virRotatingFileWriterPtr file,
+                                  int fd,
+                                  size_t len)
+{
+    char buf[4096];
+    ssize_t got;
+
+#if HAVE_SPLICE
+    if (!file->nosplice && file->entry->splicefd != -1) {
+        struct stat sb;
+
+        /* The file may have been truncated behind our back, eg by
+         * logrotate's copytruncate, so always splice at its current
+         * end rather than where we last left off. */
+        if (fstat(file->entry->splicefd, &sb) < 0) {
+            virReportSystemError(errno,
+                                 _("Unable to determine current file size: %s"),
+                                 file->basepath);
+            return -1;
+        }
+        file->entry->pos = file->entry->len = sb.st_size;
+    }
+
+    if (!file->nosplice && file->entry->splicefd != -1 &&
+        file->entry->pos + VIR_ROTATING_FILE_LINE_SEARCH < file->maxlen) {
+        size_t room = file->maxlen - file->entry->pos -
+            VIR_ROTATING_FILE_LINE_SEARCH;
+        loff_t off = file->entry->pos;
+
+        do {
+            got = splice(fd, NULL, file->entry->splicefd, &off, MIN(len, room),
+                         SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        } while (got < 0 && errno == EINTR);
+
+        if (got >= 0) {
+            file->entry->pos += got;
+            file->entry->len += got;
+            return got;
+        }
+
+        if (errno == EAGAIN)
+            return -1;
+
+        if (errno != EINVAL && errno != ENOSYS) {
+            virReportSystemError(errno,
+                                 _("Unable to write to file %s"),
+                                 file->basepath);
+            return -1;
+        }
+
+        VIR_DEBUG("splice not supported for %s, falling back to copying",
+                  file->basepath);
+        file->nosplice = true;
+    }
+#endif /* HAVE_SPLICE */
+
+    do {
+        got = read(fd, buf, MIN(len, sizeof(buf)));
+    } while (got < 0 && errno == EINTR);
+
+    if (got < 0) {
+        if (errno != EAGAIN)
+            virReportSystemError(errno, "%s",
+                                 _("Unable to read data to append"));
+        return -1;
+    }
+
+    if (got && virRotatingFileWriterAppend(file, buf, got) != got)
+        return -1;
+
+    return got;
+}
+
+
 /**
  * virRotatingFileReaderSeek
  * @file: the file context
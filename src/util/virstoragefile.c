@@ -40,6 +40,7 @@
 #include "virstorageencryption.h"
 #include "virsecret.h"
 #include "virutil.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
@@ -2351,6 +2352,113 @@ virStorageSourceCopy(const virStorageSource *src,
 }
 
 
+static virStorageSourcePtr
+virStorageSourceCopyConfigInternal(const virStorageSource *src,
+                                   bool backing)
+{
+    g_autoptr(virStorageSource) def = NULL;
+    size_t i;
+
+    if (!(def = virStorageSourceNew()))
+        return NULL;
+
+    def->type = src->type;
+
+    /* terminator of the backing chain */
+    if (backing && src->type == VIR_STORAGE_TYPE_NONE)
+        return g_steal_pointer(&def);
+
+    def->protocol = src->protocol;
+    def->format = src->format;
+    def->haveTLS = src->haveTLS;
+
+    /* backing chain members are always read-only */
+    if (backing) {
+        def->readonly = true;
+    } else {
+        def->readonly = src->readonly;
+        def->shared = src->shared;
+        def->authInherited = src->authInherited;
+        def->encryptionInherited = src->encryptionInherited;
+    }
+
+    def->path = g_strdup(src->path);
+    def->volume = g_strdup(src->volume);
+    def->snapshot = g_strdup(src->snapshot);
+    def->configFile = g_strdup(src->configFile);
+
+    if (src->sliceStorage) {
+        def->sliceStorage = g_new0(virStorageSourceSlice, 1);
+        def->sliceStorage->offset = src->sliceStorage->offset;
+        def->sliceStorage->size = src->sliceStorage->size;
+    }
+
+    if (src->nhosts) {
+        if (!(def->hosts = virStorageNetHostDefCopy(src->nhosts, src->hosts)))
+            return NULL;
+
+        def->nhosts = src->nhosts;
+    }
+
+    if (src->srcpool &&
+        !(def->srcpool = virStorageSourcePoolDefCopy(src->srcpool)))
+        return NULL;
+
+    if (src->encryption &&
+        !(def->encryption = virStorageEncryptionCopy(src->encryption)))
+        return NULL;
+
+    if (src->auth &&
+        !(def->auth = virStorageAuthDefCopy(src->auth)))
+        return NULL;
+
+    if (src->pr) {
+        def->pr = g_new0(virStoragePRDef, 1);
+        def->pr->managed = src->pr->managed;
+        def->pr->path = g_strdup(src->pr->path);
+    }
+
+    if (src->nvme)
+        def->nvme = virStorageSourceNVMeDefCopy(src->nvme);
+
+    if (virStorageSourceInitiatorCopy(&def->initiator, &src->initiator) < 0)
+        return NULL;
+
+    /* security labels of network sources are not part of the config */
+    if (src->type != VIR_STORAGE_TYPE_NETWORK) {
+        if (virStorageSourceSeclabelsCopy(def, src) < 0)
+            return NULL;
+
+        for (i = 0; i < def->nseclabels; i++)
+            def->seclabels[i]->labelskip = false;
+    }
+
+    if (src->backingStore &&
+        !(def->backingStore = virStorageSourceCopyConfigInternal(src->backingStore,
+                                                                 true)))
+        return NULL;
+
+    return g_steal_pointer(&def);
+}
+
+
+/**
+ * virStorageSourceCopyConfig:
+ * @src: storage source to copy
+ *
+ * Deep-copies the user-visible configuration of @src and of its backing
+ * chain, i.e. the data which would survive formatting @src into domain XML
+ * and parsing it back as an inactive definition. Runtime data such as chain
+ * indexes, node names, detected image metadata, sizes and private data are
+ * not copied.
+ */
+virStorageSourcePtr
+virStorageSourceCopyConfig(const virStorageSource *src)
+{
+    return virStorageSourceCopyConfigInternal(src, false);
+}
+
+
 /**
  * virStorageSourceIsSameLocation:
  *
@@ -4931,6 +5039,220 @@ virStorageFileReportBrokenChain(int errcode,
 }
 
 
+/* Headers of local image files read while walking backing chains are
+ * cached, so that probing the same chain again (on every domain start,
+ * block job or stats query) doesn't have to open and read every image.
+ * An entry is only used while the file still has the same identity,
+ * size and mtime, and only for the credentials it was read with.
+ * Files modified less than VIR_STORAGE_METADATA_CACHE_RACY_SEC before
+ * they were read are not cached: the mtime granularity might hide a
+ * later modification. On network filesystems the mtime is set by the
+ * server's clock while it is compared against ours here, so the margin
+ * is chosen to also cover the clock skew of hosts that are kept in
+ * sync by NTP, not just the timestamp granularity. Files with an mtime
+ * in the future are never cached either. Callers that know they have
+ * modified an image behind our back (e.g. block jobs) call
+ * virStorageFileMetadataCacheInvalidate(). */
+#define VIR_STORAGE_METADATA_CACHE_MAX 256
+#define VIR_STORAGE_METADATA_CACHE_RACY_SEC 60
+
+typedef struct _virStorageFileMetadataCacheEntry virStorageFileMetadataCacheEntry;
+struct _virStorageFileMetadataCacheEntry {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    uid_t uid;
+    gid_t gid;
+
+    char *buf;
+    size_t len;
+};
+
+static virMutex virStorageFileMetadataCacheLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr virStorageFileMetadataCache;
+
+
+static void
+virStorageFileMetadataCacheEntryFree(void *opaque)
+{
+    virStorageFileMetadataCacheEntry *entry = opaque;
+
+    if (!entry)
+        return;
+
+    g_free(entry->buf);
+    g_free(entry);
+}
+
+
+static struct timespec
+virStorageFileMetadataCacheGetMtime(const struct stat *st)
+{
+#if defined(__APPLE__)
+    return st->st_mtimespec;
+#elif defined(WIN32)
+    return (struct timespec){ st->st_mtime, 0 };
+#else
+    return st->st_mtim;
+#endif
+}
+
+
+static bool
+virStorageFileMetadataCacheEntryMatch(const virStorageFileMetadataCacheEntry *entry,
+                                      const struct stat *st,
+                                      uid_t uid,
+                                      gid_t gid)
+{
+    struct timespec mtime = virStorageFileMetadataCacheGetMtime(st);
+
+    return entry->dev == st->st_dev &&
+        entry->ino == st->st_ino &&
+        entry->size == st->st_size &&
+        entry->mtime.tv_sec == mtime.tv_sec &&
+        entry->mtime.tv_nsec == mtime.tv_nsec &&
+        entry->uid == uid &&
+        entry->gid == gid;
+}
+
+
+/**
+ * virStorageFileMetadataCacheGet:
+ * @name: unique identifier of the image
+ * @st: current state of the image
+ * @uid: uid the header is read as
+ * @gid: gid the header is read as
+ * @buf: filled with a copy of the cached header
+ * @len: filled with the length of @buf
+ *
+ * Returns true if a header of the unchanged image was found.
+ */
+static bool
+virStorageFileMetadataCacheGet(const char *name,
+                               const struct stat *st,
+                               uid_t uid,
+                               gid_t gid,
+                               char **buf,
+                               size_t *len)
+{
+    virStorageFileMetadataCacheEntry *entry;
+    bool found = false;
+
+    virMutexLock(&virStorageFileMetadataCacheLock);
+
+    if (virStorageFileMetadataCache &&
+        (entry = virHashLookup(virStorageFileMetadataCache, name))) {
+        if (virStorageFileMetadataCacheEntryMatch(entry, st, uid, gid)) {
+            *buf = g_memdup(entry->buf, entry->len);
+            *len = entry->len;
+            found = true;
+        } else {
+            virHashRemoveEntry(virStorageFileMetadataCache, name);
+        }
+    }
+
+    virMutexUnlock(&virStorageFileMetadataCacheLock);
+
+    VIR_DEBUG("metadata cache %s for '%s'", found ? "hit" : "miss", name);
+    return found;
+}
+
+
+static void
+virStorageFileMetadataCachePut(const char *name,
+                               const struct stat *st,
+                               uid_t uid,
+                               gid_t gid,
+                               const char *buf,
+                               size_t len)
+{
+    virStorageFileMetadataCacheEntry *entry;
+    struct timespec mtime = virStorageFileMetadataCacheGetMtime(st);
+
+    time_t now = time(NULL);
+
+    if (mtime.tv_sec > now ||
+        now - mtime.tv_sec < VIR_STORAGE_METADATA_CACHE_RACY_SEC)
+        return;
+
+    entry = g_new0(virStorageFileMetadataCacheEntry, 1);
+    entry->dev = st->st_dev;
+    entry->ino = st->st_ino;
+    entry->size = st->st_size;
+    entry->mtime = mtime;
+    entry->uid = uid;
+    entry->gid = gid;
+    entry->buf = g_memdup(buf, len);
+    entry->len = len;
+
+    virMutexLock(&virStorageFileMetadataCacheLock);
+
+    if (!virStorageFileMetadataCache &&
+        !(virStorageFileMetadataCache =
+          virHashCreate(VIR_STORAGE_METADATA_CACHE_MAX,
+                        virStorageFileMetadataCacheEntryFree)))
+        goto cleanup;
+
+    /* Don't bother with LRU tracking, the cache is refilled by the
+     * next walk of each chain anyway */
+    if (virHashSize(virStorageFileMetadataCache) >= VIR_STORAGE_METADATA_CACHE_MAX)
+        virHashRemoveAll(virStorageFileMetadataCache);
+
+    if (virHashUpdateEntry(virStorageFileMetadataCache, name, entry) < 0)
+        goto cleanup;
+    entry = NULL;
+
+ cleanup:
+    virMutexUnlock(&virStorageFileMetadataCacheLock);
+    virStorageFileMetadataCacheEntryFree(entry);
+}
+
+
+/**
+ * virStorageFileMetadataCacheInvalidate:
+ * @src: top of a backing chain (may be NULL)
+ *
+ * Drops cached headers of all local images of the chain starting at
+ * @src. To be called whenever images might have been rewritten
+ * without going through the storage file APIs, e.g. after a block job.
+ */
+void
+virStorageFileMetadataCacheInvalidate(virStorageSourcePtr src)
+{
+    virStorageSourcePtr n;
+    VIR_AUTOSTRINGLIST canonpaths = NULL;
+    size_t i;
+
+    /* Resolving the paths may block on an unresponsive (network)
+     * filesystem, so do it before taking the lock shared by every
+     * backing chain walk */
+    for (n = src; virStorageSourceIsBacking(n); n = n->backingStore) {
+        g_autofree char *canonpath = NULL;
+
+        if (virStorageSourceGetActualType(n) != VIR_STORAGE_TYPE_FILE ||
+            !n->path ||
+            !(canonpath = virFileCanonicalizePath(n->path)))
+            continue;
+
+        if (virStringListAdd(&canonpaths, canonpath) < 0)
+            return;
+    }
+
+    if (!canonpaths)
+        return;
+
+    virMutexLock(&virStorageFileMetadataCacheLock);
+
+    for (i = 0; virStorageFileMetadataCache && canonpaths[i]; i++) {
+        VIR_DEBUG("invalidating cached metadata of '%s'", canonpaths[i]);
+        virHashRemoveEntry(virStorageFileMetadataCache, canonpaths[i]);
+    }
+
+    virMutexUnlock(&virStorageFileMetadataCacheLock);
+}
+
+
 static int
 virStorageFileGetMetadataRecurseReadHeader(virStorageSourcePtr src,
                                            virStorageSourcePtr parent,
@@ -4943,6 +5265,8 @@ virStorageFileGetMetadataRecurseReadHeader(virStorageSourcePtr src,
     int ret = -1;
     const char *uniqueName;
     ssize_t len;
+    struct stat st;
+    bool cacheable;
 
     if (virStorageFileInitAs(src, uid, gid) < 0)
         return -1;
@@ -4965,10 +5289,26 @@ virStorageFileGetMetadataRecurseReadHeader(virStorageSourcePtr src,
     if (virHashAddEntry(cycle, uniqueName, NULL) < 0)
         goto cleanup;
 
+    /* Block devices don't get their mtime updated on writes */
+    cacheable = virStorageSourceGetActualType(src) == VIR_STORAGE_TYPE_FILE &&
+                virStorageFileStat(src, &st) == 0 &&
+                S_ISREG(st.st_mode);
+
+    if (cacheable &&
+        virStorageFileMetadataCacheGet(uniqueName, &st, uid, gid,
+                                       buf, headerLen)) {
+        ret = 0;
+        goto cleanup;
+    }
+
     if ((len = virStorageFileRead(src, 0, VIR_STORAGE_MAX_HEADER, buf)) < 0)
         goto cleanup;
 
     *headerLen = len;
+
+    if (cacheable)
+        virStorageFileMetadataCachePut(uniqueName, &st, uid, gid, *buf, len);
+
     ret = 0;
 
  cleanup:
@@ -261,7 +261,8 @@ typedef virStorageSource *virStorageSourcePtr;
  * chains, multiple source disks join to form a single guest view.
  *
  * IMPORTANT: When adding fields to this struct it's also necessary to add
- * appropriate code to the virStorageSourceCopy deep copy function */
+ * appropriate code to the virStorageSourceCopy deep copy function, and to
+ * virStorageSourceCopyConfig if the field is part of the XML config */
 struct _virStorageSource {
     virObject parent;
 
@@ -478,6 +479,8 @@ int virStorageSourceNewFromBacking(virStorageSourcePtr parent,
 virStorageSourcePtr virStorageSourceCopy(const virStorageSource *src,
                                          bool backingChain)
     ATTRIBUTE_NONNULL(1);
+virStorageSourcePtr virStorageSourceCopyConfig(const virStorageSource *src)
+    ATTRIBUTE_NONNULL(1);
 bool virStorageSourceIsSameLocation(virStorageSourcePtr a,
                                     virStorageSourcePtr b)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
@@ -571,6 +574,8 @@ int virStorageFileGetMetadata(virStorageSourcePtr src,
                               bool report_broken)
     ATTRIBUTE_NONNULL(1);
 
+void virStorageFileMetadataCacheInvalidate(virStorageSourcePtr src);
+
 int virStorageFileGetBackingStoreStr(virStorageSourcePtr src,
                                      char **backing)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
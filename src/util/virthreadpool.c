@@ -33,22 +33,36 @@ typedef struct _virThreadPoolJob virThreadPoolJob;
 typedef virThreadPoolJob *virThreadPoolJobPtr;
 
 struct _virThreadPoolJob {
-    virThreadPoolJobPtr prev;
     virThreadPoolJobPtr next;
     unsigned int priority;
+    unsigned long long seq;
+    unsigned long long queued; /* monotonic time of submission, in us */
 
     void *data;
 };
 
+typedef enum {
+    VIR_THREAD_POOL_QUEUE_NORMAL,
+    VIR_THREAD_POOL_QUEUE_PRIORITY,
+
+    VIR_THREAD_POOL_QUEUE_LAST
+} virThreadPoolQueueType;
+
 typedef struct _virThreadPoolJobList virThreadPoolJobList;
 typedef virThreadPoolJobList *virThreadPoolJobListPtr;
 
 struct _virThreadPoolJobList {
     virThreadPoolJobPtr head;
     virThreadPoolJobPtr tail;
-    virThreadPoolJobPtr firstPrio;
 };
 
+/* Upper bounds (in microseconds) of all but the last histogram bucket */
+static const unsigned long long virThreadPoolHistBounds[] = {
+    100, 1000, 10000, 100000, 1000000,
+};
+G_STATIC_ASSERT(G_N_ELEMENTS(virThreadPoolHistBounds) ==
+                VIR_THREAD_POOL_HIST_BUCKETS - 1);
+
 
 struct _virThreadPool {
     bool quit;
@@ -56,9 +70,16 @@ struct _virThreadPool {
     virThreadPoolJobFunc jobFunc;
     const char *jobFuncName;
     void *jobOpaque;
-    virThreadPoolJobList jobList;
+    /* Jobs are queued per priority so that neither kind of worker
+     * has to scan past jobs it cannot take. Ordinary workers keep
+     * the global FIFO order by comparing the sequence numbers of
+     * both queue heads. */
+    virThreadPoolJobList jobList[VIR_THREAD_POOL_QUEUE_LAST];
+    unsigned long long jobSeq;
     size_t jobQueueDepth;
 
+    virThreadPoolStats stats;
+
     virMutex mutex;
     virCond cond;
     virCond quit_cond;
@@ -89,6 +110,110 @@ static inline bool virThreadPoolWorkerQuitHelper(size_t count, size_t limit)
     return count > limit;
 }
 
+
+static void
+virThreadPoolJobListAppend(virThreadPoolJobListPtr list,
+                           virThreadPoolJobPtr job)
+{
+    if (list->tail)
+        list->tail->next = job;
+    else
+        list->head = job;
+    list->tail = job;
+}
+
+
+static virThreadPoolJobPtr
+virThreadPoolJobListPop(virThreadPoolJobListPtr list)
+{
+    virThreadPoolJobPtr job = list->head;
+
+    if (job) {
+        list->head = job->next;
+        if (!list->head)
+            list->tail = NULL;
+        job->next = NULL;
+    }
+
+    return job;
+}
+
+
+/* Pick the next job for a worker. Priority workers only take
+ * priority jobs, ordinary workers take whichever job is oldest. */
+static virThreadPoolJobPtr
+virThreadPoolNextJob(virThreadPoolPtr pool,
+                     bool priority)
+{
+    virThreadPoolJobListPtr normal = &pool->jobList[VIR_THREAD_POOL_QUEUE_NORMAL];
+    virThreadPoolJobListPtr prio = &pool->jobList[VIR_THREAD_POOL_QUEUE_PRIORITY];
+
+    if (priority || !normal->head)
+        return virThreadPoolJobListPop(prio);
+
+    if (prio->head && prio->head->seq < normal->head->seq)
+        return virThreadPoolJobListPop(prio);
+
+    return virThreadPoolJobListPop(normal);
+}
+
+
+static bool
+virThreadPoolHasJob(virThreadPoolPtr pool,
+                    bool priority)
+{
+    if (pool->jobList[VIR_THREAD_POOL_QUEUE_PRIORITY].head)
+        return true;
+
+    return !priority && pool->jobList[VIR_THREAD_POOL_QUEUE_NORMAL].head;
+}
+
+
+static void
+virThreadPoolHistAdd(unsigned long long *hist,
+                     unsigned long long value)
+{
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(virThreadPoolHistBounds); i++) {
+        if (value < virThreadPoolHistBounds[i])
+            break;
+    }
+
+    hist[i]++;
+}
+
+
+/* Must be called with pool->mutex held */
+static void
+virThreadPoolRecordWait(virThreadPoolPtr pool,
+                        virThreadPoolJobPtr job,
+                        unsigned long long now)
+{
+    unsigned long long wait = now > job->queued ? now - job->queued : 0;
+
+    pool->stats.waitTimeTotal += wait;
+    if (wait > pool->stats.waitTimeMax)
+        pool->stats.waitTimeMax = wait;
+    virThreadPoolHistAdd(pool->stats.waitTimeHist, wait);
+}
+
+
+/* Must be called with pool->mutex held */
+static void
+virThreadPoolRecordService(virThreadPoolPtr pool,
+                           unsigned long long start,
+                           unsigned long long end)
+{
+    unsigned long long service = end > start ? end - start : 0;
+
+    pool->stats.jobsProcessed++;
+    pool->stats.serviceTimeTotal += service;
+    if (service > pool->stats.serviceTimeMax)
+        pool->stats.serviceTimeMax = service;
+    virThreadPoolHistAdd(pool->stats.serviceTimeHist, service);
+}
+
 static void virThreadPoolWorker(void *opaque)
 {
     struct virThreadPoolWorkerData *data = opaque;
@@ -98,6 +223,8 @@ static void virThreadPoolWorker(void *opaque)
     size_t *curWorkers = priority ? &pool->nPrioWorkers : &pool->nWorkers;
     size_t *maxLimit = priority ? &pool->maxPrioWorkers : &pool->maxWorkers;
     virThreadPoolJobPtr job = NULL;
+    unsigned long long start;
+    unsigned long long end;
 
     VIR_FREE(data);
 
@@ -112,9 +239,7 @@ static void virThreadPoolWorker(void *opaque)
          */
         if (virThreadPoolWorkerQuitHelper(*curWorkers, *maxLimit))
             goto out;
-        while (!pool->quit &&
-               ((!priority && !pool->jobList.head) ||
-                (priority && !pool->jobList.firstPrio))) {
+        while (!pool->quit && !virThreadPoolHasJob(pool, priority)) {
             if (!priority)
                 pool->freeWorkers++;
             if (virCondWait(cond, &pool->mutex) < 0) {
@@ -132,37 +257,19 @@ static void virThreadPoolWorker(void *opaque)
         if (pool->quit)
             break;
 
-        if (priority) {
-            job = pool->jobList.firstPrio;
-        } else {
-            job = pool->jobList.head;
-        }
-
-        if (job == pool->jobList.firstPrio) {
-            virThreadPoolJobPtr tmp = job->next;
-            while (tmp) {
-                if (tmp->priority)
-                    break;
-                tmp = tmp->next;
-            }
-            pool->jobList.firstPrio = tmp;
-        }
-
-        if (job->prev)
-            job->prev->next = job->next;
-        else
-            pool->jobList.head = job->next;
-        if (job->next)
-            job->next->prev = job->prev;
-        else
-            pool->jobList.tail = job->prev;
-
+        job = virThreadPoolNextJob(pool, priority);
         pool->jobQueueDepth--;
 
+        start = g_get_monotonic_time();
+        virThreadPoolRecordWait(pool, job, start);
+
         virMutexUnlock(&pool->mutex);
         (pool->jobFunc)(job->data, pool->jobOpaque);
         VIR_FREE(job);
+        end = g_get_monotonic_time();
         virMutexLock(&pool->mutex);
+
+        virThreadPoolRecordService(pool, start, end);
     }
 
  out:
@@ -229,8 +336,6 @@ virThreadPoolNewFull(size_t minWorkers,
     if (VIR_ALLOC(pool) < 0)
         return NULL;
 
-    pool->jobList.tail = pool->jobList.head = NULL;
-
     pool->jobFunc = func;
     pool->jobFuncName = funcName;
     pool->jobOpaque = opaque;
@@ -269,6 +374,7 @@ void virThreadPoolFree(virThreadPoolPtr pool)
 {
     virThreadPoolJobPtr job;
     bool priority = false;
+    size_t i;
 
     if (!pool)
         return;
@@ -285,9 +391,9 @@ void virThreadPoolFree(virThreadPoolPtr pool)
     while (pool->nWorkers > 0 || pool->nPrioWorkers > 0)
         ignore_value(virCondWait(&pool->quit_cond, &pool->mutex));
 
-    while ((job = pool->jobList.head)) {
-        pool->jobList.head = pool->jobList.head->next;
-        VIR_FREE(job);
+    for (i = 0; i < VIR_THREAD_POOL_QUEUE_LAST; i++) {
+        while ((job = virThreadPoolJobListPop(&pool->jobList[i])))
+            VIR_FREE(job);
     }
 
     VIR_FREE(pool->workers);
@@ -369,6 +475,39 @@ size_t virThreadPoolGetJobQueueDepth(virThreadPoolPtr pool)
     return ret;
 }
 
+/**
+ * virThreadPoolGetStats:
+ * @pool: the thread pool
+ * @stats: filled with a snapshot of the pool's job statistics
+ *
+ * Wait time is measured from virThreadPoolSendJob until a worker
+ * picks the job up, service time is the time spent in the job
+ * function. All times are in microseconds. The histograms use the
+ * bucket bounds returned by virThreadPoolGetHistBound.
+ */
+void virThreadPoolGetStats(virThreadPoolPtr pool,
+                           virThreadPoolStatsPtr stats)
+{
+    virMutexLock(&pool->mutex);
+    *stats = pool->stats;
+    virMutexUnlock(&pool->mutex);
+}
+
+/**
+ * virThreadPoolGetHistBound:
+ * @bucket: index of a histogram bucket
+ *
+ * Returns the exclusive upper bound of @bucket in microseconds, or
+ * 0 for the last, unbounded bucket.
+ */
+unsigned long long virThreadPoolGetHistBound(size_t bucket)
+{
+    if (bucket >= G_N_ELEMENTS(virThreadPoolHistBounds))
+        return 0;
+
+    return virThreadPoolHistBounds[bucket];
+}
+
 /*
  * @priority - job priority
  * Return: 0 on success, -1 otherwise
@@ -393,19 +532,17 @@ int virThreadPoolSendJob(virThreadPoolPtr pool,
 
     job->data = jobData;
     job->priority = priority;
+    job->seq = pool->jobSeq++;
+    job->queued = g_get_monotonic_time();
 
-    job->prev = pool->jobList.tail;
-    if (pool->jobList.tail)
-        pool->jobList.tail->next = job;
-    pool->jobList.tail = job;
-
-    if (!pool->jobList.head)
-        pool->jobList.head = job;
-
-    if (priority && !pool->jobList.firstPrio)
-        pool->jobList.firstPrio = job;
+    virThreadPoolJobListAppend(&pool->jobList[priority ?
+                                              VIR_THREAD_POOL_QUEUE_PRIORITY :
+                                              VIR_THREAD_POOL_QUEUE_NORMAL],
+                               job);
 
     pool->jobQueueDepth++;
+    if (pool->jobQueueDepth > pool->stats.jobQueueDepthMax)
+        pool->stats.jobQueueDepthMax = pool->jobQueueDepth;
 
     virCondSignal(&pool->cond);
     if (priority)
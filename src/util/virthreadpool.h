@@ -28,6 +28,24 @@ typedef virThreadPool *virThreadPoolPtr;
 
 typedef void (*virThreadPoolJobFunc)(void *jobdata, void *opaque);
 
+#define VIR_THREAD_POOL_HIST_BUCKETS 6
+
+typedef struct _virThreadPoolStats virThreadPoolStats;
+typedef virThreadPoolStats *virThreadPoolStatsPtr;
+
+struct _virThreadPoolStats {
+    unsigned long long jobsProcessed;
+    size_t jobQueueDepthMax;
+
+    unsigned long long waitTimeTotal;
+    unsigned long long waitTimeMax;
+    unsigned long long waitTimeHist[VIR_THREAD_POOL_HIST_BUCKETS];
+
+    unsigned long long serviceTimeTotal;
+    unsigned long long serviceTimeMax;
+    unsigned long long serviceTimeHist[VIR_THREAD_POOL_HIST_BUCKETS];
+};
+
 #define virThreadPoolNew(min, max, prio, func, opaque) \
     virThreadPoolNewFull(min, max, prio, func, #func, opaque)
 
@@ -44,6 +62,9 @@ size_t virThreadPoolGetPriorityWorkers(virThreadPoolPtr pool);
 size_t virThreadPoolGetCurrentWorkers(virThreadPoolPtr pool);
 size_t virThreadPoolGetFreeWorkers(virThreadPoolPtr pool);
 size_t virThreadPoolGetJobQueueDepth(virThreadPoolPtr pool);
+void virThreadPoolGetStats(virThreadPoolPtr pool,
+                           virThreadPoolStatsPtr stats);
+unsigned long long virThreadPoolGetHistBound(size_t bucket);
 
 void virThreadPoolFree(virThreadPoolPtr pool);
 
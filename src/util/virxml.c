@@ -31,7 +31,9 @@
 #include "virbuffer.h"
 #include "viralloc.h"
 #include "virfile.h"
+#include "virhash.h"
 #include "virstring.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_XML
 
@@ -45,6 +47,93 @@ struct virParserData {
 };
 
 
+/* Expressions evaluated by the virXPath* helpers are mostly string literals
+ * used over and over while parsing definitions, so their compiled form is
+ * cached instead of compiling them on every evaluation. Each thread has its
+ * own cache since libxml2 makes no promises about evaluating one compiled
+ * expression from several threads at once. */
+#define VIR_XPATH_CACHE_MAX 1024
+
+static virThreadLocal virXPathCache;
+
+static void
+virXPathCacheFree(void *opaque)
+{
+    virHashFree(opaque);
+}
+
+
+static void
+virXPathCompExprFree(void *payload)
+{
+    xmlXPathFreeCompExpr(payload);
+}
+
+
+static int
+virXPathCacheOnceInit(void)
+{
+    return virThreadLocalInit(&virXPathCache, virXPathCacheFree);
+}
+
+VIR_ONCE_GLOBAL_INIT(virXPathCache);
+
+
+static virHashTablePtr
+virXPathCacheGet(void)
+{
+    virHashTablePtr cache;
+
+    if (virXPathCacheInitialize() < 0)
+        return NULL;
+
+    if ((cache = virThreadLocalGet(&virXPathCache)))
+        return cache;
+
+    if (!(cache = virHashCreate(64, virXPathCompExprFree)))
+        return NULL;
+
+    if (virThreadLocalSet(&virXPathCache, cache) < 0) {
+        virHashFree(cache);
+        return NULL;
+    }
+
+    return cache;
+}
+
+
+static xmlXPathObjectPtr
+virXPathEval(const char *xpath,
+             xmlXPathContextPtr ctxt)
+{
+    virHashTablePtr cache;
+    xmlXPathCompExprPtr comp;
+    xmlXPathObjectPtr obj;
+
+    if (!(cache = virXPathCacheGet()))
+        return xmlXPathEval(BAD_CAST xpath, ctxt);
+
+    if ((comp = virHashLookup(cache, xpath)))
+        return xmlXPathCompiledEval(comp, ctxt);
+
+    if (!(comp = xmlXPathCompile(BAD_CAST xpath)))
+        return NULL;
+
+    obj = xmlXPathCompiledEval(comp, ctxt);
+
+    /* Expressions built at runtime could grow the cache without bounds.
+     * Start over once it's full rather than tracking usage, the literals
+     * which matter are back in after parsing a single definition. */
+    if (virHashSize(cache) >= VIR_XPATH_CACHE_MAX)
+        virHashRemoveAll(cache);
+
+    if (virHashAddEntry(cache, xpath, comp) < 0)
+        xmlXPathFreeCompExpr(comp);
+
+    return obj;
+}
+
+
 xmlXPathContextPtr
 virXMLXPathContextNew(xmlDocPtr xml)
 {
@@ -83,7 +172,7 @@ virXPathString(const char *xpath,
         return NULL;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj == NULL) || (obj->type != XPATH_STRING) ||
         (obj->stringval == NULL) || (obj->stringval[0] == 0)) {
@@ -160,7 +249,7 @@ virXPathNumber(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj == NULL) || (obj->type != XPATH_NUMBER) ||
         (isnan(obj->floatval))) {
@@ -189,7 +278,7 @@ virXPathLongBase(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
@@ -294,7 +383,7 @@ virXPathULongBase(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
@@ -410,7 +499,7 @@ virXPathULongLong(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
@@ -456,7 +545,7 @@ virXPathLongLong(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
@@ -582,7 +671,7 @@ virXPathBoolean(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj == NULL) || (obj->type != XPATH_BOOLEAN) ||
         (obj->boolval < 0) || (obj->boolval > 1)) {
@@ -619,7 +708,7 @@ virXPathNode(const char *xpath,
         return NULL;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj == NULL) || (obj->type != XPATH_NODESET) ||
         (obj->nodesetval == NULL) || (obj->nodesetval->nodeNr <= 0) ||
@@ -663,7 +752,7 @@ virXPathNodeSet(const char *xpath,
         *list = NULL;
 
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if (obj == NULL)
         return 0;
@@ -22,8 +22,11 @@
 #include "virerror.h"
 #include "viralloc.h"
 #include "virlog.h"
+#include "virutil.h"
+#include "virfile.h"
 
 #include "domain_conf.h"
+#include "virdomainobjlist.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -76,6 +79,226 @@ static int testGetFilesystem(const void *opaque)
     return ret;
 }
 
+
+/* The reference implementation of virDomainDefCopy(.., false) */
+static virDomainDefPtr
+testDomainDefCopyXML(virDomainDefPtr def)
+{
+    g_autofree char *xml = NULL;
+
+    if (!(xml = virDomainDefFormat(def, xmlopt, VIR_DOMAIN_DEF_FORMAT_SECURE)))
+        return NULL;
+
+    return virDomainDefParseString(xml, xmlopt, NULL,
+                                   VIR_DOMAIN_DEF_PARSE_INACTIVE |
+                                   VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE);
+}
+
+
+static int
+testDomainDefCopyCompare(virDomainDefPtr def)
+{
+    g_autoptr(virDomainDef) copy = NULL;
+    g_autoptr(virDomainDef) reference = NULL;
+    g_autofree char *actual = NULL;
+    g_autofree char *expected = NULL;
+
+    if (!(copy = virDomainDefCopy(def, xmlopt, NULL, false)) ||
+        !(reference = testDomainDefCopyXML(def)))
+        return -1;
+
+    if (!(actual = virDomainDefFormat(copy, xmlopt,
+                                      VIR_DOMAIN_DEF_FORMAT_SECURE)) ||
+        !(expected = virDomainDefFormat(reference, xmlopt,
+                                        VIR_DOMAIN_DEF_FORMAT_SECURE)))
+        return -1;
+
+    if (STRNEQ(expected, actual)) {
+        virTestDifference(stderr, expected, actual);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testDomainDefCopy(const void *opaque)
+{
+    const char *name = opaque;
+    g_autofree char *filename = NULL;
+    g_autoptr(virDomainDef) def = NULL;
+
+    filename = g_strdup_printf("%s/domainconfdata/%s.xml", abs_srcdir, name);
+
+    /* parse as a live definition so that runtime state is present */
+    if (!(def = virDomainDefParseFile(filename, xmlopt, NULL, 0)))
+        return -1;
+
+    return testDomainDefCopyCompare(def);
+}
+
+
+#define TEST_COPY_LARGE_DISKS 256
+#define TEST_COPY_LARGE_LOOPS 20
+
+static int
+testDomainDefCopyLarge(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autoptr(virDomainDef) def = NULL;
+    g_autofree char *xml = NULL;
+    long long start;
+    long long native = 0;
+    long long roundtrip = 0;
+    size_t i;
+
+    virBufferAddLit(&buf,
+                    "<domain type='test'>\n"
+                    "  <name>large</name>\n"
+                    "  <memory unit='KiB'>1048576</memory>\n"
+                    "  <vcpu placement='static'>1</vcpu>\n"
+                    "  <os>\n"
+                    "    <type arch='x86_64'>hvm</type>\n"
+                    "  </os>\n"
+                    "  <devices>\n");
+
+    for (i = 0; i < TEST_COPY_LARGE_DISKS; i++) {
+        g_autofree char *dst = virIndexToDiskName(i, "vd");
+
+        virBufferAsprintf(&buf,
+                          "    <disk type='file' device='disk'>\n"
+                          "      <driver name='qemu' type='qcow2'/>\n"
+                          "      <source file='/var/lib/libvirt/images/%zu.qcow2'/>\n"
+                          "      <backingStore type='file'>\n"
+                          "        <format type='raw'/>\n"
+                          "        <source file='/var/lib/libvirt/images/%zu.raw'/>\n"
+                          "      </backingStore>\n"
+                          "      <target dev='%s' bus='virtio'/>\n"
+                          "      <serial>disk%zu</serial>\n"
+                          "    </disk>\n",
+                          i, i, dst, i);
+    }
+
+    virBufferAddLit(&buf,
+                    "  </devices>\n"
+                    "</domain>\n");
+
+    xml = virBufferContentAndReset(&buf);
+
+    if (!(def = virDomainDefParseString(xml, xmlopt, NULL, 0)))
+        return -1;
+
+    if (testDomainDefCopyCompare(def) < 0)
+        return -1;
+
+    for (i = 0; i < TEST_COPY_LARGE_LOOPS; i++) {
+        g_autoptr(virDomainDef) copy = NULL;
+        g_autoptr(virDomainDef) reference = NULL;
+
+        start = g_get_monotonic_time();
+        if (!(copy = virDomainDefCopy(def, xmlopt, NULL, false)))
+            return -1;
+        native += g_get_monotonic_time() - start;
+
+        start = g_get_monotonic_time();
+        if (!(reference = testDomainDefCopyXML(def)))
+            return -1;
+        roundtrip += g_get_monotonic_time() - start;
+    }
+
+    VIR_TEST_DEBUG("copying %d disks: %lld us (XML round-trip: %lld us)",
+                   TEST_COPY_LARGE_DISKS,
+                   native / TEST_COPY_LARGE_LOOPS,
+                   roundtrip / TEST_COPY_LARGE_LOOPS);
+
+    return 0;
+}
+
+
+#define TEST_LOAD_CONFIGS 5000
+#define TEST_LOAD_CONFIGS_DISKS 8
+
+static int
+testDomainObjListLoadAllConfigs(const void *opaque)
+{
+    const char *dir = opaque;
+    virDomainObjListPtr doms = NULL;
+    long long start;
+    size_t i;
+    size_t j;
+    int count;
+    int ret = -1;
+
+    for (i = 0; i < TEST_LOAD_CONFIGS; i++) {
+        g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+        g_autofree char *path = NULL;
+        g_autofree char *xml = NULL;
+
+        virBufferAsprintf(&buf,
+                          "<domain type='test'>\n"
+                          "  <name>load%zu</name>\n"
+                          "  <uuid>6e2b8a27-3a5c-4e13-9f2d-%012zx</uuid>\n"
+                          "  <memory unit='KiB'>1048576</memory>\n"
+                          "  <vcpu placement='static'>2</vcpu>\n"
+                          "  <os>\n"
+                          "    <type arch='x86_64'>hvm</type>\n"
+                          "  </os>\n"
+                          "  <clock offset='utc'/>\n"
+                          "  <devices>\n",
+                          i, i);
+
+        for (j = 0; j < TEST_LOAD_CONFIGS_DISKS; j++) {
+            g_autofree char *dst = virIndexToDiskName(j, "vd");
+
+            virBufferAsprintf(&buf,
+                              "    <disk type='file' device='disk'>\n"
+                              "      <driver name='qemu' type='qcow2'/>\n"
+                              "      <source file='/var/lib/libvirt/images/load%zu-%zu.qcow2'/>\n"
+                              "      <target dev='%s' bus='virtio'/>\n"
+                              "    </disk>\n",
+                              i, j, dst);
+        }
+
+        virBufferAddLit(&buf,
+                        "    <console type='pty'/>\n"
+                        "  </devices>\n"
+                        "</domain>\n");
+
+        path = g_strdup_printf("%s/load%zu.xml", dir, i);
+        xml = virBufferContentAndReset(&buf);
+
+        if (virFileWriteStr(path, xml, 0600) < 0) {
+            fprintf(stderr, "failed to write '%s'\n", path);
+            goto cleanup;
+        }
+    }
+
+    if (!(doms = virDomainObjListNew()))
+        goto cleanup;
+
+    start = g_get_monotonic_time();
+    if (virDomainObjListLoadAllConfigs(doms, dir, dir, false,
+                                       xmlopt, NULL, NULL) < 0)
+        goto cleanup;
+    VIR_TEST_DEBUG("loading %d configs: %lld ms", TEST_LOAD_CONFIGS,
+                   (g_get_monotonic_time() - start) / 1000);
+
+    if ((count = virDomainObjListNumOfDomains(doms, false, NULL, NULL)) !=
+        TEST_LOAD_CONFIGS) {
+        fprintf(stderr, "expected %d domains, got %d\n",
+                TEST_LOAD_CONFIGS, count);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnref(doms);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -103,6 +326,27 @@ mymain(void)
     DO_TEST_GET_FS("/dev/pts", false);
     DO_TEST_GET_FS("/doesnotexist", false);
 
+    if (virTestRun("Copy copy-disks", testDomainDefCopy, "copy-disks") < 0)
+        ret = -1;
+    if (virTestRun("Copy large definition", testDomainDefCopyLarge, NULL) < 0)
+        ret = -1;
+
+    if (virTestGetExpensive()) {
+        char scratchdir[] = abs_builddir "/domainconfdir-XXXXXX";
+
+        if (!g_mkdtemp(scratchdir)) {
+            fprintf(stderr, "Cannot create domainconfdir");
+            abort();
+        }
+
+        if (virTestRun("Load configs", testDomainObjListLoadAllConfigs,
+                       scratchdir) < 0)
+            ret = -1;
+
+        if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+            virFileDeleteTree(scratchdir);
+    }
+
     virObjectUnref(caps);
     virObjectUnref(xmlopt);
 
@@ -100,6 +100,65 @@ static int testCompareXMLToArgvFiles(const char *xml,
     return ret;
 }
 
+static void
+testCommandDryRunInput(const char *const*args,
+                       const char *const*env G_GNUC_UNUSED,
+                       const char *input,
+                       char **output,
+                       char **error,
+                       int *status,
+                       void *opaque)
+{
+    virBufferPtr inbuf = opaque;
+
+    if (input) {
+        virBufferAdd(inbuf, input, -1);
+    } else {
+        /* Rules whose failure is ignored run on their own */
+        g_autofree char *prog = g_path_get_basename(args[0]);
+        size_t i;
+
+        virBufferAdd(inbuf, prog, -1);
+        for (i = 1; args[i]; i++)
+            virBufferAsprintf(inbuf, " %s", args[i]);
+        virBufferAddChar(inbuf, '\n');
+    }
+
+    *status = 0;
+    *output = g_strdup("");
+    *error = g_strdup("");
+}
+
+static int testCompareXMLToNftablesFiles(const char *xml,
+                                         const char *script)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    virNetworkDefPtr def = NULL;
+    int ret = -1;
+
+    /* The whole transaction goes to a single nft invocation */
+    virFirewallSetBatching(true);
+    virCommandSetDryRun(NULL, testCommandDryRunInput, &buf);
+
+    if (!(def = virNetworkDefParseFile(xml, NULL)))
+        goto cleanup;
+
+    if (networkAddFirewallRules(def) < 0)
+        goto cleanup;
+
+    if (virTestCompareToFile(virBufferCurrentContent(&buf), script) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virCommandSetDryRun(NULL, NULL, NULL);
+    virFirewallSetBatching(false);
+    virBufferFreeAndReset(&buf);
+    virNetworkDefFree(def);
+    return ret;
+}
+
 struct testInfo {
     const char *name;
     const char *baseargs;
@@ -126,6 +185,21 @@ testCompareXMLToIPTablesHelper(const void *data)
     return result;
 }
 
+static int
+testCompareXMLToNftablesHelper(const void *data)
+{
+    const struct testInfo *info = data;
+    g_autofree char *xml = NULL;
+    g_autofree char *script = NULL;
+
+    xml = g_strdup_printf("%s/networkxml2firewalldata/%s.xml",
+                          abs_srcdir, info->name);
+    script = g_strdup_printf("%s/networkxml2firewalldata/%s-%s.nft",
+                             abs_srcdir, info->name, RULESTYPE);
+
+    return testCompareXMLToNftablesFiles(xml, script);
+}
+
 static bool
 hasNetfilterTools(void)
 {
@@ -175,6 +249,24 @@ mymain(void)
     DO_TEST("nat-ipv6");
     DO_TEST("route-default");
 
+# define DO_TEST_NFTABLES(name) \
+    do { \
+        struct testInfo info = { \
+            name, NULL, \
+        }; \
+        if (virTestRun("Network XML-2-nftables " name, \
+                       testCompareXMLToNftablesHelper, &info) < 0) \
+            ret = -1; \
+    } while (0)
+
+    /* Rules are only captured, so nft needn't be installed */
+    virFirewallSetBackendOverride(VIR_FIREWALL_BACKEND_NFTABLES);
+
+    DO_TEST_NFTABLES("nat-default");
+    DO_TEST_NFTABLES("nat-tftp");
+    DO_TEST_NFTABLES("nat-ipv6");
+    DO_TEST_NFTABLES("route-default");
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -36,6 +36,9 @@ static int (*real_access)(const char *path, int mode);
 
 # define LEASEDIR LOCALSTATEDIR "/lib/libvirt/dnsmasq/"
 
+/* Directory to use instead of nssdata/, keep in sync with nsstest.c */
+# define NSS_DATADIR_ENVVAR "LIBVIRT_NSS_TEST_DATADIR"
+
 /*
  * Functions to load the symbols and init the environment
  */
@@ -54,7 +57,13 @@ static int
 getrealpath(char **newpath,
             const char *path)
 {
-    if (STRPREFIX(path, LEASEDIR)) {
+    const char *datadir = getenv(NSS_DATADIR_ENVVAR);
+
+    if (STRPREFIX(path, LEASEDIR) && datadir) {
+        *newpath = g_strdup_printf("%s/%s",
+                                   datadir,
+                                   path + strlen(LEASEDIR));
+    } else if (STRPREFIX(path, LEASEDIR)) {
         *newpath = g_strdup_printf("%s/nssdata/%s",
                                    abs_srcdir,
                                    path + strlen(LEASEDIR));
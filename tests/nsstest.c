@@ -22,13 +22,29 @@
 
 #ifdef NSS
 
+# include <fcntl.h>
+# include <sys/stat.h>
+
 # include "libvirt_nss.h"
 # include "virsocket.h"
+# include "virfile.h"
+# include "virjson.h"
+# include "virlease.h"
+# include "virstring.h"
 
 # define VIR_FROM_THIS VIR_FROM_NONE
 
 # define BUF_SIZE 1024
 
+/* Directory nssmock reads leases from instead of nssdata/,
+ * keep in sync with nssmock.c */
+# define NSS_DATADIR_ENVVAR "LIBVIRT_NSS_TEST_DATADIR"
+
+static const char *const nssDataFiles[] = {
+    "virbr0.status", "virbr0.macs",
+    "virbr1.status", "virbr1.macs",
+};
+
 struct testNSSData {
     const char *hostname;
     const char *const *ipAddr;
@@ -157,10 +173,80 @@ testGetHostByName(const void *opaque)
     return 0;
 }
 
+/*
+ * Copy nssdata/ into @dir and generate an index for each leases file,
+ * just like leaseshelper does.
+ */
 static int
-mymain(void)
+testNSSPrepareIndex(const char *dir)
 {
-    int ret = 0;
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(nssDataFiles); i++) {
+        g_autofree char *src = NULL;
+        g_autofree char *dst = NULL;
+        g_autofree char *content = NULL;
+        g_autoptr(virJSONValue) leases = NULL;
+
+        src = g_strdup_printf("%s/nssdata/%s", abs_srcdir, nssDataFiles[i]);
+        dst = g_strdup_printf("%s/%s", dir, nssDataFiles[i]);
+
+        if (virFileReadAll(src, BUF_SIZE * 16, &content) < 0 ||
+            virFileWriteStr(dst, content, 0644) < 0)
+            return -1;
+
+        if (!virStringHasSuffix(dst, ".status"))
+            continue;
+
+        if (!(leases = virJSONValueFromString(content)) ||
+            virLeaseWriteIndex(leases, dst) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Replace @from with @to in virbr0.status under @dir behind the back
+ * of its index. The new file is renamed over the old one, as
+ * leaseshelper does, and gets the same size and mtime so that only
+ * its inode tells the index is out of date.
+ */
+static int
+testNSSRewriteLeases(const char *dir,
+                     const char *from,
+                     const char *to)
+{
+    g_autofree char *path = g_strdup_printf("%s/virbr0.status", dir);
+    g_autofree char *tmp = g_strdup_printf("%s.new", path);
+    g_autofree char *content = NULL;
+    struct timespec times[2];
+    struct stat sb;
+    char *p;
+
+    if (stat(path, &sb) < 0 ||
+        virFileReadAll(path, BUF_SIZE * 16, &content) < 0)
+        return -1;
+
+    if (strlen(from) != strlen(to) ||
+        !(p = strstr(content, from))) {
+        fprintf(stderr, "Cannot replace '%s' in %s\n", from, path);
+        return -1;
+    }
+    memcpy(p, to, strlen(to));
+
+    times[0] = sb.st_atim;
+    times[1] = sb.st_mtim;
+
+    if (virFileWriteStr(tmp, content, 0644) < 0 ||
+        utimensat(AT_FDCWD, tmp, times, 0) < 0 ||
+        rename(tmp, path) < 0)
+        return -1;
+
+    return 0;
+}
+
 
 # define DO_TEST(name, family, ...) \
     do { \
@@ -172,6 +258,11 @@ mymain(void)
             ret = -1; \
     } while (0)
 
+static int
+testNSSAll(void)
+{
+    int ret = 0;
+
 # if !defined(LIBVIRT_NSS_GUEST)
     DO_TEST("fedora", AF_INET, "192.168.122.197", "192.168.122.198", "192.168.122.199");
     DO_TEST("gentoo", AF_INET, "192.168.122.254");
@@ -183,6 +274,56 @@ mymain(void)
     DO_TEST("suse", AF_INET, "192.168.122.3");
 # endif /* defined(LIBVIRT_NSS_GUEST) */
 
+    return ret;
+}
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    char scratchdir[] = abs_builddir "/nssdata-XXXXXX";
+
+    /* Leases files without an index */
+    if (testNSSAll() < 0)
+        ret = -1;
+
+    /* The same lookups, served from the index */
+    if (!g_mkdtemp(scratchdir)) {
+        fprintf(stderr, "Cannot create nssdata dir");
+        abort();
+    }
+
+    if (testNSSPrepareIndex(scratchdir) < 0 ||
+        !g_setenv(NSS_DATADIR_ENVVAR, scratchdir, TRUE)) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    if (testNSSAll() < 0)
+        ret = -1;
+
+    /* An index whose leases file was replaced must be ignored */
+# if !defined(LIBVIRT_NSS_GUEST)
+    if (testNSSRewriteLeases(scratchdir, "192.168.122.254", "192.168.122.253") < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    DO_TEST("gentoo", AF_INET, "192.168.122.253");
+# else /* defined(LIBVIRT_NSS_GUEST) */
+    if (testNSSRewriteLeases(scratchdir, "192.168.122.2\"", "192.168.122.4\"") < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    DO_TEST("debian", AF_INET, "192.168.122.4");
+# endif /* defined(LIBVIRT_NSS_GUEST) */
+
+ cleanup:
+    g_unsetenv(NSS_DATADIR_ENVVAR);
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(scratchdir);
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
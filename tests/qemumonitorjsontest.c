@@ -1855,6 +1855,92 @@ testQemuMonitorJSONqemuMonitorJSONGetAllBlockStatsInfo(const void *opaque)
 }
 
 
+static int
+testQemuMonitorJSONqemuMonitorJSONGetAllBlockStatsInfoFull(const void *opaque)
+{
+    const testGenericData *data = opaque;
+    g_autoptr(qemuMonitorTest) test = NULL;
+    g_autoptr(virJSONValue) nodedata = NULL;
+    virHashTablePtr blockstats = NULL;
+    qemuBlockStatsPtr stats;
+    int ret = -1;
+
+    if (!(test = qemuMonitorTestNewSchema(data->xmlopt, data->schema)))
+        return -1;
+
+    /* the three queries are sent at once and answered in order */
+    if (qemuMonitorTestAddItem(test, "query-blockstats",
+                               "{"
+                               "    \"return\": ["
+                               "        {"
+                               "            \"device\": \"drive-virtio-disk0\","
+                               "            \"stats\": {"
+                               "                \"wr_bytes\": 2845696,"
+                               "                \"rd_bytes\": 28505088,"
+                               "                \"wr_operations\": 174,"
+                               "                \"rd_operations\": 1279"
+                               "            }"
+                               "        }"
+                               "    ]"
+                               "}") < 0 ||
+        qemuMonitorTestAddItem(test, "query-block",
+                               "{"
+                               "    \"return\": ["
+                               "        {"
+                               "            \"device\": \"drive-virtio-disk0\","
+                               "            \"inserted\": {"
+                               "                \"image\": {"
+                               "                    \"virtual-size\": 10737418240,"
+                               "                    \"actual-size\": 1048576"
+                               "                }"
+                               "            }"
+                               "        }"
+                               "    ]"
+                               "}") < 0 ||
+        qemuMonitorTestAddItem(test, "query-named-block-nodes",
+                               "{"
+                               "    \"return\": ["
+                               "        {"
+                               "            \"node-name\": \"#block123\","
+                               "            \"image\": {"
+                               "                \"virtual-size\": 10737418240"
+                               "            }"
+                               "        }"
+                               "    ]"
+                               "}") < 0)
+        return -1;
+
+    if (qemuMonitorGetAllBlockStatsInfoFull(qemuMonitorTestGetMonitor(test),
+                                            &blockstats, false, false,
+                                            &nodedata) < 0)
+        goto cleanup;
+
+    if (!(stats = virHashLookup(blockstats, "virtio-disk0"))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "block stats for device 'virtio-disk0' are missing");
+        goto cleanup;
+    }
+
+    if (stats->rd_bytes != 28505088 || stats->wr_req != 174 ||
+        stats->capacity != 10737418240ULL || stats->physical != 1048576) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "unexpected block stats for device 'virtio-disk0'");
+        goto cleanup;
+    }
+
+    if (!nodedata || virJSONValueArraySize(nodedata) != 1) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "missing named block node data");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virHashFree(blockstats);
+    return ret;
+}
+
 static int
 testQemuMonitorJSONqemuMonitorJSONGetMigrationCacheSize(const void *opaque)
 {
@@ -2797,6 +2883,96 @@ testBlockNodeNameDetect(const void *opaque)
 }
 
 
+/* size of the replies fed through the monitor by the large reply tests */
+#define TEST_LARGE_REPLY_SIZE (4 * 1024 * 1024)
+
+struct testLargeReplyData {
+    const char *name;
+    virDomainXMLOptionPtr xmlopt;
+    virHashTablePtr schema;
+};
+
+
+/*
+ * Feed a multi-megabyte query-named-block-nodes reply, built by repeating
+ * a recorded reply, through the monitor. With --debug the time it takes
+ * is printed so that the test doubles as a benchmark of the monitor input
+ * path.
+ */
+static int
+testQemuMonitorJSONLargeReply(const void *opaque)
+{
+    const struct testLargeReplyData *data = opaque;
+    g_autoptr(qemuMonitorTest) test = NULL;
+    g_autoptr(virJSONValue) nodes = NULL;
+    g_autoptr(virJSONValue) reply = NULL;
+    g_autoptr(virJSONValue) actual = NULL;
+    virJSONValuePtr bignodes = NULL;
+    g_autofree char *nodesstr = NULL;
+    g_autofree char *replystr = NULL;
+    size_t nnodes;
+    size_t repeat;
+    size_t i;
+    size_t j;
+    gint64 start;
+
+    if (!(nodes = virTestLoadFileJSON("qemumonitorjsondata/qemumonitorjson-nodename-",
+                                      data->name, "-named-nodes.json", NULL)))
+        return -1;
+
+    if (!(nodesstr = virJSONValueToString(nodes, false)))
+        return -1;
+
+    nnodes = virJSONValueArraySize(nodes);
+    repeat = TEST_LARGE_REPLY_SIZE / strlen(nodesstr) + 1;
+
+    reply = virJSONValueNewObject();
+    bignodes = virJSONValueNewArray();
+
+    if (virJSONValueObjectAppend(reply, "return", bignodes) < 0) {
+        virJSONValueFree(bignodes);
+        return -1;
+    }
+
+    for (i = 0; i < repeat; i++) {
+        for (j = 0; j < nnodes; j++) {
+            virJSONValuePtr node = virJSONValueCopy(virJSONValueArrayGet(nodes, j));
+
+            if (!node || virJSONValueArrayAppend(bignodes, node) < 0) {
+                virJSONValueFree(node);
+                return -1;
+            }
+        }
+    }
+
+    if (!(replystr = virJSONValueToString(reply, false)))
+        return -1;
+
+    if (!(test = qemuMonitorTestNewSchema(data->xmlopt, data->schema)))
+        return -1;
+
+    if (qemuMonitorTestAddItem(test, "query-named-block-nodes", replystr) < 0)
+        return -1;
+
+    start = g_get_monotonic_time();
+
+    if (!(actual = qemuMonitorJSONQueryNamedBlockNodes(qemuMonitorTestGetMonitor(test))))
+        return -1;
+
+    VIR_TEST_DEBUG("processed %zu byte reply in %lld us",
+                   strlen(replystr),
+                   (long long) (g_get_monotonic_time() - start));
+
+    if (virJSONValueArraySize(actual) != repeat * nnodes) {
+        VIR_TEST_VERBOSE("expected %zu nodes, got %zu",
+                         repeat * nnodes, virJSONValueArraySize(actual));
+        return -1;
+    }
+
+    return 0;
+}
+
+
 struct testQAPISchemaData {
     virHashTablePtr schema;
     const char *name;
@@ -3231,6 +3407,7 @@ mymain(void)
     DO_TEST(qemuMonitorJSONGetBalloonInfo);
     DO_TEST(qemuMonitorJSONGetBlockInfo);
     DO_TEST(qemuMonitorJSONGetAllBlockStatsInfo);
+    DO_TEST(qemuMonitorJSONGetAllBlockStatsInfoFull);
     DO_TEST(qemuMonitorJSONGetMigrationCacheSize);
     DO_TEST(qemuMonitorJSONGetMigrationStats);
     DO_TEST(qemuMonitorJSONGetChardevInfo);
@@ -3281,6 +3458,22 @@ mymain(void)
 
 #undef DO_TEST_BLOCK_NODE_DETECT
 
+#define DO_TEST_LARGE_REPLY(testname) \
+    do { \
+        struct testLargeReplyData largeReplyData = { \
+            testname, driver.xmlopt, qapiData.schema \
+        }; \
+        if (virTestRun("large-reply(" testname ")", \
+                       testQemuMonitorJSONLargeReply, &largeReplyData) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_LARGE_REPLY("blockjob");
+    DO_TEST_LARGE_REPLY("relative");
+    DO_TEST_LARGE_REPLY("luks");
+
+#undef DO_TEST_LARGE_REPLY
+
 #define DO_TEST_QAPI_QUERY(nme, qry, scc, rplobj) \
     do { \
         qapiData.name = nme; \
@@ -72,6 +72,14 @@ virHashTablePtr xattr_paths = NULL;
 virHashTablePtr chown_paths = NULL;
 
 
+/* Paths that are just another name for some other path, like a
+ * symlink would be. The alias is the key and the value is the
+ * path it resolves to. XATTRs and ownership are always tracked
+ * under the resolved path, and so is the inode number stat()
+ * reports. */
+virHashTablePtr alias_paths = NULL;
+
+
 static void
 init_hash(void)
 {
@@ -94,6 +102,24 @@ init_hash(void)
         fprintf(stderr, "Unable to create hash table for chowned paths\n");
         abort();
     }
+
+    if (!(alias_paths = virHashCreate(10, virHashValueFree))) {
+        fprintf(stderr, "Unable to create hash table for aliased paths\n");
+        abort();
+    }
+}
+
+
+/* Must be called with @m held */
+static const char *
+resolve_path(const char *path)
+{
+    const char *target;
+
+    if ((target = virHashLookup(alias_paths, path)))
+        return target;
+
+    return path;
 }
 
 
@@ -132,12 +158,12 @@ virFileGetXAttrQuiet(const char *path,
     char *key;
     char *val;
 
-    key = get_key(path, name);
-
     virMutexLock(&m);
     init_syms();
     init_hash();
 
+    key = get_key(resolve_path(path), name);
+
     if (!(val = virHashLookup(xattr_paths, key))) {
         errno = ENODATA;
         goto cleanup;
@@ -189,13 +215,14 @@ int virFileSetXAttr(const char *path,
     char *key;
     char *val;
 
-    key = get_key(path, name);
     val = g_strdup(value);
 
     virMutexLock(&m);
     init_syms();
     init_hash();
 
+    key = get_key(resolve_path(path), name);
+
     if (virHashUpdateEntry(xattr_paths, key, val) < 0)
         goto cleanup;
     val = NULL;
@@ -215,12 +242,12 @@ int virFileRemoveXAttr(const char *path,
     int ret = -1;
     char *key;
 
-    key = get_key(path, name);
-
     virMutexLock(&m);
     init_syms();
     init_hash();
 
+    key = get_key(resolve_path(path), name);
+
     if ((ret = virHashRemoveEntry(xattr_paths, key)) < 0)
         errno = ENODATA;
 
@@ -233,18 +260,21 @@ int virFileRemoveXAttr(const char *path,
 #define VIR_MOCK_STAT_HOOK \
     do { \
         if (getenv(ENVVAR)) { \
+            const char *resolved; \
             uint32_t *val; \
 \
             virMutexLock(&m); \
             init_hash(); \
+\
+            resolved = resolve_path(path); \
 \
             memset(sb, 0, sizeof(*sb)); \
 \
             sb->st_mode = S_IFREG | 0666; \
             sb->st_size = 123456; \
-            sb->st_ino = 1; \
+            sb->st_ino = g_str_hash(resolved); \
 \
-            if (!(val = virHashLookup(chown_paths, path))) { \
+            if (!(val = virHashLookup(chown_paths, resolved))) { \
                 /* New path. Set the defaults */ \
                 sb->st_uid = DEFAULT_UID; \
                 sb->st_gid = DEFAULT_GID; \
@@ -282,7 +312,7 @@ mock_chown(const char *path,
     virMutexLock(&m);
     init_hash();
 
-    if (virHashUpdateEntry(chown_paths, path, val) < 0)
+    if (virHashUpdateEntry(chown_paths, resolve_path(path), val) < 0)
         goto cleanup;
     val = NULL;
 
@@ -473,7 +503,31 @@ void freePaths(void)
 
     virHashFree(chown_paths);
     virHashFree(xattr_paths);
-    chown_paths = xattr_paths = NULL;
+    virHashFree(alias_paths);
+    chown_paths = xattr_paths = alias_paths = NULL;
+    virMutexUnlock(&m);
+}
+
+
+/**
+ * addAlias:
+ * @alias: path to make an alias
+ * @target: path @alias resolves to
+ *
+ * Make @alias refer to the same file as @target, for the rest
+ * of the test case (until freePaths() is called).
+ */
+void addAlias(const char *alias,
+              const char *target)
+{
+    virMutexLock(&m);
+    init_hash();
+
+    if (virHashUpdateEntry(alias_paths, alias, g_strdup(target)) < 0) {
+        fprintf(stderr, "Unable to add alias %s -> %s\n", alias, target);
+        abort();
+    }
+
     virMutexUnlock(&m);
 }
 
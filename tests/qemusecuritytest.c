@@ -31,6 +31,8 @@
 struct testData {
     virQEMUDriverPtr driver;
     const char *file; /* file name to load VM def XML from; qemuxml2argvdata/ */
+    const char *alias; /* path to make refer to the same file as @target */
+    const char *target;
 };
 
 
@@ -114,6 +116,9 @@ testDomain(const void *opaque)
     if (g_setenv(ENVVAR, "1", FALSE) == FALSE)
         return -1;
 
+    if (data->alias)
+        addAlias(data->alias, data->target);
+
     if (qemuSecuritySetAllLabel(data->driver, vm, NULL, false) < 0)
         goto cleanup;
 
@@ -158,6 +163,14 @@ mymain(void)
             ret = -1; \
     } while (0)
 
+#define DO_TEST_DOMAIN_ALIAS(f, a, t) \
+    do { \
+        struct testData data = {.driver = &driver, .file = f, \
+                                .alias = a, .target = t}; \
+        if (virTestRun(f " with aliased paths", testDomain, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
     DO_TEST_DOMAIN("acpi-table");
     DO_TEST_DOMAIN("channel-unix-guestfwd");
     DO_TEST_DOMAIN("console-virtio-unix");
@@ -187,6 +200,7 @@ mymain(void)
     DO_TEST_DOMAIN("disk-scsi-device-auto");
     DO_TEST_DOMAIN("disk-shared");
     DO_TEST_DOMAIN("disk-virtio");
+    DO_TEST_DOMAIN_ALIAS("disk-virtio", "/tmp/logs.img", "/tmp/data.img");
     DO_TEST_DOMAIN("disk-virtio-scsi-reservations");
     DO_TEST_DOMAIN("graphics-vnc-tls-secret");
     DO_TEST_DOMAIN("hugepages-nvdimm");
@@ -23,3 +23,6 @@
 extern int checkPaths(const char **paths);
 
 extern void freePaths(void);
+
+extern void addAlias(const char *alias,
+                     const char *target);
@@ -856,6 +856,90 @@ testCgroupGetMemoryStat(const void *args G_GNUC_UNUSED)
 }
 
 
+static int testCgroupGetStats(const void *args G_GNUC_UNUSED)
+{
+    virCgroupPtr cgroup = NULL;
+    virCgroupStats stats;
+    unsigned long long usage, user, sys;
+    unsigned long kb;
+    long long rbytes, wbytes, rops, wops;
+    size_t i;
+    int rv, ret = -1;
+    unsigned int all = VIR_CGROUP_STATS_CPU_USAGE |
+        VIR_CGROUP_STATS_CPU_TIMES |
+        VIR_CGROUP_STATS_MEMORY |
+        VIR_CGROUP_STATS_BLKIO;
+
+    if ((rv = virCgroupNewPartition("/virtualmachines", true,
+                                    (1 << VIR_CGROUP_CONTROLLER_CPU) |
+                                    (1 << VIR_CGROUP_CONTROLLER_CPUACCT) |
+                                    (1 << VIR_CGROUP_CONTROLLER_MEMORY) |
+                                    (1 << VIR_CGROUP_CONTROLLER_BLKIO),
+                                    &cgroup)) < 0) {
+        fprintf(stderr, "Could not create /virtualmachines cgroup: %d\n", -rv);
+        goto cleanup;
+    }
+
+    if (virCgroupGetCpuacctUsage(cgroup, &usage) < 0 ||
+        virCgroupGetCpuacctStat(cgroup, &user, &sys) < 0 ||
+        virCgroupGetMemoryUsage(cgroup, &kb) < 0 ||
+        virCgroupGetBlkioIoServiced(cgroup, &rbytes, &wbytes,
+                                    &rops, &wops) < 0) {
+        fprintf(stderr, "Could not read individual stats\n");
+        goto cleanup;
+    }
+
+    /* The second round re-reads the files kept open by the first one */
+    for (i = 0; i < 2; i++) {
+        if (virCgroupGetStats(cgroup, all, &stats) < 0 ||
+            stats.valid != all) {
+            fprintf(stderr, "Could not sample stats (round %zu)\n", i);
+            goto cleanup;
+        }
+
+        if (stats.cpuUsage != usage ||
+            stats.cpuUser != user ||
+            stats.cpuSys != sys ||
+            stats.memUsage != kb ||
+            stats.blkioReadBytes != rbytes ||
+            stats.blkioWriteBytes != wbytes ||
+            stats.blkioReadOps != rops ||
+            stats.blkioWriteOps != wops) {
+            fprintf(stderr, "Sampled stats differ (round %zu)\n", i);
+            goto cleanup;
+        }
+    }
+
+    if (cgroup->nstatFiles == 0) {
+        fprintf(stderr, "Expected stat files to be kept open\n");
+        goto cleanup;
+    }
+
+    /* Changes must be visible through the files kept open */
+    if (virCgroupSetValueU64(cgroup, VIR_CGROUP_CONTROLLER_MEMORY,
+                             "memory.usage_in_bytes", 2048 * 1024) < 0 ||
+        virCgroupGetStats(cgroup, VIR_CGROUP_STATS_MEMORY, &stats) < 0)
+        goto cleanup;
+
+    if (stats.memUsage != 2048) {
+        fprintf(stderr, "Stale memory usage %lu, expected 2048\n",
+                stats.memUsage);
+        goto cleanup;
+    }
+
+    if (virCgroupSetValueU64(cgroup, VIR_CGROUP_CONTROLLER_MEMORY,
+                             "memory.usage_in_bytes",
+                             (unsigned long long)kb << 10) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virCgroupFree(&cgroup);
+    return ret;
+}
+
+
 static int testCgroupGetBlkioIoServiced(const void *args G_GNUC_UNUSED)
 {
     virCgroupPtr cgroup = NULL;
@@ -1091,6 +1175,9 @@ mymain(void)
 
     if (virTestRun("virCgroupGetPercpuStats works", testCgroupGetPercpuStats, NULL) < 0)
         ret = -1;
+
+    if (virTestRun("virCgroupGetStats works", testCgroupGetStats, NULL) < 0)
+        ret = -1;
     cleanupFakeFS(fakerootdir);
 
     fakerootdir = initFakeFS(NULL, "all-in-one");
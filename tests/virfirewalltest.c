@@ -1080,6 +1080,117 @@ testFirewallQuery(const void *opaque G_GNUC_UNUSED)
     return ret;
 }
 
+
+static void
+testFirewallBatchHook(const char *const*args G_GNUC_UNUSED,
+                      const char *const*env G_GNUC_UNUSED,
+                      const char *input,
+                      char **output G_GNUC_UNUSED,
+                      char **error G_GNUC_UNUSED,
+                      int *status G_GNUC_UNUSED,
+                      void *opaque)
+{
+    virBufferPtr inbuf = opaque;
+
+    if (input)
+        virBufferAdd(inbuf, input, -1);
+}
+
+static int
+testFirewallBatch(const void *opaque G_GNUC_UNUSED)
+{
+    virBuffer cmdbuf = VIR_BUFFER_INITIALIZER;
+    virBuffer inbuf = VIR_BUFFER_INITIALIZER;
+    virFirewallPtr fw = NULL;
+    int ret = -1;
+    const char *actual = NULL;
+    const char *expected =
+        IPTABLES_RESTORE_PATH " --noflush\n"
+        IPTABLES_PATH " -D OUTPUT --jump DROP\n"
+        IP6TABLES_RESTORE_PATH " --noflush\n";
+    const char *expectedInput =
+        "*filter\n"
+        "-A INPUT --source-host 192.168.122.1 --jump ACCEPT\n"
+        "-A INPUT --source-host !192.168.122.1 -m comment --comment \"a comment\" --jump REJECT\n"
+        "COMMIT\n"
+        "*nat\n"
+        "-A POSTROUTING --source 192.168.122.0/24 --jump MASQUERADE\n"
+        "COMMIT\n"
+        "*filter\n"
+        "-A INPUT --source-host 2001:db8::1 --jump ACCEPT\n"
+        "-A INPUT --source-host 2001:db8::2 --jump ACCEPT\n"
+        "COMMIT\n";
+
+    if (virFirewallSetBackend(VIR_FIREWALL_BACKEND_DIRECT) < 0)
+        goto cleanup;
+
+    virFirewallSetBatching(true);
+    virCommandSetDryRun(&cmdbuf, testFirewallBatchHook, &inbuf);
+
+    fw = virFirewallNew();
+
+    virFirewallStartTransaction(fw, 0);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "INPUT",
+                       "--source-host", "192.168.122.1",
+                       "--jump", "ACCEPT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "INPUT",
+                       "--source-host", "!192.168.122.1",
+                       "-m", "comment", "--comment", "a comment",
+                       "--jump", "REJECT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "--table", "nat",
+                       "-A", "POSTROUTING",
+                       "--source", "192.168.122.0/24",
+                       "--jump", "MASQUERADE", NULL);
+
+    /* errors of this one must be ignored, so it can't be batched */
+    virFirewallAddRuleFull(fw, VIR_FIREWALL_LAYER_IPV4,
+                           true, NULL, NULL,
+                           "-D", "OUTPUT",
+                           "--jump", "DROP", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV6,
+                       "-A", "INPUT",
+                       "--source-host", "2001:db8::1",
+                       "--jump", "ACCEPT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV6,
+                       "-A", "INPUT",
+                       "--source-host", "2001:db8::2",
+                       "--jump", "ACCEPT", NULL);
+
+    if (virFirewallApply(fw) < 0)
+        goto cleanup;
+
+    actual = virBufferCurrentContent(&cmdbuf);
+    if (STRNEQ_NULLABLE(expected, actual)) {
+        fprintf(stderr, "Unexpected command execution\n");
+        virTestDifference(stderr, expected, actual);
+        goto cleanup;
+    }
+
+    actual = virBufferCurrentContent(&inbuf);
+    if (STRNEQ_NULLABLE(expectedInput, actual)) {
+        fprintf(stderr, "Unexpected restore input\n");
+        virTestDifference(stderr, expectedInput, actual);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virBufferFreeAndReset(&cmdbuf);
+    virBufferFreeAndReset(&inbuf);
+    virFirewallSetBatching(false);
+    virCommandSetDryRun(NULL, NULL, NULL);
+    virFirewallFree(fw);
+    return ret;
+}
+
 static bool
 hasNetfilterTools(void)
 {
@@ -1149,6 +1260,8 @@ mymain(void)
     RUN_TEST("many rollback", testFirewallManyRollback);
     RUN_TEST("chained rollback", testFirewallChainedRollback);
     RUN_TEST("query transaction", testFirewallQuery);
+    if (virTestRun("batched transaction", testFirewallBatch, NULL) < 0)
+        ret = -1;
 
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
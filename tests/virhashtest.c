@@ -9,6 +9,7 @@
 #include "viralloc.h"
 #include "virlog.h"
 #include "virstring.h"
+#include "virobject.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -532,6 +533,66 @@ testHashDuplicate(const void *data G_GNUC_UNUSED)
 }
 
 
+static int
+testHashAtomic(const void *data)
+{
+    const struct testInfo *info = data;
+    int count = G_N_ELEMENTS(uuids) - G_N_ELEMENTS(uuids_subset);
+    virHashAtomicPtr hash;
+    size_t iter_count = 0;
+    size_t i;
+    int ret = -1;
+
+    if (!(hash = virHashAtomicNewStriped(info->count, 0, NULL)))
+        return -1;
+
+    for (i = 0; i < G_N_ELEMENTS(uuids); i++) {
+        if (virHashAtomicAdd(hash, uuids[i], (void *) uuids[i]) < 0)
+            goto cleanup;
+    }
+
+    if (virHashAtomicAdd(hash, uuids[0], (void *) uuids[0]) == 0) {
+        VIR_TEST_VERBOSE("\nadding duplicate entry \"%s\" succeeded",
+                         uuids[0]);
+        goto cleanup;
+    }
+
+    for (i = 0; i < G_N_ELEMENTS(uuids); i++) {
+        if (!virHashAtomicHasEntry(hash, uuids[i])) {
+            VIR_TEST_VERBOSE("\nentry \"%s\" could not be found", uuids[i]);
+            goto cleanup;
+        }
+    }
+
+    for (i = 0; i < G_N_ELEMENTS(uuids_subset); i++) {
+        if (virHashAtomicRemove(hash, uuids_subset[i]) < 0) {
+            VIR_TEST_VERBOSE("\nentry \"%s\" could not be removed",
+                             uuids_subset[i]);
+            goto cleanup;
+        }
+    }
+
+    if (virHashAtomicSize(hash) != count) {
+        VIR_TEST_VERBOSE("\nhash contains %zd instead of %d elements",
+                         virHashAtomicSize(hash), count);
+        goto cleanup;
+    }
+
+    virHashAtomicForEach(hash, testHashCheckForEachCount, &iter_count);
+    if (count != iter_count) {
+        VIR_TEST_VERBOSE("\nhash claims to have %d elements but iteration "
+                         "finds %zu", count, iter_count);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnref(hash);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -569,6 +630,8 @@ mymain(void)
     DO_TEST("GetItems", GetItems);
     DO_TEST("Equal", Equal);
     DO_TEST("Duplicate entry", Duplicate);
+    DO_TEST_COUNT("Atomic", Atomic, 1);
+    DO_TEST_COUNT("Atomic", Atomic, 16);
 
     return (ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
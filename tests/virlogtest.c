@@ -19,9 +19,16 @@
 
 #include <config.h>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include "testutils.h"
 
 #include "virlog.h"
+#include "virfile.h"
+#include "virstring.h"
+
+VIR_LOG_INIT("tests.logtest");
 
 struct testLogData {
     const char *str;
@@ -107,6 +114,105 @@ testLogParseFilters(const void *opaque)
     return ret;
 }
 
+static int
+testLogAsync(const void *opaque G_GNUC_UNUSED)
+{
+    int ret = -1;
+    size_t i;
+    g_autofree char *logged = NULL;
+    const char *cur;
+
+    /* The messages are captured by the output set up by testutils */
+    if (getenv("LIBVIRT_DEBUG"))
+        return EXIT_AM_SKIP;
+
+    logged = virTestLogContentAndReset();
+    VIR_FREE(logged);
+
+    if (virLogStartAsync() < 0)
+        return -1;
+
+    for (i = 0; i < 1000; i++)
+        VIR_WARN("async message %zu", i);
+
+    virLogFlush();
+    logged = virTestLogContentAndReset();
+
+    cur = logged;
+    for (i = 0; i < 1000; i++) {
+        g_autofree char *expect = g_strdup_printf("async message %zu\n", i);
+
+        if (!(cur = strstr(cur, expect))) {
+            VIR_TEST_DEBUG("Message %zu missing or out of order", i);
+            goto cleanup;
+        }
+        cur += strlen(expect);
+    }
+
+    ret = 0;
+ cleanup:
+    virLogStopAsync();
+    return ret;
+}
+
+/* Replaces the outputs set up by testutils, so it has to run last */
+static int
+testLogMemory(const void *opaque G_GNUC_UNUSED)
+{
+    virLogOutputPtr *outputs = NULL;
+    int noutputs;
+    char path[] = abs_builddir "/virlogtest.XXXXXX";
+    VIR_AUTOCLOSE fd = -1;
+    g_autofree char *dump = NULL;
+    g_autofree char *last = NULL;
+    size_t nmsgs = 100000;
+    size_t i;
+    int len;
+
+    if ((noutputs = virLogParseOutputs("1:memory", &outputs)) != 1 ||
+        virLogDefineOutputs(outputs, noutputs) < 0) {
+        virLogOutputListFree(outputs, noutputs);
+        return -1;
+    }
+
+    /* Make sure the ring buffer wraps around a few times */
+    for (i = 0; i < nmsgs; i++)
+        VIR_WARN("recorded message %zu", i);
+
+    if ((fd = g_mkstemp_full(path, O_RDWR | O_CLOEXEC, S_IRUSR | S_IWUSR)) < 0)
+        return -1;
+    unlink(path);
+
+    if (virLogDumpMemory(fd) < 0 ||
+        lseek(fd, 0, SEEK_SET) < 0 ||
+        (len = virFileReadLimFD(fd, 8 * 1024 * 1024, &dump)) < 0)
+        return -1;
+
+    if (len > 4 * 1024 * 1024) {
+        VIR_TEST_DEBUG("Dump of %d bytes exceeds the buffer size", len);
+        return -1;
+    }
+
+    /* The oldest, partially overwritten message must have been skipped */
+    if (!virLogProbablyLogMessage(dump)) {
+        VIR_TEST_DEBUG("Dump doesn't start with a complete message");
+        return -1;
+    }
+
+    last = g_strdup_printf("recorded message %zu\n", nmsgs - 1);
+    if (!virStringHasSuffix(dump, last)) {
+        VIR_TEST_DEBUG("Dump doesn't end with the most recent message");
+        return -1;
+    }
+
+    if (strstr(dump, "recorded message 0\n")) {
+        VIR_TEST_DEBUG("Dump contains messages which should be overwritten");
+        return -1;
+    }
+
+    return 0;
+}
+
 static int
 mymain(void)
 {
@@ -151,6 +257,14 @@ mymain(void)
     TEST_PARSE_FILTERS_FAIL(":foo", 1);
     TEST_PARSE_FILTERS_FAIL("1:+", 1);
 
+    if (virTestRun("testLogAsync", testLogAsync, NULL) < 0)
+        ret = -1;
+
+    TEST_PARSE_OUTPUTS("1:memory", 1);
+    TEST_PARSE_OUTPUTS_FAIL("1:memory:foo", 1);
+    if (virTestRun("testLogMemory", testLogMemory, NULL) < 0)
+        ret = -1;
+
     return ret;
 }
 
@@ -23,6 +23,8 @@
 
 #include "virrotatingfile.h"
 #include "virlog.h"
+#include "virfile.h"
+#include "virutil.h"
 #include "testutils.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
@@ -554,6 +556,139 @@ static int testRotatingFileWriterLargeFile(const void *data G_GNUC_UNUSED)
 }
 
 
+static int testRotatingFileWriterAppendFromFD(const void *data G_GNUC_UNUSED)
+{
+    virRotatingFileWriterPtr file;
+    int ret = -1;
+    int fds[2] = { -1, -1 };
+    char buf[2048];
+    size_t i;
+    ssize_t got;
+    size_t total = 0;
+
+    if (testRotatingFileInitFiles((off_t)-1,
+                                  (off_t)-1,
+                                  (off_t)-1) < 0)
+        return -1;
+
+    file = virRotatingFileWriterNew(FILENAME,
+                                    1024,
+                                    2,
+                                    false,
+                                    0700);
+    if (!file)
+        goto cleanup;
+
+    if (virPipe(fds) < 0)
+        goto cleanup;
+
+    /* 32 lines of 64 bytes each */
+    memset(buf, 0x5e, sizeof(buf));
+    for (i = 63; i < sizeof(buf); i += 64)
+        buf[i] = '\n';
+
+    if (safewrite(fds[1], buf, sizeof(buf)) != sizeof(buf))
+        goto cleanup;
+    VIR_FORCE_CLOSE(fds[1]);
+
+    while ((got = virRotatingFileWriterAppendFromFD(file, fds[0], 4096)) > 0)
+        total += got;
+
+    if (got < 0 || total != sizeof(buf))
+        goto cleanup;
+
+    if (testRotatingFileWriterAssertFileSizes(1024,
+                                              1024,
+                                              (off_t)-1) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    VIR_FORCE_CLOSE(fds[0]);
+    VIR_FORCE_CLOSE(fds[1]);
+    virRotatingFileWriterFree(file);
+    unlink(FILENAME);
+    unlink(FILENAME0);
+    unlink(FILENAME1);
+    return ret;
+}
+
+
+static int testRotatingFileWriterTruncated(const void *data G_GNUC_UNUSED)
+{
+    virRotatingFileWriterPtr file;
+    int ret = -1;
+    int fds[2] = { -1, -1 };
+    char buf[512];
+    g_autofree char *content = NULL;
+
+    if (testRotatingFileInitFiles((off_t)-1,
+                                  (off_t)-1,
+                                  (off_t)-1) < 0)
+        return -1;
+
+    file = virRotatingFileWriterNew(FILENAME,
+                                    1024,
+                                    2,
+                                    false,
+                                    0700);
+    if (!file)
+        goto cleanup;
+
+    if (virPipe(fds) < 0)
+        goto cleanup;
+
+    memset(buf, 0x5e, sizeof(buf));
+
+    if (virRotatingFileWriterAppend(file, buf, sizeof(buf)) != sizeof(buf))
+        goto cleanup;
+
+    /* Truncated externally, as logrotate's copytruncate would do */
+    if (truncate(FILENAME, 0) < 0)
+        goto cleanup;
+
+    if (virRotatingFileWriterAppend(file, "abc\n", 4) != 4)
+        goto cleanup;
+
+    if (testRotatingFileWriterAssertFileSizes(4,
+                                              (off_t)-1,
+                                              (off_t)-1) < 0)
+        goto cleanup;
+
+    if (truncate(FILENAME, 0) < 0)
+        goto cleanup;
+
+    if (safewrite(fds[1], "defg\n", 5) != 5)
+        goto cleanup;
+
+    if (virRotatingFileWriterAppendFromFD(file, fds[0], sizeof(buf)) != 5)
+        goto cleanup;
+
+    if (testRotatingFileWriterAssertFileSizes(5,
+                                              (off_t)-1,
+                                              (off_t)-1) < 0)
+        goto cleanup;
+
+    if (virFileReadAll(FILENAME, sizeof(buf), &content) < 0)
+        goto cleanup;
+
+    if (STRNEQ(content, "defg\n")) {
+        fprintf(stderr, "Expected 'defg' at start of file, got '%s'\n", content);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FORCE_CLOSE(fds[0]);
+    VIR_FORCE_CLOSE(fds[1]);
+    virRotatingFileWriterFree(file);
+    unlink(FILENAME);
+    unlink(FILENAME0);
+    unlink(FILENAME1);
+    return ret;
+}
+
+
 static int testRotatingFileReaderOne(const void *data G_GNUC_UNUSED)
 {
     virRotatingFileReaderPtr file;
@@ -723,6 +858,12 @@ mymain(void)
     if (virTestRun("Rotating file write to file larger then maxlen", testRotatingFileWriterLargeFile, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("Rotating file write from fd", testRotatingFileWriterAppendFromFD, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Rotating file write after truncation", testRotatingFileWriterTruncated, NULL) < 0)
+        ret = -1;
+
     if (virTestRun("Rotating file read one", testRotatingFileReaderOne, NULL) < 0)
         ret = -1;
 
@@ -19,6 +19,7 @@
 #include <config.h>
 
 #include <unistd.h>
+#include <utime.h>
 
 #include "testutils.h"
 #include "vircommand.h"
@@ -109,6 +110,76 @@ testStorageFileGetMetadata(const char *path,
     return g_steal_pointer(&def);
 }
 
+/* Sets the times of @path well in the past, so that a header read from
+ * it is cached, and so that rewriting it can be hidden from the cache */
+static int
+testStorageMetadataCacheBackdate(const char *path)
+{
+    struct utimbuf times = { .actime = 1500000000, .modtime = 1500000000 };
+
+    if (utime(path, &times) < 0) {
+        fprintf(stderr, "unable to set times of %s\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testStorageMetadataCache(const void *args G_GNUC_UNUSED)
+{
+    g_autofree char *path = g_strdup_printf("%s/cache", datadir);
+    g_autoptr(virCommand) cmd = NULL;
+    g_autoptr(virStorageSource) orig = NULL;
+    g_autoptr(virStorageSource) cached = NULL;
+    g_autoptr(virStorageSource) reread = NULL;
+
+    cmd = virCommandNewArgList(qemuimg, "create", "-f", "qcow2", NULL);
+    virCommandAddArgFormat(cmd, "-obacking_file=%s,backing_fmt=raw", absraw);
+    virCommandAddArg(cmd, path);
+    if (virCommandRun(cmd, NULL) < 0 ||
+        testStorageMetadataCacheBackdate(path) < 0)
+        return -1;
+
+    if (!(orig = testStorageFileGetMetadata(path, VIR_STORAGE_FILE_QCOW2,
+                                            -1, -1)))
+        return -1;
+
+    /* Change the backing file without the size or mtime changing */
+    virCommandFree(cmd);
+    cmd = virCommandNewArgList(qemuimg, "rebase", "-u", "-f", "qcow2",
+                               "-F", "raw", "-b", "raw", path, NULL);
+    if (virCommandRun(cmd, NULL) < 0 ||
+        testStorageMetadataCacheBackdate(path) < 0)
+        return -1;
+
+    if (!(cached = testStorageFileGetMetadata(path, VIR_STORAGE_FILE_QCOW2,
+                                              -1, -1)))
+        return -1;
+
+    if (STRNEQ_NULLABLE(cached->backingStoreRaw, absraw)) {
+        fprintf(stderr, "expected cached backing store '%s', got '%s'\n",
+                absraw, NULLSTR(cached->backingStoreRaw));
+        return -1;
+    }
+
+    virStorageFileMetadataCacheInvalidate(cached);
+
+    if (!(reread = testStorageFileGetMetadata(path, VIR_STORAGE_FILE_QCOW2,
+                                              -1, -1)))
+        return -1;
+
+    if (STRNEQ_NULLABLE(reread->backingStoreRaw, "raw")) {
+        fprintf(stderr, "expected backing store 'raw', got '%s'\n",
+                NULLSTR(reread->backingStoreRaw));
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 testPrepImages(void)
 {
@@ -961,6 +1032,9 @@ mymain(void)
     };
     TEST_CHAIN(absqcow2, VIR_STORAGE_FILE_QCOW2, (&qcow2, &rbd2), EXP_PASS);
 
+    if (virTestRun("Storage metadata cache",
+                   testStorageMetadataCache, NULL) < 0)
+        ret = -1;
 
     /* Rewrite wrap and qcow2 back to 3-deep chain, absolute backing */
     virCommandFree(cmd);
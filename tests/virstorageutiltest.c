@@ -16,6 +16,9 @@
 
 #include <config.h>
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "testutils.h"
 #include "virerror.h"
@@ -24,6 +27,7 @@
 #include "virstring.h"
 
 #include "storage/storage_util.h"
+#include "conf/virstorageobj.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -70,10 +74,138 @@ testGlusterExtractPoolSources(const void *opaque)
 }
 
 
+#define COPY_MIB (1024 * 1024)
+#define COPY_CAPACITY (4 * COPY_MIB)
+
+struct testCopyRawData {
+    const char *dir;
+    unsigned long long allocation;
+};
+
+
+/* Writes a raw image with data in the first and last MiB and a hole in
+ * between. The last MiB also holds a block of zeroes. */
+static int
+testCopyRawCreateInput(const char *path)
+{
+    g_autofree char *buf = g_new0(char, COPY_MIB);
+    VIR_AUTOCLOSE fd = -1;
+    size_t i;
+
+    for (i = 0; i < COPY_MIB; i++)
+        buf[i] = (i % 251) + 1;
+
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0 ||
+        ftruncate(fd, COPY_CAPACITY) < 0 ||
+        pwrite(fd, buf, COPY_MIB, 0) != COPY_MIB)
+        return -1;
+
+    memset(buf, 0, 64 * 1024);
+    if (pwrite(fd, buf, COPY_MIB, COPY_CAPACITY - COPY_MIB) != COPY_MIB)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+testCopyRaw(const void *opaque)
+{
+    const struct testCopyRawData *data = opaque;
+    virStoragePoolObjPtr pool = NULL;
+    g_autoptr(virStoragePoolDef) pooldef = NULL;
+    g_autoptr(virStorageVolDef) vol = NULL;
+    g_autoptr(virStorageVolDef) inputvol = NULL;
+    g_autofree char *poolxml = NULL;
+    g_autofree char *volxml = NULL;
+    g_autofree char *inputxml = NULL;
+    g_autofree char *inpath = NULL;
+    g_autofree char *outpath = NULL;
+    g_autofree char *inbuf = NULL;
+    g_autofree char *outbuf = NULL;
+    int inlen;
+    int outlen;
+    struct stat sb;
+    int ret = -1;
+
+    inpath = g_strdup_printf("%s/in.img", data->dir);
+    outpath = g_strdup_printf("%s/out.img", data->dir);
+
+    poolxml = g_strdup_printf("<pool type='dir'><name>test</name>"
+                              "<target><path>%s</path></target></pool>",
+                              data->dir);
+    inputxml = g_strdup_printf("<volume><name>in.img</name>"
+                               "<capacity>%d</capacity>"
+                               "<allocation>%d</allocation>"
+                               "<target><path>%s</path>"
+                               "<format type='raw'/></target></volume>",
+                               COPY_CAPACITY, COPY_CAPACITY, inpath);
+    volxml = g_strdup_printf("<volume><name>out.img</name>"
+                             "<capacity>%d</capacity>"
+                             "<allocation>%llu</allocation>"
+                             "<target><path>%s</path>"
+                             "<format type='raw'/></target></volume>",
+                             COPY_CAPACITY, data->allocation, outpath);
+
+    if (testCopyRawCreateInput(inpath) < 0) {
+        fprintf(stderr, "Cannot create %s\n", inpath);
+        goto cleanup;
+    }
+
+    if (!(pooldef = virStoragePoolDefParseString(poolxml)) ||
+        !(inputvol = virStorageVolDefParseString(pooldef, inputxml, 0)) ||
+        !(vol = virStorageVolDefParseString(pooldef, volxml, 0)) ||
+        !(pool = virStoragePoolObjNew()))
+        goto cleanup;
+
+    virStoragePoolObjSetDef(pool, g_steal_pointer(&pooldef));
+
+    if (virStorageBackendVolBuildFromLocal(pool, vol, inputvol, 0) < 0)
+        goto cleanup;
+
+    if ((inlen = virFileReadAll(inpath, 2 * COPY_CAPACITY, &inbuf)) < 0 ||
+        (outlen = virFileReadAll(outpath, 2 * COPY_CAPACITY, &outbuf)) < 0)
+        goto cleanup;
+
+    if (inlen != outlen || memcmp(inbuf, outbuf, inlen) != 0) {
+        fprintf(stderr, "Copy of %s differs from the original\n", inpath);
+        goto cleanup;
+    }
+
+    /* A fully allocated copy must stay fully allocated, however the
+     * data got there */
+    if (data->allocation == COPY_CAPACITY) {
+        if (stat(outpath, &sb) < 0)
+            goto cleanup;
+
+        if ((unsigned long long) sb.st_blocks * 512 < data->allocation) {
+            fprintf(stderr, "Only %llu of %llu bytes of %s are allocated\n",
+                    (unsigned long long) sb.st_blocks * 512,
+                    data->allocation, outpath);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    virStoragePoolObjEndAPI(&pool);
+    unlink(inpath);
+    unlink(outpath);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
     int ret = 0;
+    char scratchdir[] = abs_builddir "/storageutilcopy-XXXXXX";
+
+    if (!g_mkdtemp(scratchdir)) {
+        fprintf(stderr, "Cannot create storageutilcopy dir");
+        abort();
+    }
 
 #define DO_TEST_GLUSTER_EXTRACT_POOL_SOURCES_FULL(testname, sffx, pooltype) \
     do { \
@@ -104,6 +236,21 @@ mymain(void)
 #undef DO_TEST_GLUSTER_EXTRACT_POOL_SOURCES_NETFS
 #undef DO_TEST_GLUSTER_EXTRACT_POOL_SOURCES_FULL
 
+#define DO_TEST_COPY_RAW(testname, alloc) \
+    do { \
+        struct testCopyRawData data = { scratchdir, alloc }; \
+        if (virTestRun("copy-raw-" testname, testCopyRaw, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_COPY_RAW("sparse", 0);
+    DO_TEST_COPY_RAW("allocated", COPY_CAPACITY);
+
+#undef DO_TEST_COPY_RAW
+
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(scratchdir);
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "virthreadpool.h"
+#include "virthread.h"
+#include "virlog.h"
+#include "testutils.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("tests.threadpooltest");
+
+#define NJOBS 5
+#define JOB_SLEEP 2000     /* microseconds each job runs for */
+#define GATE_SLEEP 10000   /* microseconds queued jobs are held back */
+
+typedef struct {
+    virMutex lock;
+    virCond cond;
+    bool open;       /* jobs may run */
+    size_t started;
+    size_t finished;
+} testThreadPoolGate;
+
+
+static void
+testThreadPoolJob(void *jobdata G_GNUC_UNUSED,
+                  void *opaque)
+{
+    testThreadPoolGate *gate = opaque;
+
+    virMutexLock(&gate->lock);
+    gate->started++;
+    virCondBroadcast(&gate->cond);
+    while (!gate->open)
+        ignore_value(virCondWait(&gate->cond, &gate->lock));
+    virMutexUnlock(&gate->lock);
+
+    g_usleep(JOB_SLEEP);
+
+    virMutexLock(&gate->lock);
+    gate->finished++;
+    virCondBroadcast(&gate->cond);
+    virMutexUnlock(&gate->lock);
+}
+
+
+static unsigned long long
+testThreadPoolHistSum(const unsigned long long *hist)
+{
+    unsigned long long sum = 0;
+    size_t i;
+
+    for (i = 0; i < VIR_THREAD_POOL_HIST_BUCKETS; i++)
+        sum += hist[i];
+
+    return sum;
+}
+
+
+static int
+testThreadPoolStats(const void *data G_GNUC_UNUSED)
+{
+    testThreadPoolGate gate = { 0 };
+    virThreadPoolPtr pool = NULL;
+    virThreadPoolStats stats;
+    size_t i;
+    int ret = -1;
+
+    if (virMutexInit(&gate.lock) < 0 ||
+        virCondInit(&gate.cond) < 0)
+        return -1;
+
+    /* A single worker, so that the jobs queue up behind the first */
+    if (!(pool = virThreadPoolNew(1, 1, 0, testThreadPoolJob, &gate)))
+        goto cleanup;
+
+    if (virThreadPoolSendJob(pool, 0, NULL) < 0)
+        goto cleanup;
+
+    virMutexLock(&gate.lock);
+    while (gate.started == 0)
+        ignore_value(virCondWait(&gate.cond, &gate.lock));
+    virMutexUnlock(&gate.lock);
+
+    for (i = 1; i < NJOBS; i++) {
+        if (virThreadPoolSendJob(pool, 0, NULL) < 0)
+            goto cleanup;
+    }
+
+    g_usleep(GATE_SLEEP);
+
+    virMutexLock(&gate.lock);
+    gate.open = true;
+    virCondBroadcast(&gate.cond);
+    while (gate.finished < NJOBS)
+        ignore_value(virCondWait(&gate.cond, &gate.lock));
+    virMutexUnlock(&gate.lock);
+
+    /* The worker accounts for a job only after it has returned */
+    for (i = 0; i < 1000; i++) {
+        virThreadPoolGetStats(pool, &stats);
+        if (stats.jobsProcessed == NJOBS)
+            break;
+        g_usleep(1000);
+    }
+
+    if (stats.jobsProcessed != NJOBS) {
+        fprintf(stderr, "Expected %d jobs processed, got %llu\n",
+                NJOBS, stats.jobsProcessed);
+        goto cleanup;
+    }
+
+    if (stats.jobQueueDepthMax != NJOBS - 1) {
+        fprintf(stderr, "Expected queue depth high-water mark %d, got %zu\n",
+                NJOBS - 1, stats.jobQueueDepthMax);
+        goto cleanup;
+    }
+
+    if (testThreadPoolHistSum(stats.waitTimeHist) != NJOBS ||
+        testThreadPoolHistSum(stats.serviceTimeHist) != NJOBS) {
+        fprintf(stderr, "Expected %d samples in each histogram\n", NJOBS);
+        goto cleanup;
+    }
+
+    /* The jobs queued behind the first one waited for the gate */
+    if (stats.waitTimeMax < GATE_SLEEP ||
+        stats.waitTimeTotal < stats.waitTimeMax) {
+        fprintf(stderr, "Unexpected wait times: total %llu max %llu\n",
+                stats.waitTimeTotal, stats.waitTimeMax);
+        goto cleanup;
+    }
+
+    if (stats.serviceTimeMax < JOB_SLEEP ||
+        stats.serviceTimeTotal < NJOBS * JOB_SLEEP ||
+        stats.serviceTimeTotal < stats.serviceTimeMax) {
+        fprintf(stderr, "Unexpected service times: total %llu max %llu\n",
+                stats.serviceTimeTotal, stats.serviceTimeMax);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virMutexLock(&gate.lock);
+    gate.open = true;
+    virCondBroadcast(&gate.cond);
+    virMutexUnlock(&gate.lock);
+    virThreadPoolFree(pool);
+    virCondDestroy(&gate.cond);
+    virMutexDestroy(&gate.lock);
+    return ret;
+}
+
+
+static int
+testThreadPoolHistBounds(const void *data G_GNUC_UNUSED)
+{
+    unsigned long long prev = 0;
+    size_t i;
+
+    for (i = 0; i < VIR_THREAD_POOL_HIST_BUCKETS - 1; i++) {
+        unsigned long long bound = virThreadPoolGetHistBound(i);
+
+        if (bound <= prev) {
+            fprintf(stderr, "Bound %llu of bucket %zu is not above %llu\n",
+                    bound, i, prev);
+            return -1;
+        }
+        prev = bound;
+    }
+
+    if (virThreadPoolGetHistBound(VIR_THREAD_POOL_HIST_BUCKETS - 1) != 0) {
+        fprintf(stderr, "The last bucket should be unbounded\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virTestRun("Histogram bounds", testThreadPoolHistBounds, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Job statistics", testThreadPoolStats, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -21,16 +21,20 @@
 #include <config.h>
 
 #include <unistd.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <yajl/yajl_gen.h>
 #include <yajl/yajl_parse.h>
 
 #include "libvirt_nss_leases.h"
 #include "libvirt_nss.h"
+#include "virleaseindex.h"
 
 enum {
     FIND_LEASES_STATE_START,
@@ -60,6 +64,55 @@ typedef struct {
 } findLeasesParser;
 
 
+static int
+appendAddrBytes(leaseAddress **tmpAddress,
+                size_t *ntmpAddress,
+                int family,
+                const unsigned char *addr,
+                long long expirytime,
+                int af)
+{
+    size_t addrlen;
+    size_t i;
+    leaseAddress *newAddr;
+
+    if (family == AF_INET) {
+        addrlen = sizeof(struct in_addr);
+    } else if (family == AF_INET6) {
+        addrlen = sizeof(struct in6_addr);
+    } else {
+        DEBUG("Skipping unexpected family %d", family);
+        return 0;
+    }
+
+    if (af != AF_UNSPEC && af != family) {
+        DEBUG("Skipping address which family is %d, %d requested", family, af);
+        return 0;
+    }
+
+    for (i = 0; i < *ntmpAddress; i++) {
+        if ((*tmpAddress)[i].af == family &&
+            memcmp((*tmpAddress)[i].addr, addr, addrlen) == 0) {
+            DEBUG("IP address already in the list");
+            return 0;
+        }
+    }
+
+    newAddr = realloc(*tmpAddress, sizeof(*newAddr) * (*ntmpAddress + 1));
+    if (!newAddr) {
+        ERROR("Out of memory");
+        return -1;
+    }
+    *tmpAddress = newAddr;
+
+    (*tmpAddress)[*ntmpAddress].expirytime = expirytime;
+    (*tmpAddress)[*ntmpAddress].af = family;
+    memcpy((*tmpAddress)[*ntmpAddress].addr, addr, addrlen);
+    (*ntmpAddress)++;
+    return 0;
+}
+
+
 static int
 appendAddr(const char *name __attribute__((unused)),
            leaseAddress **tmpAddress,
@@ -69,7 +122,6 @@ appendAddr(const char *name __attribute__((unused)),
            int af)
 {
     int family;
-    size_t i;
     struct addrinfo hints = {0};
     struct addrinfo *res = NULL;
     union {
@@ -79,7 +131,6 @@ appendAddr(const char *name __attribute__((unused)),
     } sa;
     unsigned char addr[16];
     int err;
-    leaseAddress *newAddr;
 
     DEBUG("IP address: %s", ipAddr);
 
@@ -109,50 +160,8 @@ appendAddr(const char *name __attribute__((unused)),
         return 0;
     }
 
-    if (af != AF_UNSPEC && af != family) {
-        DEBUG("Skipping address which family is %d, %d requested", family, af);
-        return 0;
-    }
-
-    for (i = 0; i < *ntmpAddress; i++) {
-        if (family == AF_INET) {
-            if ((*tmpAddress)[i].af == AF_INET &&
-                memcmp((*tmpAddress)[i].addr,
-                       &sa.sin.sin_addr,
-                       sizeof(sa.sin.sin_addr)) == 0) {
-                DEBUG("IP address already in the list");
-                return 0;
-            }
-        } else {
-            if ((*tmpAddress)[i].af == AF_INET6 &&
-                memcmp((*tmpAddress)[i].addr,
-                       &sa.sin6.sin6_addr,
-                       sizeof(sa.sin6.sin6_addr)) == 0) {
-                DEBUG("IP address already in the list");
-                return 0;
-            }
-        }
-    }
-
-    newAddr = realloc(*tmpAddress, sizeof(*newAddr) * (*ntmpAddress + 1));
-    if (!newAddr) {
-        ERROR("Out of memory");
-        return -1;
-    }
-    *tmpAddress = newAddr;
-
-    (*tmpAddress)[*ntmpAddress].expirytime = expirytime;
-    (*tmpAddress)[*ntmpAddress].af = family;
-    if (family == AF_INET)
-        memcpy((*tmpAddress)[*ntmpAddress].addr,
-               &sa.sin.sin_addr,
-               sizeof(sa.sin.sin_addr));
-    else
-        memcpy((*tmpAddress)[*ntmpAddress].addr,
-               &sa.sin6.sin6_addr,
-               sizeof(sa.sin6.sin6_addr));
-    (*ntmpAddress)++;
-    return 0;
+    return appendAddrBytes(tmpAddress, ntmpAddress,
+                           family, addr, expirytime, af);
 }
 
 
@@ -341,6 +350,180 @@ findLeasesParserEndArray(void *ctx)
 }
 
 
+static int
+findLeasesIndexRecord(const virLeaseIndexRecord *rec,
+                      int af,
+                      time_t now,
+                      leaseAddress **addrs,
+                      size_t *naddrs,
+                      bool *found)
+{
+    if (rec->expirytime < (long long)now) {
+        DEBUG("Entry expired at %lld vs now %lld",
+              (long long)rec->expirytime, (long long)now);
+        return 0;
+    }
+
+    *found = true;
+
+    return appendAddrBytes(addrs, naddrs, rec->af, rec->addr,
+                           rec->expirytime, af);
+}
+
+
+/*
+ * Look up leases in the binary index that leaseshelper keeps next to
+ * @file. Records are sorted by hostname so a name is found by binary
+ * search, looking up by MAC address scans the records. Nothing is
+ * parsed either way.
+ *
+ * Returns 0 if the lookup was done using the index, 1 if the index is
+ * missing, invalid or out of date and @file has to be parsed instead,
+ * -1 on error.
+ */
+static int
+findLeasesIndex(const char *file,
+                const char *name,
+                char **macs,
+                size_t nmacs,
+                int af,
+                time_t now,
+                leaseAddress **addrs,
+                size_t *naddrs,
+                bool *found)
+{
+    char *indexFile = NULL;
+    int fd = -1;
+    int leasesFd = -1;
+    struct stat sb;
+    struct stat leasesSb;
+    void *map = MAP_FAILED;
+    size_t mapLen = 0;
+    const virLeaseIndexHeader *header;
+    const virLeaseIndexRecord *records;
+    size_t nrecords;
+    size_t lo;
+    size_t hi;
+    size_t i;
+    size_t j;
+    int ret = 1;
+
+    if (asprintf(&indexFile, "%s" VIR_LEASE_INDEX_SUFFIX, file) < 0) {
+        indexFile = NULL;
+        ret = -1;
+        goto cleanup;
+    }
+
+    if ((fd = open(indexFile, O_RDONLY)) < 0) {
+        DEBUG("No index %s", indexFile);
+        goto cleanup;
+    }
+
+    if ((leasesFd = open(file, O_RDONLY)) < 0) {
+        ERROR("Cannot open %s", file);
+        ret = -1;
+        goto cleanup;
+    }
+
+    if (fstat(fd, &sb) < 0 ||
+        fstat(leasesFd, &leasesSb) < 0) {
+        ERROR("Cannot stat %s", indexFile);
+        ret = -1;
+        goto cleanup;
+    }
+
+    if (sb.st_size < (off_t)sizeof(*header)) {
+        DEBUG("Index %s is truncated", indexFile);
+        goto cleanup;
+    }
+
+    mapLen = sb.st_size;
+    if ((map = mmap(NULL, mapLen, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        DEBUG("Cannot map %s", indexFile);
+        goto cleanup;
+    }
+
+    header = map;
+    records = (const virLeaseIndexRecord *)(header + 1);
+    nrecords = (mapLen - sizeof(*header)) / sizeof(*records);
+
+    if (memcmp(header->magic, VIR_LEASE_INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != VIR_LEASE_INDEX_VERSION ||
+        header->recordSize != sizeof(*records) ||
+        header->nrecords != nrecords ||
+        (mapLen - sizeof(*header)) % sizeof(*records) != 0) {
+        DEBUG("Index %s is invalid", indexFile);
+        goto cleanup;
+    }
+
+    if (header->leasesInode != (uint64_t)leasesSb.st_ino ||
+        header->leasesSize != leasesSb.st_size ||
+        header->leasesMtimeSec != leasesSb.st_mtim.tv_sec ||
+        header->leasesMtimeNsec != leasesSb.st_mtim.tv_nsec) {
+        DEBUG("Index %s is out of date", indexFile);
+        goto cleanup;
+    }
+
+    DEBUG("Using index %s with %zu records", indexFile, nrecords);
+
+    /* Strings in records are compared with strncmp() so that a record
+     * lacking its NUL terminator can't make us read past it. Anything
+     * which doesn't fit into a record can't be in a valid index. */
+    if (nmacs) {
+        for (i = 0; i < nrecords; i++) {
+            for (j = 0; j < nmacs; j++) {
+                if (strlen(macs[j]) >= VIR_LEASE_INDEX_MAC_LEN ||
+                    strncmp(records[i].mac, macs[j], VIR_LEASE_INDEX_MAC_LEN) != 0)
+                    continue;
+
+                if (findLeasesIndexRecord(&records[i], af, now,
+                                          addrs, naddrs, found) < 0) {
+                    ret = -1;
+                    goto cleanup;
+                }
+                break;
+            }
+        }
+    } else if (*name && strlen(name) < VIR_LEASE_INDEX_HOSTNAME_LEN) {
+        lo = 0;
+        hi = nrecords;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+
+            if (strncmp(records[mid].hostname, name,
+                        VIR_LEASE_INDEX_HOSTNAME_LEN) < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        for (i = lo; i < nrecords; i++) {
+            if (strncmp(records[i].hostname, name,
+                        VIR_LEASE_INDEX_HOSTNAME_LEN) != 0)
+                break;
+
+            if (findLeasesIndexRecord(&records[i], af, now,
+                                      addrs, naddrs, found) < 0) {
+                ret = -1;
+                goto cleanup;
+            }
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (map != MAP_FAILED)
+        munmap(map, mapLen);
+    if (leasesFd != -1)
+        close(leasesFd);
+    if (fd != -1)
+        close(fd);
+    free(indexFile);
+    return ret;
+}
+
+
 int
 findLeases(const char *file,
            const char *name,
@@ -382,6 +565,12 @@ findLeases(const char *file,
     ssize_t nreadTotal = 0;
     int rv;
 
+    if ((rv = findLeasesIndex(file, name, macs, nmacs, af, now,
+                              addrs, naddrs, found)) <= 0) {
+        ret = rv;
+        goto cleanup;
+    }
+
     if ((fd = open(file, O_RDONLY)) < 0) {
         ERROR("Cannot open %s", file);
         goto cleanup;